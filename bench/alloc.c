@@ -0,0 +1,163 @@
+//---------------------- Allocator benchmark -----------
+// The runtime heap against glibc malloc on allocation-heavy patterns, and
+// the arena against glibc on the batch pattern. Every block is written to,
+// and the list walk checks what it reads back.
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "scc.h"
+
+#define THREADS 4
+
+typedef struct {
+    const char* name;
+    void* (*alloc)(long size);
+    void (*free)(void* p);
+} Allocator;
+
+static void* libcAlloc(long size) { return malloc(size); }
+
+static void libcFree(void* p) { free(p); }
+
+static const Allocator allocators[] = {
+    {"glibc", libcAlloc, libcFree},
+    {"scc", scc_alloc, scc_free},
+};
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// sizes from 16 to 2048 bytes, one in eight of them above 128
+static long sizeAt(long i) {
+    long r = (i * 2654435761u) >> 7;
+    return 16 << (r & 3) << ((r >> 2 & 7) == 0 ? 4 : 0);
+}
+
+// each allocation freed at once
+static long pairs(const Allocator* a, long ops) {
+    for (long i = 0; i < ops; i++) {
+        long* p = a->alloc(sizeAt(i));
+        p[0] = i;
+        a->free(p);
+    }
+    return ops;
+}
+
+// rounds of 1000 live blocks, freed in the order they were made
+static long batch(const Allocator* a, long ops) {
+    void* live[1000];
+    for (long done = 0; done < ops; done += 1000) {
+        for (int i = 0; i < 1000; i++) {
+            live[i] = a->alloc(sizeAt(done + i));
+            *(long*)live[i] = i;
+        }
+        for (int i = 0; i < 1000; i++) a->free(live[i]);
+    }
+    return ops;
+}
+
+// a linked list of small nodes, walked and then freed
+static long list(const Allocator* a, long ops) {
+    long** head = NULL;
+    for (long i = 0; i < ops; i++) {
+        long** node = a->alloc(32);
+        node[0] = (long*)head;
+        node[1] = (long*)i;
+        head = node;
+    }
+    long sum = 0;
+    while (head) {
+        long** next = (long**)head[0];
+        sum += (long)head[1];
+        a->free(head);
+        head = next;
+    }
+    if (sum != ops * (ops - 1) / 2) {
+        fprintf(stderr, "%s: list sum %ld\n", a->name, sum);
+        exit(1);
+    }
+    return ops;
+}
+
+// the batch pattern with a reset instead of the frees, through the arena
+// whatever the allocator
+static long arena(const Allocator* a, long ops) {
+    (void)a;
+    SccArena* arena = scc_arena();
+    for (long done = 0; done < ops; done += 1000) {
+        for (int i = 0; i < 1000; i++) {
+            *(long*)scc_arena_alloc(arena, sizeAt(done + i)) = i;
+        }
+        scc_arena_reset(arena);
+    }
+    scc_arena_free(arena);
+    return ops;
+}
+
+typedef struct {
+    const Allocator* allocator;
+    long ops;
+} Work;
+
+static void* batchThread(void* argument) {
+    Work* work = argument;
+    batch(work->allocator, work->ops);
+    return NULL;
+}
+
+// the batch pattern on THREADS threads at once, ops each
+static long threads(const Allocator* a, long ops) {
+    pthread_t ids[THREADS];
+    Work work = {a, ops};
+    for (int t = 0; t < THREADS; t++) {
+        pthread_create(&ids[t], NULL, batchThread, &work);
+    }
+    for (int t = 0; t < THREADS; t++) pthread_join(ids[t], NULL);
+    return ops * THREADS;
+}
+
+typedef long (*Pattern)(const Allocator* a, long ops);
+
+// best nanoseconds per allocation over three runs
+static double measure(Pattern pattern, const Allocator* a, long ops) {
+    double best = 0;
+    for (int run = 0; run < 3; run++) {
+        double start = now();
+        long done = pattern(a, ops);
+        double ns = (now() - start) / done * 1e9;
+        if (run == 0 || ns < best) best = ns;
+    }
+    return best;
+}
+
+int main() {
+    static const struct {
+        const char* name;
+        Pattern pattern;
+        long ops;
+    } patterns[] = {
+        {"pairs", pairs, 20000000},
+        {"batch", batch, 10000000},
+        {"list", list, 2000000},
+        {"threads", threads, 2000000},
+    };
+    printf("%-10s %12s %12s %9s\n", "pattern", "glibc", "scc", "speedup");
+    for (size_t p = 0; p < sizeof(patterns) / sizeof(patterns[0]); p++) {
+        double libc = measure(patterns[p].pattern, &allocators[0],
+                              patterns[p].ops);
+        double scc = measure(patterns[p].pattern, &allocators[1],
+                             patterns[p].ops);
+        printf("%-10s %9.1f ns %9.1f ns %8.1fx\n", patterns[p].name, libc,
+               scc, libc / scc);
+    }
+    double libc = measure(batch, &allocators[0], 10000000);
+    double reset = measure(arena, &allocators[1], 10000000);
+    printf("%-10s %9.1f ns %9.1f ns %8.1fx\n", "arena", libc, reset,
+           libc / reset);
+    return 0;
+}
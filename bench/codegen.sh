@@ -0,0 +1,50 @@
+#!/bin/bash
+# Compiles every program in programs/ with the naive stack machine lowering
+# (-O0), with the -O1 optimizer and scalar code (-march=x86-64), and with
+# the same optimizer vectorizing for SSE2 and for AVX2. It checks that all
+# four print the same and reports the best of three wall clock times, and
+# how much faster the vectorized code runs than the scalar -O1 code.
+set -e
+cd "$(dirname "$0")"
+SCC=../scc
+OUT=$(mktemp -d)
+trap 'rm -rf $OUT' EXIT
+CONFIGS=("-O0" "-O1 -march=x86-64" "-O1 -march=sse2" "-O1 -march=avx2")
+
+best() {
+    local best=
+    for run in 1 2 3; do
+        local start=$(date +%s%N)
+        "$1" > /dev/null
+        local elapsed=$((($(date +%s%N) - start) / 1000000))
+        if [ -z "$best" ] || [ $elapsed -lt $best ]; then best=$elapsed; fi
+    done
+    echo $best
+}
+
+# scalar / vector, or - when the vector time rounds to 0
+speedup() {
+    awk "BEGIN { if ($2 == 0) print \"-\"; else printf \"%.1f\", $1 / $2 }"
+}
+
+printf "%-10s %10s %10s %10s %10s %9s %9s\n" program -O0 scalar sse2 avx2 sse2/sc avx2/sc
+for source in programs/*.c; do
+    name=$(basename "$source" .c)
+    times=()
+    expected=
+    for i in "${!CONFIGS[@]}"; do
+        $SCC ${CONFIGS[$i]} -o "$OUT/$name.s" "$source" > /dev/null
+        gcc -o "$OUT/$name" "$OUT/$name.s"
+        output=$("$OUT/$name")
+        if [ -z "$expected" ]; then
+            expected=$output
+        elif [ "$output" != "$expected" ]; then
+            echo "$name: ${CONFIGS[$i]} printed '$output', -O0 '$expected'" >&2
+            exit 1
+        fi
+        times+=($(best "$OUT/$name"))
+    done
+    printf "%-10s %8sms %8sms %8sms %8sms %8sx %8sx\n" "$name" "${times[0]}" "${times[1]}" \
+        "${times[2]}" "${times[3]}" "$(speedup "${times[1]}" "${times[2]}")" \
+        "$(speedup "${times[1]}" "${times[3]}")"
+done
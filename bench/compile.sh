@@ -0,0 +1,51 @@
+#!/bin/bash
+# Compile time of every program in programs/ through assembly text and
+# `as` against the integrated encoder (-c), best of five batches of ten
+# compiles at -O1. Both objects have to link into programs printing the
+# same.
+set -e
+cd "$(dirname "$0")"
+SCC=../scc
+OUT=$(mktemp -d)
+trap 'rm -rf $OUT' EXIT
+BATCH=10
+
+viaAs() {
+    $SCC -o "$OUT/$1.s" "$2" > /dev/null
+    as -o "$OUT/$1.o" "$OUT/$1.s"
+}
+
+integrated() {
+    $SCC -c -o "$OUT/$1.o" "$2" > /dev/null
+}
+
+# best wall clock milliseconds of a batch of compiles with $1
+best() {
+    local best=
+    for run in 1 2 3 4 5; do
+        local start=$(date +%s%N)
+        for i in $(seq $BATCH); do "$1" "$2" "$3"; done
+        local elapsed=$((($(date +%s%N) - start) / 1000000))
+        if [ -z "$best" ] || [ $elapsed -lt $best ]; then best=$elapsed; fi
+    done
+    echo $best
+}
+
+printf "%-10s %10s %10s %9s\n" program "scc+as" "scc -c" speedup
+for source in programs/*.c; do
+    name=$(basename "$source" .c)
+    viaAs "$name" "$source"
+    gcc -o "$OUT/$name" "$OUT/$name.o"
+    expected=$("$OUT/$name")
+    integrated "$name" "$source"
+    gcc -o "$OUT/$name" "$OUT/$name.o"
+    output=$("$OUT/$name")
+    if [ "$output" != "$expected" ]; then
+        echo "$name: -c printed '$output', as '$expected'" >&2
+        exit 1
+    fi
+    text=$(best viaAs "$name" "$source")
+    object=$(best integrated "$name" "$source")
+    printf "%-10s %8sms %8sms %8sx\n" "$name" "$text" "$object" \
+        "$(awk "BEGIN { printf \"%.1f\", $text / $object }")"
+done
@@ -0,0 +1,306 @@
+//---------------------- Front-end benchmark -----------
+// Scanning and parsing throughput of the compiler's own front end on
+// generated corpora: an ordinary program, and inputs that push one thing
+// to the extreme. Reports MB/s and tokens/s for the scanner, AST nodes/s
+// for the parser and heap allocations per KB of source for both, and
+// compares them with bench/frontend.baseline: a throughput more than
+// SLOWER below it, or more allocations than it, is a regression. The
+// timings are of the machine that wrote the baseline, so -update it when
+// moving to another one; the allocation counts hold anywhere.
+//
+//   ./frontend               measure and compare
+//   ./frontend -update       measure and write the baseline
+//   ./frontend -generate K   write corpus K on stdout
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "parser.h"
+#include "phase.h"
+
+#define CORPUS_SIZE (1L << 20)
+#define RUNS 10
+#define SLOWER 0.25
+#define BASELINE "frontend.baseline"
+
+//---------------------- Allocation count --------------
+// Every allocation of the front end goes through these, which count and
+// hand over to glibc.
+
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t count, size_t size);
+void* __libc_realloc(void* p, size_t size);
+
+static long allocations;
+
+void* malloc(size_t size) {
+    allocations++;
+    return __libc_malloc(size);
+}
+
+void* calloc(size_t count, size_t size) {
+    allocations++;
+    return __libc_calloc(count, size);
+}
+
+void* realloc(void* p, size_t size) {
+    allocations++;
+    return __libc_realloc(p, size);
+}
+
+//---------------------- Corpora -----------------------
+// Each generator appends declarations until the corpus is CORPUS_SIZE
+// bytes, drawing from a fixed seed so that every run sees the same text.
+
+static unsigned seed;
+
+static unsigned randomBelow(unsigned n) {
+    seed = seed * 1103515245 + 12345;
+    return (seed >> 8) % n;
+}
+
+static char* text;
+static long length;
+
+static void emit(const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    int count = vsnprintf(text + length, CORPUS_SIZE * 2 - length, format, args);
+    va_end(args);
+    length += count;
+}
+
+static const char* operators[] = {"+", "-", "*", "/", "<", ">", "==", "!=", "<=", ">="};
+
+// a function of locals, loops, branches and calls
+static void realistic(int n) {
+    emit("int f%d(int a, int b) {\n    int total = 0;\n    int i = 0;\n", n);
+    emit("    while (i < a) {\n");
+    emit("        if (i * %d > b) {\n            total = total + f%d(i, b);\n", n % 13 + 2,
+         n > 0 ? n - 1 : 0);
+    emit("        } else {\n            total = total - i * %d;\n        }\n", n % 7 + 1);
+    emit("        i = i + 1;\n    }\n    return total;\n}\n\n");
+}
+
+static void identifiers(int n) {
+    char name[256];
+    int size = 100 + randomBelow(150);
+    for (int i = 0; i < size; i++) name[i] = 'a' + randomBelow(26);
+    name[size] = '\0';
+    emit("int %s_%d = %d;\n", name, n, n);
+    emit("int get_%s_%d(int %s) { return %s + %s_%d; }\n", name, n, name, name, name, n);
+}
+
+// blocks in blocks, then parentheses in parentheses
+static void nesting(int n) {
+    int depth = 100 + randomBelow(100);
+    emit("int nest%d(int x) {\n", n);
+    for (int i = 0; i < depth; i++) emit("if (x > %d) {\n", i);
+    emit("x = ");
+    for (int i = 0; i < depth; i++) emit("(x + ");
+    emit("1");
+    for (int i = 0; i < depth; i++) emit(")");
+    emit(";\n");
+    for (int i = 0; i < depth; i++) emit("}\n");
+    emit("return x;\n}\n");
+}
+
+static void operatorChains(int n) {
+    emit("int chain%d(int a, int b) {\n    return a", n);
+    int terms = 500 + randomBelow(500);
+    for (int i = 0; i < terms; i++) {
+        emit(" %s %s", operators[randomBelow(10)], randomBelow(2) ? "b" : "a");
+    }
+    emit(";\n}\n");
+}
+
+// one function of many statements, closed by its corpus's end
+static void hugeBlock(int n) {
+    if (n == 0) emit("int block(int a) {\n    int x = 0;\n");
+    emit("    x = x + a * %d;\n    if (x > %d) { x = x - %d; }\n", n % 97, n, n % 89);
+}
+
+static void comments(int n) {
+    emit("// function %d: a line comment that goes on for a while like prose does\n", n);
+    emit("/* a block comment\n   over several lines\n   about the function below, %d */\n", n);
+    emit("int c%d(int a) { return a + %d; } // and one at the end of the line\n", n, n);
+}
+
+// the scanner has no escapes, so no quote inside a string
+static void strings(int n) {
+    emit("int s%d() {\n", n);
+    for (int i = 0; i < 4; i++) {
+        emit("    printf(\"string %d.%d, 'quoted', a tab\\t and a newline\\n\", %d);\n", n, i, i);
+    }
+    emit("    return 0;\n}\n");
+}
+
+static const struct {
+    const char* name;
+    void (*generate)(int n);
+    const char* end;
+} corpora[] = {
+    {"realistic", realistic, ""},
+    {"identifiers", identifiers, ""},
+    {"nesting", nesting, ""},
+    {"operators", operatorChains, ""},
+    {"block", hugeBlock, "    return x;\n}\n"},
+    {"comments", comments, ""},
+    {"strings", strings, ""},
+};
+
+#define CORPUS_COUNT (int)(sizeof(corpora) / sizeof(corpora[0]))
+
+static char* generate(int corpus) {
+    seed = 1;
+    text = __libc_malloc(CORPUS_SIZE * 2);
+    length = 0;
+    for (int n = 0; length < CORPUS_SIZE; n++) corpora[corpus].generate(n);
+    emit("%s", corpora[corpus].end);
+    return text;
+}
+
+//---------------------- Measurement -------------------
+
+typedef struct {
+    double scanMBs;
+    double tokensPerSecond;
+    double nodesPerSecond;
+    double allocationsPerKB;
+} Result;
+
+static const char* metricNames[] = {"MB/s", "Mtokens/s", "Mnodes/s", "allocs/KB"};
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// best of RUNS scans and parses
+static Result measure(const char* source) {
+    long size = strlen(source);
+    double scan = 0, parsing = 0;
+    long tokenCount = 0, nodes = 0, allocated = 0;
+    for (int run = 0; run < RUNS; run++) {
+        long before = allocations;
+        double start = now();
+        Token* tokens = scanTokens(source);
+        double scanned = now();
+        Program* program = parse(tokens);
+        double parsed = now();
+        if (run == 0) {
+            allocated = allocations - before;
+            while (tokens[tokenCount].type != TOKEN_EOF) tokenCount++;
+            nodes = countAstNodes(program);
+        }
+        if (run == 0 || scanned - start < scan) scan = scanned - start;
+        if (run == 0 || parsed - scanned < parsing) parsing = parsed - scanned;
+        free(tokens);
+    }
+    return (Result){size / scan / (1 << 20), tokenCount / scan * 1e-6, nodes / parsing * 1e-6,
+                    allocated / (size / 1024.0)};
+}
+
+// measures in a child, since nothing the parser makes is ever freed
+static Result measureApart(int corpus) {
+    int fds[2];
+    if (pipe(fds) != 0) exit(1);
+    fflush(stdout);
+    if (fork() == 0) {
+        Result result = measure(generate(corpus));
+        exit(write(fds[1], &result, sizeof(result)) != sizeof(result));
+    }
+    close(fds[1]);
+    Result result;
+    int status;
+    if (read(fds[0], &result, sizeof(result)) != sizeof(result) || wait(&status) < 0 ||
+        status != 0) {
+        fprintf(stderr, "%s: the front end failed\n", corpora[corpus].name);
+        exit(1);
+    }
+    close(fds[0]);
+    return result;
+}
+
+//---------------------- Baseline ----------------------
+// A line per corpus: its name and the four metrics.
+
+static bool readBaseline(Result baseline[CORPUS_COUNT]) {
+    FILE* file = fopen(BASELINE, "r");
+    if (file == NULL) return false;
+    char name[64];
+    Result result;
+    while (fscanf(file, "%63s %lf %lf %lf %lf", name, &result.scanMBs, &result.tokensPerSecond,
+                  &result.nodesPerSecond, &result.allocationsPerKB) == 5) {
+        for (int c = 0; c < CORPUS_COUNT; c++) {
+            if (strcmp(name, corpora[c].name) == 0) baseline[c] = result;
+        }
+    }
+    fclose(file);
+    return true;
+}
+
+static void writeBaseline(Result results[CORPUS_COUNT]) {
+    FILE* file = fopen(BASELINE, "w");
+    for (int c = 0; c < CORPUS_COUNT; c++) {
+        fprintf(file, "%s %.2f %.3f %.3f %.2f\n", corpora[c].name, results[c].scanMBs,
+                results[c].tokensPerSecond, results[c].nodesPerSecond,
+                results[c].allocationsPerKB);
+    }
+    fclose(file);
+}
+
+// the metric against the baseline, marking a regression; allocation counts
+// are exact but the baseline keeps two decimals of them
+static bool compare(double value, double base, bool higherIsBetter) {
+    double change = base > 0 ? (value - base) / base * 100 : 0;
+    bool regressed =
+        base > 0 && (higherIsBetter ? value < base * (1 - SLOWER) : value > base + 0.005);
+    printf(" %9.2f %+5.0f%%%s", value, change, regressed ? "!" : " ");
+    return regressed;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc == 3 && strcmp(argv[1], "-generate") == 0) {
+        for (int c = 0; c < CORPUS_COUNT; c++) {
+            if (strcmp(argv[2], corpora[c].name) == 0) {
+                fputs(generate(c), stdout);
+                return 0;
+            }
+        }
+        fprintf(stderr, "no corpus %s\n", argv[2]);
+        return 1;
+    }
+    bool update = argc == 2 && strcmp(argv[1], "-update") == 0;
+    Result baseline[CORPUS_COUNT];
+    memset(baseline, 0, sizeof(baseline));
+    if (!update && !readBaseline(baseline)) printf("no %s to compare with\n", BASELINE);
+    printf("front end, %ld KB corpora, against %s\n%-12s", CORPUS_SIZE / 1024, BASELINE,
+           "corpus");
+    for (int m = 0; m < 4; m++) printf(" %16s", metricNames[m]);
+    printf("\n");
+    Result results[CORPUS_COUNT];
+    int regressions = 0;
+    for (int c = 0; c < CORPUS_COUNT; c++) {
+        results[c] = measureApart(c);
+        printf("%-12s", corpora[c].name);
+        regressions += compare(results[c].scanMBs, baseline[c].scanMBs, true);
+        regressions += compare(results[c].tokensPerSecond, baseline[c].tokensPerSecond, true);
+        regressions += compare(results[c].nodesPerSecond, baseline[c].nodesPerSecond, true);
+        regressions += compare(results[c].allocationsPerKB, baseline[c].allocationsPerKB, false);
+        printf("\n");
+    }
+    if (update) {
+        writeBaseline(results);
+        printf("wrote %s\n", BASELINE);
+    } else if (regressions > 0) {
+        printf("%d regressions, marked !\n", regressions);
+        return 1;
+    }
+    return 0;
+}
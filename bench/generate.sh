@@ -0,0 +1,38 @@
+#!/bin/bash
+# usage: generate.sh N -- a program of N independent functions with a few
+# loops each, all called from main
+N=${1:-600}
+for i in $(seq $N); do
+    cat <<FUNCTION
+int f$i(int n) {
+    int total = 0;
+    int i = 0;
+    while (i < n) {
+        int j = 0;
+        while (j < $((i % 7 + 3))) {
+            total = total + i * j - $i;
+            if (total > 100000) { total = total - 99991; }
+            j = j + 1;
+        }
+        i = i + 1;
+    }
+    return total + n * $i;
+}
+FUNCTION
+done
+# main calls them through groups of 100, keeping every function small
+GROUP=100
+for g in $(seq 0 $(((N - 1) / GROUP))); do
+    echo "int g$g(int total) {"
+    for i in $(seq $((g * GROUP + 1)) $(((g + 1) * GROUP < N ? (g + 1) * GROUP : N))); do
+        echo "    total = total + f$i(total - total / 5 * 5 + 3);"
+    done
+    echo "    return total;"
+    echo "}"
+done
+echo "int main() {"
+echo "    int total = 0;"
+for g in $(seq 0 $(((N - 1) / GROUP))); do echo "    total = g$g(total);"; done
+echo "    printf(\"%d\\n\", total);"
+echo "    return 0;"
+echo "}"
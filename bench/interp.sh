@@ -0,0 +1,40 @@
+#!/bin/bash
+# Run time of every program in interp/ on the tree walker (-run=tree)
+# against the bytecode machine (-run=vm), best of three runs. Both have to
+# print what the native build prints, after scc's own test report.
+set -e
+cd "$(dirname "$0")"
+SCC=../scc
+OUT=$(mktemp -d)
+trap 'rm -rf $OUT' EXIT
+
+# best wall clock milliseconds of running $2 with -run=$1
+best() {
+    local best=
+    for run in 1 2 3; do
+        local start=$(date +%s%N)
+        $SCC -run=$1 "$2" > /dev/null
+        local elapsed=$((($(date +%s%N) - start) / 1000000))
+        if [ -z "$best" ] || [ $elapsed -lt $best ]; then best=$elapsed; fi
+    done
+    echo $best
+}
+
+printf "%-10s %10s %10s %9s\n" program tree vm speedup
+for source in interp/*.c; do
+    name=$(basename "$source" .c)
+    $SCC -o "$OUT/$name.s" "$source" > /dev/null
+    gcc -o "$OUT/$name" "$OUT/$name.s"
+    expected=$("$OUT/$name")
+    for mode in tree vm; do
+        output=$($SCC -run=$mode "$source")
+        if [ "$output" != "$expected" ]; then
+            echo "$name: -run=$mode printed '$output', native '$expected'" >&2
+            exit 1
+        fi
+    done
+    tree=$(best tree "$source")
+    vm=$(best vm "$source")
+    printf "%-10s %8sms %8sms %8sx\n" "$name" "$tree" "$vm" \
+        "$(awk "BEGIN { printf \"%.1f\", $tree / ($vm > 0 ? $vm : 1) }")"
+done
@@ -0,0 +1,28 @@
+int steps(int n) {
+    int count = 0;
+    while (n != 1) {
+        if (n - n / 2 * 2 == 0) {
+            n = n / 2;
+        } else {
+            n = 3 * n + 1;
+        }
+        count = count + 1;
+    }
+    return count;
+}
+
+int main() {
+    int best = 0;
+    int total = 0;
+    int i = 1;
+    while (i < 100000) {
+        int s = steps(i);
+        total = total + s;
+        if (s > best) {
+            best = s;
+        }
+        i = i + 1;
+    }
+    printf("%ld %ld\n", best, total);
+    return 0;
+}
@@ -0,0 +1,11 @@
+int fib(int n) {
+    if (n < 2) {
+        return n;
+    }
+    return fib(n - 1) + fib(n - 2);
+}
+
+int main() {
+    printf("%ld\n", fib(27));
+    return 0;
+}
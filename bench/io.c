@@ -0,0 +1,152 @@
+//---------------------- I/O benchmark -----------------
+// Line-oriented copy and transform of a 64 MB file: a write(2) per line,
+// stdio, and the runtime's buffered I/O through plain system calls and
+// through io_uring. Every way has to produce the same file.
+#include <ctype.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "scc.h"
+
+#define INPUT_SIZE (64L << 20)
+#define LINE_MAX_SIZE 4096
+
+static char input[] = "/tmp/scc-io-in-XXXXXX";
+static char output[] = "/tmp/scc-io-out-XXXXXX";
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void makeInput() {
+    int fd = mkstemp(input);
+    FILE* file = fdopen(fd, "w");
+    unsigned seed = 1;
+    for (long size = 0; size < INPUT_SIZE;) {
+        seed = seed * 1103515245 + 12345;
+        int length = 8 + (seed >> 16) % 120;
+        for (int i = 0; i < length; i++) fputc('a' + (seed >> (i % 24)) % 26, file);
+        fputc('\n', file);
+        size += length + 1;
+    }
+    fclose(file);
+    close(mkstemp(output));
+}
+
+static void transform(char* line, long size) {
+    for (long i = 0; i < size; i++) line[i] = toupper((unsigned char)line[i]);
+}
+
+typedef void (*Copy)(int in, int out, bool upper);
+
+// buffered reads, but a system call for every line written
+static void perLine(int in, int out, bool upper) {
+    FILE* file = fdopen(dup(in), "r");
+    char line[LINE_MAX_SIZE];
+    while (fgets(line, sizeof(line), file)) {
+        long size = strlen(line);
+        if (upper) transform(line, size);
+        if (write(out, line, size) != size) exit(1);
+    }
+    fclose(file);
+}
+
+static void stdio(int in, int out, bool upper) {
+    FILE* from = fdopen(dup(in), "r");
+    FILE* to = fdopen(dup(out), "w");
+    char line[LINE_MAX_SIZE];
+    while (fgets(line, sizeof(line), from)) {
+        if (upper) transform(line, strlen(line));
+        fputs(line, to);
+    }
+    fclose(from);
+    fclose(to);
+}
+
+static void runtime(int in, int out, bool upper) {
+    char line[LINE_MAX_SIZE];
+    long size;
+    while ((size = scc_read_line(in, line, sizeof(line))) > 0) {
+        if (upper) transform(line, size);
+        scc_write(out, line, size);
+    }
+    scc_flush(out);
+}
+
+static void syscalls(int in, int out, bool upper) {
+    scc_io_mode(SCC_IO_SYSCALLS);
+    runtime(in, out, upper);
+}
+
+static void ring(int in, int out, bool upper) {
+    scc_io_mode(SCC_IO_RING);
+    runtime(in, out, upper);
+}
+
+static unsigned long hashOutput() {
+    FILE* file = fopen(output, "r");
+    unsigned long hash = 14695981039346656037UL;
+    int c;
+    while ((c = getc(file)) != EOF) hash = (hash ^ c) * 1099511628211UL;
+    fclose(file);
+    return hash;
+}
+
+// best MB/s of three runs, and the hash of what was written
+static double measure(Copy copy, bool upper, unsigned long* hash) {
+    double best = 0;
+    for (int run = 0; run < 3; run++) {
+        int in = open(input, O_RDONLY);
+        int out = open(output, O_WRONLY | O_TRUNC);
+        double start = now();
+        copy(in, out, upper);
+        double rate = INPUT_SIZE / (now() - start) / (1 << 20);
+        close(in);
+        close(out);
+        if (rate > best) best = rate;
+    }
+    *hash = hashOutput();
+    return best;
+}
+
+int main() {
+    static const struct {
+        const char* name;
+        Copy copy;
+    } ways[] = {
+        {"write per line", perLine},
+        {"stdio", stdio},
+        {"scc syscalls", syscalls},
+        {"scc io_uring", ring},
+    };
+    makeInput();
+    if (scc_io_mode(SCC_IO_RING) != SCC_IO_RING) {
+        printf("no io_uring, the last row uses plain system calls\n");
+    }
+    printf("%-16s %12s %12s\n", "", "copy", "upper");
+    unsigned long expected[2];
+    for (size_t w = 0; w < sizeof(ways) / sizeof(ways[0]); w++) {
+        double rates[2];
+        for (int upper = 0; upper <= 1; upper++) {
+            unsigned long hash;
+            rates[upper] = measure(ways[w].copy, upper, &hash);
+            if (w == 0) expected[upper] = hash;
+            if (hash != expected[upper]) {
+                fprintf(stderr, "%s wrote something else\n", ways[w].name);
+                return 1;
+            }
+        }
+        printf("%-16s %7.0f MB/s %7.0f MB/s\n", ways[w].name, rates[0],
+               rates[1]);
+    }
+    remove(input);
+    remove(output);
+    return 0;
+}
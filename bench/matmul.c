@@ -0,0 +1,92 @@
+//---------------------- Matmul benchmark --------------
+// Compares the naive triple loop against the blocked multiply with the
+// portable and the SIMD micro-kernel, and checks that all three agree.
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "scc.h"
+
+typedef void (*Gemm)(long m, long n, long k, const double* a,
+                     const double* b, double* c);
+
+static void naive(long m, long n, long k, const double* a, const double* b,
+                  double* c) {
+    for (long i = 0; i < m; i++) {
+        for (long j = 0; j < n; j++) {
+            double sum = 0;
+            for (long p = 0; p < k; p++) sum += a[i * k + p] * b[p * n + j];
+            c[i * n + j] = sum;
+        }
+    }
+}
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static double* randomMatrix(long n) {
+    double* m = malloc(sizeof(double) * n * n);
+    for (long i = 0; i < n * n; i++) m[i] = (double)rand() / RAND_MAX - 0.5;
+    return m;
+}
+
+static void check(const char* name, long n, const double* expected,
+                  const double* actual) {
+    for (long i = 0; i < n * n; i++) {
+        if (fabs(expected[i] - actual[i]) > 1e-9 * n) {
+            fprintf(stderr, "%s: wrong result at %ld for n=%ld\n", name, i,
+                    n);
+            exit(1);
+        }
+    }
+}
+
+// best GFLOP/s over a few runs of `reps` multiplies each
+static double measure(Gemm gemm, long n, long reps, const double* a,
+                      const double* b, double* c) {
+    double best = 0;
+    for (int run = 0; run < 3; run++) {
+        double start = now();
+        for (long r = 0; r < reps; r++) gemm(n, n, n, a, b, c);
+        double elapsed = now() - start;
+        double gflops = 2.0 * n * n * n * reps / elapsed * 1e-9;
+        if (gflops > best) best = gflops;
+    }
+    return best;
+}
+
+int main() {
+    static const long sizes[] = {4, 64, 128, 256, 512};
+    printf("%6s %12s %12s %12s %9s\n", "n", "naive", "blocked", "simd",
+           "speedup");
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        long n = sizes[s];
+        // aim for roughly the same amount of work at every size
+        long reps = 1 + 200000000 / (2 * n * n * n);
+        double* a = randomMatrix(n);
+        double* b = randomMatrix(n);
+        double* expected = malloc(sizeof(double) * n * n);
+        double* c = malloc(sizeof(double) * n * n);
+
+        naive(n, n, n, a, b, expected);
+        scc_gemm_scalar(n, n, n, a, b, c);
+        check("blocked", n, expected, c);
+        scc_gemm(n, n, n, a, b, c);
+        check("simd", n, expected, c);
+
+        double naiveRate = measure(naive, n, reps, a, b, c);
+        double blockedRate = measure(scc_gemm_scalar, n, reps, a, b, c);
+        double simdRate = measure(scc_gemm, n, reps, a, b, c);
+        printf("%6ld %7.2f GF/s %7.2f GF/s %7.2f GF/s %8.1fx\n", n,
+               naiveRate, blockedRate, simdRate, simdRate / naiveRate);
+        free(a);
+        free(b);
+        free(expected);
+        free(c);
+    }
+    return 0;
+}
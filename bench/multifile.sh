@@ -0,0 +1,52 @@
+#!/bin/bash
+# Wall clock time of building 100 and 1000 generated files to objects in
+# one scc process with -j 1 up to 8, best of three builds each, against
+# an scc process per file. Every job count has to produce the same bytes.
+set -e
+cd "$(dirname "$0")"
+SCC=$(realpath ../scc)
+OUT=$(mktemp -d)
+trap 'rm -rf $OUT' EXIT
+FUNCTIONS=${FUNCTIONS:-20}  # per file
+
+./generate.sh $FUNCTIONS > "$OUT/file.c"
+
+# best wall clock milliseconds of `$@` in the directory of the files
+best() {
+    local best=
+    for run in 1 2 3; do
+        local start=$(date +%s%N)
+        (cd "$OUT/src" && "$@" > /dev/null)
+        local elapsed=$((($(date +%s%N) - start) / 1000000))
+        if [ -z "$best" ] || [ $elapsed -lt $best ]; then best=$elapsed; fi
+    done
+    echo $best
+}
+
+perFile() {
+    for file in *.c; do $SCC -c "$file"; done
+}
+
+echo "$FUNCTIONS functions a file, $(nproc) processors"
+for files in 100 1000; do
+    rm -rf "$OUT/src" "$OUT/expected"
+    mkdir "$OUT/src" "$OUT/expected"
+    for i in $(seq $files); do cp "$OUT/file.c" "$OUT/src/f$i.c"; done
+    echo "$files files"
+    printf "%-16s %10s %9s\n" build time speedup
+    time=$(best perFile)
+    cp "$OUT"/src/*.o "$OUT/expected"
+    base=$time
+    printf "%-16s %8sms %8sx\n" "process per file" $time 1.00
+    for jobs in 1 2 4 8; do
+        time=$(best $SCC -j $jobs -c $(cd "$OUT/src" && ls *.c))
+        for object in "$OUT"/expected/*.o; do
+            if ! cmp -s "$object" "$OUT/src/$(basename "$object")"; then
+                echo "-j $jobs changed $(basename "$object")" >&2
+                exit 1
+            fi
+        done
+        printf "%-16s %8sms %8sx\n" "-j $jobs" $time \
+            "$(awk "BEGIN { printf \"%.2f\", $base / $time }")"
+    done
+done
@@ -0,0 +1,19 @@
+int add(int a, int b) { return a + b; }
+int minus(int a, int b) { return a - b; }
+int cal(int a, int b) {
+    if (a > b) {
+        return a * 2 - b;
+    }
+    return b - a;
+}
+
+int main() {
+    int total = 0;
+    int i = 0;
+    while (i < 100000000) {
+        total = total + cal(add(i, 3), minus(i, 2));
+        i = i + 1;
+    }
+    printf("%ld\n", total);
+    return 0;
+}
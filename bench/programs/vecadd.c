@@ -0,0 +1,29 @@
+int main() {
+    int n = 4096;
+    int a = malloc(n * 8);
+    int b = malloc(n * 8);
+    int c = malloc(n * 8);
+    int i = 0;
+    while (i < n) {
+        a[i] = i;
+        b[i] = 3 * i;
+        i = i + 1;
+    }
+    int round = 0;
+    while (round < 100000) {
+        i = 0;
+        while (i < n) {
+            c[i] = c[i] + a[i] - b[i];
+            i = i + 1;
+        }
+        round = round + 1;
+    }
+    int sum = 0;
+    i = 0;
+    while (i < n) {
+        sum = sum + c[i];
+        i = i + 1;
+    }
+    printf("%ld\n", sum);
+    return 0;
+}
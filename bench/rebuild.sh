@@ -0,0 +1,44 @@
+#!/bin/bash
+# Rebuild time after editing a single function of a large generated file
+# with -fcache, against building it without the cache and building it into
+# an empty one. Best of three compiles to assembly each; the rebuilt text
+# has to match a build without the cache.
+set -e
+cd "$(dirname "$0")"
+SCC=$(realpath ../scc)
+OUT=$(mktemp -d)
+trap 'rm -rf $OUT' EXIT
+FUNCTIONS=${FUNCTIONS:-5000}
+cd "$OUT"
+
+"$OLDPWD/generate.sh" $FUNCTIONS > many.c
+
+# wall clock milliseconds of `scc $@`
+timed() {
+    local start=$(date +%s%N)
+    $SCC "$@" > /dev/null
+    echo $((($(date +%s%N) - start) / 1000000))
+}
+
+min() { echo "$@" | tr ' ' '\n' | sort -n | head -1; }
+
+full=() cold=() edit=()
+for run in 1 2 3; do
+    full+=($(timed -o full.s many.c))
+    rm -rf cache
+    cold+=($(timed -fcache=cache -o cold.s many.c))
+    # one function's result changes, every other function stays the same
+    sed -i "s/return total + n \* 17\( + [0-9]*\)\?;/return total + n * 17 + $run;/" many.c
+    edit+=($(timed -fcache=cache -o edit.s many.c))
+done
+$SCC -o full.s many.c > /dev/null
+if ! cmp -s full.s edit.s; then
+    echo "the cached rebuild differs from a build without the cache" >&2
+    exit 1
+fi
+full=$(min ${full[@]}) cold=$(min ${cold[@]}) edit=$(min ${edit[@]})
+echo "$FUNCTIONS functions"
+printf "%-30s %8sms\n" "build without the cache" $full
+printf "%-30s %8sms\n" "build into an empty cache" $cold
+printf "%-30s %8sms %6sx\n" "rebuild after one edit" $edit \
+    "$(awk "BEGIN { printf \"%.1f\", $full / $edit }")"
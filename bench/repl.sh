@@ -0,0 +1,32 @@
+#!/bin/bash
+# Time per REPL entry as a session grows: sessions of N definitions, each
+# followed by a call of every definition so far's newest, in one scc
+# process. A constant time per entry means the earlier entries cost
+# nothing; the last call's result has to be right.
+set -e
+cd "$(dirname "$0")"
+SCC=$(realpath ${SCC:-../scc})
+OUT=$(mktemp -d)
+trap 'rm -rf $OUT' EXIT
+
+session() {
+    for i in $(seq $1); do
+        echo "int f$i(int n) {"
+        echo "    return n + $i;"
+        echo "}"
+        echo "f$i(1) + f1(0)"
+    done
+}
+
+printf "%-12s %10s %12s\n" definitions total "per entry"
+for n in 500 1000 2000 4000; do
+    session $n > "$OUT/session.txt"
+    start=$(date +%s%N)
+    last=$($SCC < "$OUT/session.txt" | tail -2 | head -1)
+    elapsed=$((($(date +%s%N) - start) / 1000))
+    if [ "${last##* }" != $((n + 2)) ]; then
+        echo "the last entry printed '$last'" >&2
+        exit 1
+    fi
+    printf "%-12s %8sms %10sus\n" $n $((elapsed / 1000)) $((elapsed / (2 * n)))
+done
@@ -0,0 +1,63 @@
+#!/bin/bash
+# Per-invocation latency of compiling through the compile server against
+# an scc process per compile: a small program and a large generated one,
+# unchanged and after editing one function. Milliseconds per compile to
+# assembly, best of three rounds of ROUNDS compiles; what the server
+# writes has to match a compile of its own.
+set -e
+cd "$(dirname "$0")"
+SCC=$(realpath ../scc)
+OUT=$(mktemp -d)
+SOCKET=$OUT/scc.sock
+FUNCTIONS=${FUNCTIONS:-1000}
+ROUNDS=${ROUNDS:-20}
+$SCC -fserve=$SOCKET &
+SERVER=$!
+trap 'kill $SERVER; rm -rf $OUT' EXIT
+cp programs/collatz.c "$OUT/small.c"
+./generate.sh $FUNCTIONS > "$OUT/large.c"
+cd "$OUT"
+while [ ! -S $SOCKET ]; do sleep 0.01; done
+
+edits=0
+edit() {
+    edits=$((edits + 1))
+    echo "int edited() { return $edits; }" >> "$1"
+}
+
+# best milliseconds per compile of $2 with `$3...`, editing it before every
+# compile if $1 is edit
+best() {
+    local change=$1 file=$2
+    shift 2
+    local best=
+    for round in 1 2 3; do
+        local elapsed=0
+        for i in $(seq $ROUNDS); do
+            if [ $change = edit ]; then edit $file; fi
+            local start=$(date +%s%N)
+            "$@" -o out.s $file > /dev/null
+            elapsed=$((elapsed + $(date +%s%N) - start))
+        done
+        elapsed=$((elapsed / ROUNDS / 1000))
+        if [ -z "$best" ] || [ $elapsed -lt $best ]; then best=$elapsed; fi
+    done
+    awk "BEGIN { printf \"%.2f\", $best / 1000 }"
+}
+
+echo "$(basename $0 .sh): ms per compile, $FUNCTIONS functions in the large file"
+printf "%-10s %-10s %10s %10s %9s\n" file change process server speedup
+for file in small.c large.c; do
+    for change in none edit; do
+        process=$(best $change $file $SCC)
+        server=$(best $change $file $SCC -fconnect=$SOCKET)
+        cp out.s served.s
+        $SCC -o out.s $file > /dev/null
+        if ! cmp -s out.s served.s; then
+            echo "the server compiled $file differently" >&2
+            exit 1
+        fi
+        printf "%-10s %-10s %10s %10s %8sx\n" $file $change $process $server \
+            "$(awk "BEGIN { printf \"%.1f\", $process / $server }")"
+    done
+done
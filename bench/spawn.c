@@ -0,0 +1,51 @@
+//---------------------- Spawn timer -------------------
+// Exec-to-exit latency: runs each program given a number of times with
+// its output sent to /dev/null and prints the mean wall clock time of a
+// run, fork, exec, startup, exit and wait included.
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void run(const char* program) {
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        exit(1);
+    }
+    if (pid == 0) {
+        int null = open("/dev/null", O_WRONLY);
+        dup2(null, 1);
+        execl(program, program, (char*)NULL);
+        _exit(127);
+    }
+    int status;
+    waitpid(pid, &status, 0);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        fprintf(stderr, "%s failed\n", program);
+        exit(1);
+    }
+}
+
+int main(int argc, char** argv) {
+    if (argc < 3) {
+        fprintf(stderr, "usage: %s runs program...\n", argv[0]);
+        return 1;
+    }
+    int runs = atoi(argv[1]);
+    for (int p = 2; p < argc; p++) {
+        run(argv[p]);  // warm the page cache
+        double start = now();
+        for (int i = 0; i < runs; i++) run(argv[p]);
+        printf("%-24s %8.1fus\n", argv[p], (now() - start) / runs * 1e6);
+    }
+    return 0;
+}
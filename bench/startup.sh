@@ -0,0 +1,34 @@
+#!/bin/bash
+# Exec-to-exit latency of a program that prints a line through the sys_*
+# intrinsics, linked without libc against runtime/start.o, and the same
+# object linked against libc dynamically and statically. All three have to
+# print the same.
+set -e
+cd "$(dirname "$0")"
+SCC=../scc
+SPAWN=$(realpath spawn)
+OUT=$(mktemp -d)
+trap 'rm -rf $OUT' EXIT
+RUNS=${RUNS:-2000}
+
+cat > "$OUT/hello.c" <<'SCC'
+int main() {
+    sys_write(1, "hello\n", 6);
+    return 0;
+}
+SCC
+$SCC -O1 -c -o "$OUT/hello.o" "$OUT/hello.c" > /dev/null
+gcc -nostdlib -static -o "$OUT/nolibc" "$OUT/hello.o" ../runtime/start.o
+gcc -static -o "$OUT/static-libc" "$OUT/hello.o"
+gcc -o "$OUT/dynamic-libc" "$OUT/hello.o"
+cd "$OUT"
+for program in nolibc static-libc dynamic-libc; do
+    output=$(./$program)
+    if [ "$output" != hello ]; then
+        echo "$program printed '$output'" >&2
+        exit 1
+    fi
+done
+echo "mean of $RUNS runs, $(stat -c %s nolibc), $(stat -c %s static-libc)" \
+    "and $(stat -c %s dynamic-libc) bytes"
+$SPAWN $RUNS ./nolibc ./static-libc ./dynamic-libc
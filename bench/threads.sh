@@ -0,0 +1,38 @@
+#!/bin/bash
+# Compile time of a generated program of many independent functions with
+# -fthreads=1 up to 16, best of three compiles to an object each. Every
+# thread count has to produce the same bytes.
+set -e
+cd "$(dirname "$0")"
+SCC=../scc
+OUT=$(mktemp -d)
+trap 'rm -rf $OUT' EXIT
+FUNCTIONS=${FUNCTIONS:-600}
+
+./generate.sh $FUNCTIONS > "$OUT/many.c"
+
+# best wall clock milliseconds of compiling with $1 threads
+best() {
+    local best=
+    for run in 1 2 3; do
+        local start=$(date +%s%N)
+        $SCC -fthreads=$1 -c -o "$OUT/many$1.o" "$OUT/many.c" > /dev/null
+        local elapsed=$((($(date +%s%N) - start) / 1000000))
+        if [ -z "$best" ] || [ $elapsed -lt $best ]; then best=$elapsed; fi
+    done
+    echo $best
+}
+
+echo "$FUNCTIONS functions, $(nproc) processors"
+printf "%-8s %10s %9s\n" threads time speedup
+base=
+for threads in 1 2 4 8 16; do
+    time=$(best $threads)
+    [ -z "$base" ] && base=$time
+    if ! cmp -s "$OUT/many1.o" "$OUT/many$threads.o"; then
+        echo "-fthreads=$threads changed the object" >&2
+        exit 1
+    fi
+    printf "%-8s %8sms %8sx\n" $threads $time \
+        "$(awk "BEGIN { printf \"%.2f\", $base / $time }")"
+done
@@ -0,0 +1,229 @@
+//---------------------- Allocator ---------------------
+// Size-class heap and bump arenas on anonymous mmap, without libc, so that
+// programs linked with start.o can use them too. Memory comes in chunks
+// aligned to their size, each holding blocks of one class, so a block's
+// class is found by masking its address. Every thread allocates from free
+// lists and bump chunks of its own and takes the lock only to map more.
+//
+// Only mmap and munmap are used: moving the program break behind a libc
+// malloc that also uses it would corrupt its heap.
+#include <stddef.h>
+
+#include "scc.h"
+#include "sys.h"
+
+#define CHUNK_SIZE (64 * 1024)
+#define CHUNK_HEADER 64    // a cache line for the Chunk
+#define REGION_CHUNKS 64   // chunks mapped at a time
+#define CLASS_COUNT 14
+#define LARGE -1
+#define ARENA_BLOCK (64 * 1024)
+#define ARENA_MAX_BLOCK (4 * 1024 * 1024)
+
+static const long classSizes[CLASS_COUNT] = {
+    16, 32, 48, 64, 96, 128, 192, 256, 384, 512, 768, 1024, 1536, 2048,
+};
+
+typedef struct {
+    long cls;   // size class of the blocks, or LARGE
+    long size;  // bytes mapped for a LARGE block
+} Chunk;
+
+typedef struct FreeBlock {
+    struct FreeBlock* next;
+} FreeBlock;
+
+typedef struct {
+    FreeBlock* free[CLASS_COUNT];
+    char* next[CLASS_COUNT];  // bump pointer into the current chunk
+    char* end[CLASS_COUNT];
+} Heap;
+
+static __thread Heap heap;
+
+// chunks mapped but not handed to a thread yet
+static char* regionNext;
+static char* regionEnd;
+static char regionLock;
+
+static void unmap(void* start, long size) {
+    if (size > 0) syscall6(NR_MUNMAP, (long)start, size, 0, 0, 0, 0);
+}
+
+// zeroed pages, or NULL
+static char* mapPages(long size) {
+    long start = syscall6(NR_MMAP, 0, size, PROT_RW, MAP_ANON_PRIVATE, -1, 0);
+    return IS_ERROR(start) ? NULL : (char*)start;
+}
+
+// size bytes at an address that is a multiple of CHUNK_SIZE, or NULL
+static char* mapAligned(long size) {
+    long mapped = size + CHUNK_SIZE;
+    long start = (long)mapPages(mapped);
+    if (start == 0) return NULL;
+    long aligned = (start + CHUNK_SIZE - 1) & -(long)CHUNK_SIZE;
+    unmap((void*)start, aligned - start);
+    unmap((void*)(aligned + size), start + mapped - aligned - size);
+    return (char*)aligned;
+}
+
+static Chunk* chunkOf(void* p) {
+    return (Chunk*)((long)p & -(long)CHUNK_SIZE);
+}
+
+static char* takeChunk() {
+    while (__atomic_test_and_set(&regionLock, __ATOMIC_ACQUIRE)) {
+    }
+    if (regionNext == regionEnd) {
+        regionNext = mapAligned((long)REGION_CHUNKS * CHUNK_SIZE);
+        regionEnd = regionNext ? regionNext + (long)REGION_CHUNKS * CHUNK_SIZE
+                               : NULL;
+    }
+    char* chunk = regionNext;
+    if (chunk) regionNext += CHUNK_SIZE;
+    __atomic_clear(&regionLock, __ATOMIC_RELEASE);
+    return chunk;
+}
+
+// classes go 16, 32, 48, 64 and then 1.5 and 2 times each power of two
+static int sizeClass(long size) {
+    if (size <= 64) return size <= 0 ? 0 : (size - 1) >> 4;
+    int log = 63 - __builtin_clzl(size - 1);  // 2^log < size <= 2^(log+1)
+    int cls = 4 + 2 * (log - 6) + (size > 3L << (log - 1));
+    return cls < CLASS_COUNT ? cls : LARGE;
+}
+
+static void* allocLarge(long size) {
+    long mapped = (size + CHUNK_HEADER + 4095) & -4096L;
+    Chunk* chunk = (Chunk*)mapAligned(mapped);
+    if (chunk == NULL) return NULL;
+    chunk->cls = LARGE;
+    chunk->size = mapped;
+    return (char*)chunk + CHUNK_HEADER;
+}
+
+void* scc_alloc(long size) {
+    int cls = sizeClass(size);
+    if (cls == LARGE) return allocLarge(size);
+    FreeBlock* block = heap.free[cls];
+    if (block) {
+        heap.free[cls] = block->next;
+        return block;
+    }
+    long blockSize = classSizes[cls];
+    if (heap.end[cls] - heap.next[cls] < blockSize) {
+        Chunk* chunk = (Chunk*)takeChunk();
+        if (chunk == NULL) return NULL;
+        chunk->cls = cls;
+        heap.next[cls] = (char*)chunk + CHUNK_HEADER;
+        heap.end[cls] = heap.next[cls] +
+                        (CHUNK_SIZE - CHUNK_HEADER) / blockSize * blockSize;
+    }
+    void* p = heap.next[cls];
+    heap.next[cls] += blockSize;
+    return p;
+}
+
+void scc_free(void* p) {
+    if (p == NULL) return;
+    Chunk* chunk = chunkOf(p);
+    if (chunk->cls == LARGE) {
+        unmap(chunk, chunk->size);
+        return;
+    }
+    FreeBlock* block = p;
+    block->next = heap.free[chunk->cls];
+    heap.free[chunk->cls] = block;
+}
+
+void* scc_realloc(void* p, long size) {
+    if (p == NULL) return scc_alloc(size);
+    Chunk* chunk = chunkOf(p);
+    long usable = chunk->cls == LARGE ? chunk->size - CHUNK_HEADER
+                                      : classSizes[chunk->cls];
+    if (size <= usable) return p;
+    long* copy = scc_alloc(size);
+    if (copy == NULL) return NULL;
+    // blocks are multiples of 16 bytes, so whole words cover them
+    for (long i = 0; i < usable / 8; i++) copy[i] = ((long*)p)[i];
+    scc_free(p);
+    return copy;
+}
+
+//---------------------- Arenas ------------------------
+
+typedef struct ArenaBlock {
+    struct ArenaBlock* next;
+    long size;  // bytes mapped, this header included
+} ArenaBlock;
+
+struct SccArena {
+    ArenaBlock* first;  // holds the arena itself
+    ArenaBlock* current;
+    char* next;
+    char* end;
+};
+
+#define ARENA_HEADER ((long)(sizeof(ArenaBlock) + 15) & -16L)
+
+static ArenaBlock* mapArenaBlock(long size) {
+    ArenaBlock* block = (ArenaBlock*)mapPages(size);
+    if (block == NULL) return NULL;
+    block->next = NULL;
+    block->size = size;
+    return block;
+}
+
+static void enterBlock(SccArena* arena, ArenaBlock* block) {
+    arena->current = block;
+    arena->next = (char*)block + ARENA_HEADER;
+    arena->end = (char*)block + block->size;
+}
+
+SccArena* scc_arena(void) {
+    ArenaBlock* block = mapArenaBlock(ARENA_BLOCK);
+    if (block == NULL) return NULL;
+    SccArena* arena = (SccArena*)((char*)block + ARENA_HEADER);
+    arena->first = block;
+    enterBlock(arena, block);
+    arena->next += (sizeof(SccArena) + 15) & -16L;
+    return arena;
+}
+
+void* scc_arena_alloc(SccArena* arena, long size) {
+    size = (size + 15) & -16L;
+    if (arena->end - arena->next < size) {
+        // after a reset the blocks of the last round are used again
+        ArenaBlock* next = arena->current->next;
+        if (next == NULL || next->size - ARENA_HEADER < size) {
+            long blockSize = arena->current->size * 2;
+            if (blockSize > ARENA_MAX_BLOCK) blockSize = ARENA_MAX_BLOCK;
+            long needed = (size + ARENA_HEADER + 4095) & -4096L;
+            if (blockSize < needed) blockSize = needed;
+            ArenaBlock* block = mapArenaBlock(blockSize);
+            if (block == NULL) return NULL;
+            block->next = next;
+            arena->current->next = block;
+            next = block;
+        }
+        enterBlock(arena, next);
+    }
+    void* p = arena->next;
+    arena->next += size;
+    return p;
+}
+
+void scc_arena_reset(SccArena* arena) {
+    enterBlock(arena, arena->first);
+    arena->next += (sizeof(SccArena) + 15) & -16L;
+}
+
+void scc_arena_free(SccArena* arena) {
+    ArenaBlock* block = arena->first->next;
+    while (block) {
+        ArenaBlock* next = block->next;
+        unmap(block, block->size);
+        block = next;
+    }
+    unmap(arena->first, arena->first->size);
+}
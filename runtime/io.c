@@ -0,0 +1,427 @@
+//---------------------- I/O ---------------------------
+// Buffered reads and writes on file descriptors, without libc. Writes
+// gather in a 64 KB buffer per descriptor and reach the kernel a buffer at
+// a time. With plain system calls a write that does not fit goes out in
+// one writev with the buffered bytes, without copying it. With io_uring
+// each descriptor has two buffers: one fills while the other is written,
+// and input is read a buffer ahead, so the program does not wait for the
+// kernel in between. Without io_uring, or when the kernel refuses to set
+// one up, everything falls back to plain system calls.
+//
+// A descriptor's stream belongs to one thread at a time.
+#include <emmintrin.h>
+#include <linux/io_uring.h>
+#include <stddef.h>
+
+#include "scc.h"
+#include "sys.h"
+
+#define bool _Bool
+#define true 1
+#define false 0
+
+#define IO_BUFFER (64 * 1024)
+#define IO_STREAMS 64  // descriptors from here on are not buffered
+#define RING_ENTRIES 16
+
+typedef struct {
+    bool done;
+    long result;
+} Request;
+
+typedef struct {
+    // output gathers in out[filling], the other buffer may be in flight
+    char* out[2];
+    int filling;
+    long used;
+    Request writing;
+    bool writePending;
+    long writeSize;
+    long error;  // of a write that finished in the background
+    // input from inStart to inEnd of in[current], the next buffer may be
+    // on its way into the other one
+    char* in[2];
+    int current;
+    long inStart;
+    long inEnd;
+    Request reading;
+    bool readPending;
+} Stream;
+
+typedef struct {
+    int fd;
+    char* rings;
+    long ringsSize;
+    struct io_uring_sqe* sqes;
+    long sqesSize;
+    unsigned* sqTail;
+    unsigned sqMask;
+    unsigned* sqArray;
+    unsigned* cqHead;
+    unsigned* cqTail;
+    unsigned cqMask;
+    struct io_uring_cqe* cqes;
+} Ring;
+
+static Stream* streams[IO_STREAMS];
+static Ring ring;
+static int mode = -1;  // SCC_IO_SYSCALLS or SCC_IO_RING once chosen
+
+static void copyBytes(void* to, const void* from, long size) {
+    __asm__ volatile("rep movsb"
+                     : "+D"(to), "+S"(from), "+c"(size)
+                     :
+                     : "memory");
+}
+
+static void clearBytes(void* to, long size) {
+    __asm__ volatile("rep stosb" : "+D"(to), "+c"(size) : "a"(0) : "memory");
+}
+
+// bytes up to and including the first newline, or -1
+static long findNewline(const char* p, long size) {
+    __m128i newline = _mm_set1_epi8('\n');
+    long i = 0;
+    for (; i + 16 <= size; i += 16) {
+        __m128i bytes = _mm_loadu_si128((const __m128i*)(p + i));
+        int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(bytes, newline));
+        if (mask) return i + __builtin_ctz(mask) + 1;
+    }
+    for (; i < size; i++) {
+        if (p[i] == '\n') return i + 1;
+    }
+    return -1;
+}
+
+//---------------------- Plain system calls ------------
+
+static long writeAll(long fd, const char* data, long size) {
+    for (long done = 0; done < size;) {
+        long n = syscall6(NR_WRITE, fd, (long)(data + done), size - done, 0,
+                          0, 0);
+        if (IS_ERROR(n)) return n;
+        done += n;
+    }
+    return size;
+}
+
+typedef struct {
+    const void* base;
+    long length;
+} IoVec;
+
+// a then b in as few writev calls as the kernel allows
+static long writeBoth(long fd, const char* a, long aSize, const char* b,
+                      long bSize) {
+    while (aSize > 0) {
+        IoVec parts[2] = {{a, aSize}, {b, bSize}};
+        long n = syscall6(NR_WRITEV, fd, (long)parts, 2, 0, 0, 0);
+        if (IS_ERROR(n)) return n;
+        if (n >= aSize) return writeAll(fd, b + (n - aSize), bSize - (n - aSize));
+        a += n;
+        aSize -= n;
+    }
+    return writeAll(fd, b, bSize);
+}
+
+//---------------------- io_uring ----------------------
+
+static void closeRing() {
+    syscall6(NR_MUNMAP, (long)ring.rings, ring.ringsSize, 0, 0, 0, 0);
+    syscall6(NR_MUNMAP, (long)ring.sqes, ring.sqesSize, 0, 0, 0, 0);
+    syscall6(NR_CLOSE, ring.fd, 0, 0, 0, 0, 0);
+    ring.fd = -1;
+}
+
+static bool openRing() {
+    struct io_uring_params params;
+    clearBytes(&params, sizeof(params));
+    long fd = syscall6(NR_IO_URING_SETUP, RING_ENTRIES, (long)&params, 0, 0,
+                       0, 0);
+    if (IS_ERROR(fd)) return false;
+    ring.fd = fd;
+    // older kernels without these are left to plain system calls
+    unsigned needed = IORING_FEAT_SINGLE_MMAP | IORING_FEAT_RW_CUR_POS;
+    if ((params.features & needed) != needed) {
+        syscall6(NR_CLOSE, fd, 0, 0, 0, 0, 0);
+        return false;
+    }
+    long sqSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    long cqSize = params.cq_off.cqes +
+                  params.cq_entries * sizeof(struct io_uring_cqe);
+    ring.ringsSize = sqSize > cqSize ? sqSize : cqSize;
+    ring.sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+    long rings = syscall6(NR_MMAP, 0, ring.ringsSize, PROT_RW,
+                          MAP_SHARED_POPULATE, fd, IORING_OFF_SQ_RING);
+    long sqes = syscall6(NR_MMAP, 0, ring.sqesSize, PROT_RW,
+                         MAP_SHARED_POPULATE, fd, IORING_OFF_SQES);
+    if (IS_ERROR(rings) || IS_ERROR(sqes)) {
+        if (!IS_ERROR(rings)) syscall6(NR_MUNMAP, rings, ring.ringsSize, 0, 0, 0, 0);
+        if (!IS_ERROR(sqes)) syscall6(NR_MUNMAP, sqes, ring.sqesSize, 0, 0, 0, 0);
+        syscall6(NR_CLOSE, fd, 0, 0, 0, 0, 0);
+        return false;
+    }
+    ring.rings = (char*)rings;
+    ring.sqes = (struct io_uring_sqe*)sqes;
+    ring.sqTail = (unsigned*)(ring.rings + params.sq_off.tail);
+    ring.sqMask = *(unsigned*)(ring.rings + params.sq_off.ring_mask);
+    ring.sqArray = (unsigned*)(ring.rings + params.sq_off.array);
+    ring.cqHead = (unsigned*)(ring.rings + params.cq_off.head);
+    ring.cqTail = (unsigned*)(ring.rings + params.cq_off.tail);
+    ring.cqMask = *(unsigned*)(ring.rings + params.cq_off.ring_mask);
+    ring.cqes = (struct io_uring_cqe*)(ring.rings + params.cq_off.cqes);
+    return true;
+}
+
+// starts a read or write at the file position, finished by waitFor
+static void submit(int opcode, long fd, char* buffer, long size,
+                   Request* request) {
+    unsigned tail = *ring.sqTail;
+    unsigned index = tail & ring.sqMask;
+    struct io_uring_sqe* sqe = &ring.sqes[index];
+    clearBytes(sqe, sizeof(*sqe));
+    sqe->opcode = opcode;
+    sqe->fd = fd;
+    sqe->off = -1;
+    sqe->addr = (long)buffer;
+    sqe->len = size;
+    sqe->user_data = (long)request;
+    ring.sqArray[index] = index;
+    __atomic_store_n(ring.sqTail, tail + 1, __ATOMIC_RELEASE);
+    request->done = false;
+    long submitted = syscall6(NR_IO_URING_ENTER, ring.fd, 1, 0, 0, 0, 0);
+    if (IS_ERROR(submitted)) {
+        request->done = true;
+        request->result = submitted;
+    }
+}
+
+// completions come in any order and each lands in its own request
+static void waitFor(Request* request) {
+    while (!request->done) {
+        unsigned head = *ring.cqHead;
+        if (head == __atomic_load_n(ring.cqTail, __ATOMIC_ACQUIRE)) {
+            syscall6(NR_IO_URING_ENTER, ring.fd, 0, 1, IORING_ENTER_GETEVENTS,
+                     0, 0);
+            continue;
+        }
+        struct io_uring_cqe* cqe = &ring.cqes[head & ring.cqMask];
+        Request* done = (Request*)cqe->user_data;
+        done->result = cqe->res;
+        done->done = true;
+        __atomic_store_n(ring.cqHead, head + 1, __ATOMIC_RELEASE);
+    }
+}
+
+//---------------------- Streams -----------------------
+
+static void chooseMode() {
+    if (mode < 0) scc_io_mode(SCC_IO_RING);
+}
+
+static Stream* streamOf(long fd) {
+    if (fd < 0 || fd >= IO_STREAMS) return NULL;
+    if (streams[fd] == NULL) {
+        Stream* stream = scc_alloc(sizeof(Stream));
+        if (stream == NULL) return NULL;
+        clearBytes(stream, sizeof(Stream));
+        streams[fd] = stream;
+    }
+    chooseMode();
+    return streams[fd];
+}
+
+// the buffer in slot, made on first use
+static char* buffer(char** slot) {
+    if (*slot == NULL) *slot = scc_alloc(IO_BUFFER);
+    return *slot;
+}
+
+// the write in flight done, a short one finished by hand
+static void finishWrite(long fd, Stream* stream) {
+    if (!stream->writePending) return;
+    waitFor(&stream->writing);
+    stream->writePending = false;
+    long written = stream->writing.result;
+    if (!IS_ERROR(written) && written < stream->writeSize) {
+        written = writeAll(fd, stream->out[!stream->filling] + written,
+                           stream->writeSize - written);
+    }
+    if (IS_ERROR(written) && stream->error == 0) stream->error = written;
+}
+
+// hands the buffered bytes to the kernel, waiting for them or not
+static void flushStream(long fd, Stream* stream, bool wait) {
+    if (mode == SCC_IO_RING) {
+        finishWrite(fd, stream);
+        if (stream->used > 0) {
+            submit(IORING_OP_WRITE, fd, stream->out[stream->filling],
+                   stream->used, &stream->writing);
+            stream->writePending = true;
+            stream->writeSize = stream->used;
+            stream->filling ^= 1;
+            stream->used = 0;
+        }
+        if (wait) finishWrite(fd, stream);
+    } else if (stream->used > 0) {
+        long written = writeAll(fd, stream->out[stream->filling], stream->used);
+        if (IS_ERROR(written) && stream->error == 0) stream->error = written;
+        stream->used = 0;
+    }
+}
+
+// an error kept from the background, reported once
+static long takeError(Stream* stream) {
+    long error = stream->error;
+    stream->error = 0;
+    return error;
+}
+
+long scc_write(long fd, const void* data, long size) {
+    Stream* stream = streamOf(fd);
+    if (stream == NULL || buffer(&stream->out[stream->filling]) == NULL) {
+        return writeAll(fd, data, size);
+    }
+    if (stream->error) return takeError(stream);
+    const char* bytes = data;
+    if (stream->used + size > IO_BUFFER && mode == SCC_IO_SYSCALLS) {
+        long written = writeBoth(fd, stream->out[stream->filling],
+                                 stream->used, bytes, size);
+        stream->used = 0;
+        return IS_ERROR(written) ? written : size;
+    }
+    for (long left = size; left > 0;) {
+        if (buffer(&stream->out[stream->filling]) == NULL) {
+            return writeAll(fd, bytes, left);
+        }
+        long n = IO_BUFFER - stream->used;
+        if (n > left) n = left;
+        copyBytes(stream->out[stream->filling] + stream->used, bytes, n);
+        stream->used += n;
+        bytes += n;
+        left -= n;
+        if (stream->used == IO_BUFFER) flushStream(fd, stream, false);
+    }
+    return size;
+}
+
+long scc_flush(long fd) {
+    if (fd < 0 || fd >= IO_STREAMS || streams[fd] == NULL) return 0;
+    flushStream(fd, streams[fd], true);
+    return takeError(streams[fd]);
+}
+
+void scc_flush_all(void) {
+    for (int fd = 0; fd < IO_STREAMS; fd++) scc_flush(fd);
+}
+
+// libc runs this at exit, start.o calls scc_flush_all itself
+__attribute__((destructor)) static void flushAtExit() { scc_flush_all(); }
+
+// bytes in in[current] again, 0 at the end of input or -errno
+static long fill(long fd, Stream* stream) {
+    long n;
+    if (stream->readPending) {
+        // read ahead, possibly before a switch to plain system calls
+        if (mode == SCC_IO_RING) waitFor(&stream->reading);
+        stream->readPending = false;
+        n = stream->reading.result;
+    } else if (mode == SCC_IO_RING) {
+        if (buffer(&stream->in[!stream->current]) == NULL) return -12;
+        submit(IORING_OP_READ, fd, stream->in[!stream->current], IO_BUFFER,
+               &stream->reading);
+        waitFor(&stream->reading);
+        n = stream->reading.result;
+    } else {
+        if (buffer(&stream->in[stream->current]) == NULL) return -12;
+        n = syscall6(NR_READ, fd, (long)stream->in[stream->current],
+                     IO_BUFFER, 0, 0, 0);
+        if (n > 0) {
+            stream->inStart = 0;
+            stream->inEnd = n;
+        }
+        return n;
+    }
+    if (n <= 0) return n;
+    stream->current ^= 1;
+    stream->inStart = 0;
+    stream->inEnd = n;
+    if (mode == SCC_IO_RING && buffer(&stream->in[!stream->current])) {
+        submit(IORING_OP_READ, fd, stream->in[!stream->current], IO_BUFFER,
+               &stream->reading);
+        stream->readPending = true;
+    }
+    return n;
+}
+
+long scc_read(long fd, void* data, long size) {
+    Stream* stream = streamOf(fd);
+    if (stream == NULL) return syscall6(NR_READ, fd, (long)data, size, 0, 0, 0);
+    if (stream->inStart == stream->inEnd) {
+        long n = fill(fd, stream);
+        if (n <= 0) return n;
+    }
+    long n = stream->inEnd - stream->inStart;
+    if (n > size) n = size;
+    copyBytes(data, stream->in[stream->current] + stream->inStart, n);
+    stream->inStart += n;
+    return n;
+}
+
+long scc_read_line(long fd, void* line, long capacity) {
+    Stream* stream = streamOf(fd);
+    if (stream == NULL) return -9;  // EBADF
+    char* to = line;
+    long total = 0;
+    while (total < capacity) {
+        if (stream->inStart == stream->inEnd) {
+            long n = fill(fd, stream);
+            if (n < 0 && total == 0) return n;
+            if (n <= 0) break;
+        }
+        char* from = stream->in[stream->current] + stream->inStart;
+        long available = stream->inEnd - stream->inStart;
+        if (available > capacity - total) available = capacity - total;
+        long end = findNewline(from, available);
+        long n = end < 0 ? available : end;
+        copyBytes(to + total, from, n);
+        total += n;
+        stream->inStart += n;
+        if (end >= 0) break;
+    }
+    return total;
+}
+
+long scc_close(long fd) {
+    long error = 0;
+    Stream* stream = fd >= 0 && fd < IO_STREAMS ? streams[fd] : NULL;
+    if (stream) {
+        error = scc_flush(fd);
+        if (stream->readPending && mode == SCC_IO_RING) {
+            waitFor(&stream->reading);
+        }
+        // the next file on fd starts empty but keeps the buffers
+        char* out[2] = {stream->out[0], stream->out[1]};
+        char* in[2] = {stream->in[0], stream->in[1]};
+        clearBytes(stream, sizeof(Stream));
+        copyBytes(stream->out, out, sizeof(out));
+        copyBytes(stream->in, in, sizeof(in));
+    }
+    long closed = syscall6(NR_CLOSE, fd, 0, 0, 0, 0, 0);
+    return error ? error : closed;
+}
+
+long scc_io_mode(long requested) {
+    for (int fd = 0; fd < IO_STREAMS; fd++) {
+        Stream* stream = streams[fd];
+        if (stream == NULL) continue;
+        flushStream(fd, stream, true);
+        if (stream->readPending && mode == SCC_IO_RING) {
+            waitFor(&stream->reading);
+        }
+    }
+    if (mode == SCC_IO_RING) closeRing();
+    mode = requested == SCC_IO_RING && openRing() ? SCC_IO_RING
+                                                  : SCC_IO_SYSCALLS;
+    return mode;
+}
@@ -0,0 +1,237 @@
+//---------------------- Matrix -----------------------
+// Cache-blocked, register-tiled matrix multiply in the style of BLIS:
+// blocks of A and B are packed into contiguous panels that the
+// micro-kernel streams through while it keeps an MR x NR tile of C in
+// registers. The micro-kernel uses AVX2/FMA when the CPU has it and plain
+// C otherwise.
+#include <immintrin.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "scc.h"
+
+// register tile of the micro-kernel: MR rows by NR columns of C
+#define MR 6
+#define NR 8
+// cache blocks: a KC x NR panel of B stays in L1, an MC x KC block of A in
+// L2 and a KC x NC block of B in L3
+#define MC 72
+#define KC 256
+#define NC 1024
+
+typedef void (*Kernel)(long kc, const double* a, const double* b, double* c,
+                       long ldc);
+
+static long min(long a, long b) { return a < b ? a : b; }
+
+// c[MR][NR] += packed a (kc x MR) * packed b (kc x NR)
+static void kernelScalar(long kc, const double* a, const double* b, double* c,
+                         long ldc) {
+    double acc[MR][NR] = {{0}};
+    for (long p = 0; p < kc; p++) {
+        for (int i = 0; i < MR; i++) {
+            for (int j = 0; j < NR; j++) acc[i][j] += a[i] * b[j];
+        }
+        a += MR;
+        b += NR;
+    }
+    for (int i = 0; i < MR; i++) {
+        for (int j = 0; j < NR; j++) c[i * ldc + j] += acc[i][j];
+    }
+}
+
+#define FMA_ROW(row)                                    \
+    ai = _mm256_broadcast_sd(a + row);                  \
+    c##row##0 = _mm256_fmadd_pd(ai, b0, c##row##0);     \
+    c##row##1 = _mm256_fmadd_pd(ai, b1, c##row##1);
+
+#define STORE_ROW(row)                                                    \
+    _mm256_storeu_pd(c + row * ldc,                                       \
+                     _mm256_add_pd(_mm256_loadu_pd(c + row * ldc),        \
+                                   c##row##0));                           \
+    _mm256_storeu_pd(c + row * ldc + 4,                                   \
+                     _mm256_add_pd(_mm256_loadu_pd(c + row * ldc + 4),    \
+                                   c##row##1));
+
+// the 6 x 8 tile lives in 12 ymm registers, two more hold the row of B
+__attribute__((target("avx2,fma"))) static void kernelAvx2(
+    long kc, const double* a, const double* b, double* c, long ldc) {
+    __m256d c00 = _mm256_setzero_pd(), c01 = _mm256_setzero_pd();
+    __m256d c10 = _mm256_setzero_pd(), c11 = _mm256_setzero_pd();
+    __m256d c20 = _mm256_setzero_pd(), c21 = _mm256_setzero_pd();
+    __m256d c30 = _mm256_setzero_pd(), c31 = _mm256_setzero_pd();
+    __m256d c40 = _mm256_setzero_pd(), c41 = _mm256_setzero_pd();
+    __m256d c50 = _mm256_setzero_pd(), c51 = _mm256_setzero_pd();
+    for (long p = 0; p < kc; p++) {
+        __m256d b0 = _mm256_load_pd(b);
+        __m256d b1 = _mm256_load_pd(b + 4);
+        __m256d ai;
+        FMA_ROW(0)
+        FMA_ROW(1)
+        FMA_ROW(2)
+        FMA_ROW(3)
+        FMA_ROW(4)
+        FMA_ROW(5)
+        a += MR;
+        b += NR;
+    }
+    STORE_ROW(0)
+    STORE_ROW(1)
+    STORE_ROW(2)
+    STORE_ROW(3)
+    STORE_ROW(4)
+    STORE_ROW(5)
+}
+
+// MR-row panels of an mc x kc block of A, zero padded at the bottom
+static void packA(long kc, long mc, const double* a, long lda, double* out) {
+    for (long i = 0; i < mc; i += MR) {
+        for (long p = 0; p < kc; p++) {
+            for (long r = 0; r < MR; r++) {
+                *out++ = i + r < mc ? a[(i + r) * lda + p] : 0;
+            }
+        }
+    }
+}
+
+// NR-column panels of a kc x nc block of B, zero padded on the right
+static void packB(long kc, long nc, const double* b, long ldb, double* out) {
+    for (long j = 0; j < nc; j += NR) {
+        for (long p = 0; p < kc; p++) {
+            for (long r = 0; r < NR; r++) {
+                *out++ = j + r < nc ? b[p * ldb + j + r] : 0;
+            }
+        }
+    }
+}
+
+static double* alignedBuffer(long words) {
+    void* buffer = NULL;
+    if (posix_memalign(&buffer, 64, sizeof(double) * words) != 0) {
+        fprintf(stderr, "scc: out of memory in matrix multiply\n");
+        exit(1);
+    }
+    return buffer;
+}
+
+static void gemmBlocked(long m, long n, long k, const double* a,
+                        const double* b, double* c, Kernel kernel) {
+    memset(c, 0, sizeof(double) * m * n);
+    double* packedA = alignedBuffer(MC * KC);
+    double* packedB = alignedBuffer(KC * NC);
+    for (long jc = 0; jc < n; jc += NC) {
+        long nc = min(NC, n - jc);
+        for (long pc = 0; pc < k; pc += KC) {
+            long kc = min(KC, k - pc);
+            packB(kc, nc, b + pc * n + jc, n, packedB);
+            for (long ic = 0; ic < m; ic += MC) {
+                long mc = min(MC, m - ic);
+                packA(kc, mc, a + ic * k + pc, k, packedA);
+                for (long jr = 0; jr < nc; jr += NR) {
+                    for (long ir = 0; ir < mc; ir += MR) {
+                        const double* pa = packedA + ir * kc;
+                        const double* pb = packedB + jr * kc;
+                        double* tile = c + (ic + ir) * n + jc + jr;
+                        if (ir + MR <= mc && jr + NR <= nc) {
+                            kernel(kc, pa, pb, tile, n);
+                            continue;
+                        }
+                        // partial tile at the edge of C
+                        double edge[MR * NR] = {0};
+                        kernel(kc, pa, pb, edge, NR);
+                        for (long i = 0; i < min(MR, mc - ir); i++) {
+                            for (long j = 0; j < min(NR, nc - jr); j++) {
+                                tile[i * n + j] += edge[i * NR + j];
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+    free(packedA);
+    free(packedB);
+}
+
+// fully unrolled kernels for small square shapes
+#define SMALL_GEMM(N)                                                  \
+    static void gemm##N(const double* a, const double* b, double* c) { \
+        _Pragma("GCC unroll 4") for (int i = 0; i < N; i++) {          \
+            _Pragma("GCC unroll 4") for (int j = 0; j < N; j++) {      \
+                double sum = 0;                                        \
+                _Pragma("GCC unroll 4") for (int p = 0; p < N; p++) {  \
+                    sum += a[i * N + p] * b[p * N + j];                \
+                }                                                      \
+                c[i * N + j] = sum;                                    \
+            }                                                          \
+        }                                                              \
+    }
+
+SMALL_GEMM(2)
+SMALL_GEMM(3)
+SMALL_GEMM(4)
+
+static bool smallGemm(long m, long n, long k, const double* a,
+                      const double* b, double* c) {
+    if (m != n || n != k) return false;
+    switch (n) {
+        case 2:
+            gemm2(a, b, c);
+            return true;
+        case 3:
+            gemm3(a, b, c);
+            return true;
+        case 4:
+            gemm4(a, b, c);
+            return true;
+        default:
+            return false;
+    }
+}
+
+static Kernel selectKernel() {
+    static Kernel kernel = NULL;
+    if (kernel == NULL) {
+        __builtin_cpu_init();
+        bool simd =
+            __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+        kernel = simd ? kernelAvx2 : kernelScalar;
+    }
+    return kernel;
+}
+
+void scc_gemm(long m, long n, long k, const double* a, const double* b,
+              double* c) {
+    if (smallGemm(m, n, k, a, b, c)) return;
+    gemmBlocked(m, n, k, a, b, c, selectKernel());
+}
+
+void scc_gemm_scalar(long m, long n, long k, const double* a,
+                     const double* b, double* c) {
+    gemmBlocked(m, n, k, a, b, c, kernelScalar);
+}
+
+Matrix* scc_matrix(long rows, long cols) {
+    Matrix* matrix = calloc(1, sizeof(Matrix) + sizeof(double) * rows * cols);
+    if (matrix == NULL) {
+        fprintf(stderr, "scc: out of memory for a %ldx%ld matrix\n", rows,
+                cols);
+        exit(1);
+    }
+    matrix->rows = rows;
+    matrix->cols = cols;
+    return matrix;
+}
+
+Matrix* scc_matmul(Matrix* a, Matrix* b) {
+    if (a->cols != b->rows) {
+        fprintf(stderr, "scc: cannot multiply %ldx%ld by %ldx%ld matrix\n",
+                a->rows, a->cols, b->rows, b->cols);
+        exit(1);
+    }
+    Matrix* c = scc_matrix(a->rows, b->cols);
+    scc_gemm(a->rows, b->cols, a->cols, a->data, b->data, c->data);
+    return c;
+}
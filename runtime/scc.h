@@ -0,0 +1,84 @@
+#ifndef SCC_RUNTIME_H
+#define SCC_RUNTIME_H
+
+//---------------------- Runtime -----------------------
+// Support library linked into programs compiled by scc. Every scc value is
+// a 64-bit word, so runtime entry points take and return `long` or
+// pointers.
+
+//---------------------- Matrix ------------------------
+// `a @ b` in scc is lowered to scc_matmul(a, b). A matrix is a pointer to
+// its shape followed by its elements, row major.
+typedef struct {
+    long rows;
+    long cols;
+    double data[];
+} Matrix;
+
+Matrix* scc_matrix(long rows, long cols);
+Matrix* scc_matmul(Matrix* a, Matrix* b);
+
+// c = a * b for row-major m x k and k x n operands
+void scc_gemm(long m, long n, long k, const double* a, const double* b,
+              double* c);
+// same blocking with the portable micro-kernel, for comparison
+void scc_gemm_scalar(long m, long n, long k, const double* a,
+                     const double* b, double* c);
+
+//---------------------- Allocator ---------------------
+// A heap that maps its memory itself, so it also serves programs linked
+// without libc. Sizes up to 2 KB are rounded up to one of 14 classes and
+// served from free lists and bump chunks of the calling thread, larger
+// ones get a mapping of their own. Any thread may free a block, which
+// joins that thread's lists. Blocks are 16-byte aligned; NULL means the
+// kernel refused more memory.
+void* scc_alloc(long size);
+void* scc_realloc(void* p, long size);
+void scc_free(void* p);
+
+// An arena hands out memory by bumping a pointer and takes it back all at
+// once: scc_arena_reset keeps the mappings for the next round of
+// allocations, scc_arena_free unmaps them.
+typedef struct SccArena SccArena;
+SccArena* scc_arena(void);
+void* scc_arena_alloc(SccArena* arena, long size);
+void scc_arena_reset(SccArena* arena);
+void scc_arena_free(SccArena* arena);
+
+//---------------------- I/O ---------------------------
+// Buffered reads and writes on descriptors 0 to 63, others go straight to
+// the kernel. Each returns the bytes moved or -errno; an error of a write
+// finished in the background comes back from the next write or flush.
+// Buffered output is flushed when main returns, but not on sys_exit, and
+// does not mix with stdio on the same descriptor.
+long scc_write(long fd, const void* data, long size);
+long scc_read(long fd, void* data, long size);
+// up to capacity bytes ending with the first newline, 0 at the end
+long scc_read_line(long fd, void* line, long capacity);
+long scc_flush(long fd);
+void scc_flush_all(void);
+// flushes fd, waits for a read ahead on it, forgets what was buffered and
+// closes it, so that a file opened on the same number later starts afresh;
+// a descriptor of a stream has to be closed with this rather than sys_close
+long scc_close(long fd);
+
+// how buffers reach the kernel: SCC_IO_RING submits them to io_uring and
+// overlaps the I/O with the program, SCC_IO_SYSCALLS makes read and writev
+// calls. The ring is the default, and scc_io_mode returns the mode in
+// effect, which is SCC_IO_SYSCALLS when the kernel has no io_uring.
+#define SCC_IO_SYSCALLS 0
+#define SCC_IO_RING 1
+long scc_io_mode(long mode);
+
+//---------------------- Startup -----------------------
+// Calls to sys_write, sys_exit and the other sys_* intrinsics compile to
+// syscall instructions, so a program using nothing else needs no libc.
+// start.o supplies the entry point, calling main(argc, argv) and exiting
+// with its result:
+//
+//     gcc -nostdlib -static -o prog prog.s runtime/start.o runtime/libscc.a
+//
+// It also sets up the thread-locals of the allocator and flushes buffered
+// output after main returns.
+
+#endif
@@ -0,0 +1,43 @@
+//---------------------- Startup -----------------------
+// Entry point for programs that make their own system calls and link
+// without libc, see scc.h. The kernel leaves argc at the top of the stack
+// and argv just above it; main's result is the exit status.
+//
+// fs points at a static block for the thread-locals of the runtime, as
+// libc would set it up: zero-initialized ones below the pointer, which
+// holds its own address. Initialized thread-locals are not copied in.
+
+__asm__(
+    ".text\n"
+    ".globl _start\n"
+    ".weak scc_flush_all\n"
+    ".type _start, @function\n"
+    "_start:\n"
+    "\txorl\t%ebp, %ebp\n"
+    "\tleaq\tscc_tls_end(%rip), %rsi\n"
+    "\tmovq\t%rsi, (%rsi)\n"
+    "\tmovl\t$0x1002, %edi\n"  // arch_prctl(ARCH_SET_FS, rsi)
+    "\tmovl\t$158, %eax\n"
+    "\tsyscall\n"
+    "\tmovq\t(%rsp), %rdi\n"
+    "\tleaq\t8(%rsp), %rsi\n"
+    "\tandq\t$-16, %rsp\n"
+    "\tcall\tmain\n"
+    "\tmovq\t%rax, %rbx\n"
+    // defined only when the program uses buffered I/O
+    "\tleaq\tscc_flush_all(%rip), %rax\n"
+    "\ttestq\t%rax, %rax\n"
+    "\tjz\t1f\n"
+    "\tcall\t*%rax\n"
+    "1:\n"
+    "\tmovq\t%rbx, %rdi\n"
+    "\tmovl\t$60, %eax\n"
+    "\tsyscall\n"
+    "\thlt\n"
+    ".size _start, . - _start\n"
+    ".bss\n"
+    ".balign 64\n"
+    "scc_tls:\n"
+    "\t.zero 4096\n"
+    "scc_tls_end:\n"
+    "\t.zero 64\n");  // the thread control block, with the stack guard
@@ -0,0 +1,38 @@
+#ifndef SCC_SYS_H
+#define SCC_SYS_H
+
+//---------------------- System calls ------------------
+// Raw system calls for the parts of the runtime that must work without
+// libc. Numbers are those of x86-64 Linux, as in src/syscall.c; failures
+// come back as -errno.
+
+#define NR_READ 0
+#define NR_WRITE 1
+#define NR_CLOSE 3
+#define NR_MMAP 9
+#define NR_MUNMAP 11
+#define NR_WRITEV 20
+#define NR_IO_URING_SETUP 425
+#define NR_IO_URING_ENTER 426
+
+#define PROT_RW 3              // PROT_READ | PROT_WRITE
+#define MAP_ANON_PRIVATE 0x22  // MAP_PRIVATE | MAP_ANONYMOUS
+#define MAP_SHARED_POPULATE 0x8001  // MAP_SHARED | MAP_POPULATE
+
+#define IS_ERROR(result) ((unsigned long)(result) > -4096UL)
+
+static inline long syscall6(long number, long a, long b, long c, long d,
+                            long e, long f) {
+    register long r10 __asm__("r10") = d;
+    register long r8 __asm__("r8") = e;
+    register long r9 __asm__("r9") = f;
+    long result;
+    __asm__ volatile("syscall"
+                     : "=a"(result)
+                     : "a"(number), "D"(a), "S"(b), "d"(c), "r"(r10), "r"(r8),
+                       "r"(r9)
+                     : "rcx", "r11", "memory");
+    return result;
+}
+
+#endif
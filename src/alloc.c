@@ -0,0 +1,277 @@
+//---------------------- Allocation --------------------
+#include "alloc.h"
+
+#include <pthread.h>
+#include <stdint.h>
+
+#include "util.h"
+
+#define SITE_CAPACITY 1024  // a power of two, well over the call sites
+#define TOP_SITES 30
+#define BAR_WIDTH 30
+
+static const char* tagNames[ALLOC_TAG_COUNT] = {
+    "strings", "names", "tokens", "ast", "ir", "optimizer",
+    "codegen", "interpreter", "jit", "cache", "driver",
+};
+
+typedef struct {
+    const char* file;  // NULL for a free slot
+    int line;
+    AllocTag tag;
+    AllocStats stats;
+} Site;
+
+// a live block, by address
+typedef struct {
+    void* p;  // NULL for a free slot
+    size_t size;
+    int site;     // -1 if it is not counted
+    bool arena;   // released by closeArena
+} Block;
+
+static bool tracking;
+static unsigned arenaTags;  // of the open arena, 0 if there is none
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static AllocStats tags[ALLOC_TAG_COUNT];
+static Site sites[SITE_CAPACITY];
+static int siteCount;
+static Block* blocks;
+static long blockCapacity;  // a power of two, at least twice blockCount
+static long blockCount;
+
+static unsigned long hashPointer(void* p) {
+    return ((uintptr_t)p >> 4) * 0x9e3779b97f4a7c15UL;
+}
+
+// the same file can be two copies of its name, so names are compared
+static int findSite(AllocTag tag, const char* file, int line) {
+    unsigned long hash = line * 0x9e3779b97f4a7c15UL;
+    for (const char* c = file; *c; c++) hash = (hash ^ (unsigned char)*c) * 1099511628211UL;
+    for (int i = hash & (SITE_CAPACITY - 1);; i = (i + 1) & (SITE_CAPACITY - 1)) {
+        Site* site = &sites[i];
+        if (site->file == NULL) {
+            if (siteCount * 2 >= SITE_CAPACITY) panic("too many allocation sites\n");
+            siteCount++;
+            site->file = file;
+            site->line = line;
+            site->tag = tag;
+            return i;
+        }
+        if (site->line == line && strcmp(site->file, file) == 0) return i;
+    }
+}
+
+static void count(AllocStats* stats, long bytes, long live) {
+    stats->calls++;
+    stats->bytes += bytes;
+    stats->live += live;
+    if (stats->live > stats->peak) stats->peak = stats->live;
+}
+
+static Block* findBlock(void* p) {
+    for (long i = hashPointer(p) & (blockCapacity - 1);; i = (i + 1) & (blockCapacity - 1)) {
+        if (blocks[i].p == p || blocks[i].p == NULL) return &blocks[i];
+    }
+}
+
+static void insertBlock(void* p, size_t size, int site, bool arena) {
+    if ((blockCount + 1) * 2 > blockCapacity) {
+        Block* old = blocks;
+        long oldCapacity = blockCapacity;
+        blockCapacity = blockCapacity ? blockCapacity * 2 : 4096;
+        blocks = calloc(blockCapacity, sizeof(Block));
+        if (blocks == NULL) panic("out of memory tracking allocations\n");
+        for (long i = 0; i < oldCapacity; i++) {
+            if (old[i].p) *findBlock(old[i].p) = old[i];
+        }
+        free(old);
+    }
+    Block* block = findBlock(p);
+    if (block->p == NULL) blockCount++;
+    *block = (Block){p, size, site, arena};
+}
+
+// the size and site of p, taking it out of the table; false if p is not
+// there
+static bool removeBlock(void* p, size_t* size, int* site) {
+    if (blockCount == 0) return false;
+    Block* block = findBlock(p);
+    if (block->p == NULL) return false;
+    *size = block->size;
+    *site = block->site;
+    // shift the blocks after it back, so that no probe meets a hole
+    long hole = block - blocks;
+    for (long i = (hole + 1) & (blockCapacity - 1); blocks[i].p;
+         i = (i + 1) & (blockCapacity - 1)) {
+        long home = hashPointer(blocks[i].p) & (blockCapacity - 1);
+        if (((i - home) & (blockCapacity - 1)) >= ((i - hole) & (blockCapacity - 1))) {
+            blocks[hole] = blocks[i];
+            hole = i;
+        }
+    }
+    blocks[hole].p = NULL;
+    blockCount--;
+    return true;
+}
+
+static void uncount(int site, size_t size) {
+    if (site < 0) return;
+    sites[site].stats.live -= size;
+    tags[sites[site].tag].live -= size;
+}
+
+// takes p out of the table and its bytes off the counts, if it is there
+static void forget(void* p) {
+    size_t size;
+    int site;
+    if (removeBlock(p, &size, &site)) uncount(site, size);
+}
+
+// whether p goes in the table at all
+static bool noted(AllocTag tag) { return tracking || (arenaTags & ALLOC_TAG_BIT(tag)); }
+
+static void remember(void* p, size_t size, AllocTag tag, const char* file, int line) {
+    int site = -1;
+    if (tracking) {
+        site = findSite(tag, file, line);
+        count(&sites[site].stats, size, size);
+        count(&tags[tag], size, size);
+    }
+    insertBlock(p, size, site, (arenaTags & ALLOC_TAG_BIT(tag)) != 0);
+}
+
+void* allocateAt(AllocTag tag, size_t size, bool zeroed, const char* file, int line) {
+    void* p = zeroed ? calloc(1, size) : malloc(size);
+    if (p == NULL && size > 0) panic("out of memory allocating %zu bytes\n", size);
+    if (p && noted(tag)) {
+        pthread_mutex_lock(&lock);
+        // an address libc handed out behind the table's back is reused
+        forget(p);
+        remember(p, size, tag, file, line);
+        pthread_mutex_unlock(&lock);
+    }
+    return p;
+}
+
+void* reallocateAt(AllocTag tag, void* p, size_t size, const char* file, int line) {
+    void* grown;
+    if (tracking || arenaTags) {
+        // p is forgotten before realloc frees it, so that another thread
+        // handed the address afterwards finds it gone from the table
+        pthread_mutex_lock(&lock);
+        if (p) forget(p);
+        grown = realloc(p, size);
+        if (grown) {
+            forget(grown);
+            if (noted(tag)) remember(grown, size, tag, file, line);
+        }
+        pthread_mutex_unlock(&lock);
+    } else {
+        grown = realloc(p, size);
+    }
+    if (grown == NULL && size > 0) panic("out of memory allocating %zu bytes\n", size);
+    return grown;
+}
+
+char* duplicateTextAt(AllocTag tag, const char* text, const char* file, int line) {
+    size_t size = strlen(text) + 1;
+    char* copy = allocateAt(tag, size, false, file, line);
+    memcpy(copy, text, size);
+    return copy;
+}
+
+void release(void* p) {
+    if (p == NULL) return;
+    if (tracking || arenaTags) {
+        pthread_mutex_lock(&lock);
+        forget(p);
+        pthread_mutex_unlock(&lock);
+    }
+    free(p);
+}
+
+bool trackAllocations(bool on) {
+    bool was = tracking;
+    tracking = on;
+    return was;
+}
+
+void openArena(unsigned tagMask) {
+    pthread_mutex_lock(&lock);
+    bool nested = arenaTags != 0;
+    if (!nested) arenaTags = tagMask;
+    pthread_mutex_unlock(&lock);
+    if (nested) panic("an arena is open already\n");
+}
+
+// the table is built again from the blocks that stay
+long closeArena(void) {
+    pthread_mutex_lock(&lock);
+    Block* old = blocks;
+    long oldCapacity = blockCapacity;
+    blocks = NULL;
+    blockCapacity = blockCount = 0;
+    long released = 0;
+    for (long i = 0; i < oldCapacity; i++) {
+        if (old[i].p == NULL) continue;
+        if (old[i].arena) {
+            uncount(old[i].site, old[i].size);
+            free(old[i].p);
+            released++;
+        } else {
+            insertBlock(old[i].p, old[i].size, old[i].site, false);
+        }
+    }
+    free(old);
+    arenaTags = 0;
+    pthread_mutex_unlock(&lock);
+    return released;
+}
+
+AllocStats allocationStats(AllocTag tag) {
+    pthread_mutex_lock(&lock);
+    AllocStats stats = tags[tag];
+    pthread_mutex_unlock(&lock);
+    return stats;
+}
+
+static int byCalls(const void* a, const void* b) {
+    long x = (*(Site**)a)->stats.calls, y = (*(Site**)b)->stats.calls;
+    return x < y ? 1 : x > y ? -1 : 0;
+}
+
+void printAllocations(FILE* out) {
+    pthread_mutex_lock(&lock);
+    fprintf(out, "%-12s %10s %12s %12s %12s\n", "allocations", "calls", "bytes", "live",
+            "peak live");
+    AllocStats total = {0, 0, 0, 0};
+    for (int t = 0; t < ALLOC_TAG_COUNT; t++) {
+        AllocStats* s = &tags[t];
+        if (s->calls == 0) continue;
+        fprintf(out, "%-12s %10ld %12ld %12ld %12ld\n", tagNames[t], s->calls, s->bytes, s->live,
+                s->peak);
+        total.calls += s->calls;
+        total.bytes += s->bytes;
+        total.live += s->live;
+    }
+    fprintf(out, "%-12s %10ld %12ld %12ld\n", "total", total.calls, total.bytes, total.live);
+    Site* ranked[SITE_CAPACITY];
+    int count = 0;
+    for (int i = 0; i < SITE_CAPACITY; i++) {
+        if (sites[i].file) ranked[count++] = &sites[i];
+    }
+    qsort(ranked, count, sizeof(Site*), byCalls);
+    if (count > TOP_SITES) count = TOP_SITES;
+    fprintf(out, "\n%-20s %-12s %10s %12s %12s\n", "site", "tag", "calls", "bytes", "live");
+    for (int i = 0; i < count; i++) {
+        Site* site = ranked[i];
+        char name[64];
+        snprintf(name, sizeof(name), "%s:%d", site->file, site->line);
+        int bar = (int)(site->stats.calls * BAR_WIDTH / ranked[0]->stats.calls);
+        fprintf(out, "%-20s %-12s %10ld %12ld %12ld %.*s\n", name, tagNames[site->tag],
+                site->stats.calls, site->stats.bytes, site->stats.live, bar < 1 ? 1 : bar,
+                "##############################");
+    }
+    pthread_mutex_unlock(&lock);
+}
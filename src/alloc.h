@@ -0,0 +1,71 @@
+#ifndef ALLOC_H
+#define ALLOC_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+//---------------------- Allocation --------------------
+// Every allocation of the compiler goes through these, under the tag of
+// the subsystem it is for, and panics when memory runs out. With tracking
+// on (-falloc-report) they also count calls, bytes and live bytes per tag
+// and per call site, for finding allocation hot spots and checking that
+// they are gone. Tracking keeps the size and site of each live block in a
+// table of its own rather than in a header, so that release() of a block
+// libc allocated, such as getline's or open_memstream's, or of one
+// allocated before tracking began, is only not counted.
+
+typedef enum {
+    ALLOC_STRINGS,      // copies of names and literals
+    ALLOC_NAMES,        // name tables
+    ALLOC_TOKENS,
+    ALLOC_AST,
+    ALLOC_IR,
+    ALLOC_OPTIMIZER,    // the AST and IR passes of -O1
+    ALLOC_CODEGEN,      // machine code, registers, assembly and objects
+    ALLOC_INTERPRETER,  // the tree walker and the bytecode VM
+    ALLOC_JIT,
+    ALLOC_CACHE,
+    ALLOC_DRIVER,       // options, jobs, sources, the pool and the server
+    ALLOC_TAG_COUNT,
+} AllocTag;
+
+#define allocate(tag, size) allocateAt(tag, size, false, __FILE__, __LINE__)
+#define allocateZeroed(tag, count, size) \
+    allocateAt(tag, (size_t)(count) * (size), true, __FILE__, __LINE__)
+// like realloc, moving the block to tag and this site
+#define reallocate(tag, p, size) reallocateAt(tag, p, size, __FILE__, __LINE__)
+// a copy of a NUL-terminated text
+#define duplicateText(tag, text) duplicateTextAt(tag, text, __FILE__, __LINE__)
+
+void* allocateAt(AllocTag tag, size_t size, _Bool zeroed, const char* file, int line);
+void* reallocateAt(AllocTag tag, void* p, size_t size, const char* file, int line);
+char* duplicateTextAt(AllocTag tag, const char* text, const char* file, int line);
+void release(void* p);
+
+typedef struct {
+    long calls;  // allocations and reallocations
+    long bytes;  // requested by them
+    long live;   // not released yet
+    long peak;   // most live at once
+} AllocStats;
+
+// counting from now on, or no longer, the counts being kept; whether it
+// was counting before
+_Bool trackAllocations(_Bool on);
+AllocStats allocationStats(AllocTag tag);
+// the counts of every tag, then the call sites by calls with a bar each
+void printAllocations(FILE* out);
+
+// An arena collects what a piece of work leaves behind, such as the
+// tokens, AST and IR of a compile server request, which the compiler
+// otherwise lets go at exit. While it is open, blocks of the tags in its
+// mask, allocated by any thread, are noted in the same table tracking
+// uses; closeArena releases those still live. Blocks the work keeps must
+// be of other tags, as the server's caches are.
+#define ALLOC_TAG_BIT(tag) (1u << (tag))
+
+void openArena(unsigned tags);
+// returns the number of blocks it released
+long closeArena(void);
+
+#endif
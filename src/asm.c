@@ -0,0 +1,379 @@
+//---------------------- Assembly Emission -------------
+// GNU as (AT&T syntax) text for allocated machine code.
+#include "x86.h"
+
+static const char* names64[] = {"rax", "rcx", "rdx", "rbx", "rsp", "rbp",
+                                "rsi", "rdi", "r8",  "r9",  "r10", "r11",
+                                "r12", "r13", "r14", "r15"};
+static const char* names8[] = {"al",  "cl",  "dl",   "bl",   "spl",  "bpl",
+                               "sil", "dil", "r8b",  "r9b",  "r10b", "r11b",
+                               "r12b", "r13b", "r14b", "r15b"};
+static const char* names32[] = {"eax", "ecx", "edx",  "ebx",  "esp",  "ebp",
+                                "esi", "edi", "r8d",  "r9d",  "r10d", "r11d",
+                                "r12d", "r13d", "r14d", "r15d"};
+static const char* condNames[] = {"e", "ne", "l", "le", "g", "ge"};
+
+//---------------------- Frame Layout ----------------
+
+// red zone below the stack pointer that leaf functions may use freely
+#define RED_ZONE 128
+
+static const Reg calleeSaved[] = {RBX, R12, R13, R14, R15};
+
+// frame slots sit below the callee-saved registers; leaf functions whose
+// frame fits the red zone do not move the stack pointer at all
+void layoutFrame(MFunction* fn, Frame* frame) {
+    frame->savedCount = 0;
+    for (int i = 0; i < 5; i++) {
+        if (fn->usedRegs & (1u << calleeSaved[i])) {
+            frame->saved[frame->savedCount++] = calleeSaved[i];
+        }
+    }
+    frame->slotOffsets = irAlloc(ALLOC_CODEGEN, sizeof(int) * (fn->frameSlotCount + 1));
+    int size = 0;
+    for (int i = 0; i < fn->frameSlotCount; i++) {
+        size += fn->frameSlots[i];
+        frame->slotOffsets[i] = size;
+    }
+    frame->framePointer = fn->hasCalls || fn->paramCount > 6 || size > RED_ZONE;
+    if (frame->framePointer) {
+        // keep the stack 16-byte aligned at calls
+        int below = 8 * frame->savedCount + size;
+        size += (16 - below % 16) % 16;
+    }
+    frame->size = size;
+}
+
+long frameOffset(Frame* frame, MOperand* op) {
+    long offset = op->imm - frame->slotOffsets[op->slot];
+    return frame->framePointer ? offset - 8 * frame->savedCount : offset;
+}
+
+//---------------------- Emitter ---------------------
+
+typedef struct {
+    FILE* out;
+    IrProgram* ir;
+    MFunction* fn;
+    Frame frame;
+} Emitter;
+
+static void printReg(Emitter* em, int reg, int bytes) {
+    if (reg >= XMM0) {
+        fprintf(em->out, "%%%cmm%d", bytes == 32 ? 'y' : 'x', reg - XMM0);
+    } else {
+        fprintf(em->out, "%%%s",
+                bytes == 1 ? names8[reg] : bytes == 4 ? names32[reg] : names64[reg]);
+    }
+}
+
+static void printOperand(Emitter* em, MOperand* op, int bytes) {
+    switch (op->kind) {
+        case OPND_REG:
+            printReg(em, op->reg, bytes);
+            break;
+        case OPND_IMM:
+            fprintf(em->out, "$%ld", op->imm);
+            break;
+        case OPND_MEM:
+            if (op->imm) fprintf(em->out, "%ld", op->imm);
+            fprintf(em->out, "(");
+            printReg(em, op->reg, 8);
+            if (op->index >= 0) {
+                fprintf(em->out, ",");
+                printReg(em, op->index, 8);
+                fprintf(em->out, ",%d", op->scale);
+            }
+            fprintf(em->out, ")");
+            break;
+        case OPND_FRAME:
+            fprintf(em->out, "%ld(%%%s)", frameOffset(&em->frame, op),
+                    em->frame.framePointer ? "rbp" : "rsp");
+            break;
+        case OPND_GLOBAL:
+            fprintf(em->out, "%s(%%rip)", op->name.chars);
+            break;
+        case OPND_NONE:
+            break;
+    }
+}
+
+// `mnemonic src, dst` for an operation written as dst = src
+static void printBinary(Emitter* em, const char* mnemonic, MOperand* dst,
+                        MOperand* src, int bytes) {
+    fprintf(em->out, "\t%s\t", mnemonic);
+    printOperand(em, src, bytes);
+    fprintf(em->out, ", ");
+    printOperand(em, dst, bytes);
+    fprintf(em->out, "\n");
+}
+
+static void printLabel(Emitter* em, MBlock* block) {
+    // named after the function rather than numbered, so that a function's
+    // text does not depend on where it sits in the file
+    fprintf(em->out, ".L%s_%d", em->fn->name.chars, block->id);
+}
+
+// restores what the prologue saved, leaving the return address on top
+static void emitEpilogue(Emitter* em) {
+    Frame* frame = &em->frame;
+    if (frame->framePointer) {
+        if (frame->savedCount) {
+            fprintf(em->out, "\tleaq\t-%d(%%rbp), %%rsp\n", 8 * frame->savedCount);
+        } else {
+            fprintf(em->out, "\tmovq\t%%rbp, %%rsp\n");
+        }
+    }
+    for (int i = frame->savedCount - 1; i >= 0; i--) {
+        fprintf(em->out, "\tpopq\t%%%s\n", names64[frame->saved[i]]);
+    }
+    if (frame->framePointer) fprintf(em->out, "\tpopq\t%%rbp\n");
+    if (em->fn->usesYmm) fprintf(em->out, "\tvzeroupper\n");
+}
+
+static bool isExternal(Emitter* em, String name) {
+    return findIrFunction(em->ir, name) == NULL;
+}
+
+static void emitVector(Emitter* em, MInstr* instr) {
+    bool vex = em->fn->usesYmm;
+    int bytes = instr->imm;
+    MOperand* ops = instr->ops;
+    switch (instr->opcode) {
+        case M_VMOV: {
+            bool regs = ops[0].kind == OPND_REG && ops[1].kind == OPND_REG;
+            const char* mnemonic = regs ? (vex ? "vmovdqa" : "movdqa")
+                                        : (vex ? "vmovdqu" : "movdqu");
+            printBinary(em, mnemonic, &ops[0], &ops[1], bytes);
+            break;
+        }
+        case M_VADD:
+        case M_VSUB: {
+            const char* mnemonic = instr->opcode == M_VADD ? "paddq" : "psubq";
+            if (vex) {
+                fprintf(em->out, "\tv%s\t", mnemonic);
+                printOperand(em, &ops[2], bytes);
+                fprintf(em->out, ", ");
+                printOperand(em, &ops[1], bytes);
+                fprintf(em->out, ", ");
+                printOperand(em, &ops[0], bytes);
+                fprintf(em->out, "\n");
+            } else {
+                if (ops[0].reg != ops[1].reg) {
+                    panic("SSE operands of %s were not tied\n", mnemonic);
+                }
+                printBinary(em, mnemonic, &ops[0], &ops[2], bytes);
+            }
+            break;
+        }
+        case M_VSPLAT:
+            if (vex) {
+                printBinary(em, "vmovq", &ops[0], &ops[1], 16);
+                fprintf(em->out, "\tvpbroadcastq\t");
+                printOperand(em, &ops[0], 16);
+                fprintf(em->out, ", ");
+                printOperand(em, &ops[0], bytes);
+                fprintf(em->out, "\n");
+            } else {
+                printBinary(em, "movq", &ops[0], &ops[1], 16);
+                printBinary(em, "punpcklqdq", &ops[0], &ops[0], 16);
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+// `next` is the block laid out after the current one, for fall through
+static void emitInstr(Emitter* em, MInstr* instr, MInstr* following,
+                      MBlock* next, bool* skipFollowing) {
+    FILE* out = em->out;
+    MOperand* ops = instr->ops;
+    switch (instr->opcode) {
+        case M_MOV:
+            if (ops[0].kind == OPND_REG && ops[1].kind == OPND_REG &&
+                ops[0].reg == ops[1].reg) {
+                break;
+            }
+            if (ops[1].kind == OPND_IMM && ops[1].imm != (int)ops[1].imm) {
+                printBinary(em, "movabsq", &ops[0], &ops[1], 8);
+            } else {
+                printBinary(em, "movq", &ops[0], &ops[1], 8);
+            }
+            break;
+        case M_LEA:
+            printBinary(em, "leaq", &ops[0], &ops[1], 8);
+            break;
+        case M_ADD:
+            printBinary(em, "addq", &ops[0], &ops[1], 8);
+            break;
+        case M_SUB:
+            printBinary(em, "subq", &ops[0], &ops[1], 8);
+            break;
+        case M_IMUL:
+            if (ops[2].kind == OPND_IMM) {
+                fprintf(out, "\timulq\t$%ld, ", ops[2].imm);
+                printOperand(em, &ops[1], 8);
+                fprintf(out, ", ");
+                printOperand(em, &ops[0], 8);
+                fprintf(out, "\n");
+            } else {
+                printBinary(em, "imulq", &ops[0], &ops[1], 8);
+            }
+            break;
+        case M_NEG:
+            fprintf(out, "\tnegq\t");
+            printOperand(em, &ops[0], 8);
+            fprintf(out, "\n");
+            break;
+        case M_XOR:
+            // the 32 bit form is shorter and zero extends
+            if (ops[0].kind == OPND_REG && ops[1].kind == OPND_REG &&
+                ops[0].reg == ops[1].reg) {
+                printBinary(em, "xorl", &ops[0], &ops[1], 4);
+            } else {
+                printBinary(em, "xorq", &ops[0], &ops[1], 8);
+            }
+            break;
+        case M_CQO:
+            fprintf(out, "\tcqto\n");
+            break;
+        case M_IDIV:
+            fprintf(out, "\tidivq\t");
+            printOperand(em, &ops[0], 8);
+            fprintf(out, "\n");
+            break;
+        case M_CMP:
+            printBinary(em, "cmpq", &ops[0], &ops[1], 8);
+            break;
+        case M_TEST:
+            printBinary(em, "testq", &ops[0], &ops[1], 8);
+            break;
+        case M_SETCC:
+            fprintf(out, "\tset%s\t", condNames[instr->cond]);
+            printOperand(em, &ops[0], 1);
+            fprintf(out, "\n");
+            fprintf(out, "\tmovzbl\t");
+            printOperand(em, &ops[0], 1);
+            fprintf(out, ", ");
+            printOperand(em, &ops[0], 4);
+            fprintf(out, "\n");
+            break;
+        case M_PUSH:
+            fprintf(out, "\tpushq\t");
+            printOperand(em, &ops[0], 8);
+            fprintf(out, "\n");
+            break;
+        case M_CALL:
+            if (em->fn->usesYmm) fprintf(out, "\tvzeroupper\n");
+            fprintf(out, "\tcall\t%s%s\n", instr->name.chars,
+                    isExternal(em, instr->name) ? "@PLT" : "");
+            break;
+        case M_SYSCALL:
+            fprintf(out, "\tsyscall\n");
+            break;
+        case M_JMP:
+            if (instr->target == next) break;
+            fprintf(out, "\tjmp\t");
+            printLabel(em, instr->target);
+            fprintf(out, "\n");
+            break;
+        case M_JCC: {
+            Cond cond = instr->cond;
+            MBlock* target = instr->target;
+            // jump over the fall through block instead of to it
+            if (target == next && following && following->opcode == M_JMP) {
+                cond = invertCond(cond);
+                target = following->target;
+                *skipFollowing = true;
+            }
+            fprintf(out, "\tj%s\t", condNames[cond]);
+            printLabel(em, target);
+            fprintf(out, "\n");
+            break;
+        }
+        case M_TAILCALL:
+            // through the PLT even within the program, or `as` would bind a
+            // jump to a symbol of the same section at once, unlike a call
+            emitEpilogue(em);
+            fprintf(out, "\tjmp\t%s@PLT\n", instr->name.chars);
+            break;
+        case M_RET:
+            emitEpilogue(em);
+            fprintf(out, "\tret\n");
+            break;
+        case M_VMOV:
+        case M_VADD:
+        case M_VSUB:
+        case M_VSPLAT:
+            emitVector(em, instr);
+            break;
+    }
+}
+
+static void emitFunction(Emitter* em) {
+    MFunction* fn = em->fn;
+    FILE* out = em->out;
+    Frame* frame = &em->frame;
+    layoutFrame(fn, frame);
+    fprintf(out, "\t.globl\t%s\n", fn->name.chars);
+    fprintf(out, "\t.type\t%s, @function\n", fn->name.chars);
+    fprintf(out, "%s:\n", fn->name.chars);
+    if (frame->framePointer) {
+        fprintf(out, "\tpushq\t%%rbp\n");
+        fprintf(out, "\tmovq\t%%rsp, %%rbp\n");
+    }
+    for (int i = 0; i < frame->savedCount; i++) {
+        fprintf(out, "\tpushq\t%%%s\n", names64[frame->saved[i]]);
+    }
+    if (frame->framePointer && frame->size) {
+        fprintf(out, "\tsubq\t$%d, %%rsp\n", frame->size);
+    }
+    for (int b = 0; b < fn->blockCount; b++) {
+        MBlock* block = fn->blocks[b];
+        MBlock* next = b + 1 < fn->blockCount ? fn->blocks[b + 1] : NULL;
+        if (b > 0) {
+            printLabel(em, block);
+            fprintf(out, ":\n");
+        }
+        for (int i = 0; i < block->count; i++) {
+            bool skip = false;
+            MInstr* following = i + 1 < block->count ? block->instrs[i + 1] : NULL;
+            emitInstr(em, block->instrs[i], following, next, &skip);
+            if (skip) i++;
+        }
+    }
+    fprintf(out, "\t.size\t%s, .-%s\n\n", fn->name.chars, fn->name.chars);
+    release(frame->slotOffsets);
+}
+
+void emitFunctionAssembly(IrProgram* ir, MFunction* fn, FILE* out) {
+    Emitter em;
+    memset(&em, 0, sizeof(Emitter));
+    em.out = out;
+    em.ir = ir;
+    em.fn = fn;
+    emitFunction(&em);
+}
+
+void emitDataAssembly(IrProgram* ir, FILE* out) {
+    for (int i = 0; i < ir->globalCount; i++) {
+        IrGlobal* global = &ir->globals[i];
+        if (global->bytes.chars) {
+            fprintf(out, "\t.section\t.rodata\n%s:\n\t.string\t\"%s\"\n",
+                    global->name.chars, global->bytes.chars);
+        } else {
+            fprintf(out, "\t.data\n\t.globl\t%s\n\t.p2align\t3\n%s:\n\t.quad\t%ld\n",
+                    global->name.chars, global->name.chars, global->value);
+        }
+    }
+    fprintf(out, "\t.section\t.note.GNU-stack,\"\",@progbits\n");
+}
+
+void emitAssembly(MProgram* program, FILE* out) {
+    fprintf(out, "\t.text\n");
+    for (int i = 0; i < program->functionCount; i++) {
+        emitFunctionAssembly(program->ir, program->functions[i], out);
+    }
+    emitDataAssembly(program->ir, out);
+}
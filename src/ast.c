@@ -218,6 +218,10 @@ Op getOp(Token* token, bool isBinary) {
             return OP_GTE;
         case TOKEN_AT:
             return OP_AT;
+        case TOKEN_AND:
+            return OP_AND;
+        case TOKEN_OR:
+            return OP_OR;
         case TOKEN_DOT:
             return OP_DOT;
         case TOKEN_LEFT_BRACKET:
@@ -238,23 +242,25 @@ Op getOp(Token* token, bool isBinary) {
 
 char* sprintStmt(Stmt* stmt) {
     char buffer[1024];
+    int len = 0;
     switch (stmt->type) {
         case STMT_EXPRESSION:
             sprintf(buffer, "%s;", sprintExpr(stmt->expr.expression));
             break;
         case STMT_BLOCK:
-            sprintf(buffer, "{\n");
+            len = sprintf(buffer, "{\n");
             for (int i = 0; i < stmt->block.count; i++) {
-                sprintf(buffer, "%s%s", buffer,
-                        sprintStmt(stmt->block.statements[i]));
+                len += sprintf(buffer + len, "%s",
+                               sprintStmt(stmt->block.statements[i]));
             }
-            sprintf(buffer, "%s}", buffer);
+            sprintf(buffer + len, "}");
             break;
         case STMT_IF:
-            sprintf(buffer, "if (%s) %s", sprintExpr(stmt->ifStmt.condition),
-                    sprintStmt(stmt->ifStmt.thenBranch));
+            len = sprintf(buffer, "if (%s) %s",
+                          sprintExpr(stmt->ifStmt.condition),
+                          sprintStmt(stmt->ifStmt.thenBranch));
             if (stmt->ifStmt.elseBranch) {
-                sprintf(buffer, "%s else %s", buffer,
+                sprintf(buffer + len, " else %s",
                         sprintStmt(stmt->ifStmt.elseBranch));
             }
             break;
@@ -277,7 +283,7 @@ char* sprintStmt(Stmt* stmt) {
         default:
             panic("unknown statement type %d\n", stmt->type);
     }
-    return strdup(buffer);
+    return duplicateText(ALLOC_STRINGS, buffer);
 }
 
 char* sprintExpr(Expr* expr) {
@@ -315,20 +321,20 @@ char* sprintExpr(Expr* expr) {
         case EXPR_VARIABLE:
             sprintf(buffer, "%s", expr->variable.name.chars);
             break;
-        case EXPR_CALL:
-            sprintf(buffer, "%s", sprintExpr(expr->call.callee));
-            sprintf(buffer, "%s(", buffer);
+        case EXPR_CALL: {
+            int len = sprintf(buffer, "%s(", sprintExpr(expr->call.callee));
             for (int i = 0; i < expr->call.argcount; i++) {
-                sprintf(buffer, "%s%s", buffer,
-                        sprintExpr(expr->call.arguments[i]));
+                len += sprintf(buffer + len, "%s",
+                               sprintExpr(expr->call.arguments[i]));
                 if (i < expr->call.argcount - 1) {
-                    sprintf(buffer, "%s, ", buffer);
+                    len += sprintf(buffer + len, ", ");
                 }
             }
-            sprintf(buffer, "%s)", buffer);
+            sprintf(buffer + len, ")");
             break;
+        }
         default:
             panic("unknown expression type %d\n", expr->type);
     }
-    return strdup(buffer);
+    return duplicateText(ALLOC_STRINGS, buffer);
 }
\ No newline at end of file
@@ -197,5 +197,6 @@ char* sprintExpr(Expr* expr);
 char* sprintStmt(Stmt* stmt);
 
 Op getOp(Token* token, bool isBinary);
+char* OptoString(Op op);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,678 @@
+//---------------------- Bytecode Compiler -------------
+// One pass over the AST. Locals live in registers for their whole scope
+// and temporaries are allocated stack-like above them, so `top` is the
+// first free register. Conditions compile to compare-and-branch
+// superinstructions, with small constant operands inline, and loops test
+// at the bottom so that an iteration costs one branch.
+#include "syscall.h"
+#include "vm.h"
+
+typedef struct {
+    String name;
+    int reg;
+} VmLocal;
+
+// instructions whose jump offsets are patched once the target is known
+typedef struct {
+    int* at;
+    int count;
+    int capacity;
+} JumpList;
+
+typedef struct {
+    Program* ast;
+    VmProgram* program;
+    VmFunction* fn;
+    VmLocal* locals;  // scope stack, innermost last
+    int localCount;
+    int localCapacity;
+    int top;  // first free register
+} Compiler;
+
+static void exprTo(Compiler* c, Expr* expr, int dst);
+static void statement(Compiler* c, Stmt* stmt);
+
+static int emitWord(Compiler* c, uint32_t word) {
+    VmFunction* fn = c->fn;
+    if (fn->count == fn->capacity) {
+        fn->capacity = fn->capacity ? fn->capacity * 2 : 64;
+        fn->code = reallocate(ALLOC_INTERPRETER, fn->code, sizeof(uint32_t) * fn->capacity);
+    }
+    fn->code[fn->count] = word;
+    return fn->count++;
+}
+
+static int emitABC(Compiler* c, VmOpcode op, int a, int b, int cc) {
+    return emitWord(c, op | a << 8 | (b & 0xff) << 16 | (uint32_t)(cc & 0xff) << 24);
+}
+
+static int emitABx(Compiler* c, VmOpcode op, int a, int bx) {
+    return emitWord(c, op | a << 8 | (uint32_t)(bx & 0xffff) << 16);
+}
+
+static int allocReg(Compiler* c) {
+    if (c->top == 256) {
+        panic("%s needs more than 256 registers\n", c->fn->name.chars);
+    }
+    if (c->top + 1 > c->fn->registerCount) c->fn->registerCount = c->top + 1;
+    return c->top++;
+}
+
+static int addConstant(Compiler* c, long value) {
+    VmProgram* program = c->program;
+    for (int i = 0; i < program->constantCount; i++) {
+        if (program->constants[i] == value) return i;
+    }
+    if (program->constantCount == program->constantCapacity) {
+        program->constantCapacity =
+            program->constantCapacity ? program->constantCapacity * 2 : 16;
+        program->constants =
+            reallocate(ALLOC_INTERPRETER, program->constants,
+                       sizeof(long) * program->constantCapacity);
+    }
+    program->constants[program->constantCount] = value;
+    return program->constantCount++;
+}
+
+static int lookupLocal(Compiler* c, String name) {
+    for (int i = c->localCount - 1; i >= 0; i--) {
+        if (stringEqual(c->locals[i].name, name)) return c->locals[i].reg;
+    }
+    return -1;
+}
+
+static void declareLocal(Compiler* c, String name, int reg) {
+    if (c->localCount == c->localCapacity) {
+        c->localCapacity = c->localCapacity ? c->localCapacity * 2 : 16;
+        c->locals = reallocate(ALLOC_INTERPRETER, c->locals, sizeof(VmLocal) * c->localCapacity);
+    }
+    c->locals[c->localCount].name = name;
+    c->locals[c->localCount].reg = reg;
+    c->localCount++;
+}
+
+static int lookupGlobal(Compiler* c, String name) {
+    for (int i = 0; i < c->program->globalCount; i++) {
+        if (stringEqual(c->program->globalNames[i], name)) return i;
+    }
+    return -1;
+}
+
+static int lookupFunction(Compiler* c, String name) {
+    for (int i = 0; i < c->program->functionCount; i++) {
+        if (stringEqual(c->program->functions[i].name, name)) return i;
+    }
+    return -1;
+}
+
+//---------------------- Jumps -------------------------
+
+static void addJump(JumpList* list, int at) {
+    if (list->count == list->capacity) {
+        list->capacity = list->capacity ? list->capacity * 2 : 4;
+        list->at = reallocate(ALLOC_INTERPRETER, list->at, sizeof(int) * list->capacity);
+    }
+    list->at[list->count++] = at;
+}
+
+static void patch(Compiler* c, int at, int target) {
+    uint32_t* word = &c->fn->code[at];
+    int op = VM_OPCODE(*word);
+    if (op == VM_JMP) {
+        *word = op | (uint32_t)((target - at - 1) & 0xffffff) << 8;
+    } else if (op == VM_JZ || op == VM_JNZ) {
+        int offset = target - at - 1;
+        if (offset != (int16_t)offset) {
+            panic("branch in %s is too long\n", c->fn->name.chars);
+        }
+        *word = (*word & 0xffff) | (uint32_t)(offset & 0xffff) << 16;
+    } else {
+        word[1] = target - at - 2;
+    }
+}
+
+static void patchList(Compiler* c, JumpList* list, int target) {
+    for (int i = 0; i < list->count; i++) patch(c, list->at[i], target);
+    release(list->at);
+}
+
+static int emitJump(Compiler* c) { return emitWord(c, VM_JMP); }
+
+//---------------------- Expressions -------------------
+
+static bool isSmallLiteral(Expr* expr, long* value) {
+    if (expr->type != EXPR_LITERAL || expr->literal.type != TYPE_INT) return false;
+    *value = expr->literal.value.intVal;
+    return *value == (int8_t)*value;
+}
+
+static bool isComparison(Op op) {
+    return op == OP_EQ || op == OP_NEQ || op == OP_LT || op == OP_LTE ||
+           op == OP_GT || op == OP_GTE;
+}
+
+// VM_EQ ... VM_GE, and the branches after them, are in this order
+static int comparisonIndex(Op op) {
+    switch (op) {
+        case OP_EQ: return 0;
+        case OP_NEQ: return 1;
+        case OP_LT: return 2;
+        case OP_LTE: return 3;
+        case OP_GT: return 4;
+        default: return 5;
+    }
+}
+
+// the comparison that holds exactly when index does not
+static int negateComparison(int index) {
+    static const int negated[] = {1, 0, 5, 4, 3, 2};
+    return negated[index];
+}
+
+// the register holding expr: a local's own, or a fresh temporary
+static int exprAny(Compiler* c, Expr* expr) {
+    if (expr->type == EXPR_VARIABLE) {
+        int reg = lookupLocal(c, expr->variable.name);
+        if (reg >= 0) return reg;
+    }
+    int reg = allocReg(c);
+    exprTo(c, expr, reg);
+    return reg;
+}
+
+static void move(Compiler* c, int dst, int src) {
+    if (dst >= 0 && dst != src) emitABC(c, VM_MOVE, dst, src, 0);
+}
+
+// jumps to list when expr is true, or false when sense is, and falls
+// through otherwise
+static void branch(Compiler* c, Expr* expr, bool sense, JumpList* list) {
+    if (expr->type == EXPR_UNARY && expr->unary.op == OP_NOT) {
+        branch(c, expr->unary.right, !sense, list);
+        return;
+    }
+    if (expr->type == EXPR_BINARY &&
+        (expr->binary.op == OP_AND || expr->binary.op == OP_OR)) {
+        bool both = expr->binary.op == OP_AND;
+        if (sense != both) {
+            // either operand decides on its own
+            branch(c, expr->binary.left, sense, list);
+            branch(c, expr->binary.right, sense, list);
+        } else {
+            JumpList skip = {NULL, 0, 0};
+            branch(c, expr->binary.left, !sense, &skip);
+            branch(c, expr->binary.right, sense, list);
+            patchList(c, &skip, c->fn->count);
+        }
+        return;
+    }
+    int mark = c->top;
+    if (expr->type == EXPR_BINARY && isComparison(expr->binary.op)) {
+        int index = comparisonIndex(expr->binary.op);
+        if (!sense) index = negateComparison(index);
+        int left = exprAny(c, expr->binary.left);
+        long constant;
+        if (isSmallLiteral(expr->binary.right, &constant)) {
+            addJump(list, emitABC(c, VM_JEQI + index, left, constant, 0));
+        } else {
+            int right = exprAny(c, expr->binary.right);
+            addJump(list, emitABC(c, VM_JEQ + index, left, right, 0));
+        }
+        emitWord(c, 0);
+    } else if (expr->type == EXPR_LITERAL && expr->literal.type != TYPE_STRING) {
+        bool truth = expr->literal.type == TYPE_BOOL ? expr->literal.value.boolVal
+                                                     : expr->literal.value.intVal != 0;
+        if (truth == sense) addJump(list, emitJump(c));
+    } else {
+        int reg = exprAny(c, expr);
+        addJump(list, emitABx(c, sense ? VM_JNZ : VM_JZ, reg, 0));
+    }
+    c->top = mark;
+}
+
+static void address(Compiler* c, Expr* expr, int dst) {
+    int mark = c->top;
+    if (expr->type == EXPR_VARIABLE) {
+        int reg = lookupLocal(c, expr->variable.name);
+        int global = lookupGlobal(c, expr->variable.name);
+        if (reg >= 0) {
+            emitABC(c, VM_ADDR, dst, reg, 0);
+        } else if (global >= 0) {
+            emitABx(c, VM_ADDRG, dst, global);
+        } else if (lookupFunction(c, expr->variable.name) >= 0) {
+            panic("function %s has no address in interpreter mode\n",
+                  expr->variable.name.chars);
+        } else {
+            panic("undefined variable %s\n", expr->variable.name.chars);
+        }
+    } else if (expr->type == EXPR_UNARY && expr->unary.op == OP_DEREF) {
+        exprTo(c, expr->unary.right, dst);
+    } else if (expr->type == EXPR_BINARY && expr->binary.op == OP_SUBSCRIPT) {
+        int base = exprAny(c, expr->binary.left);
+        int index = exprAny(c, expr->binary.right);
+        int scale = allocReg(c);
+        emitABx(c, VM_LOADI, scale, 8);
+        emitABC(c, VM_MUL, scale, index, scale);
+        emitABC(c, VM_ADD, dst, base, scale);
+    } else {
+        panic("expression %s is not assignable\n", sprintExpr(expr));
+    }
+    c->top = mark;
+}
+
+// target = value, leaving the value in dst unless it is -1
+static void assign(Compiler* c, Expr* target, Expr* value, int dst) {
+    int mark = c->top;
+    if (target->type == EXPR_VARIABLE) {
+        int reg = lookupLocal(c, target->variable.name);
+        if (reg >= 0) {
+            exprTo(c, value, reg);
+            move(c, dst, reg);
+            return;
+        }
+        int global = lookupGlobal(c, target->variable.name);
+        if (global < 0) {
+            panic("undefined variable %s\n", target->variable.name.chars);
+        }
+        int reg2 = dst >= 0 ? dst : allocReg(c);
+        exprTo(c, value, reg2);
+        emitABx(c, VM_SETG, reg2, global);
+    } else if (target->type == EXPR_BINARY && target->binary.op == OP_SUBSCRIPT) {
+        int base = exprAny(c, target->binary.left);
+        int index = exprAny(c, target->binary.right);
+        int reg = exprAny(c, value);
+        emitABC(c, VM_SETINDEX, base, index, reg);
+        move(c, dst, reg);
+    } else {
+        int pointer = allocReg(c);
+        address(c, target, pointer);
+        int reg = exprAny(c, value);
+        emitABC(c, VM_STORE, pointer, reg, 0);
+        move(c, dst, reg);
+    }
+    c->top = mark;
+}
+
+// arguments go in consecutive registers from `top`, where the result
+// comes back
+static void call(Compiler* c, Expr* expr, int dst) {
+    if (expr->call.callee->type != EXPR_VARIABLE) {
+        panic("indirect calls are not supported: %s\n", sprintExpr(expr));
+    }
+    String name = expr->call.callee->variable.name;
+    int base = c->top;
+    for (int i = 0; i < expr->call.argcount; i++) {
+        exprTo(c, expr->call.arguments[i], allocReg(c));
+    }
+    if (expr->call.argcount == 0) allocReg(c);
+    int function = lookupFunction(c, name);
+    if (function >= 0) {
+        if (c->program->functions[function].paramCount != expr->call.argcount) {
+            panic("%s takes %d arguments\n", name.chars,
+                  c->program->functions[function].paramCount);
+        }
+        emitABC(c, VM_CALL, base, 0, expr->call.argcount);
+        emitWord(c, function);
+    } else if (findSyscall(name) >= 0) {
+        const SyscallInfo* sys = &syscalls[findSyscall(name)];
+        if (expr->call.argcount != sys->argCount) {
+            panic("%s takes %d arguments, not %d\n", sys->name, sys->argCount,
+                  expr->call.argcount);
+        }
+        emitABC(c, VM_SYSCALL, base, 0, expr->call.argcount);
+        emitWord(c, sys->number);
+    } else {
+        void* native = nativeFunction(name);
+        if (native == NULL) {
+            panic("undefined function %s\n", name.chars);
+        }
+        if (expr->call.argcount > NATIVE_MAX_ARGS) {
+            panic("calls to %s pass at most %d arguments\n", name.chars, NATIVE_MAX_ARGS);
+        }
+        emitABC(c, VM_CALLN, base, 0, expr->call.argcount);
+        emitWord(c, addConstant(c, (long)native));
+    }
+    move(c, dst, base);
+    c->top = base;
+}
+
+static void binary(Compiler* c, Expr* expr, int dst) {
+    static const VmOpcode opcodes[] = {
+        [OP_ADD] = VM_ADD, [OP_SUB] = VM_SUB, [OP_MUL] = VM_MUL,
+        [OP_DIV] = VM_DIV, [OP_EQ] = VM_EQ,   [OP_NEQ] = VM_NE,
+        [OP_LT] = VM_LT,   [OP_LTE] = VM_LE,  [OP_GT] = VM_GT,
+        [OP_GTE] = VM_GE,
+    };
+    Op op = expr->binary.op;
+    int mark = c->top;
+    long constant;
+    switch (op) {
+        case OP_ASSIGN:
+            assign(c, expr->binary.left, expr->binary.right, dst);
+            return;
+        case OP_AND:
+        case OP_OR: {
+            JumpList falses = {NULL, 0, 0};
+            branch(c, expr, false, &falses);
+            emitABx(c, VM_LOADI, dst, 1);
+            int end = emitJump(c);
+            patchList(c, &falses, c->fn->count);
+            emitABx(c, VM_LOADI, dst, 0);
+            patch(c, end, c->fn->count);
+            return;
+        }
+        case OP_SUBSCRIPT: {
+            int base = exprAny(c, expr->binary.left);
+            int index = exprAny(c, expr->binary.right);
+            emitABC(c, VM_INDEX, dst, base, index);
+            break;
+        }
+        case OP_ADD:
+        case OP_SUB:
+            if (isSmallLiteral(expr->binary.right, &constant) && constant != -128) {
+                int left = exprAny(c, expr->binary.left);
+                emitABC(c, VM_ADDI, dst, left, op == OP_ADD ? constant : -constant);
+                break;
+            }
+            // fall through
+        case OP_MUL:
+        case OP_DIV:
+        case OP_EQ:
+        case OP_NEQ:
+        case OP_LT:
+        case OP_LTE:
+        case OP_GT:
+        case OP_GTE: {
+            int left = exprAny(c, expr->binary.left);
+            int right = exprAny(c, expr->binary.right);
+            emitABC(c, opcodes[op], dst, left, right);
+            break;
+        }
+        default:
+            panic("operator %s is not supported by the bytecode compiler\n",
+                  OptoString(op));
+    }
+    c->top = mark;
+}
+
+static void exprTo(Compiler* c, Expr* expr, int dst) {
+    switch (expr->type) {
+        case EXPR_LITERAL:
+            switch (expr->literal.type) {
+                case TYPE_INT: {
+                    long value = expr->literal.value.intVal;
+                    if (value == (int16_t)value) {
+                        emitABx(c, VM_LOADI, dst, value);
+                    } else {
+                        emitABx(c, VM_LOADK, dst, addConstant(c, value));
+                    }
+                    return;
+                }
+                case TYPE_BOOL:
+                    emitABx(c, VM_LOADI, dst, expr->literal.value.boolVal);
+                    return;
+                case TYPE_STRING: {
+                    // the token keeps its quotes
+                    String literal = expr->literal.value.stringVal;
+                    String bytes = unescape(makeString(literal.chars + 1, literal.length - 2));
+                    emitABx(c, VM_LOADK, dst, addConstant(c, (long)bytes.chars));
+                    return;
+                }
+                default:
+                    panic("literal type %d is not supported by the bytecode compiler\n",
+                          expr->literal.type);
+            }
+            return;
+        case EXPR_VARIABLE: {
+            int reg = lookupLocal(c, expr->variable.name);
+            int global = lookupGlobal(c, expr->variable.name);
+            if (reg >= 0) {
+                move(c, dst, reg);
+            } else if (global >= 0) {
+                emitABx(c, VM_GETG, dst, global);
+            } else if (lookupFunction(c, expr->variable.name) >= 0) {
+                panic("function %s has no address in interpreter mode\n",
+                      expr->variable.name.chars);
+            } else {
+                panic("undefined variable %s\n", expr->variable.name.chars);
+            }
+            return;
+        }
+        case EXPR_ASSIGNMENT: {
+            Expr target;
+            target.type = EXPR_VARIABLE;
+            target.variable.name = expr->assignment.name;
+            assign(c, &target, expr->assignment.value, dst);
+            return;
+        }
+        case EXPR_UNARY: {
+            int mark = c->top;
+            switch (expr->unary.op) {
+                case OP_REF:
+                    address(c, expr->unary.right, dst);
+                    break;
+                case OP_DEREF:
+                    emitABC(c, VM_LOAD, dst, exprAny(c, expr->unary.right), 0);
+                    break;
+                case OP_NOT:
+                    emitABC(c, VM_NOT, dst, exprAny(c, expr->unary.right), 0);
+                    break;
+                case OP_NEG:
+                    emitABC(c, VM_NEG, dst, exprAny(c, expr->unary.right), 0);
+                    break;
+                default:
+                    panic("operator %s is not supported by the bytecode compiler\n",
+                          OptoString(expr->unary.op));
+            }
+            c->top = mark;
+            return;
+        }
+        case EXPR_BINARY:
+            binary(c, expr, dst);
+            return;
+        case EXPR_CALL:
+            call(c, expr, dst);
+            return;
+        case EXPR_GROUPING:
+            panic("grouping expressions are folded by the parser\n");
+    }
+}
+
+//---------------------- Statements --------------------
+
+static void statement(Compiler* c, Stmt* stmt) {
+    int mark = c->top;
+    switch (stmt->type) {
+        case STMT_EXPRESSION: {
+            // an assignment's value is dropped, not moved anywhere
+            Expr* expr = stmt->expr.expression;
+            if (expr->type == EXPR_BINARY && expr->binary.op == OP_ASSIGN) {
+                assign(c, expr->binary.left, expr->binary.right, -1);
+            } else {
+                exprTo(c, expr, allocReg(c));
+            }
+            break;
+        }
+        case STMT_BLOCK: {
+            int scope = c->localCount;
+            for (int i = 0; i < stmt->block.count; i++) {
+                statement(c, stmt->block.statements[i]);
+            }
+            c->localCount = scope;
+            break;
+        }
+        case STMT_IF: {
+            JumpList otherwise = {NULL, 0, 0};
+            branch(c, stmt->ifStmt.condition, false, &otherwise);
+            statement(c, stmt->ifStmt.thenBranch);
+            if (stmt->ifStmt.elseBranch) {
+                int end = emitJump(c);
+                patchList(c, &otherwise, c->fn->count);
+                statement(c, stmt->ifStmt.elseBranch);
+                patch(c, end, c->fn->count);
+            } else {
+                patchList(c, &otherwise, c->fn->count);
+            }
+            break;
+        }
+        case STMT_WHILE: {
+            // the condition sits at the bottom
+            int entry = emitJump(c);
+            int body = c->fn->count;
+            statement(c, stmt->whileStmt.body);
+            patch(c, entry, c->fn->count);
+            JumpList again = {NULL, 0, 0};
+            branch(c, stmt->whileStmt.condition, true, &again);
+            patchList(c, &again, body);
+            break;
+        }
+        case STMT_RETURN: {
+            int reg;
+            if (stmt->returnStmt.value) {
+                reg = exprAny(c, stmt->returnStmt.value);
+            } else {
+                reg = allocReg(c);
+                emitABx(c, VM_LOADI, reg, 0);
+            }
+            emitABC(c, VM_RET, reg, 0, 0);
+            break;
+        }
+        case STMT_DECL: {
+            Decl* decl = stmt->decl.decl;
+            if (decl->type != DECL_VARIABLE) {
+                panic("only variables can be declared inside a function\n");
+            }
+            int reg = allocReg(c);
+            if (decl->variable.initializer) {
+                exprTo(c, decl->variable.initializer, reg);
+            } else {
+                emitABx(c, VM_LOADI, reg, 0);
+            }
+            declareLocal(c, decl->variable.name, reg);
+            // the local keeps its register
+            return;
+        }
+    }
+    c->top = mark;
+}
+
+static void function(Compiler* c, VmFunction* fn, Decl* decl) {
+    c->fn = fn;
+    c->localCount = 0;
+    c->top = 0;
+    for (int i = 0; i < decl->function.count; i++) {
+        declareLocal(c, decl->function.parameters[i]->name, allocReg(c));
+    }
+    statement(c, decl->function.body);
+    // falling off the end returns 0
+    int zero = allocReg(c);
+    emitABx(c, VM_LOADI, zero, 0);
+    emitABC(c, VM_RET, zero, 0, 0);
+}
+
+static long constantInitializer(Expr* expr) {
+    if (expr->type == EXPR_LITERAL && expr->literal.type == TYPE_INT) {
+        return expr->literal.value.intVal;
+    }
+    if (expr->type == EXPR_UNARY && expr->unary.op == OP_NEG) {
+        return -constantInitializer(expr->unary.right);
+    }
+    panic("global initializer %s is not a constant, nor a call of pure functions that can be "
+          "evaluated at compile time\n",
+          sprintExpr(expr));
+    return 0;
+}
+
+VmProgram* compileBytecode(Program* ast) {
+    Compiler c;
+    memset(&c, 0, sizeof(Compiler));
+    c.ast = ast;
+    c.program = allocateZeroed(ALLOC_INTERPRETER, 1, sizeof(VmProgram));
+    VmProgram* program = c.program;
+    program->functions = allocateZeroed(ALLOC_INTERPRETER, ast->count + 1, sizeof(VmFunction));
+    program->globals = allocateZeroed(ALLOC_INTERPRETER, ast->count + 1, sizeof(long));
+    program->globalNames = allocateZeroed(ALLOC_INTERPRETER, ast->count + 1, sizeof(String));
+    // every function is known before any body is compiled
+    for (int i = 0; i < ast->count; i++) {
+        Decl* decl = ast->declarations[i];
+        if (decl->type == DECL_FUNCTION) {
+            VmFunction* fn = &program->functions[program->functionCount++];
+            fn->name = decl->function.name;
+            fn->paramCount = decl->function.count;
+        } else if (decl->type == DECL_VARIABLE) {
+            program->globalNames[program->globalCount] = decl->variable.name;
+            if (decl->variable.initializer) {
+                program->globals[program->globalCount] =
+                    constantInitializer(decl->variable.initializer);
+            }
+            program->globalCount++;
+        }
+    }
+    int index = 0;
+    for (int i = 0; i < ast->count; i++) {
+        Decl* decl = ast->declarations[i];
+        if (decl->type != DECL_FUNCTION) continue;
+        function(&c, &program->functions[index++], decl);
+    }
+    release(c.locals);
+    return program;
+}
+
+//---------------------- Printing ----------------------
+
+static const char* opcodeNames[] = {
+    "move", "loadi", "loadk", "getg",  "setg", "addrg", "addr",  "add",
+    "addi", "sub",   "mul",   "div",   "eq",   "ne",    "lt",    "le",
+    "gt",   "ge",    "not",   "neg",   "load", "store", "index", "setindex",
+    "jmp",  "jz",    "jnz",   "jeq",   "jne",  "jlt",   "jle",   "jgt",
+    "jge",  "jeqi",  "jnei",  "jlti",  "jlei", "jgti",  "jgei",  "call",
+    "calln", "ret",
+};
+
+void printBytecode(VmProgram* program) {
+    for (int f = 0; f < program->functionCount; f++) {
+        VmFunction* fn = &program->functions[f];
+        printf("%s: %d registers\n", fn->name.chars, fn->registerCount);
+        for (int i = 0; i < fn->count; i++) {
+            uint32_t word = fn->code[i];
+            int op = VM_OPCODE(word);
+            printf("%5d  %-8s ", i, opcodeNames[op]);
+            switch (op) {
+                case VM_LOADI:
+                case VM_JZ:
+                case VM_JNZ:
+                    printf("r%d, %d", VM_A(word), VM_SBX(word));
+                    break;
+                case VM_LOADK:
+                case VM_GETG:
+                case VM_SETG:
+                case VM_ADDRG:
+                    printf("r%d, #%d", VM_A(word), VM_BX(word));
+                    break;
+                case VM_JMP:
+                    printf("%d", VM_SAX(word));
+                    break;
+                case VM_ADDI:
+                    printf("r%d, r%d, %d", VM_A(word), VM_B(word), VM_SC(word));
+                    break;
+                case VM_CALL:
+                case VM_CALLN:
+                case VM_SYSCALL:
+                    printf("r%d, %d args, #%u", VM_A(word), VM_C(word), fn->code[++i]);
+                    break;
+                case VM_RET:
+                    printf("r%d", VM_A(word));
+                    break;
+                default:
+                    if (op >= VM_JEQI && op <= VM_JGEI) {
+                        printf("r%d, %d, %d", VM_A(word), VM_SB(word), (int32_t)fn->code[++i]);
+                    } else if (op >= VM_JEQ && op <= VM_JGE) {
+                        printf("r%d, r%d, %d", VM_A(word), VM_B(word), (int32_t)fn->code[++i]);
+                    } else {
+                        printf("r%d, r%d, r%d", VM_A(word), VM_B(word), VM_C(word));
+                    }
+            }
+            printf("\n");
+        }
+    }
+}
@@ -0,0 +1,258 @@
+//---------------------- Function Cache ----------------
+#include "cache.h"
+
+#include <pthread.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// FNV-1a, 64 bit
+#define FNV_OFFSET 0xcbf29ce484222325UL
+#define FNV_PRIME 0x100000001b3UL
+
+static void hashBytes(CacheKey* key, const void* data, size_t length) {
+    const unsigned char* bytes = data;
+    for (size_t i = 0; i < length; i++) {
+        *key = (*key ^ bytes[i]) * FNV_PRIME;
+    }
+}
+
+CacheKey hashText(CacheKey key, const char* text, size_t length) {
+    hashBytes(&key, text, length);
+    return key;
+}
+
+static void hashLong(CacheKey* key, long value) { hashBytes(key, &value, sizeof(long)); }
+
+static void hashString(CacheKey* key, String string) {
+    hashLong(key, string.chars ? string.length : -1);
+    if (string.chars) hashBytes(key, string.chars, string.length);
+}
+
+static void hashBlock(CacheKey* key, IrBlock* block) {
+    hashLong(key, block ? block->id : -1);
+}
+
+// the executable is hashed once per process, by whichever thread gets
+// there first
+static CacheKey executableKey;
+static bool executableRead;
+static pthread_once_t executableOnce = PTHREAD_ONCE_INIT;
+
+static void hashExecutable(void) {
+    FILE* self = fopen("/proc/self/exe", "rb");
+    if (self == NULL) return;
+    executableKey = FNV_OFFSET;
+    char buffer[1 << 16];
+    size_t count;
+    while ((count = fread(buffer, 1, sizeof(buffer), self)) > 0) {
+        hashBytes(&executableKey, buffer, count);
+    }
+    fclose(self);
+    executableRead = true;
+}
+
+CacheKey cacheSeed(int optLevel, int vectorLanes) {
+    pthread_once(&executableOnce, hashExecutable);
+    if (!executableRead) {
+        panic("could not read the compiler executable to key the cache\n");
+    }
+    CacheKey key = executableKey;
+    hashLong(&key, optLevel);
+    hashLong(&key, vectorLanes);
+    return key;
+}
+
+CacheKey hashFunction(CacheKey seed, IrProgram* program, IrFunction* fn) {
+    CacheKey key = seed;
+    hashString(&key, fn->name);
+    hashLong(&key, fn->paramCount);
+    hashLong(&key, fn->vregCount);
+    hashLong(&key, fn->slotCount);
+    for (int s = 0; s < fn->slotCount; s++) hashLong(&key, fn->slots[s].addressTaken);
+    hashLong(&key, fn->blockCount);
+    for (int b = 0; b < fn->blockCount; b++) {
+        IrBlock* block = fn->blocks[b];
+        hashBlock(&key, block);
+        hashLong(&key, block->count);
+        for (int i = 0; i < block->count; i++) {
+            IrInstr* instr = block->instrs[i];
+            hashLong(&key, instr->opcode);
+            hashLong(&key, instr->dst);
+            hashLong(&key, instr->usecount);
+            for (int u = 0; u < instr->usecount; u++) {
+                hashLong(&key, instr->uses[u]);
+                if (instr->opcode == IR_PHI) hashBlock(&key, instr->sources[u]);
+            }
+            hashLong(&key, instr->imm);
+            hashLong(&key, instr->op);
+            hashLong(&key, instr->slot);
+            hashString(&key, instr->name);
+            hashBlock(&key, instr->target);
+            hashBlock(&key, instr->otherwise);
+            // calls out of the program are made differently
+            if (instr->opcode == IR_CALL) {
+                hashLong(&key, findIrFunction(program, instr->name) != NULL);
+            }
+        }
+    }
+    return key;
+}
+
+static char* entryPath(const char* dir, CacheKey key) {
+    char* path = allocate(ALLOC_CACHE, strlen(dir) + 32);
+    sprintf(path, "%s/%016lx.s", dir, key);
+    return path;
+}
+
+//---------------------- Memory Cache ----------------
+// An open addressing table, shared by every thread of the process. Each
+// entry has the time of its last load or store on a clock of its own,
+// and eviction builds the table again from the newest entries.
+
+typedef struct {
+    CacheKey key;
+    char* text;  // NULL for a free slot
+    size_t length;
+    unsigned long used;
+} MemoryEntry;
+
+static MemoryEntry* memoryEntries;
+static int memoryCapacity;
+static int memoryCount;
+static size_t memoryBytes;  // of every text
+static unsigned long memoryClock;
+static pthread_mutex_t memoryLock = PTHREAD_MUTEX_INITIALIZER;
+
+static MemoryEntry* memorySlot(MemoryEntry* entries, int capacity, CacheKey key) {
+    int i = (int)(key & (capacity - 1));
+    while (entries[i].text && entries[i].key != key) i = (i + 1) & (capacity - 1);
+    return &entries[i];
+}
+
+static char* copyText(const char* text, size_t length) {
+    char* copy = allocate(ALLOC_CACHE, length + 1);
+    memcpy(copy, text, length);
+    copy[length] = '\0';
+    return copy;
+}
+
+static char* memoryLoad(CacheKey key, size_t* length) {
+    char* text = NULL;
+    pthread_mutex_lock(&memoryLock);
+    if (memoryCapacity > 0) {
+        MemoryEntry* entry = memorySlot(memoryEntries, memoryCapacity, key);
+        if (entry->text) {
+            text = copyText(entry->text, entry->length);
+            *length = entry->length;
+            entry->used = ++memoryClock;
+        }
+    }
+    pthread_mutex_unlock(&memoryLock);
+    return text;
+}
+
+static int newestFirst(const void* a, const void* b) {
+    unsigned long x = ((const MemoryEntry*)a)->used, y = ((const MemoryEntry*)b)->used;
+    return x < y ? 1 : x > y ? -1 : 0;
+}
+
+static void evictMemory(void) {
+    MemoryEntry* live = allocate(ALLOC_CACHE, sizeof(MemoryEntry) * memoryCount);
+    int count = 0;
+    for (int i = 0; i < memoryCapacity; i++) {
+        if (memoryEntries[i].text) live[count++] = memoryEntries[i];
+    }
+    qsort(live, count, sizeof(MemoryEntry), newestFirst);
+    memset(memoryEntries, 0, sizeof(MemoryEntry) * memoryCapacity);
+    memoryCount = 0;
+    memoryBytes = 0;
+    for (int i = 0; i < count; i++) {
+        if (memoryBytes + live[i].length > MEMORY_CACHE_LIMIT / 4 * 3) {
+            release(live[i].text);
+            continue;
+        }
+        *memorySlot(memoryEntries, memoryCapacity, live[i].key) = live[i];
+        memoryCount++;
+        memoryBytes += live[i].length;
+    }
+    release(live);
+}
+
+static void memoryStore(CacheKey key, const char* text, size_t length) {
+    pthread_mutex_lock(&memoryLock);
+    // at most half full
+    if (2 * (memoryCount + 1) > memoryCapacity) {
+        int capacity = memoryCapacity ? memoryCapacity * 2 : 256;
+        MemoryEntry* entries = allocateZeroed(ALLOC_CACHE, capacity, sizeof(MemoryEntry));
+        for (int i = 0; i < memoryCapacity; i++) {
+            if (memoryEntries[i].text) {
+                *memorySlot(entries, capacity, memoryEntries[i].key) = memoryEntries[i];
+            }
+        }
+        release(memoryEntries);
+        memoryEntries = entries;
+        memoryCapacity = capacity;
+    }
+    MemoryEntry* entry = memorySlot(memoryEntries, memoryCapacity, key);
+    if (entry->text) {
+        release(entry->text);
+        memoryBytes -= entry->length;
+    } else {
+        memoryCount++;
+    }
+    entry->key = key;
+    entry->text = copyText(text, length);
+    entry->length = length;
+    entry->used = ++memoryClock;
+    memoryBytes += length;
+    if (memoryBytes > MEMORY_CACHE_LIMIT) evictMemory();
+    pthread_mutex_unlock(&memoryLock);
+}
+
+//---------------------- Entries ---------------------
+
+char* cacheLoad(const char* dir, CacheKey key, size_t* length) {
+    if (dir == NULL) return memoryLoad(key, length);
+    char* path = entryPath(dir, key);
+    FILE* file = fopen(path, "rb");
+    release(path);
+    if (file == NULL) return NULL;
+    fseek(file, 0L, SEEK_END);
+    *length = ftell(file);
+    rewind(file);
+    char* text = allocate(ALLOC_CACHE, *length + 1);
+    if (fread(text, 1, *length, file) != *length) {
+        release(text);
+        text = NULL;
+    } else {
+        text[*length] = '\0';
+    }
+    fclose(file);
+    return text;
+}
+
+// written under a temporary name and renamed, so that a concurrent build
+// never reads half an entry; the name is mkstemp's, as two threads of one
+// -j build can store the same key at once
+void cacheStore(const char* dir, CacheKey key, const char* text, size_t length) {
+    if (dir == NULL) {
+        memoryStore(key, text, length);
+        return;
+    }
+    mkdir(dir, 0755);
+    char* path = entryPath(dir, key);
+    char* temporary = allocate(ALLOC_CACHE, strlen(path) + 32);
+    sprintf(temporary, "%s.XXXXXX", path);
+    int fd = mkstemp(temporary);
+    FILE* file = fd < 0 ? NULL : fdopen(fd, "wb");
+    if (fd >= 0) fchmod(fd, 0644);
+    if (file == NULL) {
+        panic("could not write the cache entry \"%s\"\n", temporary);
+    }
+    bool written = fwrite(text, 1, length, file) == length;
+    if (fclose(file) != 0 || !written || rename(temporary, path) != 0) {
+        remove(temporary);
+    }
+    release(temporary);
+    release(path);
+}
@@ -0,0 +1,32 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include "ir.h"
+
+//---------------------- Function Cache ----------------
+// Assembly text of compiled functions kept on disk, a file per function
+// named by a hash of everything the text depends on: the function's IR
+// once the -O1 passes are done, so that inlined callees and folded calls
+// are part of it, which of its callees the program defines, the code
+// generation options and the compiler executable itself. A rebuild
+// generates code only for functions whose hash is not there yet.
+
+typedef unsigned long CacheKey;
+
+// the part of every key besides the function, hashing the running
+// executable so that a rebuilt compiler starts afresh
+CacheKey cacheSeed(int optLevel, int vectorLanes);
+CacheKey hashFunction(CacheKey seed, IrProgram* program, IrFunction* fn);
+CacheKey hashText(CacheKey key, const char* text, size_t length);
+
+// with a NULL dir the entries are kept in memory instead: the compile
+// server's cache. Once their texts come to more than MEMORY_CACHE_LIMIT
+// bytes, the entries used longest ago are dropped, down to 3/4 of it.
+
+#define MEMORY_CACHE_LIMIT (32L << 20)
+
+// the text cached under key, NULL if there is none; the caller frees it
+char* cacheLoad(const char* dir, CacheKey key, size_t* length);
+void cacheStore(const char* dir, CacheKey key, const char* text, size_t length);
+
+#endif
@@ -0,0 +1,577 @@
+//---------------------- Machine Code Encoding ---------
+// Encodes allocated machine code as x86-64 bytes into an ELF object, so
+// that no assembler has to run. The byte sequences are those of the
+// instructions asm.c prints. Each block is encoded apart from the jumps
+// ending it; jumps start out short and are widened until every
+// displacement fits, which is how assemblers relax branches too.
+#include "x86.h"
+
+typedef struct {
+    long offset;  // of the 32 bit field, in the code of the block
+    int symbol;
+    RelocType type;
+    long addend;
+} Fixup;
+
+typedef struct {
+    bool conditional;
+    Cond cond;
+    MBlock* target;
+    bool wide;  // rel32 rather than rel8
+} Jump;
+
+typedef struct {
+    Buffer code;  // everything but the jumps ending the block
+    Fixup* fixups;
+    int fixupCount;
+    int fixupCapacity;
+    Jump jumps[2];
+    int jumpCount;
+    long offset;  // in the function, once laid out
+} BlockCode;
+
+typedef struct {
+    MProgram* program;
+    ObjectFile* object;
+    MFunction* fn;
+    Frame frame;
+    BlockCode* block;  // receiving the bytes
+} Encoder;
+
+// condition codes in the order of Cond
+static const int condCodes[] = {0x4, 0x5, 0xc, 0xe, 0xf, 0xd};
+
+static void emitByte(Encoder* e, int byte) { appendByte(&e->block->code, byte); }
+
+static void emitImm(Encoder* e, long value, int size) {
+    appendBytes(&e->block->code, value, size);
+}
+
+static bool fitsByte(long value) { return value == (signed char)value; }
+
+static bool fitsInt(long value) { return value == (int)value; }
+
+static void addFixup(Encoder* e, int symbol, RelocType type, long addend) {
+    BlockCode* block = e->block;
+    if (block->fixupCount == block->fixupCapacity) {
+        block->fixupCapacity = block->fixupCapacity ? block->fixupCapacity * 2 : 4;
+        block->fixups =
+            reallocate(ALLOC_CODEGEN, block->fixups, sizeof(Fixup) * block->fixupCapacity);
+    }
+    Fixup* fixup = &block->fixups[block->fixupCount++];
+    fixup->offset = block->code.count;
+    fixup->symbol = symbol;
+    fixup->type = type;
+    fixup->addend = addend;
+    emitImm(e, 0, 4);
+}
+
+//---------------------- Operands ----------------------
+
+// number of a register in its register file
+static int hw(int reg) { return reg >= XMM0 ? reg - XMM0 : reg; }
+
+// frame slots are addressed off rbp, or off rsp in leaves
+static MOperand resolveFrame(Encoder* e, MOperand* op) {
+    if (op->kind != OPND_FRAME) return *op;
+    return memOperand(e->frame.framePointer ? RBP : RSP, -1, 0,
+                      frameOffset(&e->frame, op));
+}
+
+// the REX.R, REX.X and REX.B bits of a reg field and an r/m operand
+static int extensionBits(int reg, MOperand* rm) {
+    int bits = hw(reg) >= 8 ? 4 : 0;
+    if (rm->kind == OPND_REG && hw(rm->reg) >= 8) bits |= 1;
+    if (rm->kind == OPND_MEM) {
+        if (rm->reg >= 8) bits |= 1;
+        if (rm->index >= 8) bits |= 2;
+    }
+    return bits;
+}
+
+static int log2Scale(int scale) {
+    return scale == 8 ? 3 : scale == 4 ? 2 : scale == 2 ? 1 : 0;
+}
+
+// the ModRM byte and what follows it; immBytes of immediate come after,
+// which rip-relative displacements have to account for
+static void emitModrm(Encoder* e, int reg, MOperand* rm, int immBytes) {
+    int r = hw(reg) & 7;
+    switch (rm->kind) {
+        case OPND_REG:
+            emitByte(e, 0xc0 | r << 3 | (hw(rm->reg) & 7));
+            return;
+        case OPND_GLOBAL:
+            emitByte(e, r << 3 | 5);
+            addFixup(e, symbolOf(e->object, rm->name), RELOC_PC32, -4 - immBytes);
+            return;
+        case OPND_MEM:
+            break;
+        default:
+            panic("cannot encode operand kind %d\n", rm->kind);
+    }
+    int base = rm->reg & 7;
+    long disp = rm->imm;
+    // rbp and r13 as a base always take a displacement
+    int mod = disp == 0 && base != 5 ? 0 : fitsByte(disp) ? 1 : 2;
+    if (rm->index < 0 && base != 4) {
+        emitByte(e, mod << 6 | r << 3 | base);
+    } else {
+        // rsp and r12 as a base, or any index, take a SIB byte
+        int index = rm->index < 0 ? 4 : rm->index & 7;
+        emitByte(e, mod << 6 | r << 3 | 4);
+        emitByte(e, log2Scale(rm->scale) << 6 | index << 3 | base);
+    }
+    if (mod == 1) emitImm(e, disp, 1);
+    if (mod == 2) emitImm(e, disp, 4);
+}
+
+typedef struct {
+    int prefix;  // mandatory 0x66 or 0xf3, or 0
+    bool wide;   // REX.W
+    bool byte;   // byte registers, which need a REX for spl..dil
+    int opcode;  // up to three bytes, the first in the highest
+    int length;
+} Form;
+
+static Form form(int opcode, int length, bool wide) {
+    Form f = {0, wide, false, opcode, length};
+    return f;
+}
+
+// legacy and REX prefixes, the opcode and the operand bytes
+static void emitRM(Encoder* e, Form f, int reg, MOperand* operand, int immBytes) {
+    MOperand rm = resolveFrame(e, operand);
+    if (f.prefix) emitByte(e, f.prefix);
+    int bits = extensionBits(reg, &rm);
+    bool lowByte = f.byte && ((reg >= 4 && reg < 8) ||
+                              (rm.kind == OPND_REG && rm.reg >= 4 && rm.reg < 8));
+    if (f.wide || bits || lowByte) emitByte(e, 0x40 | (f.wide ? 8 : 0) | bits);
+    for (int i = f.length - 1; i >= 0; i--) emitByte(e, (f.opcode >> (8 * i)) & 0xff);
+    emitModrm(e, reg, &rm, immBytes);
+}
+
+// three byte VEX prefix: map 1 is 0f, 2 is 0f38; pp 1 is 66, 2 is f3
+static void emitVex(Encoder* e, int map, int pp, bool w, bool l, int source,
+                    int opcode, int reg, MOperand* operand) {
+    MOperand rm = resolveFrame(e, operand);
+    int bits = extensionBits(reg, &rm);
+    emitByte(e, 0xc4);
+    emitByte(e, (~bits & 7) << 5 | map);
+    emitByte(e, (w ? 0x80 : 0) | (~hw(source) & 15) << 3 | (l ? 4 : 0) | pp);
+    emitByte(e, opcode);
+    emitModrm(e, reg, &rm, 0);
+}
+
+//---------------------- Instructions ------------------
+
+static MOperand regOf(int reg) { return regOperand(reg); }
+
+static void emitPush(Encoder* e, int reg) {
+    if (reg >= 8) emitByte(e, 0x41);
+    emitByte(e, 0x50 | (reg & 7));
+}
+
+static void emitPop(Encoder* e, int reg) {
+    if (reg >= 8) emitByte(e, 0x41);
+    emitByte(e, 0x58 | (reg & 7));
+}
+
+// add, sub, xor and cmp share their encodings, told apart by `ext`
+static void emitAlu(Encoder* e, int ext, MOperand* dst, MOperand* src, bool wide) {
+    if (src->kind == OPND_IMM) {
+        bool small = fitsByte(src->imm);
+        if (!small && dst->kind == OPND_REG && dst->reg == RAX) {
+            // short form without a ModRM byte, as the assembler picks it
+            if (wide) emitByte(e, 0x48);
+            emitByte(e, 8 * ext + 5);
+            emitImm(e, src->imm, 4);
+            return;
+        }
+        emitRM(e, form(small ? 0x83 : 0x81, 1, wide), ext, dst, small ? 1 : 4);
+        emitImm(e, src->imm, small ? 1 : 4);
+    } else if (src->kind == OPND_REG) {
+        emitRM(e, form(8 * ext + 1, 1, wide), src->reg, dst, 0);
+    } else {
+        emitRM(e, form(8 * ext + 3, 1, wide), dst->reg, src, 0);
+    }
+}
+
+static void emitVzeroupper(Encoder* e) {
+    emitByte(e, 0xc5);
+    emitByte(e, 0xf8);
+    emitByte(e, 0x77);
+}
+
+static void emitPrologue(Encoder* e) {
+    Frame* frame = &e->frame;
+    if (frame->framePointer) {
+        emitPush(e, RBP);
+        MOperand rbp = regOf(RBP);
+        emitRM(e, form(0x89, 1, true), RSP, &rbp, 0);
+    }
+    for (int i = 0; i < frame->savedCount; i++) emitPush(e, frame->saved[i]);
+    if (frame->framePointer && frame->size) {
+        MOperand rsp = regOf(RSP), size = immOperand(frame->size);
+        emitAlu(e, 5, &rsp, &size, true);
+    }
+}
+
+static void emitEpilogue(Encoder* e) {
+    Frame* frame = &e->frame;
+    if (frame->framePointer) {
+        if (frame->savedCount) {
+            MOperand saved = memOperand(RBP, -1, 0, -8 * frame->savedCount);
+            emitRM(e, form(0x8d, 1, true), RSP, &saved, 0);
+        } else {
+            MOperand rsp = regOf(RSP);
+            emitRM(e, form(0x89, 1, true), RBP, &rsp, 0);
+        }
+    }
+    for (int i = frame->savedCount - 1; i >= 0; i--) emitPop(e, frame->saved[i]);
+    if (frame->framePointer) emitPop(e, RBP);
+    if (e->fn->usesYmm) emitVzeroupper(e);
+}
+
+static void emitMove(Encoder* e, MOperand* dst, MOperand* src) {
+    if (dst->kind == OPND_REG && src->kind == OPND_REG) {
+        if (dst->reg != src->reg) emitRM(e, form(0x89, 1, true), src->reg, dst, 0);
+    } else if (src->kind == OPND_IMM) {
+        if (fitsInt(src->imm)) {
+            emitRM(e, form(0xc7, 1, true), 0, dst, 4);
+            emitImm(e, src->imm, 4);
+        } else {
+            // movabsq
+            emitByte(e, dst->reg >= 8 ? 0x49 : 0x48);
+            emitByte(e, 0xb8 | (dst->reg & 7));
+            emitImm(e, src->imm, 8);
+        }
+    } else if (src->kind == OPND_REG) {
+        emitRM(e, form(0x89, 1, true), src->reg, dst, 0);
+    } else {
+        emitRM(e, form(0x8b, 1, true), dst->reg, src, 0);
+    }
+}
+
+static void emitVector(Encoder* e, MInstr* instr) {
+    bool vex = e->fn->usesYmm;
+    bool l = instr->imm == 32;
+    MOperand* ops = instr->ops;
+    switch (instr->opcode) {
+        case M_VMOV: {
+            bool regs = ops[0].kind == OPND_REG && ops[1].kind == OPND_REG;
+            // movdqa x, x / movdqu x, m / movdqu m, x
+            int prefix = regs ? 0x66 : 0xf3;
+            bool store = ops[0].kind != OPND_REG;
+            int reg = store ? ops[1].reg : ops[0].reg;
+            MOperand* rm = store ? &ops[0] : &ops[1];
+            int opcode = store ? 0x7f : 0x6f;
+            if (vex) {
+                emitVex(e, 1, regs ? 1 : 2, false, l, XMM0, opcode, reg, rm);
+            } else {
+                Form f = form(0x0f00 | opcode, 2, false);
+                f.prefix = prefix;
+                emitRM(e, f, reg, rm, 0);
+            }
+            break;
+        }
+        case M_VADD:
+        case M_VSUB: {
+            int opcode = instr->opcode == M_VADD ? 0xd4 : 0xfb;
+            if (vex) {
+                emitVex(e, 1, 1, false, l, ops[1].reg, opcode, ops[0].reg, &ops[2]);
+            } else {
+                Form f = form(0x0f00 | opcode, 2, false);
+                f.prefix = 0x66;
+                emitRM(e, f, ops[0].reg, &ops[2], 0);
+            }
+            break;
+        }
+        case M_VSPLAT:
+            if (vex) {
+                // vmovq, then vpbroadcastq
+                emitVex(e, 1, 1, true, false, XMM0, 0x6e, ops[0].reg, &ops[1]);
+                emitVex(e, 2, 1, false, l, XMM0, 0x59, ops[0].reg, &ops[0]);
+            } else {
+                // movq, then punpcklqdq
+                Form movq = form(0x0f6e, 2, true);
+                movq.prefix = 0x66;
+                emitRM(e, movq, ops[0].reg, &ops[1], 0);
+                Form unpack = form(0x0f6c, 2, false);
+                unpack.prefix = 0x66;
+                emitRM(e, unpack, ops[0].reg, &ops[0], 0);
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+static void encodeInstr(Encoder* e, MInstr* instr) {
+    MOperand* ops = instr->ops;
+    switch (instr->opcode) {
+        case M_MOV:
+            emitMove(e, &ops[0], &ops[1]);
+            break;
+        case M_LEA:
+            emitRM(e, form(0x8d, 1, true), ops[0].reg, &ops[1], 0);
+            break;
+        case M_ADD:
+            emitAlu(e, 0, &ops[0], &ops[1], true);
+            break;
+        case M_SUB:
+            emitAlu(e, 5, &ops[0], &ops[1], true);
+            break;
+        case M_XOR: {
+            // the 32 bit form is shorter and zero extends
+            bool zero = ops[0].kind == OPND_REG && ops[1].kind == OPND_REG &&
+                        ops[0].reg == ops[1].reg;
+            emitAlu(e, 6, &ops[0], &ops[1], !zero);
+            break;
+        }
+        case M_CMP:
+            emitAlu(e, 7, &ops[0], &ops[1], true);
+            break;
+        case M_TEST:
+            if (ops[1].kind == OPND_IMM) {
+                emitRM(e, form(0xf7, 1, true), 0, &ops[0], 4);
+                emitImm(e, ops[1].imm, 4);
+            } else {
+                emitRM(e, form(0x85, 1, true), ops[1].reg, &ops[0], 0);
+            }
+            break;
+        case M_IMUL:
+            if (ops[2].kind == OPND_IMM) {
+                bool small = fitsByte(ops[2].imm);
+                emitRM(e, form(small ? 0x6b : 0x69, 1, true), ops[0].reg, &ops[1],
+                       small ? 1 : 4);
+                emitImm(e, ops[2].imm, small ? 1 : 4);
+            } else {
+                emitRM(e, form(0x0faf, 2, true), ops[0].reg, &ops[1], 0);
+            }
+            break;
+        case M_NEG:
+            emitRM(e, form(0xf7, 1, true), 3, &ops[0], 0);
+            break;
+        case M_CQO:
+            emitByte(e, 0x48);
+            emitByte(e, 0x99);
+            break;
+        case M_IDIV:
+            emitRM(e, form(0xf7, 1, true), 7, &ops[0], 0);
+            break;
+        case M_SETCC: {
+            // setcc, then movzbl of the byte into the whole register
+            Form set = form(0x0f90 | condCodes[instr->cond], 2, false);
+            set.byte = true;
+            emitRM(e, set, 0, &ops[0], 0);
+            Form movzx = form(0x0fb6, 2, false);
+            movzx.byte = true;
+            emitRM(e, movzx, ops[0].reg, &ops[0], 0);
+            break;
+        }
+        case M_PUSH:
+            if (ops[0].kind == OPND_REG) {
+                emitPush(e, ops[0].reg);
+            } else if (ops[0].kind == OPND_IMM) {
+                bool small = fitsByte(ops[0].imm);
+                emitByte(e, small ? 0x6a : 0x68);
+                emitImm(e, ops[0].imm, small ? 1 : 4);
+            } else {
+                emitRM(e, form(0xff, 1, false), 6, &ops[0], 0);
+            }
+            break;
+        case M_CALL:
+            if (e->fn->usesYmm) emitVzeroupper(e);
+            emitByte(e, 0xe8);
+            addFixup(e, symbolOf(e->object, instr->name), RELOC_PLT32, -4);
+            break;
+        case M_SYSCALL:
+            emitByte(e, 0x0f);
+            emitByte(e, 0x05);
+            break;
+        case M_TAILCALL:
+            emitEpilogue(e);
+            emitByte(e, 0xe9);
+            addFixup(e, symbolOf(e->object, instr->name), RELOC_PLT32, -4);
+            break;
+        case M_RET:
+            emitEpilogue(e);
+            emitByte(e, 0xc3);
+            break;
+        case M_VMOV:
+        case M_VADD:
+        case M_VSUB:
+        case M_VSPLAT:
+            emitVector(e, instr);
+            break;
+        case M_JMP:
+        case M_JCC:
+            panic("jumps are laid out with their block\n");
+    }
+}
+
+//---------------------- Layout ------------------------
+
+static int jumpSize(Jump* jump) {
+    if (!jump->wide) return 2;
+    return jump->conditional ? 6 : 5;
+}
+
+static void addJump(BlockCode* code, bool conditional, Cond cond, MBlock* target) {
+    Jump* jump = &code->jumps[code->jumpCount++];
+    jump->conditional = conditional;
+    jump->cond = cond;
+    jump->target = target;
+    jump->wide = false;
+}
+
+// the instructions of a block, then its jumps with the same fall through
+// rules as the assembly
+static void encodeBlock(Encoder* e, MBlock* block, MBlock* next) {
+    for (int i = 0; i < block->count; i++) {
+        MInstr* instr = block->instrs[i];
+        if (instr->opcode == M_JCC) {
+            MInstr* following = i + 1 < block->count ? block->instrs[i + 1] : NULL;
+            if (instr->target == next && following && following->opcode == M_JMP) {
+                addJump(e->block, true, invertCond(instr->cond), following->target);
+                i++;
+            } else {
+                addJump(e->block, true, instr->cond, instr->target);
+            }
+        } else if (instr->opcode == M_JMP) {
+            if (instr->target != next) addJump(e->block, false, 0, instr->target);
+        } else if (e->block->jumpCount) {
+            panic("instruction after a jump in %s\n", e->fn->name.chars);
+        } else {
+            encodeInstr(e, instr);
+        }
+    }
+}
+
+// place the blocks, widening jumps until all displacements fit
+static long layoutBlocks(MFunction* fn, BlockCode* blocks) {
+    bool changed = true;
+    long size = 0;
+    while (changed) {
+        changed = false;
+        size = 0;
+        for (int b = 0; b < fn->blockCount; b++) {
+            blocks[b].offset = size;
+            size += blocks[b].code.count;
+            for (int j = 0; j < blocks[b].jumpCount; j++) {
+                size += jumpSize(&blocks[b].jumps[j]);
+            }
+        }
+        for (int b = 0; b < fn->blockCount; b++) {
+            long end = blocks[b].offset + blocks[b].code.count;
+            for (int j = 0; j < blocks[b].jumpCount; j++) {
+                Jump* jump = &blocks[b].jumps[j];
+                end += jumpSize(jump);
+                long disp = blocks[jump->target->id].offset - end;
+                if (!jump->wide && !fitsByte(disp)) {
+                    jump->wide = true;
+                    changed = true;
+                }
+            }
+        }
+    }
+    return size;
+}
+
+static void writeJump(Buffer* text, Jump* jump, long disp) {
+    int cc = condCodes[jump->cond];
+    if (!jump->wide) {
+        appendByte(text, jump->conditional ? 0x70 | cc : 0xeb);
+        appendBytes(text, disp, 1);
+    } else if (jump->conditional) {
+        appendByte(text, 0x0f);
+        appendByte(text, 0x80 | cc);
+        appendBytes(text, disp, 4);
+    } else {
+        appendByte(text, 0xe9);
+        appendBytes(text, disp, 4);
+    }
+}
+
+static void encodeFunction(Encoder* e) {
+    MFunction* fn = e->fn;
+    layoutFrame(fn, &e->frame);
+    BlockCode* blocks = irAlloc(ALLOC_CODEGEN, sizeof(BlockCode) * fn->blockCount);
+    for (int b = 0; b < fn->blockCount; b++) {
+        e->block = &blocks[b];
+        if (b == 0) emitPrologue(e);
+        encodeBlock(e, fn->blocks[b], b + 1 < fn->blockCount ? fn->blocks[b + 1] : NULL);
+    }
+    long size = layoutBlocks(fn, blocks);
+
+    Buffer* text = &e->object->sections[SECTION_TEXT];
+    long start = text->count;
+    int symbol = symbolOf(e->object, fn->name);
+    defineSymbol(e->object, symbol, SECTION_TEXT, start, true);
+    e->object->symbols[symbol].function = true;
+    e->object->symbols[symbol].size = size;
+    for (int b = 0; b < fn->blockCount; b++) {
+        BlockCode* code = &blocks[b];
+        long at = text->count;
+        appendBuffer(text, code->code.bytes, code->code.count);
+        for (int f = 0; f < code->fixupCount; f++) {
+            Fixup* fixup = &code->fixups[f];
+            addRelocation(e->object, at + fixup->offset, fixup->symbol, fixup->type,
+                          fixup->addend);
+        }
+        for (int j = 0; j < code->jumpCount; j++) {
+            Jump* jump = &code->jumps[j];
+            long end = text->count - start + jumpSize(jump);
+            writeJump(text, jump, blocks[jump->target->id].offset - end);
+        }
+        release(code->code.bytes);
+        release(code->fixups);
+    }
+    release(blocks);
+    release(e->frame.slotOffsets);
+}
+
+//---------------------- Data --------------------------
+
+static void encodeGlobals(ObjectFile* object, IrProgram* ir) {
+    for (int i = 0; i < ir->globalCount; i++) {
+        IrGlobal* global = &ir->globals[i];
+        int symbol = symbolOf(object, global->name);
+        if (global->bytes.chars) {
+            Buffer* rodata = &object->sections[SECTION_RODATA];
+            defineSymbol(object, symbol, SECTION_RODATA, rodata->count, false);
+            // string literals keep their escapes until here, as `as` reads
+            // them too
+            String bytes = unescape(global->bytes);
+            appendBuffer(rodata, bytes.chars, bytes.length + 1);
+            release(bytes.chars);
+        } else {
+            Buffer* data = &object->sections[SECTION_DATA];
+            while (data->count % 8) appendByte(data, 0);
+            defineSymbol(object, symbol, SECTION_DATA, data->count, true);
+            object->symbols[symbol].size = 8;
+            appendBytes(data, global->value, 8);
+        }
+    }
+}
+
+void encodeProgram(MProgram* program, ObjectFile* object) {
+    Encoder e;
+    memset(&e, 0, sizeof(Encoder));
+    e.program = program;
+    e.object = object;
+    for (int i = 0; i < program->functionCount; i++) {
+        e.fn = program->functions[i];
+        encodeFunction(&e);
+    }
+    encodeGlobals(object, program->ir);
+}
+
+void emitObject(MProgram* program, FILE* out) {
+    ObjectFile object;
+    memset(&object, 0, sizeof(ObjectFile));
+    encodeProgram(program, &object);
+    writeElf(&object, out);
+    freeObject(&object);
+}
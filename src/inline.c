@@ -0,0 +1,389 @@
+//---------------------- Inliner -----------------------
+#include "inline.h"
+
+#include "loop.h"
+
+typedef struct {
+    IrFunction* fn;
+    int* callees;  // a function index per call to a function of the program
+    int calleeCount;
+    int index;  // Tarjan's depth first numbering, -1 until visited
+    int lowlink;
+    bool onStack;
+    int component;
+} CallNode;
+
+typedef struct {
+    IrProgram* program;
+    CallNode* nodes;
+    int count;
+    int* stack;
+    int top;
+    int nextIndex;
+    int* order;  // functions grouped by component, callees first
+    int orderCount;
+    int componentCount;
+} CallGraph;
+
+typedef struct {
+    IrInstr* call;
+    IrFunction* callee;
+    int depth;      // loops around the call
+    int constArgs;  // arguments that are IR_CONST
+} CallSite;
+
+static int functionSize(IrFunction* fn) {
+    int size = 0;
+    for (int b = 0; b < fn->blockCount; b++) size += fn->blocks[b]->count;
+    return size;
+}
+
+static int programSize(IrProgram* program) {
+    int size = 0;
+    for (int i = 0; i < program->functionCount; i++) {
+        size += functionSize(program->functions[i]);
+    }
+    return size;
+}
+
+// nodes are numbered like the program's functions
+static int nodeOf(CallGraph* graph, String name) {
+    return irFunctionIndex(graph->program, name);
+}
+
+// Tarjan's algorithm: a component is complete when the depth first search
+// leaves its root, and every component it reaches is complete before it
+static void strongConnect(CallGraph* graph, int v) {
+    CallNode* node = &graph->nodes[v];
+    node->index = node->lowlink = graph->nextIndex++;
+    graph->stack[graph->top++] = v;
+    node->onStack = true;
+    for (int i = 0; i < node->calleeCount; i++) {
+        CallNode* callee = &graph->nodes[node->callees[i]];
+        if (callee->index < 0) {
+            strongConnect(graph, node->callees[i]);
+            if (callee->lowlink < node->lowlink) node->lowlink = callee->lowlink;
+        } else if (callee->onStack && callee->index < node->lowlink) {
+            node->lowlink = callee->index;
+        }
+    }
+    if (node->lowlink != node->index) return;
+    int w;
+    do {
+        w = graph->stack[--graph->top];
+        graph->nodes[w].onStack = false;
+        graph->nodes[w].component = graph->componentCount;
+        graph->order[graph->orderCount++] = w;
+    } while (w != v);
+    graph->componentCount++;
+}
+
+static void buildCallGraph(IrProgram* program, CallGraph* graph) {
+    memset(graph, 0, sizeof(CallGraph));
+    graph->program = program;
+    graph->count = program->functionCount;
+    graph->nodes = irAlloc(ALLOC_OPTIMIZER, sizeof(CallNode) * (graph->count + 1));
+    graph->stack = irAlloc(ALLOC_OPTIMIZER, sizeof(int) * (graph->count + 1));
+    graph->order = irAlloc(ALLOC_OPTIMIZER, sizeof(int) * (graph->count + 1));
+    for (int i = 0; i < graph->count; i++) {
+        graph->nodes[i].fn = program->functions[i];
+        graph->nodes[i].index = -1;
+    }
+    for (int i = 0; i < graph->count; i++) {
+        CallNode* node = &graph->nodes[i];
+        for (int b = 0; b < node->fn->blockCount; b++) {
+            IrBlock* block = node->fn->blocks[b];
+            for (int j = 0; j < block->count; j++) {
+                IrInstr* instr = block->instrs[j];
+                int callee = instr->opcode == IR_CALL ? nodeOf(graph, instr->name) : -1;
+                if (callee < 0) continue;
+                node->callees = reallocate(ALLOC_OPTIMIZER, node->callees,
+                                           sizeof(int) * (node->calleeCount + 1));
+                node->callees[node->calleeCount++] = callee;
+            }
+        }
+    }
+    for (int i = 0; i < graph->count; i++) {
+        if (graph->nodes[i].index < 0) strongConnect(graph, i);
+    }
+}
+
+static void freeCallGraph(CallGraph* graph) {
+    for (int i = 0; i < graph->count; i++) release(graph->nodes[i].callees);
+    release(graph->nodes);
+    release(graph->stack);
+    release(graph->order);
+}
+
+// loops around each block, indexed by block id
+static int* loopDepths(IrFunction* fn) {
+    computeDominators(fn);
+    Loop* loops;
+    int count = findLoops(fn, &loops);
+    int* depths = irAlloc(ALLOC_OPTIMIZER, sizeof(int) * (fn->nextBlockId + 1));
+    for (int i = 0; i < count; i++) {
+        for (int b = 0; b < loops[i].blockCount; b++) depths[loops[i].blocks[b]->id]++;
+    }
+    release(loops);
+    return depths;
+}
+
+static int returnCount(IrFunction* fn) {
+    int count = 0;
+    for (int b = 0; b < fn->blockCount; b++) {
+        if (terminator(fn->blocks[b])->opcode == IR_RET) count++;
+    }
+    return count;
+}
+
+// the calls of fn to other functions of the program, as fn stands now
+static int findCallSites(IrFunction* fn, CallGraph* graph, CallSite** out) {
+    int* depths = loopDepths(fn);
+    IrInstr** defs = buildDefMap(fn);
+    CallSite* sites = NULL;
+    int count = 0;
+    for (int b = 0; b < fn->blockCount; b++) {
+        IrBlock* block = fn->blocks[b];
+        for (int i = 0; i < block->count; i++) {
+            IrInstr* call = block->instrs[i];
+            int callee = call->opcode == IR_CALL ? nodeOf(graph, call->name) : -1;
+            if (callee < 0) continue;
+            sites = reallocate(ALLOC_OPTIMIZER, sites, sizeof(CallSite) * (count + 1));
+            CallSite* site = &sites[count++];
+            site->call = call;
+            site->callee = graph->nodes[callee].fn;
+            site->depth = depths[block->id];
+            site->constArgs = 0;
+            for (int u = 0; u < call->usecount; u++) {
+                if (defs[call->uses[u]]->opcode == IR_CONST) site->constArgs++;
+            }
+        }
+    }
+    release(depths);
+    release(defs);
+    *out = sites;
+    return count;
+}
+
+static int sizeLimit(CallSite* site) {
+    int depth = site->depth < INLINE_MAX_DEPTH ? site->depth : INLINE_MAX_DEPTH;
+    return (INLINE_BASE_SIZE + INLINE_CONST_ARG_BONUS * site->constArgs) << depth;
+}
+
+// replaces block->instrs[index], a call, by a copy of the callee's blocks.
+// the instructions after the call move to a new block that every return
+// of the copy jumps to.
+static void inlineCall(IrFunction* fn, IrBlock* block, int index, IrFunction* callee) {
+    IrInstr* call = block->instrs[index];
+    IrBlock* rest = newBlock(fn);
+    for (int i = index + 1; i < block->count; i++) appendInstr(rest, block->instrs[i]);
+    block->count = index;
+
+    int vregBase = fn->vregCount;
+    fn->vregCount += callee->vregCount;
+    int slotBase = fn->slotCount;
+    for (int s = 0; s < callee->slotCount; s++) {
+        newSlot(fn, callee->slots[s].name);
+        fn->slots[slotBase + s].addressTaken = callee->slots[s].addressTaken;
+    }
+    IrBlock** copies = irAlloc(ALLOC_OPTIMIZER, sizeof(IrBlock*) * (callee->nextBlockId + 1));
+    for (int b = 0; b < callee->blockCount; b++) {
+        copies[callee->blocks[b]->id] = newBlock(fn);
+    }
+    // several returns meet in a slot, a single one hands its vreg over
+    int result = -1, value = -1;
+    if (call->dst >= 0 && returnCount(callee) > 1) result = newSlot(fn, makeString("", 0));
+
+    for (int b = 0; b < callee->blockCount; b++) {
+        IrBlock* from = callee->blocks[b];
+        IrBlock* to = copies[from->id];
+        for (int i = 0; i < from->count; i++) {
+            IrInstr* instr = cloneInstr(from->instrs[i]);
+            if (instr->dst >= 0) instr->dst += vregBase;
+            for (int u = 0; u < instr->usecount; u++) instr->uses[u] += vregBase;
+            if (instr->opcode == IR_LOAD_SLOT || instr->opcode == IR_STORE_SLOT ||
+                instr->opcode == IR_ADDR_SLOT) {
+                instr->slot += slotBase;
+            }
+            if (instr->target) instr->target = copies[instr->target->id];
+            if (instr->otherwise) instr->otherwise = copies[instr->otherwise->id];
+            if (instr->opcode == IR_PARAM) {
+                IrInstr* argument = newInstr(IR_COPY, instr->dst, 1);
+                argument->uses[0] = call->uses[instr->imm];
+                instr = argument;
+            } else if (instr->opcode == IR_RET) {
+                int returned = instr->usecount ? instr->uses[0] : -1;
+                if (call->dst >= 0 && returned < 0) {
+                    IrInstr* zero = newInstr(IR_CONST, newVreg(fn), 0);
+                    appendInstr(to, zero);
+                    returned = zero->dst;
+                }
+                if (result >= 0) {
+                    IrInstr* store = newInstr(IR_STORE_SLOT, -1, 1);
+                    store->slot = result;
+                    store->uses[0] = returned;
+                    appendInstr(to, store);
+                } else {
+                    value = returned;
+                }
+                instr = newInstr(IR_JUMP, -1, 0);
+                instr->target = rest;
+            }
+            appendInstr(to, instr);
+        }
+    }
+
+    IrInstr* enter = newInstr(IR_JUMP, -1, 0);
+    enter->target = copies[callee->blocks[0]->id];
+    appendInstr(block, enter);
+    if (call->dst >= 0) {
+        IrInstr* get;
+        if (result >= 0) {
+            get = newInstr(IR_LOAD_SLOT, call->dst, 0);
+            get->slot = result;
+        } else {
+            get = newInstr(IR_COPY, call->dst, 1);
+            get->uses[0] = value;
+        }
+        insertInstr(rest, 0, get);
+    }
+    release(copies);
+}
+
+static bool inlineSite(IrFunction* fn, IrInstr* call, IrFunction* callee) {
+    for (int b = 0; b < fn->blockCount; b++) {
+        IrBlock* block = fn->blocks[b];
+        for (int i = 0; i < block->count; i++) {
+            if (block->instrs[i] != call) continue;
+            inlineCall(fn, block, i, callee);
+            return true;
+        }
+    }
+    return false;
+}
+
+void inlineFunctions(IrProgram* program, FILE* report) {
+    CallGraph graph;
+    buildCallGraph(program, &graph);
+    int before = programSize(program);
+    int budget = before * INLINE_GROWTH_PERCENT / 100;
+    if (budget < INLINE_MIN_BUDGET) budget = INLINE_MIN_BUDGET;
+    int siteCount = 0, inlinedCount = 0;
+
+    for (int o = 0; o < graph.orderCount; o++) {
+        CallNode* node = &graph.nodes[graph.order[o]];
+        IrFunction* fn = node->fn;
+        CallSite* sites;
+        int count = findCallSites(fn, &graph, &sites);
+        bool changed = false;
+        for (int s = 0; s < count; s++) {
+            CallSite* site = &sites[s];
+            IrFunction* callee = site->callee;
+            int size = functionSize(callee);
+            int limit = sizeLimit(site);
+            const char* reason = NULL;
+            if (graph.nodes[nodeOf(&graph, callee->name)].component == node->component) {
+                reason = "recursive";
+            } else if (site->call->usecount != callee->paramCount) {
+                reason = "argument count mismatch";
+            } else if (returnCount(callee) == 0) {
+                reason = "never returns";
+            } else if (size > limit) {
+                reason = "too large";
+            } else if (size > budget) {
+                reason = "over the growth budget";
+            }
+            siteCount++;
+            if (reason == NULL && inlineSite(fn, site->call, callee)) {
+                budget -= size;
+                inlinedCount++;
+                changed = true;
+            }
+            if (report == NULL) continue;
+            fprintf(report, "%-6s %s -> %s: size %d, limit %d (loop depth %d, %d constant args)",
+                    reason ? "keep" : "inline", fn->name.chars, callee->name.chars, size,
+                    limit, site->depth, site->constArgs);
+            if (reason) fprintf(report, ", %s", reason);
+            fprintf(report, "\n");
+        }
+        if (changed) computeCFG(fn);
+        release(sites);
+    }
+    if (report) {
+        fprintf(report, "inlined %d of %d calls, %d -> %d instructions\n", inlinedCount,
+                siteCount, before, programSize(program));
+    }
+    freeCallGraph(&graph);
+}
+
+//---------------------- Tail Calls --------------------
+
+// is block's last instruction `return fn(...)`?
+static bool endsInSelfCall(IrFunction* fn, IrBlock* block) {
+    if (block->count < 2) return false;
+    IrInstr* call = block->instrs[block->count - 2];
+    IrInstr* ret = block->instrs[block->count - 1];
+    return call->opcode == IR_CALL && stringEqual(call->name, fn->name) &&
+           call->usecount == fn->paramCount && ret->opcode == IR_RET &&
+           ret->usecount == 1 && ret->uses[0] == call->dst;
+}
+
+bool eliminateTailRecursion(IrFunction* fn) {
+    // an argument could point into the frame that is about to be reused
+    for (int s = 0; s < fn->slotCount; s++) {
+        if (fn->slots[s].addressTaken) return false;
+    }
+    bool found = false;
+    for (int b = 0; b < fn->blockCount; b++) found |= endsInSelfCall(fn, fn->blocks[b]);
+    if (!found) return false;
+    // the prologue is `param k` followed by its store for each parameter
+    IrBlock* entry = fn->blocks[0];
+    int* paramSlots = irAlloc(ALLOC_OPTIMIZER, sizeof(int) * (fn->paramCount + 1));
+    int prologue = 0;
+    for (int k = 0; k < fn->paramCount; k++, prologue += 2) {
+        if (prologue + 1 >= entry->count) break;
+        IrInstr* param = entry->instrs[prologue];
+        IrInstr* store = entry->instrs[prologue + 1];
+        if (param->opcode != IR_PARAM || param->imm != k || store->opcode != IR_STORE_SLOT ||
+            store->uses[0] != param->dst) {
+            break;
+        }
+        paramSlots[k] = store->slot;
+    }
+    if (prologue != 2 * fn->paramCount) {
+        release(paramSlots);
+        return false;
+    }
+
+    IrBlock* body = newBlock(fn);
+    for (int i = prologue; i < entry->count; i++) appendInstr(body, entry->instrs[i]);
+    entry->count = prologue;
+    IrInstr* enter = newInstr(IR_JUMP, -1, 0);
+    enter->target = body;
+    appendInstr(entry, enter);
+    for (int b = 0; b < fn->blockCount; b++) {
+        IrBlock* block = fn->blocks[b];
+        if (!endsInSelfCall(fn, block)) continue;
+        IrInstr* call = block->instrs[block->count - 2];
+        block->count -= 2;
+        // the arguments are all computed before the first store
+        for (int k = 0; k < fn->paramCount; k++) {
+            IrInstr* store = newInstr(IR_STORE_SLOT, -1, 1);
+            store->slot = paramSlots[k];
+            store->uses[0] = call->uses[k];
+            appendInstr(block, store);
+        }
+        IrInstr* loop = newInstr(IR_JUMP, -1, 0);
+        loop->target = body;
+        appendInstr(block, loop);
+    }
+    release(paramSlots);
+    computeCFG(fn);
+    return true;
+}
+
+void eliminateTailCalls(IrProgram* program) {
+    for (int i = 0; i < program->functionCount; i++) {
+        eliminateTailRecursion(program->functions[i]);
+    }
+}
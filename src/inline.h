@@ -0,0 +1,38 @@
+#ifndef INLINE_H
+#define INLINE_H
+
+#include "ir.h"
+
+//---------------------- Inliner -----------------------
+// Replaces calls by copies of the callee's body. Functions are visited
+// bottom-up over the strongly connected components of the call graph, so
+// a callee has already absorbed its own callees when it is weighed, and
+// calls inside a component (recursion) are never inlined.
+//
+// A call site is inlined when the callee is at most INLINE_BASE_SIZE
+// instructions, plus INLINE_CONST_ARG_BONUS for every constant argument,
+// doubled for each loop around the call up to INLINE_MAX_DEPTH loops. The
+// whole program may grow by INLINE_GROWTH_PERCENT of its size, and by at
+// least INLINE_MIN_BUDGET instructions.
+
+#define INLINE_BASE_SIZE 16
+#define INLINE_CONST_ARG_BONUS 8
+#define INLINE_MAX_DEPTH 2
+#define INLINE_GROWTH_PERCENT 50
+#define INLINE_MIN_BUDGET 64
+
+// report, if not NULL, gets a line for every call between two functions
+// of the program saying what was decided and why
+void inlineFunctions(IrProgram* program, FILE* report);
+
+//---------------------- Tail Calls --------------------
+// A function ending in `return f(...)` with f itself stores the arguments
+// into its parameter slots and jumps back to the code after its prologue,
+// so the recursion runs as a loop. Other calls in tail position become
+// jumps during instruction selection, see selectTailCall in isel.c.
+
+// returns true if fn changed
+bool eliminateTailRecursion(IrFunction* fn);
+void eliminateTailCalls(IrProgram* program);
+
+#endif
@@ -1,2 +1,898 @@
 //---------------------- IR-Gen-----------------------
-#include "ir.h"
\ No newline at end of file
+#include "ir.h"
+
+#include <limits.h>
+#include "syscall.h"
+
+#define WORD_SIZE 8
+
+IrBlock* newBlock(IrFunction* fn) {
+    IrBlock* block = irAlloc(ALLOC_IR, sizeof(IrBlock));
+    block->id = fn->nextBlockId++;
+    block->capacity = 8;
+    block->instrs = irAlloc(ALLOC_IR, sizeof(IrInstr*) * block->capacity);
+    if (fn->blockCount == fn->blockCapacity) {
+        fn->blockCapacity = fn->blockCapacity ? fn->blockCapacity * 2 : 8;
+        fn->blocks = reallocate(ALLOC_IR, fn->blocks, sizeof(IrBlock*) * fn->blockCapacity);
+    }
+    fn->blocks[fn->blockCount++] = block;
+    return block;
+}
+
+IrInstr* newInstr(IrOpcode opcode, int dst, int usecount) {
+    IrInstr* instr = irAlloc(ALLOC_IR, sizeof(IrInstr));
+    instr->opcode = opcode;
+    instr->dst = dst;
+    instr->usecount = usecount;
+    instr->uses = usecount ? irAlloc(ALLOC_IR, sizeof(int) * usecount) : NULL;
+    return instr;
+}
+
+IrInstr* cloneInstr(IrInstr* instr) {
+    IrInstr* copy = newInstr(instr->opcode, instr->dst, instr->usecount);
+    IrInstr saved = *copy;
+    *copy = *instr;
+    copy->uses = saved.uses;
+    for (int i = 0; i < instr->usecount; i++) {
+        copy->uses[i] = instr->uses[i];
+    }
+    if (instr->sources) {
+        copy->sources = irAlloc(ALLOC_IR, sizeof(IrBlock*) * instr->usecount);
+        memcpy(copy->sources, instr->sources, sizeof(IrBlock*) * instr->usecount);
+    }
+    return copy;
+}
+
+int newVreg(IrFunction* fn) { return fn->vregCount++; }
+
+int newSlot(IrFunction* fn, String name) {
+    if (fn->slotCount == fn->slotCapacity) {
+        fn->slotCapacity = fn->slotCapacity ? fn->slotCapacity * 2 : 8;
+        fn->slots = reallocate(ALLOC_IR, fn->slots, sizeof(IrSlot) * fn->slotCapacity);
+    }
+    fn->slots[fn->slotCount].name = name;
+    fn->slots[fn->slotCount].addressTaken = false;
+    return fn->slotCount++;
+}
+
+void insertInstr(IrBlock* block, int index, IrInstr* instr) {
+    if (block->count == block->capacity) {
+        block->capacity *= 2;
+        block->instrs =
+            reallocate(ALLOC_IR, block->instrs, sizeof(IrInstr*) * block->capacity);
+    }
+    memmove(&block->instrs[index + 1], &block->instrs[index],
+            sizeof(IrInstr*) * (block->count - index));
+    block->instrs[index] = instr;
+    block->count++;
+}
+
+void appendInstr(IrBlock* block, IrInstr* instr) {
+    insertInstr(block, block->count, instr);
+}
+
+void removeInstr(IrBlock* block, int index) {
+    memmove(&block->instrs[index], &block->instrs[index + 1],
+            sizeof(IrInstr*) * (block->count - index - 1));
+    block->count--;
+}
+
+IrInstr* terminator(IrBlock* block) {
+    if (block->count == 0) return NULL;
+    IrInstr* last = block->instrs[block->count - 1];
+    switch (last->opcode) {
+        case IR_JUMP:
+        case IR_BRANCH:
+        case IR_RET:
+            return last;
+        default:
+            return NULL;
+    }
+}
+
+// redirect every edge of a terminator that goes to `from`
+void retarget(IrInstr* instr, IrBlock* from, IrBlock* to) {
+    if (instr->target == from) instr->target = to;
+    if (instr->otherwise == from) instr->otherwise = to;
+}
+
+// pure instructions have no side effect and may be deleted when unused
+bool isPure(IrInstr* instr) {
+    switch (instr->opcode) {
+        case IR_CONST:
+        case IR_COPY:
+        case IR_PARAM:
+        case IR_BINARY:
+        case IR_UNARY:
+        case IR_LOAD_SLOT:
+        case IR_ADDR_SLOT:
+        case IR_ADDR_GLOBAL:
+        case IR_LOAD:
+        case IR_VLOAD:
+        case IR_VBINARY:
+        case IR_VSPLAT:
+        case IR_PHI:
+            return true;
+        default:
+            return false;
+    }
+}
+
+bool foldBinary(Op op, long a, long b, long* value) {
+    switch (op) {
+        case OP_ADD:
+            *value = (long)((unsigned long)a + (unsigned long)b);
+            return true;
+        case OP_SUB:
+            *value = (long)((unsigned long)a - (unsigned long)b);
+            return true;
+        case OP_MUL:
+            *value = (long)((unsigned long)a * (unsigned long)b);
+            return true;
+        case OP_DIV:
+            if (b == 0 || (a == LONG_MIN && b == -1)) return false;
+            *value = a / b;
+            return true;
+        case OP_EQ:
+            *value = a == b;
+            return true;
+        case OP_NEQ:
+            *value = a != b;
+            return true;
+        case OP_LT:
+            *value = a < b;
+            return true;
+        case OP_LTE:
+            *value = a <= b;
+            return true;
+        case OP_GT:
+            *value = a > b;
+            return true;
+        case OP_GTE:
+            *value = a >= b;
+            return true;
+        default:
+            panic("cannot fold binary operator %s\n", OptoString(op));
+    }
+    return false;
+}
+
+long foldUnary(Op op, long a) {
+    switch (op) {
+        case OP_NEG:
+            return (long)-(unsigned long)a;
+        case OP_NOT:
+            return !a;
+        default:
+            panic("cannot fold unary operator %s\n", OptoString(op));
+    }
+    return 0;
+}
+
+IrInstr** buildDefMap(IrFunction* fn) {
+    IrInstr** defs = irAlloc(ALLOC_IR, sizeof(IrInstr*) * (fn->vregCount + 1));
+    for (int b = 0; b < fn->blockCount; b++) {
+        IrBlock* block = fn->blocks[b];
+        for (int i = 0; i < block->count; i++) {
+            if (block->instrs[i]->dst >= 0) {
+                defs[block->instrs[i]->dst] = block->instrs[i];
+            }
+        }
+    }
+    return defs;
+}
+
+int irFunctionIndex(IrProgram* program, String name) {
+    return nameTableFind(&program->functionIndex, name);
+}
+
+IrFunction* findIrFunction(IrProgram* program, String name) {
+    int index = irFunctionIndex(program, name);
+    return index < 0 ? NULL : program->functions[index];
+}
+
+//---------------------- CFG --------------------------
+
+// fill successors and predecessors, drop unreachable blocks and put the
+// remaining ones in reverse postorder.
+void computeCFG(IrFunction* fn) {
+    for (int b = 0; b < fn->blockCount; b++) {
+        IrBlock* block = fn->blocks[b];
+        IrInstr* term = terminator(block);
+        if (term == NULL) {
+            panic("block b%d of %s has no terminator\n", block->id,
+                  fn->name.chars);
+        }
+        if (term->opcode == IR_BRANCH && term->target == term->otherwise) {
+            term->opcode = IR_JUMP;
+            term->usecount = 0;
+        }
+        block->succCount = 0;
+        block->predCount = 0;
+        block->rpo = -1;
+        if (term->opcode != IR_RET) block->succs[block->succCount++] = term->target;
+        if (term->opcode == IR_BRANCH) {
+            block->succs[block->succCount++] = term->otherwise;
+        }
+    }
+    // iterative depth first search from the entry
+    bool* visited = irAlloc(ALLOC_IR, sizeof(bool) * fn->nextBlockId);
+    IrBlock** stack = irAlloc(ALLOC_IR, sizeof(IrBlock*) * fn->blockCount);
+    int* next = irAlloc(ALLOC_IR, sizeof(int) * fn->blockCount);
+    IrBlock** postorder = irAlloc(ALLOC_IR, sizeof(IrBlock*) * fn->blockCount);
+    int sp = 0, count = 0;
+    stack[sp] = fn->blocks[0];
+    next[sp++] = 0;
+    visited[fn->blocks[0]->id] = true;
+    while (sp > 0) {
+        IrBlock* block = stack[sp - 1];
+        if (next[sp - 1] < block->succCount) {
+            IrBlock* succ = block->succs[next[sp - 1]++];
+            if (!visited[succ->id]) {
+                visited[succ->id] = true;
+                stack[sp] = succ;
+                next[sp++] = 0;
+            }
+        } else {
+            postorder[count++] = block;
+            sp--;
+        }
+    }
+    for (int i = 0; i < count; i++) {
+        fn->blocks[i] = postorder[count - 1 - i];
+        fn->blocks[i]->rpo = i;
+    }
+    fn->blockCount = count;
+    for (int b = 0; b < count; b++) {
+        IrBlock* block = fn->blocks[b];
+        for (int s = 0; s < block->succCount; s++) block->succs[s]->predCount++;
+    }
+    for (int b = 0; b < count; b++) {
+        IrBlock* block = fn->blocks[b];
+        block->preds = irAlloc(ALLOC_IR, sizeof(IrBlock*) * (block->predCount + 1));
+        block->predCount = 0;
+    }
+    for (int b = 0; b < count; b++) {
+        IrBlock* block = fn->blocks[b];
+        for (int s = 0; s < block->succCount; s++) {
+            IrBlock* succ = block->succs[s];
+            succ->preds[succ->predCount++] = block;
+        }
+    }
+    release(visited);
+    release(stack);
+    release(next);
+    release(postorder);
+}
+
+// delete pure instructions whose result is never used
+void removeDeadCode(IrFunction* fn) {
+    int* uses = irAlloc(ALLOC_IR, sizeof(int) * (fn->vregCount + 1));
+    for (int b = 0; b < fn->blockCount; b++) {
+        IrBlock* block = fn->blocks[b];
+        for (int i = 0; i < block->count; i++) {
+            for (int u = 0; u < block->instrs[i]->usecount; u++) {
+                uses[block->instrs[i]->uses[u]]++;
+            }
+        }
+    }
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (int b = fn->blockCount - 1; b >= 0; b--) {
+            IrBlock* block = fn->blocks[b];
+            for (int i = block->count - 1; i >= 0; i--) {
+                IrInstr* instr = block->instrs[i];
+                if (instr->dst < 0 || uses[instr->dst] > 0 || !isPure(instr)) {
+                    continue;
+                }
+                for (int u = 0; u < instr->usecount; u++) uses[instr->uses[u]]--;
+                removeInstr(block, i);
+                changed = true;
+            }
+        }
+    }
+    release(uses);
+}
+
+//---------------------- Lowering ---------------------
+
+typedef struct {
+    String name;
+    int slot;
+} Local;
+
+typedef struct {
+    Program* ast;
+    IrContext* context;    // declarations defined elsewhere, or NULL
+    NameTable functions;  // the functions of ast
+    IrProgram* program;
+    IrFunction* fn;
+    IrBlock* block;  // block receiving new instructions
+    Local* locals;   // scope stack, innermost last
+    int localCount;
+    int localCapacity;
+    int stringCount;
+} IrGen;
+
+static int genExpr(IrGen* gen, Expr* expr);
+static void genStmt(IrGen* gen, Stmt* stmt);
+
+static IrInstr* emit(IrGen* gen, IrOpcode opcode, bool hasDst, int usecount) {
+    IrInstr* instr =
+        newInstr(opcode, hasDst ? newVreg(gen->fn) : -1, usecount);
+    appendInstr(gen->block, instr);
+    return instr;
+}
+
+static int emitConst(IrGen* gen, long value) {
+    IrInstr* instr = emit(gen, IR_CONST, true, 0);
+    instr->imm = value;
+    return instr->dst;
+}
+
+static int emitBinary(IrGen* gen, Op op, int a, int b) {
+    IrInstr* instr = emit(gen, IR_BINARY, true, 2);
+    instr->op = op;
+    instr->uses[0] = a;
+    instr->uses[1] = b;
+    return instr->dst;
+}
+
+static int emitLoadSlot(IrGen* gen, int slot) {
+    IrInstr* instr = emit(gen, IR_LOAD_SLOT, true, 0);
+    instr->slot = slot;
+    return instr->dst;
+}
+
+static void emitStoreSlot(IrGen* gen, int slot, int value) {
+    IrInstr* instr = emit(gen, IR_STORE_SLOT, false, 1);
+    instr->slot = slot;
+    instr->uses[0] = value;
+}
+
+static int emitAddrGlobal(IrGen* gen, String name) {
+    IrInstr* instr = emit(gen, IR_ADDR_GLOBAL, true, 0);
+    instr->name = name;
+    return instr->dst;
+}
+
+static void emitJump(IrGen* gen, IrBlock* target) {
+    emit(gen, IR_JUMP, false, 0)->target = target;
+}
+
+static void emitBranch(IrGen* gen, int cond, IrBlock* target,
+                       IrBlock* otherwise) {
+    IrInstr* instr = emit(gen, IR_BRANCH, false, 1);
+    instr->uses[0] = cond;
+    instr->target = target;
+    instr->otherwise = otherwise;
+}
+
+static IrGlobal* addGlobal(IrProgram* program, String name) {
+    if (program->globalCount == program->globalCapacity) {
+        program->globalCapacity =
+            program->globalCapacity ? program->globalCapacity * 2 : 16;
+        program->globals = reallocate(ALLOC_IR, program->globals,
+                                      sizeof(IrGlobal) * program->globalCapacity);
+    }
+    IrGlobal* global = &program->globals[program->globalCount++];
+    memset(global, 0, sizeof(IrGlobal));
+    global->name = name;
+    return global;
+}
+
+static IrGlobal* findGlobal(IrProgram* program, String name) {
+    for (int i = 0; i < program->globalCount; i++) {
+        if (program->globals[i].bytes.chars == NULL &&
+            stringEqual(program->globals[i].name, name)) {
+            return &program->globals[i];
+        }
+    }
+    return NULL;
+}
+
+void addIrContext(IrContext* context, Program* program) {
+    for (int i = 0; i < program->count; i++) {
+        Decl* decl = program->declarations[i];
+        if (decl->type == DECL_FUNCTION) {
+            nameTableAdd(&context->functions, decl->function.name, 0);
+        } else if (decl->type == DECL_VARIABLE) {
+            nameTableAdd(&context->globals, decl->variable.name, 0);
+        }
+    }
+}
+
+void freeIrContext(IrContext* context) {
+    freeNameTable(&context->functions);
+    freeNameTable(&context->globals);
+}
+
+static bool isFunctionName(IrGen* gen, String name) {
+    return nameTableFind(&gen->functions, name) >= 0 ||
+           (gen->context && nameTableFind(&gen->context->functions, name) >= 0);
+}
+
+static bool isGlobalName(IrGen* gen, String name) {
+    return findGlobal(gen->program, name) ||
+           (gen->context && nameTableFind(&gen->context->globals, name) >= 0);
+}
+
+static void declareLocal(IrGen* gen, String name, int slot) {
+    if (gen->localCount == gen->localCapacity) {
+        gen->localCapacity = gen->localCapacity ? gen->localCapacity * 2 : 16;
+        gen->locals = reallocate(ALLOC_IR, gen->locals, sizeof(Local) * gen->localCapacity);
+    }
+    gen->locals[gen->localCount].name = name;
+    gen->locals[gen->localCount].slot = slot;
+    gen->localCount++;
+}
+
+// innermost slot named `name`, or -1
+static int lookupLocal(IrGen* gen, String name) {
+    for (int i = gen->localCount - 1; i >= 0; i--) {
+        if (stringEqual(gen->locals[i].name, name)) return gen->locals[i].slot;
+    }
+    return -1;
+}
+
+// string literal tokens keep their quotes
+static int genString(IrGen* gen, String literal) {
+    char name[32];
+    sprintf(name, ".Lstr%d", gen->stringCount++);
+    IrGlobal* global =
+        addGlobal(gen->program, makeString(name, strlen(name)));
+    global->bytes = makeString(literal.chars + 1, literal.length - 2);
+    return emitAddrGlobal(gen, global->name);
+}
+
+// address of an lvalue
+static int genAddress(IrGen* gen, Expr* expr) {
+    if (expr->type == EXPR_VARIABLE) {
+        int slot = lookupLocal(gen, expr->variable.name);
+        if (slot >= 0) {
+            gen->fn->slots[slot].addressTaken = true;
+            IrInstr* instr = emit(gen, IR_ADDR_SLOT, true, 0);
+            instr->slot = slot;
+            return instr->dst;
+        }
+        if (isGlobalName(gen, expr->variable.name) ||
+            isFunctionName(gen, expr->variable.name)) {
+            return emitAddrGlobal(gen, expr->variable.name);
+        }
+        panic("undefined variable %s\n", expr->variable.name.chars);
+    }
+    if (expr->type == EXPR_UNARY && expr->unary.op == OP_DEREF) {
+        return genExpr(gen, expr->unary.right);
+    }
+    if (expr->type == EXPR_BINARY && expr->binary.op == OP_SUBSCRIPT) {
+        // a[i] is the word at a + i * 8
+        int base = genExpr(gen, expr->binary.left);
+        int index = genExpr(gen, expr->binary.right);
+        int offset = emitBinary(gen, OP_MUL, index, emitConst(gen, WORD_SIZE));
+        return emitBinary(gen, OP_ADD, base, offset);
+    }
+    panic("expression %s is not assignable\n", sprintExpr(expr));
+    return -1;
+}
+
+static int genAssign(IrGen* gen, Expr* target, Expr* valueExpr) {
+    int value = genExpr(gen, valueExpr);
+    if (target->type == EXPR_VARIABLE) {
+        int slot = lookupLocal(gen, target->variable.name);
+        if (slot >= 0) {
+            emitStoreSlot(gen, slot, value);
+            return value;
+        }
+    }
+    int address = genAddress(gen, target);
+    IrInstr* store = emit(gen, IR_STORE, false, 2);
+    store->uses[0] = address;
+    store->uses[1] = value;
+    return value;
+}
+
+// && and || only evaluate their right operand when needed; the result is
+// kept in an anonymous slot so that both paths can produce it.
+static int genLogical(IrGen* gen, Expr* expr) {
+    int slot = newSlot(gen->fn, makeString("", 0));
+    IrBlock* rhs = newBlock(gen->fn);
+    IrBlock* end = newBlock(gen->fn);
+    int left = genExpr(gen, expr->binary.left);
+    left = emitBinary(gen, OP_NEQ, left, emitConst(gen, 0));
+    emitStoreSlot(gen, slot, left);
+    if (expr->binary.op == OP_AND) {
+        emitBranch(gen, left, rhs, end);
+    } else {
+        emitBranch(gen, left, end, rhs);
+    }
+    gen->block = rhs;
+    int right = genExpr(gen, expr->binary.right);
+    right = emitBinary(gen, OP_NEQ, right, emitConst(gen, 0));
+    emitStoreSlot(gen, slot, right);
+    emitJump(gen, end);
+    gen->block = end;
+    return emitLoadSlot(gen, slot);
+}
+
+static int genExpr(IrGen* gen, Expr* expr) {
+    switch (expr->type) {
+        case EXPR_LITERAL:
+            switch (expr->literal.type) {
+                case TYPE_INT:
+                    return emitConst(gen, expr->literal.value.intVal);
+                case TYPE_BOOL:
+                    return emitConst(gen, expr->literal.value.boolVal);
+                case TYPE_STRING:
+                    return genString(gen, expr->literal.value.stringVal);
+                default:
+                    panic("literal type %d is not supported by IR gen\n",
+                          expr->literal.type);
+            }
+            break;
+        case EXPR_VARIABLE: {
+            int slot = lookupLocal(gen, expr->variable.name);
+            if (slot >= 0) return emitLoadSlot(gen, slot);
+            if (isFunctionName(gen, expr->variable.name) &&
+                !isGlobalName(gen, expr->variable.name)) {
+                return emitAddrGlobal(gen, expr->variable.name);
+            }
+            int address = genAddress(gen, expr);
+            IrInstr* load = emit(gen, IR_LOAD, true, 1);
+            load->uses[0] = address;
+            return load->dst;
+        }
+        case EXPR_ASSIGNMENT: {
+            Expr target;
+            target.type = EXPR_VARIABLE;
+            target.variable.name = expr->assignment.name;
+            return genAssign(gen, &target, expr->assignment.value);
+        }
+        case EXPR_GROUPING:
+            panic("grouping expressions are folded by the parser\n");
+            break;
+        case EXPR_UNARY:
+            switch (expr->unary.op) {
+                case OP_REF:
+                    return genAddress(gen, expr->unary.right);
+                case OP_DEREF: {
+                    int address = genExpr(gen, expr->unary.right);
+                    IrInstr* load = emit(gen, IR_LOAD, true, 1);
+                    load->uses[0] = address;
+                    return load->dst;
+                }
+                default: {
+                    int operand = genExpr(gen, expr->unary.right);
+                    IrInstr* instr = emit(gen, IR_UNARY, true, 1);
+                    instr->op = expr->unary.op;
+                    instr->uses[0] = operand;
+                    return instr->dst;
+                }
+            }
+        case EXPR_BINARY:
+            switch (expr->binary.op) {
+                case OP_ASSIGN:
+                    return genAssign(gen, expr->binary.left,
+                                     expr->binary.right);
+                case OP_AND:
+                case OP_OR:
+                    return genLogical(gen, expr);
+                case OP_SUBSCRIPT: {
+                    int address = genAddress(gen, expr);
+                    IrInstr* load = emit(gen, IR_LOAD, true, 1);
+                    load->uses[0] = address;
+                    return load->dst;
+                }
+                case OP_AT: {
+                    // matrix multiply is a call into the runtime, see
+                    // runtime/scc.h
+                    int left = genExpr(gen, expr->binary.left);
+                    int right = genExpr(gen, expr->binary.right);
+                    IrInstr* call = emit(gen, IR_CALL, true, 2);
+                    call->name = makeString("scc_matmul", 10);
+                    call->uses[0] = left;
+                    call->uses[1] = right;
+                    return call->dst;
+                }
+                case OP_DOT:
+                    panic("operator %s is not supported by IR gen yet\n",
+                          OptoString(expr->binary.op));
+                    break;
+                default: {
+                    int left = genExpr(gen, expr->binary.left);
+                    int right = genExpr(gen, expr->binary.right);
+                    return emitBinary(gen, expr->binary.op, left, right);
+                }
+            }
+            break;
+        case EXPR_CALL: {
+            if (expr->call.callee->type != EXPR_VARIABLE) {
+                panic("indirect calls are not supported: %s\n",
+                      sprintExpr(expr));
+            }
+            String name = expr->call.callee->variable.name;
+            int sys = isFunctionName(gen, name) ? -1 : findSyscall(name);
+            if (sys >= 0 && expr->call.argcount != syscalls[sys].argCount) {
+                panic("%s takes %d arguments, not %d\n", syscalls[sys].name,
+                      syscalls[sys].argCount, expr->call.argcount);
+            }
+            int* args = irAlloc(ALLOC_IR, sizeof(int) * (expr->call.argcount + 1));
+            for (int i = 0; i < expr->call.argcount; i++) {
+                args[i] = genExpr(gen, expr->call.arguments[i]);
+            }
+            IrInstr* call = emit(gen, sys >= 0 ? IR_SYSCALL : IR_CALL, true,
+                                 expr->call.argcount);
+            call->name = name;
+            if (sys >= 0) call->imm = syscalls[sys].number;
+            for (int i = 0; i < expr->call.argcount; i++) {
+                call->uses[i] = args[i];
+            }
+            release(args);
+            return call->dst;
+        }
+    }
+    panic("unknown expression type %d\n", expr->type);
+    return -1;
+}
+
+static void genStmt(IrGen* gen, Stmt* stmt) {
+    switch (stmt->type) {
+        case STMT_EXPRESSION:
+            genExpr(gen, stmt->expr.expression);
+            break;
+        case STMT_BLOCK: {
+            int scope = gen->localCount;
+            for (int i = 0; i < stmt->block.count; i++) {
+                genStmt(gen, stmt->block.statements[i]);
+            }
+            gen->localCount = scope;
+            break;
+        }
+        case STMT_IF: {
+            IrBlock* thenBlock = newBlock(gen->fn);
+            IrBlock* elseBlock = newBlock(gen->fn);
+            IrBlock* end = stmt->ifStmt.elseBranch ? newBlock(gen->fn) : elseBlock;
+            emitBranch(gen, genExpr(gen, stmt->ifStmt.condition), thenBlock,
+                       elseBlock);
+            gen->block = thenBlock;
+            genStmt(gen, stmt->ifStmt.thenBranch);
+            emitJump(gen, end);
+            if (stmt->ifStmt.elseBranch) {
+                gen->block = elseBlock;
+                genStmt(gen, stmt->ifStmt.elseBranch);
+                emitJump(gen, end);
+            }
+            gen->block = end;
+            break;
+        }
+        case STMT_WHILE: {
+            IrBlock* header = newBlock(gen->fn);
+            IrBlock* body = newBlock(gen->fn);
+            IrBlock* exit = newBlock(gen->fn);
+            emitJump(gen, header);
+            gen->block = header;
+            emitBranch(gen, genExpr(gen, stmt->whileStmt.condition), body,
+                       exit);
+            gen->block = body;
+            genStmt(gen, stmt->whileStmt.body);
+            emitJump(gen, header);
+            gen->block = exit;
+            break;
+        }
+        case STMT_RETURN: {
+            if (stmt->returnStmt.value) {
+                int value = genExpr(gen, stmt->returnStmt.value);
+                emit(gen, IR_RET, false, 1)->uses[0] = value;
+            } else {
+                emit(gen, IR_RET, false, 0);
+            }
+            // anything after a return is unreachable
+            gen->block = newBlock(gen->fn);
+            break;
+        }
+        case STMT_DECL: {
+            Decl* decl = stmt->decl.decl;
+            if (decl->type != DECL_VARIABLE) {
+                panic("only variables can be declared inside a function\n");
+            }
+            int slot = newSlot(gen->fn, decl->variable.name);
+            if (decl->variable.initializer) {
+                emitStoreSlot(gen, slot,
+                              genExpr(gen, decl->variable.initializer));
+            }
+            declareLocal(gen, decl->variable.name, slot);
+            break;
+        }
+        default:
+            panic("unknown statement type %d\n", stmt->type);
+    }
+}
+
+static IrFunction* genFunction(IrGen* gen, Decl* decl) {
+    IrFunction* fn = irAlloc(ALLOC_IR, sizeof(IrFunction));
+    fn->name = decl->function.name;
+    fn->paramCount = decl->function.count;
+    gen->fn = fn;
+    gen->block = newBlock(fn);
+    gen->localCount = 0;
+    for (int i = 0; i < decl->function.count; i++) {
+        Param* param = decl->function.parameters[i];
+        int slot = newSlot(fn, param->name);
+        IrInstr* instr = emit(gen, IR_PARAM, true, 0);
+        instr->imm = i;
+        emitStoreSlot(gen, slot, instr->dst);
+        declareLocal(gen, param->name, slot);
+    }
+    genStmt(gen, decl->function.body);
+    // falling off the end returns 0
+    if (terminator(gen->block) == NULL) {
+        int zero = emitConst(gen, 0);
+        emit(gen, IR_RET, false, 1)->uses[0] = zero;
+    }
+    computeCFG(fn);
+    return fn;
+}
+
+static long constantInitializer(Expr* expr) {
+    if (expr->type == EXPR_LITERAL && expr->literal.type == TYPE_INT) {
+        return expr->literal.value.intVal;
+    }
+    if (expr->type == EXPR_UNARY && expr->unary.op == OP_NEG) {
+        return -constantInitializer(expr->unary.right);
+    }
+    panic("global initializer %s is not a constant, nor a call of pure functions that can be "
+          "evaluated at compile time\n",
+          sprintExpr(expr));
+    return 0;
+}
+
+IrProgram* genIR(Program* ast) { return genIRInContext(ast, NULL); }
+
+IrProgram* genIRInContext(Program* ast, IrContext* context) {
+    IrGen gen;
+    memset(&gen, 0, sizeof(IrGen));
+    gen.ast = ast;
+    gen.context = context;
+    gen.program = irAlloc(ALLOC_IR, sizeof(IrProgram));
+    gen.program->functions = irAlloc(ALLOC_IR, sizeof(IrFunction*) * (ast->count + 1));
+    for (int i = 0; i < ast->count; i++) {
+        Decl* decl = ast->declarations[i];
+        if (decl->type == DECL_FUNCTION) nameTableAdd(&gen.functions, decl->function.name, i);
+        if (decl->type != DECL_VARIABLE) continue;
+        IrGlobal* global = addGlobal(gen.program, decl->variable.name);
+        if (decl->variable.initializer) {
+            global->value = constantInitializer(decl->variable.initializer);
+        }
+    }
+    for (int i = 0; i < ast->count; i++) {
+        Decl* decl = ast->declarations[i];
+        if (decl->type != DECL_FUNCTION) continue;
+        IrFunction* fn = genFunction(&gen, decl);
+        nameTableAdd(&gen.program->functionIndex, fn->name, gen.program->functionCount);
+        gen.program->functions[gen.program->functionCount++] = fn;
+    }
+    release(gen.locals);
+    freeNameTable(&gen.functions);
+    return gen.program;
+}
+
+//---------------------- Printing ---------------------
+
+static void printSlot(IrFunction* fn, int slot) {
+    if (fn->slots[slot].name.length == 0) {
+        printf("$t%d", slot);
+    } else {
+        printf("$%s", fn->slots[slot].name.chars);
+    }
+}
+
+static void printInstr(IrFunction* fn, IrInstr* instr) {
+    printf("    ");
+    if (instr->dst >= 0) printf("v%d = ", instr->dst);
+    switch (instr->opcode) {
+        case IR_CONST:
+            printf("%ld", instr->imm);
+            break;
+        case IR_COPY:
+            printf("v%d", instr->uses[0]);
+            break;
+        case IR_PARAM:
+            printf("param %ld", instr->imm);
+            break;
+        case IR_BINARY:
+            printf("v%d %s v%d", instr->uses[0], OptoString(instr->op),
+                   instr->uses[1]);
+            break;
+        case IR_UNARY:
+            printf("%s v%d", OptoString(instr->op), instr->uses[0]);
+            break;
+        case IR_LOAD_SLOT:
+            printSlot(fn, instr->slot);
+            break;
+        case IR_STORE_SLOT:
+            printSlot(fn, instr->slot);
+            printf(" = v%d", instr->uses[0]);
+            break;
+        case IR_ADDR_SLOT:
+            printf("&");
+            printSlot(fn, instr->slot);
+            break;
+        case IR_ADDR_GLOBAL:
+            printf("&%s", instr->name.chars);
+            break;
+        case IR_LOAD:
+            printf("load v%d", instr->uses[0]);
+            break;
+        case IR_STORE:
+            printf("store v%d, v%d", instr->uses[0], instr->uses[1]);
+            break;
+        case IR_VLOAD:
+            printf("vload.%ld v%d", instr->imm, instr->uses[0]);
+            break;
+        case IR_VSTORE:
+            printf("vstore.%ld v%d, v%d", instr->imm, instr->uses[0],
+                   instr->uses[1]);
+            break;
+        case IR_VBINARY:
+            printf("v%d %s.%ld v%d", instr->uses[0], OptoString(instr->op),
+                   instr->imm, instr->uses[1]);
+            break;
+        case IR_VSPLAT:
+            printf("splat.%ld v%d", instr->imm, instr->uses[0]);
+            break;
+        case IR_CALL:
+        case IR_SYSCALL:
+            printf("%s %s(", instr->opcode == IR_CALL ? "call" : "syscall",
+                   instr->name.chars);
+            for (int i = 0; i < instr->usecount; i++) {
+                printf(i ? ", v%d" : "v%d", instr->uses[i]);
+            }
+            printf(")");
+            break;
+        case IR_JUMP:
+            printf("jump b%d", instr->target->id);
+            break;
+        case IR_BRANCH:
+            printf("br v%d, b%d, b%d", instr->uses[0], instr->target->id,
+                   instr->otherwise->id);
+            break;
+        case IR_RET:
+            printf("ret");
+            if (instr->usecount) printf(" v%d", instr->uses[0]);
+            break;
+        case IR_PHI:
+            printf("phi");
+            for (int i = 0; i < instr->usecount; i++) {
+                printf(i ? ", [v%d, b%d]" : " [v%d, b%d]", instr->uses[i],
+                       instr->sources[i]->id);
+            }
+            break;
+    }
+    printf("\n");
+}
+
+void printIrFunction(IrFunction* fn) {
+    printf("function %s(%d params):\n", fn->name.chars, fn->paramCount);
+    for (int b = 0; b < fn->blockCount; b++) {
+        IrBlock* block = fn->blocks[b];
+        printf("  b%d:\n", block->id);
+        for (int i = 0; i < block->count; i++) {
+            printInstr(fn, block->instrs[i]);
+        }
+    }
+}
+
+void printIrProgram(IrProgram* program) {
+    for (int i = 0; i < program->globalCount; i++) {
+        IrGlobal* global = &program->globals[i];
+        if (global->bytes.chars) {
+            printf("global %s = \"%s\"\n", global->name.chars,
+                   global->bytes.chars);
+        } else {
+            printf("global %s = %ld\n", global->name.chars, global->value);
+        }
+    }
+    for (int i = 0; i < program->functionCount; i++) {
+        printIrFunction(program->functions[i]);
+    }
+}
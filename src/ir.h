@@ -1,8 +1,157 @@
 #ifndef IR_H
 #define IR_H
 
+#include "ast.h"
 
+//---------------------- IR ----------------------------
+// Three-address code over an explicit control flow graph.
+// Every value is a 64-bit word held in a virtual register (vreg), and every
+// vreg is defined by exactly one instruction. Named variables live in stack
+// slots and are only reached through IR_LOAD_SLOT / IR_STORE_SLOT, so a slot
+// whose address is never taken can be reasoned about without alias analysis.
 
+typedef struct IrInstr IrInstr;
+typedef struct IrBlock IrBlock;
+typedef struct IrFunction IrFunction;
+typedef struct IrProgram IrProgram;
 
+typedef enum {
+    IR_CONST,        // dst = imm
+    IR_COPY,         // dst = uses[0]
+    IR_PARAM,        // dst = incoming argument #imm
+    IR_BINARY,       // dst = uses[0] op uses[1]
+    IR_UNARY,        // dst = op uses[0]
+    IR_LOAD_SLOT,    // dst = slot
+    IR_STORE_SLOT,   // slot = uses[0]
+    IR_ADDR_SLOT,    // dst = &slot
+    IR_ADDR_GLOBAL,  // dst = &name
+    IR_LOAD,         // dst = *uses[0]
+    IR_STORE,        // *uses[0] = uses[1]
+    IR_VLOAD,        // dst = imm consecutive words at *uses[0]
+    IR_VSTORE,       // imm consecutive words at *uses[0] = uses[1]
+    IR_VBINARY,      // dst = uses[0] op uses[1], lane by lane over imm lanes
+    IR_VSPLAT,       // dst = uses[0] in each of imm lanes
+    IR_CALL,         // dst = name(uses...)
+    IR_SYSCALL,      // dst = system call #imm(uses...), named name
+    IR_JUMP,         // goto target
+    IR_BRANCH,       // if uses[0] goto target else otherwise
+    IR_RET,          // return uses[0] (usecount may be 0)
+    IR_PHI,          // dst = uses[i] when control came from sources[i]
+} IrOpcode;
 
-#endif
\ No newline at end of file
+struct IrInstr {
+    IrOpcode opcode;
+    int dst;  // -1 if the instruction defines nothing
+    int* uses;
+    int usecount;
+    long imm;
+    Op op;
+    int slot;
+    String name;
+    IrBlock* target;
+    IrBlock* otherwise;
+    IrBlock** sources;  // IR_PHI: the predecessor of each use
+};
+
+struct IrBlock {
+    int id;
+    IrInstr** instrs;
+    int count;
+    int capacity;
+    // filled by computeCFG
+    IrBlock** preds;
+    int predCount;
+    IrBlock* succs[2];
+    int succCount;
+    int rpo;  // index in reverse postorder
+    // filled by computeDominators
+    IrBlock* idom;
+};
+
+typedef struct {
+    String name;
+    bool addressTaken;
+} IrSlot;
+
+struct IrFunction {
+    String name;
+    int paramCount;
+    IrBlock** blocks;  // blocks[0] is the entry
+    int blockCount;
+    int blockCapacity;
+    int nextBlockId;
+    IrSlot* slots;
+    int slotCount;
+    int slotCapacity;
+    int vregCount;
+};
+
+// a global word, or a string literal when bytes.chars != NULL
+typedef struct {
+    String name;
+    long value;
+    String bytes;
+} IrGlobal;
+
+struct IrProgram {
+    IrFunction** functions;
+    int functionCount;
+    IrGlobal* globals;
+    int globalCount;
+    int globalCapacity;
+    NameTable functionIndex;  // index of each function by name
+};
+
+// every IR node is allocated here, zero initialized, under the tag of
+// the subsystem that makes it
+#define irAlloc(tag, size) allocateZeroed(tag, 1, size)
+
+// the names of functions and globals defined elsewhere, as by the REPL's
+// earlier lines, kept by name so that looking one up does not get slower
+// as they grow
+typedef struct {
+    NameTable functions;
+    NameTable globals;
+} IrContext;
+
+void addIrContext(IrContext* context, Program* program);
+void freeIrContext(IrContext* context);
+
+IrProgram* genIR(Program* program);
+// lowers program where the declarations of context are visible but
+// defined elsewhere
+IrProgram* genIRInContext(Program* program, IrContext* context);
+
+IrFunction* findIrFunction(IrProgram* program, String name);
+// -1 if the program defines no function called name
+int irFunctionIndex(IrProgram* program, String name);
+
+IrBlock* newBlock(IrFunction* fn);
+IrInstr* newInstr(IrOpcode opcode, int dst, int usecount);
+IrInstr* cloneInstr(IrInstr* instr);
+int newVreg(IrFunction* fn);
+int newSlot(IrFunction* fn, String name);
+
+void appendInstr(IrBlock* block, IrInstr* instr);
+void insertInstr(IrBlock* block, int index, IrInstr* instr);
+void removeInstr(IrBlock* block, int index);
+IrInstr* terminator(IrBlock* block);
+void retarget(IrInstr* instr, IrBlock* from, IrBlock* to);
+
+bool isPure(IrInstr* instr);
+// what the instruction computes at run time, wrapping around as it does;
+// false, leaving value alone, where it traps instead: division by zero
+// and LONG_MIN / -1
+bool foldBinary(Op op, long a, long b, long* value);
+long foldUnary(Op op, long a);
+
+// vreg -> defining instruction, valid until the function is next modified
+IrInstr** buildDefMap(IrFunction* fn);
+
+void computeCFG(IrFunction* fn);
+void removeDeadCode(IrFunction* fn);
+
+void printIrProgram(IrProgram* program);
+void printIrFunction(IrFunction* fn);
+
+#endif
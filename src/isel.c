@@ -0,0 +1,948 @@
+//---------------------- Instruction Selection ---------
+#include "x86.h"
+
+const Reg argumentRegs[6] = {RDI, RSI, RDX, RCX, R8, R9};
+const Reg syscallRegs[6] = {RDI, RSI, RDX, R10, R8, R9};
+
+bool isCalleeSaved(Reg reg) {
+    return reg == RBX || reg == RBP || (reg >= R12 && reg <= R15);
+}
+
+RegClass regClass(MFunction* fn, int reg) { return fn->classes[reg]; }
+
+Cond invertCond(Cond cond) {
+    switch (cond) {
+        case COND_E:
+            return COND_NE;
+        case COND_NE:
+            return COND_E;
+        case COND_L:
+            return COND_GE;
+        case COND_LE:
+            return COND_G;
+        case COND_G:
+            return COND_LE;
+        default:
+            return COND_L;
+    }
+}
+
+int newMReg(MFunction* fn, RegClass cls) {
+    if (fn->regCount == fn->regCapacity) {
+        fn->regCapacity = fn->regCapacity ? fn->regCapacity * 2 : 64;
+        fn->classes =
+            reallocate(ALLOC_CODEGEN, fn->classes, sizeof(RegClass) * fn->regCapacity);
+    }
+    fn->classes[fn->regCount] = cls;
+    return fn->regCount++;
+}
+
+int newFrameSlot(MFunction* fn, int size) {
+    if (fn->frameSlotCount == fn->frameSlotCapacity) {
+        fn->frameSlotCapacity =
+            fn->frameSlotCapacity ? fn->frameSlotCapacity * 2 : 8;
+        fn->frameSlots =
+            reallocate(ALLOC_CODEGEN, fn->frameSlots, sizeof(int) * fn->frameSlotCapacity);
+    }
+    fn->frameSlots[fn->frameSlotCount] = size;
+    return fn->frameSlotCount++;
+}
+
+MInstr* newMInstr(MOpcode opcode) {
+    MInstr* instr = irAlloc(ALLOC_CODEGEN, sizeof(MInstr));
+    instr->opcode = opcode;
+    return instr;
+}
+
+void insertMInstr(MBlock* block, int index, MInstr* instr) {
+    if (block->count == block->capacity) {
+        block->capacity = block->capacity ? block->capacity * 2 : 8;
+        block->instrs =
+            reallocate(ALLOC_CODEGEN, block->instrs, sizeof(MInstr*) * block->capacity);
+    }
+    memmove(&block->instrs[index + 1], &block->instrs[index],
+            sizeof(MInstr*) * (block->count - index));
+    block->instrs[index] = instr;
+    block->count++;
+}
+
+void appendMInstr(MBlock* block, MInstr* instr) {
+    insertMInstr(block, block->count, instr);
+}
+
+void removeMInstr(MBlock* block, int index) {
+    memmove(&block->instrs[index], &block->instrs[index + 1],
+            sizeof(MInstr*) * (block->count - index - 1));
+    block->count--;
+}
+
+MOperand regOperand(int reg) {
+    MOperand operand = {0};
+    operand.kind = OPND_REG;
+    operand.reg = reg;
+    return operand;
+}
+
+MOperand immOperand(long imm) {
+    MOperand operand = {0};
+    operand.kind = OPND_IMM;
+    operand.imm = imm;
+    return operand;
+}
+
+MOperand memOperand(int base, int index, int scale, long disp) {
+    MOperand operand = {0};
+    operand.kind = OPND_MEM;
+    operand.reg = base;
+    operand.index = index;
+    operand.scale = scale;
+    operand.imm = disp;
+    return operand;
+}
+
+MOperand frameOperand(int slot) {
+    MOperand operand = {0};
+    operand.kind = OPND_FRAME;
+    operand.slot = slot;
+    return operand;
+}
+
+MOperand globalOperand(String name) {
+    MOperand operand = {0};
+    operand.kind = OPND_GLOBAL;
+    operand.name = name;
+    return operand;
+}
+
+MInstr* moveInstr(RegClass cls, MOperand dst, MOperand src) {
+    MInstr* instr = newMInstr(cls == CLASS_XMM ? M_VMOV : M_MOV);
+    instr->ops[0] = dst;
+    instr->ops[1] = src;
+    return instr;
+}
+
+static void addReg(int* regs, int* count, int reg) {
+    for (int i = 0; i < *count; i++) {
+        if (regs[i] == reg) return;
+    }
+    regs[(*count)++] = reg;
+}
+
+static bool sameRegs(MOperand* a, MOperand* b) {
+    return a->kind == OPND_REG && b->kind == OPND_REG && a->reg == b->reg;
+}
+
+void machineOperands(MInstr* instr, int* uses, int* useCount, int* defs,
+                     int* defCount) {
+    *useCount = 0;
+    *defCount = 0;
+    // registers forming an address are always read
+    for (int i = 0; i < 3; i++) {
+        MOperand* op = &instr->ops[i];
+        if (op->kind != OPND_MEM) continue;
+        addReg(uses, useCount, op->reg);
+        if (op->index >= 0) addReg(uses, useCount, op->index);
+    }
+    MOperand* ops = instr->ops;
+    switch (instr->opcode) {
+        case M_IMUL:
+            if (ops[2].kind != OPND_IMM) goto twoAddress;
+            // fall through
+        case M_MOV:
+        case M_LEA:
+        case M_SETCC:
+        case M_VMOV:
+        case M_VADD:
+        case M_VSUB:
+        case M_VSPLAT:
+            if (ops[0].kind == OPND_REG) addReg(defs, defCount, ops[0].reg);
+            for (int i = 1; i < 3; i++) {
+                if (ops[i].kind == OPND_REG) addReg(uses, useCount, ops[i].reg);
+            }
+            break;
+        case M_XOR:
+            if (sameRegs(&ops[0], &ops[1])) {
+                addReg(defs, defCount, ops[0].reg);
+                break;
+            }
+            // fall through
+        case M_ADD:
+        case M_SUB:
+        twoAddress:
+            if (ops[1].kind == OPND_REG) addReg(uses, useCount, ops[1].reg);
+            // fall through
+        case M_NEG:
+            if (ops[0].kind == OPND_REG) {
+                addReg(uses, useCount, ops[0].reg);
+                addReg(defs, defCount, ops[0].reg);
+            }
+            break;
+        case M_CQO:
+            addReg(uses, useCount, RAX);
+            addReg(defs, defCount, RDX);
+            break;
+        case M_IDIV:
+            addReg(uses, useCount, RAX);
+            addReg(uses, useCount, RDX);
+            if (ops[0].kind == OPND_REG) addReg(uses, useCount, ops[0].reg);
+            addReg(defs, defCount, RAX);
+            addReg(defs, defCount, RDX);
+            break;
+        case M_CMP:
+        case M_TEST:
+        case M_PUSH:
+            for (int i = 0; i < 2; i++) {
+                if (ops[i].kind == OPND_REG) addReg(uses, useCount, ops[i].reg);
+            }
+            break;
+        case M_TAILCALL:
+            for (int i = 0; i < instr->imm; i++) addReg(uses, useCount, argumentRegs[i]);
+            if (ops[0].kind == OPND_REG) addReg(uses, useCount, ops[0].reg);
+            break;
+        case M_CALL: {
+            for (int i = 0; i < instr->imm && i < 6; i++) {
+                addReg(uses, useCount, argumentRegs[i]);
+            }
+            if (ops[0].kind == OPND_REG) addReg(uses, useCount, ops[0].reg);
+            // everything the callee may clobber
+            for (int reg = 0; reg < REG_COUNT; reg++) {
+                if (reg != RSP && !isCalleeSaved(reg)) {
+                    addReg(defs, defCount, reg);
+                }
+            }
+            break;
+        }
+        case M_SYSCALL:
+            addReg(uses, useCount, RAX);
+            for (int i = 0; i < instr->imm; i++) addReg(uses, useCount, syscallRegs[i]);
+            // the return address and flags
+            addReg(defs, defCount, RAX);
+            addReg(defs, defCount, RCX);
+            addReg(defs, defCount, R11);
+            break;
+        case M_RET:
+            if (instr->imm) addReg(uses, useCount, RAX);
+            break;
+        case M_JMP:
+        case M_JCC:
+            break;
+    }
+}
+
+//---------------------- Selection ---------------------
+
+typedef struct {
+    IrProgram* program;
+    IrFunction* ir;
+    MFunction* fn;
+    MBlock* block;       // block receiving new instructions
+    IrBlock* irBlock;    // the block being selected
+    bool optimize;       // fold operands and keep variables in registers
+    IrInstr** defs;
+    int* useCounts;
+    int* regOf;          // IR vreg -> machine register
+    int* slotReg;        // IR slot -> register, or -1 when kept in the frame
+    int* slotFrame;      // IR slot -> frame slot
+    MBlock** blockOf;    // IR block id -> machine block
+    bool* fused;         // comparisons emitted by the branch using them
+} Selector;
+
+static bool isVectorDef(IrInstr* def) {
+    return def->opcode == IR_VLOAD || def->opcode == IR_VBINARY ||
+           def->opcode == IR_VSPLAT;
+}
+
+static int regFor(Selector* sel, int vreg) {
+    if (sel->regOf[vreg] < 0) {
+        IrInstr* def = sel->defs[vreg];
+        sel->regOf[vreg] = newMReg(
+            sel->fn, def && isVectorDef(def) ? CLASS_XMM : CLASS_GPR);
+    }
+    return sel->regOf[vreg];
+}
+
+static bool constantOf(Selector* sel, int vreg, long* value) {
+    IrInstr* def = sel->defs[vreg];
+    if (!sel->optimize || def == NULL || def->opcode != IR_CONST) return false;
+    *value = def->imm;
+    return true;
+}
+
+// constants that fit a sign extended 32 bit immediate
+static bool immediateOf(Selector* sel, int vreg, long* value) {
+    return constantOf(sel, vreg, value) && *value == (int)*value;
+}
+
+static MOperand reg(Selector* sel, int vreg) {
+    return regOperand(regFor(sel, vreg));
+}
+
+// register or immediate
+static MOperand operand(Selector* sel, int vreg) {
+    long value;
+    if (immediateOf(sel, vreg, &value)) return immOperand(value);
+    return reg(sel, vreg);
+}
+
+static MInstr* emit(Selector* sel, MOpcode opcode, MOperand a, MOperand b) {
+    MInstr* instr = newMInstr(opcode);
+    instr->ops[0] = a;
+    instr->ops[1] = b;
+    appendMInstr(sel->block, instr);
+    return instr;
+}
+
+static MOperand none() {
+    MOperand operand = {0};
+    return operand;
+}
+
+// memory operand for the word at vreg, folding `base + disp`,
+// `base + index * scale` and the addresses of slots and globals
+static MOperand address(Selector* sel, int vreg) {
+    IrInstr* def = sel->defs[vreg];
+    if (!sel->optimize || def == NULL) return memOperand(regFor(sel, vreg), -1, 0, 0);
+    if (def->opcode == IR_ADDR_SLOT) return frameOperand(sel->slotFrame[def->slot]);
+    if (def->opcode == IR_ADDR_GLOBAL) return globalOperand(def->name);
+    if (def->opcode != IR_BINARY || def->op != OP_ADD) {
+        return memOperand(regFor(sel, vreg), -1, 0, 0);
+    }
+    for (int side = 0; side < 2; side++) {
+        int base = def->uses[side], other = def->uses[1 - side];
+        long value;
+        if (immediateOf(sel, other, &value)) {
+            return memOperand(regFor(sel, base), -1, 0, value);
+        }
+        IrInstr* mul = sel->defs[other];
+        if (mul && mul->opcode == IR_BINARY && mul->op == OP_MUL &&
+            constantOf(sel, mul->uses[1], &value) &&
+            (value == 1 || value == 2 || value == 4 || value == 8)) {
+            return memOperand(regFor(sel, base), regFor(sel, mul->uses[0]),
+                              value, 0);
+        }
+    }
+    return memOperand(regFor(sel, def->uses[0]), regFor(sel, def->uses[1]), 1,
+                      0);
+}
+
+static bool isComparison(Op op) {
+    switch (op) {
+        case OP_EQ:
+        case OP_NEQ:
+        case OP_LT:
+        case OP_LTE:
+        case OP_GT:
+        case OP_GTE:
+            return true;
+        default:
+            return false;
+    }
+}
+
+static Cond condOf(Op op) {
+    switch (op) {
+        case OP_EQ:
+            return COND_E;
+        case OP_NEQ:
+            return COND_NE;
+        case OP_LT:
+            return COND_L;
+        case OP_LTE:
+            return COND_LE;
+        case OP_GT:
+            return COND_G;
+        default:
+            return COND_GE;
+    }
+}
+
+// condition holding with the operands swapped
+static Cond mirror(Cond cond) {
+    switch (cond) {
+        case COND_L:
+            return COND_G;
+        case COND_LE:
+            return COND_GE;
+        case COND_G:
+            return COND_L;
+        case COND_GE:
+            return COND_LE;
+        default:
+            return cond;
+    }
+}
+
+static Cond selectCompare(Selector* sel, IrInstr* instr) {
+    Cond cond = condOf(instr->op);
+    MOperand left = operand(sel, instr->uses[0]);
+    MOperand right = operand(sel, instr->uses[1]);
+    if (left.kind == OPND_IMM && right.kind != OPND_IMM) {
+        MOperand swap = left;
+        left = right;
+        right = swap;
+        cond = mirror(cond);
+    } else if (left.kind == OPND_IMM) {
+        left = reg(sel, instr->uses[0]);
+    }
+    emit(sel, M_CMP, left, right);
+    return cond;
+}
+
+static void selectBinary(Selector* sel, IrInstr* instr) {
+    MOperand dst = reg(sel, instr->dst);
+    int a = instr->uses[0], b = instr->uses[1];
+    long value;
+    if (isComparison(instr->op)) {
+        if (sel->fused[instr->dst]) return;
+        Cond cond = selectCompare(sel, instr);
+        emit(sel, M_SETCC, dst, none())->cond = cond;
+        return;
+    }
+    switch (instr->op) {
+        case OP_ADD:
+            if (sel->optimize) {
+                // lea adds without tying the result to an operand
+                if (immediateOf(sel, b, &value)) {
+                    emit(sel, M_LEA, dst, memOperand(regFor(sel, a), -1, 0, value));
+                } else if (immediateOf(sel, a, &value)) {
+                    emit(sel, M_LEA, dst, memOperand(regFor(sel, b), -1, 0, value));
+                } else {
+                    emit(sel, M_LEA, dst,
+                         memOperand(regFor(sel, a), regFor(sel, b), 1, 0));
+                }
+                return;
+            }
+            emit(sel, M_MOV, dst, reg(sel, a));
+            emit(sel, M_ADD, dst, reg(sel, b));
+            return;
+        case OP_SUB:
+            if (immediateOf(sel, b, &value) && -value == (int)-value) {
+                emit(sel, M_LEA, dst, memOperand(regFor(sel, a), -1, 0, -value));
+                return;
+            }
+            emit(sel, M_MOV, dst, operand(sel, a));
+            emit(sel, M_SUB, dst, reg(sel, b));
+            return;
+        case OP_MUL:
+            for (int side = 0; side < 2; side++) {
+                if (immediateOf(sel, instr->uses[1 - side], &value)) {
+                    MInstr* mul =
+                        emit(sel, M_IMUL, dst, reg(sel, instr->uses[side]));
+                    mul->ops[2] = immOperand(value);
+                    return;
+                }
+            }
+            emit(sel, M_MOV, dst, reg(sel, a));
+            emit(sel, M_IMUL, dst, reg(sel, b));
+            return;
+        case OP_DIV:
+            emit(sel, M_MOV, regOperand(RAX), operand(sel, a));
+            emit(sel, M_CQO, none(), none());
+            emit(sel, M_IDIV, reg(sel, b), none());
+            emit(sel, M_MOV, dst, regOperand(RAX));
+            return;
+        default:
+            panic("operator %s has no x86-64 lowering\n", OptoString(instr->op));
+    }
+}
+
+// variadic callees read the number of vector arguments from al, and only
+// functions of the program are known not to be variadic
+static void passVectorCount(Selector* sel, MInstr* call) {
+    if (findIrFunction(sel->program, call->name) == NULL) {
+        emit(sel, M_MOV, regOperand(RAX), immOperand(0));
+        call->ops[0] = regOperand(RAX);
+    }
+}
+
+static void selectCall(Selector* sel, IrInstr* instr) {
+    int stackArgs = instr->usecount > 6 ? instr->usecount - 6 : 0;
+    int padding = stackArgs % 2 ? 8 : 0;
+    if (padding) emit(sel, M_SUB, regOperand(RSP), immOperand(padding));
+    for (int i = instr->usecount - 1; i >= 6; i--) {
+        emit(sel, M_PUSH, operand(sel, instr->uses[i]), none());
+    }
+    for (int i = 0; i < instr->usecount && i < 6; i++) {
+        emit(sel, M_MOV, regOperand(argumentRegs[i]),
+             operand(sel, instr->uses[i]));
+    }
+    MInstr* call = newMInstr(M_CALL);
+    call->name = instr->name;
+    call->imm = instr->usecount < 6 ? instr->usecount : 6;
+    passVectorCount(sel, call);
+    appendMInstr(sel->block, call);
+    sel->fn->hasCalls = true;
+    if (stackArgs) {
+        emit(sel, M_ADD, regOperand(RSP), immOperand(8 * stackArgs + padding));
+    }
+    emit(sel, M_MOV, reg(sel, instr->dst), regOperand(RAX));
+}
+
+// the kernel preserves every register but rax, rcx and r11, so unlike a
+// call this leaves the caller's values where they are
+static void selectSyscall(Selector* sel, IrInstr* instr) {
+    for (int i = 0; i < instr->usecount; i++) {
+        emit(sel, M_MOV, regOperand(syscallRegs[i]),
+             operand(sel, instr->uses[i]));
+    }
+    emit(sel, M_MOV, regOperand(RAX), immOperand(instr->imm));
+    MInstr* syscall = emit(sel, M_SYSCALL, none(), none());
+    syscall->imm = instr->usecount;
+    emit(sel, M_MOV, reg(sel, instr->dst), regOperand(RAX));
+}
+
+// is block->instrs[i] a call whose result is returned at once, with all
+// arguments in registers? the frame is gone by the time the callee runs,
+// so no pointer into it may have been made.
+static bool isTailCall(Selector* sel, IrBlock* block, int i) {
+    IrInstr* call = block->instrs[i];
+    if (call->opcode != IR_CALL || call->usecount > 6 || i + 2 != block->count) {
+        return false;
+    }
+    IrInstr* ret = block->instrs[i + 1];
+    if (ret->opcode != IR_RET || ret->usecount != 1 || ret->uses[0] != call->dst) {
+        return false;
+    }
+    for (int s = 0; s < sel->ir->slotCount; s++) {
+        if (sel->ir->slots[s].addressTaken) return false;
+    }
+    return true;
+}
+
+// `return f(...)` leaves through the epilogue and a jump to f, which
+// returns straight to our caller
+static void selectTailCall(Selector* sel, IrInstr* instr) {
+    for (int i = 0; i < instr->usecount; i++) {
+        emit(sel, M_MOV, regOperand(argumentRegs[i]), operand(sel, instr->uses[i]));
+    }
+    MInstr* jump = newMInstr(M_TAILCALL);
+    jump->name = instr->name;
+    jump->imm = instr->usecount;
+    passVectorCount(sel, jump);
+    appendMInstr(sel->block, jump);
+}
+
+static void selectVector(Selector* sel, IrInstr* instr) {
+    long bytes = instr->imm * 8;
+    if (bytes == 32) sel->fn->usesYmm = true;
+    MInstr* out = NULL;
+    switch (instr->opcode) {
+        case IR_VLOAD:
+            out = emit(sel, M_VMOV, reg(sel, instr->dst),
+                       address(sel, instr->uses[0]));
+            break;
+        case IR_VSTORE:
+            out = emit(sel, M_VMOV, address(sel, instr->uses[0]),
+                       reg(sel, instr->uses[1]));
+            break;
+        case IR_VSPLAT:
+            out = emit(sel, M_VSPLAT, reg(sel, instr->dst),
+                       reg(sel, instr->uses[0]));
+            break;
+        case IR_VBINARY: {
+            MOpcode opcode = instr->op == OP_ADD ? M_VADD : M_VSUB;
+            MOperand dst = reg(sel, instr->dst);
+            MOperand left = reg(sel, instr->uses[0]);
+            if (bytes == 16 && !sel->fn->usesYmm) {
+                // SSE2 arithmetic overwrites its first operand
+                emit(sel, M_VMOV, dst, left)->imm = bytes;
+                left = dst;
+            }
+            out = emit(sel, opcode, dst, left);
+            out->ops[2] = reg(sel, instr->uses[1]);
+            break;
+        }
+        default:
+            break;
+    }
+    out->imm = bytes;
+}
+
+// on the way into a block, each of its phis takes the value coming from
+// this block. the moves happen at once in effect: a move waits while its
+// destination is still to be read, and a cycle of them is broken by
+// saving one destination in a fresh register.
+static void phiMoves(Selector* sel, IrBlock* target) {
+    int count = 0;
+    while (count < target->count && target->instrs[count]->opcode == IR_PHI) count++;
+    if (count == 0) return;
+    int* dsts = irAlloc(ALLOC_CODEGEN, sizeof(int) * count);
+    MOperand* srcs = irAlloc(ALLOC_CODEGEN, sizeof(MOperand) * count);
+    for (int i = 0; i < count; i++) {
+        IrInstr* phi = target->instrs[i];
+        int value = -1;
+        for (int u = 0; u < phi->usecount; u++) {
+            if (phi->sources[u] == sel->irBlock) value = phi->uses[u];
+        }
+        if (value < 0) {
+            panic("phi v%d has no value from b%d\n", phi->dst, sel->irBlock->id);
+        }
+        dsts[i] = regFor(sel, phi->dst);
+        srcs[i] = operand(sel, value);
+    }
+    int pending = count;
+    while (pending > 0) {
+        int ready = -1;
+        for (int i = 0; i < count && ready < 0; i++) {
+            if (dsts[i] < 0) continue;
+            bool read = false;
+            for (int j = 0; j < count; j++) {
+                read |= j != i && dsts[j] >= 0 && srcs[j].kind == OPND_REG &&
+                        srcs[j].reg == dsts[i];
+            }
+            if (!read) ready = i;
+        }
+        if (ready < 0) {
+            for (ready = 0; dsts[ready] < 0; ready++) {
+            }
+            int saved = newMReg(sel->fn, CLASS_GPR);
+            emit(sel, M_MOV, regOperand(saved), regOperand(dsts[ready]));
+            for (int j = 0; j < count; j++) {
+                if (srcs[j].kind == OPND_REG && srcs[j].reg == dsts[ready]) {
+                    srcs[j] = regOperand(saved);
+                }
+            }
+        }
+        if (srcs[ready].kind != OPND_REG || srcs[ready].reg != dsts[ready]) {
+            emit(sel, M_MOV, regOperand(dsts[ready]), srcs[ready]);
+        }
+        dsts[ready] = -1;
+        pending--;
+    }
+    release(dsts);
+    release(srcs);
+}
+
+static void selectInstr(Selector* sel, IrInstr* instr) {
+    switch (instr->opcode) {
+        case IR_CONST:
+            emit(sel, M_MOV, reg(sel, instr->dst), immOperand(instr->imm));
+            break;
+        case IR_COPY: {
+            RegClass cls = regClass(sel->fn, regFor(sel, instr->uses[0]));
+            MInstr* copy = moveInstr(cls, reg(sel, instr->dst),
+                                     reg(sel, instr->uses[0]));
+            copy->imm = sel->fn->usesYmm ? 32 : 16;
+            appendMInstr(sel->block, copy);
+            break;
+        }
+        case IR_PARAM:
+            if (instr->imm < 6) {
+                emit(sel, M_MOV, reg(sel, instr->dst),
+                     regOperand(argumentRegs[instr->imm]));
+            } else {
+                // above the return address and the saved frame pointer
+                emit(sel, M_MOV, reg(sel, instr->dst),
+                     memOperand(RBP, -1, 0, 16 + 8 * (instr->imm - 6)));
+            }
+            break;
+        case IR_BINARY:
+            selectBinary(sel, instr);
+            break;
+        case IR_UNARY:
+            if (instr->op == OP_NEG) {
+                emit(sel, M_MOV, reg(sel, instr->dst), reg(sel, instr->uses[0]));
+                emit(sel, M_NEG, reg(sel, instr->dst), none());
+            } else if (instr->op == OP_NOT) {
+                emit(sel, M_TEST, reg(sel, instr->uses[0]),
+                     reg(sel, instr->uses[0]));
+                emit(sel, M_SETCC, reg(sel, instr->dst), none())->cond = COND_E;
+            } else {
+                panic("operator %s has no x86-64 lowering\n",
+                      OptoString(instr->op));
+            }
+            break;
+        case IR_LOAD_SLOT: {
+            int slot = instr->slot;
+            emit(sel, M_MOV, reg(sel, instr->dst),
+                 sel->slotReg[slot] >= 0 ? regOperand(sel->slotReg[slot])
+                                         : frameOperand(sel->slotFrame[slot]));
+            break;
+        }
+        case IR_STORE_SLOT: {
+            int slot = instr->slot;
+            emit(sel, M_MOV,
+                 sel->slotReg[slot] >= 0 ? regOperand(sel->slotReg[slot])
+                                         : frameOperand(sel->slotFrame[slot]),
+                 operand(sel, instr->uses[0]));
+            break;
+        }
+        case IR_ADDR_SLOT:
+            emit(sel, M_LEA, reg(sel, instr->dst),
+                 frameOperand(sel->slotFrame[instr->slot]));
+            break;
+        case IR_ADDR_GLOBAL:
+            emit(sel, M_LEA, reg(sel, instr->dst), globalOperand(instr->name));
+            break;
+        case IR_LOAD:
+            emit(sel, M_MOV, reg(sel, instr->dst), address(sel, instr->uses[0]));
+            break;
+        case IR_STORE:
+            emit(sel, M_MOV, address(sel, instr->uses[0]),
+                 operand(sel, instr->uses[1]));
+            break;
+        case IR_VLOAD:
+        case IR_VSTORE:
+        case IR_VBINARY:
+        case IR_VSPLAT:
+            selectVector(sel, instr);
+            break;
+        case IR_CALL:
+            selectCall(sel, instr);
+            break;
+        case IR_SYSCALL:
+            selectSyscall(sel, instr);
+            break;
+        case IR_PHI:
+            // the predecessors write the phi's register, see phiMoves
+            break;
+        case IR_JUMP: {
+            phiMoves(sel, instr->target);
+            MInstr* jump = emit(sel, M_JMP, none(), none());
+            jump->target = sel->blockOf[instr->target->id];
+            break;
+        }
+        case IR_BRANCH: {
+            IrInstr* def = sel->defs[instr->uses[0]];
+            MInstr* jump = newMInstr(M_JCC);
+            if (sel->fused[instr->uses[0]]) {
+                jump->cond = selectCompare(sel, def);
+            } else {
+                emit(sel, M_TEST, reg(sel, instr->uses[0]),
+                     reg(sel, instr->uses[0]));
+                jump->cond = COND_NE;
+            }
+            jump->target = sel->blockOf[instr->target->id];
+            appendMInstr(sel->block, jump);
+            emit(sel, M_JMP, none(), none())->target =
+                sel->blockOf[instr->otherwise->id];
+            break;
+        }
+        case IR_RET: {
+            MInstr* ret = newMInstr(M_RET);
+            if (instr->usecount) {
+                emit(sel, M_MOV, regOperand(RAX), operand(sel, instr->uses[0]));
+                ret->imm = 1;
+            }
+            appendMInstr(sel->block, ret);
+            break;
+        }
+    }
+}
+
+// give every edge from a block with two successors into a block with
+// several predecessors a block of its own, so that the register allocator
+// has a place for the moves of that edge
+static void splitCriticalEdges(IrFunction* fn) {
+    int count = fn->blockCount;
+    for (int b = 0; b < count; b++) {
+        IrBlock* block = fn->blocks[b];
+        if (block->succCount < 2) continue;
+        for (int s = 0; s < block->succCount; s++) {
+            IrBlock* succ = block->succs[s];
+            if (succ->predCount < 2) continue;
+            IrBlock* edge = newBlock(fn);
+            IrInstr* jump = newInstr(IR_JUMP, -1, 0);
+            jump->target = succ;
+            appendInstr(edge, jump);
+            retarget(terminator(block), succ, edge);
+            for (int i = 0; i < succ->count && succ->instrs[i]->opcode == IR_PHI; i++) {
+                IrInstr* phi = succ->instrs[i];
+                for (int u = 0; u < phi->usecount; u++) {
+                    if (phi->sources[u] == block) phi->sources[u] = edge;
+                }
+            }
+        }
+    }
+    computeCFG(fn);
+}
+
+// comparisons only used by the branch ending their block set the flags
+// for that branch directly
+static void findFusedCompares(Selector* sel) {
+    for (int b = 0; b < sel->ir->blockCount && sel->optimize; b++) {
+        IrBlock* block = sel->ir->blocks[b];
+        IrInstr* branch = terminator(block);
+        if (branch->opcode != IR_BRANCH) continue;
+        int cond = branch->uses[0];
+        for (int i = 0; i < block->count - 1; i++) {
+            IrInstr* instr = block->instrs[i];
+            if (instr->dst == cond && instr->opcode == IR_BINARY &&
+                isComparison(instr->op) && sel->useCounts[cond] == 1) {
+                sel->fused[cond] = true;
+            }
+        }
+    }
+}
+
+static void replaceUses(MInstr* instr, int from, int to) {
+    int uses[REG_COUNT + 8], defs[REG_COUNT + 8], useCount, defCount;
+    machineOperands(instr, uses, &useCount, defs, &defCount);
+    for (int k = 0; k < 3; k++) {
+        MOperand* op = &instr->ops[k];
+        bool written = false;
+        for (int d = 0; d < defCount; d++) {
+            written |= op->kind == OPND_REG && defs[d] == op->reg;
+        }
+        if (op->kind == OPND_MEM || (op->kind == OPND_REG && !written)) {
+            if (op->reg == from) op->reg = to;
+        }
+        if (op->kind == OPND_MEM && op->index == from) op->index = to;
+    }
+}
+
+// reading a variable copies its register into a fresh one; later reads in
+// the same block use the variable directly while it is unchanged, which
+// usually leaves the copy dead
+static void propagateCopies(MFunction* fn) {
+    int* defCounts = irAlloc(ALLOC_CODEGEN, sizeof(int) * fn->regCount);
+    int uses[REG_COUNT + 8], defs[REG_COUNT + 8], useCount, defCount;
+    for (int b = 0; b < fn->blockCount; b++) {
+        MBlock* block = fn->blocks[b];
+        for (int i = 0; i < block->count; i++) {
+            machineOperands(block->instrs[i], uses, &useCount, defs, &defCount);
+            for (int d = 0; d < defCount; d++) defCounts[defs[d]]++;
+        }
+    }
+    for (int b = 0; b < fn->blockCount; b++) {
+        MBlock* block = fn->blocks[b];
+        for (int i = 0; i < block->count; i++) {
+            MInstr* copy = block->instrs[i];
+            if (copy->opcode != M_MOV || copy->ops[0].kind != OPND_REG ||
+                copy->ops[1].kind != OPND_REG) {
+                continue;
+            }
+            int dst = copy->ops[0].reg, src = copy->ops[1].reg;
+            if (!IS_VIRTUAL(dst) || !IS_VIRTUAL(src) || defCounts[dst] != 1) {
+                continue;
+            }
+            for (int j = i + 1; j < block->count; j++) {
+                MInstr* instr = block->instrs[j];
+                machineOperands(instr, uses, &useCount, defs, &defCount);
+                bool redefined = false;
+                for (int d = 0; d < defCount; d++) {
+                    redefined |= defs[d] == src || defs[d] == dst;
+                }
+                // a two-address instruction reads what it overwrites
+                if (!redefined) replaceUses(instr, dst, src);
+                if (redefined) break;
+            }
+        }
+    }
+    release(defCounts);
+}
+
+static MFunction* selectFunction(IrProgram* program, IrFunction* ir,
+                                 int optLevel) {
+    splitCriticalEdges(ir);
+    MFunction* fn = irAlloc(ALLOC_CODEGEN, sizeof(MFunction));
+    fn->name = ir->name;
+    fn->paramCount = ir->paramCount;
+    for (int reg = 0; reg < REG_COUNT; reg++) {
+        newMReg(fn, reg >= XMM0 ? CLASS_XMM : CLASS_GPR);
+    }
+    Selector sel;
+    memset(&sel, 0, sizeof(Selector));
+    sel.program = program;
+    sel.ir = ir;
+    sel.fn = fn;
+    sel.optimize = optLevel > 0;
+    sel.defs = buildDefMap(ir);
+    sel.useCounts = irAlloc(ALLOC_CODEGEN, sizeof(int) * (ir->vregCount + 1));
+    sel.fused = irAlloc(ALLOC_CODEGEN, sizeof(bool) * (ir->vregCount + 1));
+    sel.regOf = irAlloc(ALLOC_CODEGEN, sizeof(int) * (ir->vregCount + 1));
+    for (int v = 0; v < ir->vregCount; v++) sel.regOf[v] = -1;
+    sel.slotReg = irAlloc(ALLOC_CODEGEN, sizeof(int) * (ir->slotCount + 1));
+    sel.slotFrame = irAlloc(ALLOC_CODEGEN, sizeof(int) * (ir->slotCount + 1));
+    for (int s = 0; s < ir->slotCount; s++) {
+        // variables whose address is never taken live in registers
+        bool promote = sel.optimize && !ir->slots[s].addressTaken;
+        sel.slotReg[s] = promote ? newMReg(fn, CLASS_GPR) : -1;
+        sel.slotFrame[s] = promote ? -1 : newFrameSlot(fn, 8);
+    }
+    for (int b = 0; b < ir->blockCount; b++) {
+        IrBlock* block = ir->blocks[b];
+        for (int i = 0; i < block->count; i++) {
+            for (int u = 0; u < block->instrs[i]->usecount; u++) {
+                sel.useCounts[block->instrs[i]->uses[u]]++;
+            }
+        }
+    }
+    findFusedCompares(&sel);
+
+    sel.blockOf = irAlloc(ALLOC_CODEGEN, sizeof(MBlock*) * (ir->nextBlockId + 1));
+    fn->blocks = irAlloc(ALLOC_CODEGEN, sizeof(MBlock*) * (ir->blockCount + 1));
+    fn->blockCount = ir->blockCount;
+    for (int b = 0; b < ir->blockCount; b++) {
+        MBlock* block = irAlloc(ALLOC_CODEGEN, sizeof(MBlock));
+        block->id = b;
+        fn->blocks[b] = block;
+        sel.blockOf[ir->blocks[b]->id] = block;
+    }
+    for (int b = 0; b < ir->blockCount; b++) {
+        IrBlock* irBlock = ir->blocks[b];
+        MBlock* block = fn->blocks[b];
+        block->succCount = irBlock->succCount;
+        for (int s = 0; s < irBlock->succCount; s++) {
+            block->succs[s] = sel.blockOf[irBlock->succs[s]->id];
+        }
+        block->predCount = irBlock->predCount;
+        block->preds = irAlloc(ALLOC_CODEGEN, sizeof(MBlock*) * (irBlock->predCount + 1));
+        for (int p = 0; p < irBlock->predCount; p++) {
+            block->preds[p] = sel.blockOf[irBlock->preds[p]->id];
+        }
+        sel.block = block;
+        sel.irBlock = irBlock;
+        for (int i = 0; i < irBlock->count; i++) {
+            if (sel.optimize && isTailCall(&sel, irBlock, i)) {
+                selectTailCall(&sel, irBlock->instrs[i]);
+                break;
+            }
+            selectInstr(&sel, irBlock->instrs[i]);
+        }
+    }
+    if (sel.optimize) propagateCopies(fn);
+    release(sel.defs);
+    release(sel.useCounts);
+    release(sel.fused);
+    release(sel.regOf);
+    release(sel.slotReg);
+    release(sel.slotFrame);
+    release(sel.blockOf);
+    return fn;
+}
+
+MProgram* selectInstructions(IrProgram* program, int optLevel) {
+    MProgram* machine = irAlloc(ALLOC_CODEGEN, sizeof(MProgram));
+    machine->ir = program;
+    machine->functionCount = program->functionCount;
+    machine->functions =
+        irAlloc(ALLOC_CODEGEN, sizeof(MFunction*) * (program->functionCount + 1));
+    for (int i = 0; i < program->functionCount; i++) {
+        machine->functions[i] =
+            selectFunction(program, program->functions[i], optLevel);
+    }
+    return machine;
+}
+
+MFunction* genMachineFunction(IrProgram* program, IrFunction* fn, int optLevel) {
+    MFunction* machine = selectFunction(program, fn, optLevel);
+    if (optLevel > 0) {
+        allocateRegisters(machine);
+        peephole(machine);
+    } else {
+        spillEverything(machine);
+    }
+    return machine;
+}
+
+MProgram* genMachineCode(IrProgram* program, int optLevel) {
+    MProgram* machine = irAlloc(ALLOC_CODEGEN, sizeof(MProgram));
+    machine->ir = program;
+    machine->functionCount = program->functionCount;
+    machine->functions = irAlloc(ALLOC_CODEGEN, sizeof(MFunction*) * (program->functionCount + 1));
+    for (int i = 0; i < program->functionCount; i++) {
+        machine->functions[i] = genMachineFunction(program, program->functions[i], optLevel);
+    }
+    return machine;
+}
@@ -0,0 +1,201 @@
+//---------------------- JIT ---------------------------
+// Memory comes from one reservation so that rel32 displacements reach
+// between any two loaded programs. Each program gets its own pages:
+// code is copied and relocated while the pages are writable and only
+// then made executable. Calls to a global symbol go to a stub after the
+// code, `jmp *cell(%rip)`, with the cells on pages that stay writable
+// and never executable.
+#define _GNU_SOURCE
+#include <dlfcn.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "jit.h"
+
+#define JIT_RESERVE (1L << 30)
+#define STUB_SIZE 8
+
+typedef struct {
+    String name;
+    void* address;  // NULL until defined
+    void** cell;    // NULL until called
+} JitSymbol;
+
+struct Jit {
+    unsigned char* base;
+    long used;  // bytes of the reservation handed out
+    long pageSize;
+    void** cells;  // free cells on the current page
+    int cellsLeft;
+    JitSymbol* symbols;
+    int symbolCount;
+    int symbolCapacity;
+    NameTable symbolIndex;  // index into symbols by name
+};
+
+Jit* newJit(void) {
+    Jit* jit = allocateZeroed(ALLOC_JIT, 1, sizeof(Jit));
+    jit->pageSize = sysconf(_SC_PAGESIZE);
+    jit->base = mmap(NULL, JIT_RESERVE, PROT_NONE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (jit->base == MAP_FAILED) {
+        panic("could not reserve JIT memory\n");
+    }
+    return jit;
+}
+
+void freeJit(Jit* jit) {
+    munmap(jit->base, JIT_RESERVE);
+    for (int i = 0; i < jit->symbolCount; i++) release(jit->symbols[i].name.chars);
+    release(jit->symbols);
+    freeNameTable(&jit->symbolIndex);
+    release(jit);
+}
+
+static JitSymbol* findSymbol(Jit* jit, String name) {
+    int index = nameTableFind(&jit->symbolIndex, name);
+    return index < 0 ? NULL : &jit->symbols[index];
+}
+
+static JitSymbol* internSymbol(Jit* jit, String name) {
+    JitSymbol* symbol = findSymbol(jit, name);
+    if (symbol) return symbol;
+    if (jit->symbolCount == jit->symbolCapacity) {
+        jit->symbolCapacity = jit->symbolCapacity ? jit->symbolCapacity * 2 : 16;
+        jit->symbols = reallocate(ALLOC_JIT, jit->symbols, sizeof(JitSymbol) * jit->symbolCapacity);
+    }
+    symbol = &jit->symbols[jit->symbolCount++];
+    symbol->name = makeString(name.chars, name.length);
+    symbol->address = NULL;
+    symbol->cell = NULL;
+    nameTableAdd(&jit->symbolIndex, symbol->name, jit->symbolCount - 1);
+    return symbol;
+}
+
+void* jitLookup(Jit* jit, String name) {
+    JitSymbol* symbol = findSymbol(jit, name);
+    return symbol ? symbol->address : NULL;
+}
+
+static void protect(void* start, long size, int protection) {
+    if (mprotect(start, size, protection) != 0) {
+        panic("could not protect JIT memory\n");
+    }
+}
+
+// fresh writable pages for size bytes
+static unsigned char* carve(Jit* jit, long size) {
+    size = (size + jit->pageSize - 1) / jit->pageSize * jit->pageSize;
+    if (jit->used + size > JIT_RESERVE) {
+        panic("JIT memory exhausted\n");
+    }
+    unsigned char* start = jit->base + jit->used;
+    jit->used += size;
+    protect(start, size, PROT_READ | PROT_WRITE);
+    return start;
+}
+
+static void** cellOf(Jit* jit, JitSymbol* symbol) {
+    if (symbol->cell) return symbol->cell;
+    if (jit->cellsLeft == 0) {
+        jit->cells = (void**)carve(jit, jit->pageSize);
+        jit->cellsLeft = jit->pageSize / sizeof(void*);
+    }
+    symbol->cell = jit->cells++;
+    jit->cellsLeft--;
+    *symbol->cell = symbol->address;
+    return symbol->cell;
+}
+
+static void patch32(unsigned char* at, long value, String name) {
+    if (value != (int)value) {
+        panic("%s is out of reach of a rel32 displacement\n", name.chars);
+    }
+    int field = value;
+    memcpy(at, &field, 4);
+}
+
+void jitLoad(Jit* jit, MProgram* program) {
+    ObjectFile object;
+    memset(&object, 0, sizeof(ObjectFile));
+    encodeProgram(program, &object);
+
+    // where each symbol of the object is, resolving undefined ones against
+    // earlier programs and then the process
+    void** addresses = allocateZeroed(ALLOC_JIT, object.symbolCount + 1, sizeof(void*));
+    for (int i = 0; i < object.symbolCount; i++) {
+        Symbol* symbol = &object.symbols[i];
+        if (symbol->section >= 0) continue;
+        JitSymbol* known = findSymbol(jit, symbol->name);
+        addresses[i] = known && known->address ? known->address
+                                               : dlsym(RTLD_DEFAULT, symbol->name.chars);
+        if (addresses[i] == NULL) {
+            panic("undefined symbol %s\n", symbol->name.chars);
+        }
+    }
+
+    // a stub per called global symbol after the code
+    int* stubs = allocate(ALLOC_JIT, sizeof(int) * (object.symbolCount + 1));
+    for (int i = 0; i < object.symbolCount; i++) stubs[i] = -1;
+    int stubCount = 0;
+    for (int i = 0; i < object.relocationCount; i++) {
+        Relocation* relocation = &object.relocations[i];
+        if (relocation->type == RELOC_PLT32 && object.symbols[relocation->symbol].global &&
+            stubs[relocation->symbol] < 0) {
+            stubs[relocation->symbol] = stubCount++;
+        }
+    }
+    Buffer* text = &object.sections[SECTION_TEXT];
+    long stubStart = (text->count + STUB_SIZE - 1) / STUB_SIZE * STUB_SIZE;
+    long sizes[SECTION_COUNT];
+    sizes[SECTION_TEXT] = stubStart + stubCount * STUB_SIZE;
+    sizes[SECTION_DATA] = object.sections[SECTION_DATA].count;
+    sizes[SECTION_RODATA] = object.sections[SECTION_RODATA].count;
+    unsigned char* sections[SECTION_COUNT];
+    for (int s = 0; s < SECTION_COUNT; s++) {
+        sections[s] = sizes[s] ? carve(jit, sizes[s]) : NULL;
+        if (sizes[s]) {
+            memcpy(sections[s], object.sections[s].bytes, object.sections[s].count);
+        }
+    }
+    for (int i = 0; i < object.symbolCount; i++) {
+        Symbol* symbol = &object.symbols[i];
+        if (symbol->section < 0) continue;
+        addresses[i] = sections[symbol->section] + symbol->offset;
+        if (!symbol->global) continue;
+        JitSymbol* defined = internSymbol(jit, symbol->name);
+        defined->address = addresses[i];
+        if (defined->cell) *defined->cell = defined->address;
+    }
+
+    for (int i = 0; i < object.symbolCount; i++) {
+        if (stubs[i] < 0) continue;
+        JitSymbol* callee = internSymbol(jit, object.symbols[i].name);
+        if (callee->address == NULL) callee->address = addresses[i];
+        unsigned char* stub = sections[SECTION_TEXT] + stubStart + stubs[i] * STUB_SIZE;
+        void** cell = cellOf(jit, callee);
+        stub[0] = 0xff;
+        stub[1] = 0x25;
+        patch32(stub + 2, (unsigned char*)cell - (stub + 6), callee->name);
+        stub[6] = stub[7] = 0xcc;
+    }
+    for (int i = 0; i < object.relocationCount; i++) {
+        Relocation* relocation = &object.relocations[i];
+        int symbol = relocation->symbol;
+        unsigned char* at = sections[SECTION_TEXT] + relocation->offset;
+        unsigned char* target = stubs[symbol] >= 0
+                                    ? sections[SECTION_TEXT] + stubStart + stubs[symbol] * STUB_SIZE
+                                    : addresses[symbol];
+        patch32(at, target + relocation->addend - at, object.symbols[symbol].name);
+    }
+
+    if (sections[SECTION_TEXT]) {
+        protect(sections[SECTION_TEXT], sizes[SECTION_TEXT], PROT_READ | PROT_EXEC);
+    }
+    if (sections[SECTION_RODATA]) {
+        protect(sections[SECTION_RODATA], sizes[SECTION_RODATA], PROT_READ);
+    }
+    release(stubs);
+    release(addresses);
+    freeObject(&object);
+}
@@ -0,0 +1,23 @@
+#ifndef JIT_H
+#define JIT_H
+
+#include "x86.h"
+
+//---------------------- JIT ---------------------------
+// Links encoded programs into executable memory of this process one at a
+// time, so the REPL runs what it compiles at once. Calls go through a
+// cell holding the callee's address: later programs call earlier ones by
+// name and a redefinition takes over every caller. Pages are writable or
+// executable, never both.
+
+typedef struct Jit Jit;
+
+Jit* newJit(void);
+// encodes program and links it against everything loaded before it and
+// the symbols of the process, panicking on undefined ones
+void jitLoad(Jit* jit, MProgram* program);
+// address of a loaded function or global, NULL if there is none
+void* jitLookup(Jit* jit, String name);
+void freeJit(Jit* jit);
+
+#endif
@@ -0,0 +1,662 @@
+//---------------------- Loop-Opt ---------------------
+#include "loop.h"
+
+#include "vectorize.h"
+
+// only loops running at most this many times are fully unrolled
+#define MAX_UNROLL_TRIPS 8
+// and only if the unrolled body stays below this many instructions
+#define MAX_UNROLL_SIZE 128
+
+static IrBlock* intersect(IrBlock* a, IrBlock* b) {
+    while (a != b) {
+        while (a->rpo > b->rpo) a = a->idom;
+        while (b->rpo > a->rpo) b = b->idom;
+    }
+    return a;
+}
+
+// Cooper, Harvey and Kennedy, "A Simple, Fast Dominance Algorithm".
+// blocks must be in reverse postorder, see computeCFG.
+void computeDominators(IrFunction* fn) {
+    for (int b = 0; b < fn->blockCount; b++) fn->blocks[b]->idom = NULL;
+    IrBlock* entry = fn->blocks[0];
+    entry->idom = entry;
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (int b = 1; b < fn->blockCount; b++) {
+            IrBlock* block = fn->blocks[b];
+            IrBlock* idom = NULL;
+            for (int p = 0; p < block->predCount; p++) {
+                IrBlock* pred = block->preds[p];
+                if (pred->idom == NULL) continue;
+                idom = idom ? intersect(pred, idom) : pred;
+            }
+            if (block->idom != idom) {
+                block->idom = idom;
+                changed = true;
+            }
+        }
+    }
+    entry->idom = NULL;
+}
+
+bool dominates(IrBlock* a, IrBlock* b) {
+    for (; b != NULL; b = b->idom) {
+        if (b == a) return true;
+    }
+    return false;
+}
+
+static Loop* loopWithHeader(Loop* loops, int count, IrBlock* header) {
+    for (int i = 0; i < count; i++) {
+        if (loops[i].header == header) return &loops[i];
+    }
+    return NULL;
+}
+
+// a back edge goes from a block to one of its dominators; the natural loop
+// of the edge is everything that reaches its source without passing the
+// header. expects computeCFG and computeDominators to be up to date.
+int findLoops(IrFunction* fn, Loop** out) {
+    Loop* loops = NULL;
+    int count = 0;
+    IrBlock** worklist = irAlloc(ALLOC_OPTIMIZER, sizeof(IrBlock*) * (fn->blockCount + 1));
+    for (int b = 0; b < fn->blockCount; b++) {
+        IrBlock* latch = fn->blocks[b];
+        for (int s = 0; s < latch->succCount; s++) {
+            IrBlock* header = latch->succs[s];
+            if (!dominates(header, latch)) continue;
+            Loop* loop = loopWithHeader(loops, count, header);
+            if (loop == NULL) {
+                loops = reallocate(ALLOC_OPTIMIZER, loops, sizeof(Loop) * (count + 1));
+                loop = &loops[count++];
+                memset(loop, 0, sizeof(Loop));
+                loop->header = header;
+                loop->body = irAlloc(ALLOC_OPTIMIZER, sizeof(bool) * fn->nextBlockId);
+                loop->body[header->id] = true;
+            }
+            loop->latch = loop->latchCount++ == 0 ? latch : NULL;
+            int top = 0;
+            if (!loop->body[latch->id]) {
+                loop->body[latch->id] = true;
+                worklist[top++] = latch;
+            }
+            while (top > 0) {
+                IrBlock* block = worklist[--top];
+                for (int p = 0; p < block->predCount; p++) {
+                    IrBlock* pred = block->preds[p];
+                    if (loop->body[pred->id]) continue;
+                    loop->body[pred->id] = true;
+                    worklist[top++] = pred;
+                }
+            }
+        }
+    }
+    release(worklist);
+    for (int i = 0; i < count; i++) {
+        Loop* loop = &loops[i];
+        loop->blocks = irAlloc(ALLOC_OPTIMIZER, sizeof(IrBlock*) * fn->blockCount);
+        for (int b = 0; b < fn->blockCount; b++) {
+            if (loop->body[fn->blocks[b]->id]) {
+                loop->blocks[loop->blockCount++] = fn->blocks[b];
+            }
+        }
+        IrBlock* outside = NULL;
+        int outsideCount = 0;
+        for (int p = 0; p < loop->header->predCount; p++) {
+            IrBlock* pred = loop->header->preds[p];
+            if (loop->body[pred->id]) continue;
+            outside = pred;
+            outsideCount++;
+        }
+        if (outsideCount == 1 && outside->succCount == 1) {
+            loop->preheader = outside;
+        }
+        loop->innermost = true;
+        for (int j = 0; j < count; j++) {
+            if (j != i && loop->body[loops[j].header->id]) {
+                loop->innermost = false;
+            }
+        }
+    }
+    // innermost first: a loop nested in another has fewer blocks
+    for (int i = 1; i < count; i++) {
+        Loop loop = loops[i];
+        int j = i - 1;
+        for (; j >= 0 && loops[j].blockCount > loop.blockCount; j--) {
+            loops[j + 1] = loops[j];
+        }
+        loops[j + 1] = loop;
+    }
+    *out = loops;
+    return count;
+}
+
+// give every loop a block that is the only way into its header, so that
+// hoisted code has a place to go. returns true if the CFG changed.
+bool insertPreheaders(IrFunction* fn) {
+    Loop* loops;
+    int count = findLoops(fn, &loops);
+    bool changed = false;
+    for (int i = 0; i < count; i++) {
+        Loop* loop = &loops[i];
+        if (loop->preheader) continue;
+        IrBlock* preheader = newBlock(fn);
+        IrInstr* jump = newInstr(IR_JUMP, -1, 0);
+        jump->target = loop->header;
+        appendInstr(preheader, jump);
+        for (int p = 0; p < loop->header->predCount; p++) {
+            IrBlock* pred = loop->header->preds[p];
+            if (loop->body[pred->id]) continue;
+            retarget(terminator(pred), loop->header, preheader);
+        }
+        changed = true;
+    }
+    release(loops);
+    return changed;
+}
+
+bool* loopDefinitions(IrFunction* fn, Loop* loop) {
+    bool* defined = irAlloc(ALLOC_OPTIMIZER, sizeof(bool) * (fn->vregCount + 1));
+    for (int b = 0; b < loop->blockCount; b++) {
+        IrBlock* block = loop->blocks[b];
+        for (int i = 0; i < block->count; i++) {
+            if (block->instrs[i]->dst >= 0) defined[block->instrs[i]->dst] = true;
+        }
+    }
+    return defined;
+}
+
+int findInductionVars(IrFunction* fn, Loop* loop, IrInstr** defs,
+                      InductionVar** out) {
+    int* stores = irAlloc(ALLOC_OPTIMIZER, sizeof(int) * (fn->slotCount + 1));
+    IrInstr** update = irAlloc(ALLOC_OPTIMIZER, sizeof(IrInstr*) * (fn->slotCount + 1));
+    IrBlock** updateBlock = irAlloc(ALLOC_OPTIMIZER, sizeof(IrBlock*) * (fn->slotCount + 1));
+    for (int b = 0; b < loop->blockCount; b++) {
+        IrBlock* block = loop->blocks[b];
+        for (int i = 0; i < block->count; i++) {
+            IrInstr* instr = block->instrs[i];
+            if (instr->opcode != IR_STORE_SLOT) continue;
+            stores[instr->slot]++;
+            update[instr->slot] = instr;
+            updateBlock[instr->slot] = block;
+        }
+    }
+    InductionVar* ivs = irAlloc(ALLOC_OPTIMIZER, sizeof(InductionVar) * (fn->slotCount + 1));
+    int count = 0;
+    for (int slot = 0; slot < fn->slotCount; slot++) {
+        if (stores[slot] != 1 || fn->slots[slot].addressTaken) continue;
+        IrInstr* value = defs[update[slot]->uses[0]];
+        if (value == NULL || value->opcode != IR_BINARY) continue;
+        if (value->op != OP_ADD && value->op != OP_SUB) continue;
+        IrInstr* left = defs[value->uses[0]];
+        IrInstr* right = defs[value->uses[1]];
+        long step;
+        if (left->opcode == IR_LOAD_SLOT && left->slot == slot &&
+            right->opcode == IR_CONST) {
+            step = value->op == OP_ADD ? right->imm : -right->imm;
+        } else if (value->op == OP_ADD && right->opcode == IR_LOAD_SLOT &&
+                   right->slot == slot && left->opcode == IR_CONST) {
+            step = left->imm;
+        } else {
+            continue;
+        }
+        ivs[count].slot = slot;
+        ivs[count].step = step;
+        ivs[count].block = updateBlock[slot];
+        ivs[count].update = update[slot];
+        count++;
+    }
+    release(stores);
+    release(update);
+    release(updateBlock);
+    *out = ivs;
+    return count;
+}
+
+// walk back from the preheader through straight-line predecessors looking
+// for the last store to `slot`
+bool initialValue(Loop* loop, int slot, IrInstr** defs, long* value) {
+    IrBlock* block = loop->preheader;
+    while (block != NULL) {
+        for (int i = block->count - 1; i >= 0; i--) {
+            IrInstr* instr = block->instrs[i];
+            if (instr->opcode != IR_STORE_SLOT || instr->slot != slot) continue;
+            IrInstr* def = defs[instr->uses[0]];
+            if (def->opcode != IR_CONST) return false;
+            *value = def->imm;
+            return true;
+        }
+        block = block->predCount == 1 ? block->preds[0] : NULL;
+    }
+    return false;
+}
+
+//---------------------- LICM -------------------------
+
+static void hoistInvariants(IrFunction* fn, Loop* loop) {
+    if (loop->preheader == NULL) return;
+    bool* defined = loopDefinitions(fn, loop);
+    bool* stored = irAlloc(ALLOC_OPTIMIZER, sizeof(bool) * (fn->slotCount + 1));
+    bool writesMemory = false;
+    for (int b = 0; b < loop->blockCount; b++) {
+        IrBlock* block = loop->blocks[b];
+        for (int i = 0; i < block->count; i++) {
+            IrInstr* instr = block->instrs[i];
+            if (instr->opcode == IR_STORE_SLOT) stored[instr->slot] = true;
+            if (instr->opcode == IR_STORE || instr->opcode == IR_CALL ||
+                instr->opcode == IR_SYSCALL) {
+                writesMemory = true;
+            }
+        }
+    }
+    IrBlock* preheader = loop->preheader;
+    // blocks are in reverse postorder, so operands are always visited (and
+    // hoisted) before the instructions using them
+    for (int b = 0; b < loop->blockCount; b++) {
+        IrBlock* block = loop->blocks[b];
+        for (int i = 0; i < block->count;) {
+            IrInstr* instr = block->instrs[i];
+            bool invariant;
+            switch (instr->opcode) {
+                case IR_CONST:
+                case IR_VSPLAT:
+                case IR_ADDR_SLOT:
+                case IR_ADDR_GLOBAL:
+                    invariant = true;
+                    break;
+                case IR_BINARY:
+                    // hoisting a division could trap on a path that never
+                    // executed it
+                    invariant = instr->op != OP_DIV;
+                    break;
+                case IR_COPY:
+                case IR_UNARY:
+                    invariant = true;
+                    break;
+                case IR_LOAD_SLOT:
+                    invariant = !stored[instr->slot] &&
+                                !(fn->slots[instr->slot].addressTaken &&
+                                  writesMemory);
+                    break;
+                default:
+                    invariant = false;
+            }
+            for (int u = 0; u < instr->usecount && invariant; u++) {
+                if (defined[instr->uses[u]]) invariant = false;
+            }
+            if (!invariant) {
+                i++;
+                continue;
+            }
+            removeInstr(block, i);
+            insertInstr(preheader, preheader->count - 1, instr);
+            defined[instr->dst] = false;
+        }
+    }
+    release(defined);
+    release(stored);
+}
+
+//---------------------- Strength Reduction -----------
+
+typedef struct {
+    int base;      // invariant base vreg
+    int baseSlot;  // slot the base was loaded from, or -1
+    int ivSlot;
+    long scale;
+    int pointer;   // slot holding base + iv * scale
+} ReducedAddress;
+
+static int baseSlotOf(IrInstr** defs, int base) {
+    IrInstr* def = defs[base];
+    return def && def->opcode == IR_LOAD_SLOT ? def->slot : -1;
+}
+
+static void emitAt(IrBlock* block, int* index, IrInstr* instr) {
+    insertInstr(block, (*index)++, instr);
+}
+
+// materialize a new slot p = base + iv * scale, kept in sync by adding
+// step * scale wherever the induction variable is updated
+static int newPointerSlot(IrFunction* fn, Loop* loop, InductionVar* iv,
+                          int base, long scale) {
+    char name[64];
+    snprintf(name, sizeof(name), "%s.sr%d", fn->slots[iv->slot].name.chars,
+             fn->slotCount);
+    int pointer = newSlot(fn, makeString(name, strlen(name)));
+
+    IrBlock* preheader = loop->preheader;
+    int at = preheader->count - 1;
+    IrInstr* index = newInstr(IR_LOAD_SLOT, newVreg(fn), 0);
+    index->slot = iv->slot;
+    IrInstr* stride = newInstr(IR_CONST, newVreg(fn), 0);
+    stride->imm = scale;
+    IrInstr* offset = newInstr(IR_BINARY, newVreg(fn), 2);
+    offset->op = OP_MUL;
+    offset->uses[0] = index->dst;
+    offset->uses[1] = stride->dst;
+    IrInstr* start = newInstr(IR_BINARY, newVreg(fn), 2);
+    start->op = OP_ADD;
+    start->uses[0] = base;
+    start->uses[1] = offset->dst;
+    IrInstr* init = newInstr(IR_STORE_SLOT, -1, 1);
+    init->slot = pointer;
+    init->uses[0] = start->dst;
+    emitAt(preheader, &at, index);
+    emitAt(preheader, &at, stride);
+    emitAt(preheader, &at, offset);
+    emitAt(preheader, &at, start);
+    emitAt(preheader, &at, init);
+
+    int after = 0;
+    while (iv->block->instrs[after] != iv->update) after++;
+    after++;
+    IrInstr* current = newInstr(IR_LOAD_SLOT, newVreg(fn), 0);
+    current->slot = pointer;
+    IrInstr* delta = newInstr(IR_CONST, newVreg(fn), 0);
+    delta->imm = iv->step * scale;
+    IrInstr* next = newInstr(IR_BINARY, newVreg(fn), 2);
+    next->op = OP_ADD;
+    next->uses[0] = current->dst;
+    next->uses[1] = delta->dst;
+    IrInstr* store = newInstr(IR_STORE_SLOT, -1, 1);
+    store->slot = pointer;
+    store->uses[0] = next->dst;
+    emitAt(iv->block, &after, current);
+    emitAt(iv->block, &after, delta);
+    emitAt(iv->block, &after, next);
+    emitAt(iv->block, &after, store);
+    return pointer;
+}
+
+// rewrite one `base + iv * scale` in the loop, returns false if none is left
+static bool reduceOne(IrFunction* fn, Loop* loop, ReducedAddress* reduced,
+                      int* reducedCount) {
+    IrInstr** defs = buildDefMap(fn);
+    bool* defined = loopDefinitions(fn, loop);
+    InductionVar* ivs;
+    int ivCount = findInductionVars(fn, loop, defs, &ivs);
+    bool changed = false;
+    for (int b = 0; b < loop->blockCount && !changed; b++) {
+        IrBlock* block = loop->blocks[b];
+        for (int i = 0; i < block->count && !changed; i++) {
+            IrInstr* add = block->instrs[i];
+            if (add->opcode != IR_BINARY || add->op != OP_ADD) continue;
+            for (int side = 0; side < 2 && !changed; side++) {
+                IrInstr* mul = defs[add->uses[side]];
+                int base = add->uses[1 - side];
+                if (defined[base] || mul->opcode != IR_BINARY ||
+                    mul->op != OP_MUL) {
+                    continue;
+                }
+                IrInstr* load = defs[mul->uses[0]];
+                IrInstr* scale = defs[mul->uses[1]];
+                if (scale->opcode != IR_CONST) {
+                    IrInstr* swap = load;
+                    load = scale;
+                    scale = swap;
+                }
+                if (load->opcode != IR_LOAD_SLOT || scale->opcode != IR_CONST) {
+                    continue;
+                }
+                InductionVar* iv = NULL;
+                for (int v = 0; v < ivCount; v++) {
+                    if (ivs[v].slot == load->slot) iv = &ivs[v];
+                }
+                if (iv == NULL) continue;
+                // the index must be read in this block with no update of the
+                // induction variable before the address is formed
+                int from = -1;
+                for (int j = 0; j < i; j++) {
+                    IrInstr* instr = block->instrs[j];
+                    if (instr == load) from = j;
+                    if (from >= 0 && instr->opcode == IR_STORE_SLOT &&
+                        instr->slot == iv->slot) {
+                        from = -1;
+                        break;
+                    }
+                }
+                if (from < 0) continue;
+                int baseSlot = baseSlotOf(defs, base);
+                int pointer = -1;
+                for (int r = 0; r < *reducedCount; r++) {
+                    ReducedAddress* seen = &reduced[r];
+                    bool sameBase = seen->base == base ||
+                                    (baseSlot >= 0 && seen->baseSlot == baseSlot);
+                    if (sameBase && seen->ivSlot == iv->slot &&
+                        seen->scale == scale->imm) {
+                        pointer = seen->pointer;
+                    }
+                }
+                if (pointer < 0) {
+                    pointer = newPointerSlot(fn, loop, iv, base, scale->imm);
+                    ReducedAddress* entry = &reduced[(*reducedCount)++];
+                    entry->base = base;
+                    entry->baseSlot = baseSlot;
+                    entry->ivSlot = iv->slot;
+                    entry->scale = scale->imm;
+                    entry->pointer = pointer;
+                }
+                add->opcode = IR_LOAD_SLOT;
+                add->usecount = 0;
+                add->slot = pointer;
+                changed = true;
+            }
+        }
+    }
+    release(defs);
+    release(defined);
+    release(ivs);
+    return changed;
+}
+
+static void reduceStrength(IrFunction* fn, Loop* loop) {
+    if (loop->preheader == NULL) return;
+    int capacity = 0;
+    for (int b = 0; b < loop->blockCount; b++) {
+        capacity += loop->blocks[b]->count;
+    }
+    ReducedAddress* reduced = irAlloc(ALLOC_OPTIMIZER, sizeof(ReducedAddress) * (capacity + 1));
+    int count = 0;
+    while (count < capacity && reduceOne(fn, loop, reduced, &count)) {
+    }
+    release(reduced);
+}
+
+//---------------------- Unrolling --------------------
+
+static bool isComparison(Op op) {
+    switch (op) {
+        case OP_EQ:
+        case OP_NEQ:
+        case OP_LT:
+        case OP_LTE:
+        case OP_GT:
+        case OP_GTE:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// replace a loop whose trip count is a small constant by that many copies
+// of its body, dropping the exit test.
+static bool unrollLoop(IrFunction* fn, Loop* loop) {
+    if (!loop->innermost || loop->preheader == NULL || loop->latchCount != 1) {
+        return false;
+    }
+    IrBlock* header = loop->header;
+    IrInstr* branch = terminator(header);
+    if (branch->opcode != IR_BRANCH) return false;
+    IrBlock* entry = branch->target;
+    IrBlock* exit = branch->otherwise;
+    if (!loop->body[entry->id] || loop->body[exit->id]) return false;
+    for (int b = 1; b < loop->blockCount; b++) {
+        IrBlock* block = loop->blocks[b];
+        for (int s = 0; s < block->succCount; s++) {
+            if (!loop->body[block->succs[s]->id]) return false;
+        }
+    }
+
+    IrInstr** defs = buildDefMap(fn);
+    bool* defined = loopDefinitions(fn, loop);
+    bool ok = true;
+    // the header may only compute the exit test, and no value computed in
+    // the loop may be used after it
+    for (int b = 0; b < fn->blockCount && ok; b++) {
+        IrBlock* block = fn->blocks[b];
+        for (int i = 0; i < block->count && ok; i++) {
+            IrInstr* instr = block->instrs[i];
+            if (block == header) {
+                ok = instr == branch || (isPure(instr) && instr->opcode != IR_LOAD);
+                continue;
+            }
+            for (int u = 0; u < instr->usecount; u++) {
+                IrInstr* def = defs[instr->uses[u]];
+                bool inHeader = false;
+                for (int h = 0; h < header->count; h++) {
+                    if (header->instrs[h] == def) inHeader = true;
+                }
+                if (inHeader || (!loop->body[block->id] && defined[instr->uses[u]])) {
+                    ok = false;
+                }
+            }
+        }
+    }
+    IrInstr* cond = defs[branch->uses[0]];
+    if (!ok || cond->opcode != IR_BINARY || !isComparison(cond->op)) {
+        release(defs);
+        release(defined);
+        return false;
+    }
+    IrInstr* left = defs[cond->uses[0]];
+    IrInstr* right = defs[cond->uses[1]];
+    bool ivLeft = left->opcode == IR_LOAD_SLOT && right->opcode == IR_CONST;
+    bool ivRight = right->opcode == IR_LOAD_SLOT && left->opcode == IR_CONST;
+    InductionVar* ivs;
+    int ivCount = findInductionVars(fn, loop, defs, &ivs);
+    InductionVar* iv = NULL;
+    for (int v = 0; v < ivCount && (ivLeft || ivRight); v++) {
+        if (ivs[v].slot == (ivLeft ? left : right)->slot) iv = &ivs[v];
+    }
+    long value;
+    int trips = 0;
+    if (iv == NULL || !dominates(iv->block, loop->latch) ||
+        !initialValue(loop, iv->slot, defs, &value)) {
+        trips = -1;
+    }
+    long bound = ivLeft ? right->imm : left->imm;
+    long holds;
+    while (trips >= 0 &&
+           foldBinary(cond->op, ivLeft ? value : bound, ivLeft ? bound : value, &holds) &&
+           holds) {
+        if (++trips > MAX_UNROLL_TRIPS) trips = -1;
+        value += iv->step;
+    }
+    int size = 0;
+    for (int b = 1; b < loop->blockCount; b++) size += loop->blocks[b]->count;
+    release(defs);
+    release(ivs);
+    if (trips < 0 || size * trips > MAX_UNROLL_SIZE) {
+        release(defined);
+        return false;
+    }
+
+    // build the copies back to front so each knows where its back edge goes
+    int* vmap = irAlloc(ALLOC_OPTIMIZER, sizeof(int) * (fn->vregCount + 1));
+    IrBlock** bmap = irAlloc(ALLOC_OPTIMIZER, sizeof(IrBlock*) * fn->nextBlockId);
+    IrBlock* next = exit;
+    for (int t = trips - 1; t >= 0; t--) {
+        for (int b = 1; b < loop->blockCount; b++) {
+            IrBlock* block = loop->blocks[b];
+            bmap[block->id] = newBlock(fn);
+            for (int i = 0; i < block->count; i++) {
+                int dst = block->instrs[i]->dst;
+                if (dst >= 0) vmap[dst] = newVreg(fn);
+            }
+        }
+        for (int b = 1; b < loop->blockCount; b++) {
+            IrBlock* block = loop->blocks[b];
+            for (int i = 0; i < block->count; i++) {
+                IrInstr* copy = cloneInstr(block->instrs[i]);
+                if (copy->dst >= 0) copy->dst = vmap[copy->dst];
+                for (int u = 0; u < copy->usecount; u++) {
+                    if (defined[copy->uses[u]]) copy->uses[u] = vmap[copy->uses[u]];
+                }
+                if (copy->target) {
+                    copy->target = copy->target == header
+                                       ? next
+                                       : bmap[copy->target->id];
+                }
+                if (copy->otherwise) {
+                    copy->otherwise = copy->otherwise == header
+                                          ? next
+                                          : bmap[copy->otherwise->id];
+                }
+                appendInstr(bmap[block->id], copy);
+            }
+        }
+        next = bmap[entry->id];
+    }
+    retarget(terminator(loop->preheader), header, next);
+    release(vmap);
+    release(bmap);
+    release(defined);
+    return true;
+}
+
+//---------------------- Driver -----------------------
+
+// recompute the CFG and dominators, making sure every loop has a preheader
+static int prepareLoops(IrFunction* fn, Loop** loops) {
+    computeCFG(fn);
+    computeDominators(fn);
+    if (insertPreheaders(fn)) {
+        computeCFG(fn);
+        computeDominators(fn);
+    }
+    return findLoops(fn, loops);
+}
+
+void optimizeFunctionLoops(IrFunction* fn, int vectorLanes) {
+    Loop* loops;
+    int count = prepareLoops(fn, &loops);
+    for (int i = 0; i < count; i++) hoistInvariants(fn, &loops[i]);
+    bool vectorized = false;
+    for (int i = 0; i < count; i++) {
+        vectorized |= vectorizeLoop(fn, &loops[i], vectorLanes);
+    }
+    if (vectorized) {
+        release(loops);
+        count = prepareLoops(fn, &loops);
+        for (int i = 0; i < count; i++) hoistInvariants(fn, &loops[i]);
+    }
+    for (int i = 0; i < count; i++) reduceStrength(fn, &loops[i]);
+    // strength reduction leaves new constants in the loop bodies
+    for (int i = 0; i < count; i++) hoistInvariants(fn, &loops[i]);
+    release(loops);
+    removeDeadCode(fn);
+    // unrolling rewrites the CFG, so loops are rediscovered after each one
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        count = findLoops(fn, &loops);
+        for (int i = 0; i < count && !changed; i++) {
+            if (unrollLoop(fn, &loops[i])) {
+                computeCFG(fn);
+                computeDominators(fn);
+                changed = true;
+            }
+        }
+        release(loops);
+    }
+}
+
+void optimizeLoops(IrProgram* program, int vectorLanes) {
+    for (int i = 0; i < program->functionCount; i++) {
+        optimizeFunctionLoops(program->functions[i], vectorLanes);
+    }
+}
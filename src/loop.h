@@ -0,0 +1,49 @@
+#ifndef LOOP_H
+#define LOOP_H
+
+#include "ir.h"
+
+//---------------------- Loops -------------------------
+// Dominator tree, natural loops and induction variables over the IR, and
+// the loop optimizations built on them: loop-invariant code motion,
+// vectorization (see vectorize.h), strength reduction of subscript
+// addresses and full unrolling of loops with a small constant trip count.
+
+typedef struct {
+    IrBlock* header;
+    IrBlock* preheader;  // sole outside predecessor of the header, or NULL
+    bool* body;          // indexed by block id
+    IrBlock** blocks;    // in reverse postorder, header first
+    int blockCount;
+    IrBlock* latch;      // source of the back edge when there is only one
+    int latchCount;
+    bool innermost;
+} Loop;
+
+// a slot updated exactly once per loop by `slot = slot + step`
+typedef struct {
+    int slot;
+    long step;
+    IrBlock* block;   // block holding the update
+    IrInstr* update;  // the IR_STORE_SLOT
+} InductionVar;
+
+void computeDominators(IrFunction* fn);
+bool dominates(IrBlock* a, IrBlock* b);
+
+// loops are returned innermost first
+int findLoops(IrFunction* fn, Loop** loops);
+// vregs defined inside the loop, indexed by vreg
+bool* loopDefinitions(IrFunction* fn, Loop* loop);
+bool insertPreheaders(IrFunction* fn);
+int findInductionVars(IrFunction* fn, Loop* loop, IrInstr** defs,
+                      InductionVar** ivs);
+// constant value of `slot` on entry to the loop, if it can be seen
+bool initialValue(Loop* loop, int slot, IrInstr** defs, long* value);
+
+// vectorLanes is the number of words per vector register, 0 disables the
+// vectorizer
+void optimizeFunctionLoops(IrFunction* fn, int vectorLanes);
+void optimizeLoops(IrProgram* program, int vectorLanes);
+
+#endif
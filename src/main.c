@@ -1,8 +1,22 @@
 #include "ast.h"
+#include "cache.h"
+#include "inline.h"
+#include "ir.h"
+#include "jit.h"
+#include "loop.h"
 #include "parser.h"
+#include "partial.h"
+#include "phase.h"
+#include "pool.h"
+#include "prune.h"
 #include "scanner.h"
+#include "server.h"
+#include "ssa.h"
 #include "test.h"
+#include "vectorize.h"
 #include "util.h"
+#include "vm.h"
+#include "x86.h"
 
 //---------------------- Common Macros ----------------------
 #ifndef DUMMY
@@ -27,41 +41,577 @@ void read() { printf("read() is implemented in non-bootstrap mode\n"); }
 #endif
 #endif
 
-//---------------------- Assembly----------------------
+//---------------------- Options ----------------------
+
+typedef enum {
+    RUN_NATIVE,    // compile, the default
+    RUN_TREE,      // -run=tree: walk the AST of main
+    RUN_BYTECODE,  // -run=vm: run main on the bytecode machine
+} RunMode;
+
+typedef struct {
+    const char** inputs;  // none starts the REPL
+    int inputCount;
+    const char* output;  // derived from the input if NULL
+    bool object;         // -c: an ELF object rather than assembly
+    int vectorLanes;     // -march: words per vector register, 0 for scalar
+    int optLevel;        // -O0 is a naive stack machine lowering
+    bool peepholeStats;  // print how often each peephole rule fired
+    bool inlineReport;   // print what the inliner did with each call
+    bool deadReport;     // print the declarations nothing reaches
+    String* exports;     // -fexport=name: roots besides main
+    int exportCount;
+    int threads;         // -fthreads=N: functions compiled at once, 0 for all cores
+    const char* cache;   // -fcache=dir: reuse the assembly of unchanged functions
+    RunMode run;         // interpret the program instead of compiling it
+    int jobs;            // -j N: files compiled at once, 0 for all cores
+    bool test;           // -ftest: run the unit tests first
+    const char* serve;   // -fserve=path: be the compile server on this socket
+    const char* server;  // -fconnect=path: have the server there compile
+    unsigned report;     // REPORT_* of -ftime-report, -fmem-report and -fperf-report
+    bool jsonReport;     // any of them with =json
+    bool allocReport;    // -falloc-report: allocations by subsystem and call site
+} Options;
+
+static const Options defaultOptions = {NULL, 0, NULL, false, LANES_SSE2, 1, false, false, false, NULL, 0, 1, NULL, RUN_NATIVE, 1, false, NULL, NULL, 0, false, false};
+
+static Options options;
+
+// exits, unless the compile server is reading a client's command line
+static void usage(const char* program) {
+    fprintf(panicOutput ? panicOutput : stdout,
+            "Usage: %s [-O0|-O1] [-march=x86-64|sse2|avx2] "
+            "[-fpeephole-stats] [-finline-report] [-fdead-report] [-fexport=name]\n"
+            "       [-fthreads=N] [-fcache=dir] [-j N] [-c] [-o file] [-run=tree|vm] [-ftest]\n"
+            "       [-ftime-report[=json]] [-fmem-report[=json]] [-fperf-report[=json]]\n"
+            "       [-falloc-report] [-fserve=socket | -fconnect=socket] [filename...]\n",
+            program);
+    if (panicRecovery) longjmp(*panicRecovery, 1);
+    exit(1);
+}
+
+// name or name=json, adding what to the phase report
+static bool parseReport(const char* arg, const char* name, unsigned what) {
+    size_t length = strlen(name);
+    if (strncmp(arg, name, length) != 0) return false;
+    if (arg[length] != '\0' && strcmp(arg + length, "=json") != 0) return false;
+    options.report |= what;
+    options.jsonReport = options.jsonReport || arg[length] == '=';
+    return true;
+}
+
+static void parseOptions(int argc, char* argv[]) {
+    for (int i = 1; i < argc; i++) {
+        const char* arg = argv[i];
+        if (strcmp(arg, "-march=x86-64") == 0) {
+            options.vectorLanes = LANES_SCALAR;
+        } else if (strcmp(arg, "-march=sse2") == 0) {
+            options.vectorLanes = LANES_SSE2;
+        } else if (strcmp(arg, "-march=avx2") == 0) {
+            options.vectorLanes = LANES_AVX2;
+        } else if (strcmp(arg, "-O0") == 0 || strcmp(arg, "-O1") == 0) {
+            options.optLevel = arg[2] - '0';
+        } else if (strcmp(arg, "-fpeephole-stats") == 0) {
+            options.peepholeStats = true;
+        } else if (strcmp(arg, "-finline-report") == 0) {
+            options.inlineReport = true;
+        } else if (strcmp(arg, "-fdead-report") == 0) {
+            options.deadReport = true;
+        } else if (strncmp(arg, "-fexport=", 9) == 0) {
+            options.exports = reallocate(ALLOC_DRIVER, options.exports,
+                                         sizeof(String) * (options.exportCount + 2));
+            options.exports[options.exportCount++] = makeString(arg + 9, strlen(arg + 9));
+        } else if (strncmp(arg, "-fthreads=", 10) == 0) {
+            options.threads = atoi(arg + 10);
+        } else if (strncmp(arg, "-fcache=", 8) == 0) {
+            options.cache = arg + 8;
+        } else if (parseReport(arg, "-ftime-report", REPORT_TIME) ||
+                   parseReport(arg, "-fmem-report", REPORT_MEMORY) ||
+                   parseReport(arg, "-fperf-report", REPORT_COUNTERS)) {
+            // taken by parseReport
+        } else if (strcmp(arg, "-falloc-report") == 0) {
+            options.allocReport = true;
+            trackAllocations(true);
+        } else if (strcmp(arg, "-ftest") == 0) {
+            options.test = true;
+        } else if (strncmp(arg, "-fserve=", 8) == 0) {
+            options.serve = arg + 8;
+        } else if (strncmp(arg, "-fconnect=", 10) == 0) {
+            options.server = arg + 10;
+        } else if (strcmp(arg, "-run=tree") == 0) {
+            options.run = RUN_TREE;
+        } else if (strcmp(arg, "-run=vm") == 0) {
+            options.run = RUN_BYTECODE;
+        } else if (strcmp(arg, "-c") == 0) {
+            options.object = true;
+        } else if (strcmp(arg, "-o") == 0 && i + 1 < argc) {
+            options.output = argv[++i];
+        } else if (strcmp(arg, "-j") == 0 && i + 1 < argc) {
+            options.jobs = atoi(argv[++i]);
+        } else if (strncmp(arg, "-j", 2) == 0 && arg[2] != '\0') {
+            options.jobs = atoi(arg + 2);
+        } else if (arg[0] == '-') {
+            usage(argv[0]);
+        } else {
+            options.inputs = reallocate(ALLOC_DRIVER, options.inputs,
+                                        sizeof(char*) * (options.inputCount + 1));
+            options.inputs[options.inputCount++] = arg;
+        }
+    }
+    // one output file, one interpreted program
+    if (options.inputCount > 1 && (options.output || options.run != RUN_NATIVE)) {
+        usage(argv[0]);
+    }
+}
+
+//---------------------- Output ------------------------
+
+// foo.c -> foo.s, or foo.o with -c
+static char* derivePath(const char* input, const char* extension) {
+    size_t length = strlen(input);
+    const char* dot = strrchr(input, '.');
+    if (dot != NULL && strchr(dot, '/') == NULL) length = dot - input;
+    char* path = allocate(ALLOC_DRIVER, length + strlen(extension) + 1);
+    memcpy(path, input, length);
+    strcpy(path + length, extension);
+    return path;
+}
+
+static char* outputPath(const char* input) {
+    return options.output ? (char*)options.output
+                          : derivePath(input, options.object ? ".o" : ".s");
+}
+
+static FILE* openOutput(const char* input, char** path) {
+    *path = outputPath(input);
+    FILE* file = fopen(*path, options.object ? "wb" : "w");
+    if (file == NULL) {
+        panic("Could not write \"%s\".\n", *path);
+    }
+    return file;
+}
+
+static void freeOutputPath(char* path) {
+    if (path != options.output) release(path);
+}
+
+static void closeOutput(FILE* file, char* path) {
+    fclose(file);
+    freeOutputPath(path);
+}
+
+//---------------------- Jobs ------------------------
+// Each input file is compiled by a job of its own, several at once with
+// -j. Nothing in the compiler is shared between jobs but the options, so
+// a job needs only its own place for diagnostics: with several inputs
+// the panics and reports of a job are kept and printed in the order of
+// the inputs once all have finished, and the debugging dumps are left
+// out.
+
+typedef struct {
+    const char* input;
+    bool dump;     // print tokens, AST, IR and assembly on stdout
+    FILE* log;     // panics and reports, NULL for stdout and stderr
+    char* logText;
+    size_t logLength;
+    bool failed;
+    PhaseReport* phases;  // with -ftime-report or -fmem-report
+} Job;
+
+static FILE* reports(Job* job) { return job->log ? job->log : stderr; }
+
+static PhaseReport* phaseReport() {
+    return options.report ? newPhaseReport(options.report) : NULL;
+}
+
+static void printPhases(Job* job, FILE* out) {
+    if (job->phases == NULL || job->failed) return;
+    printPhaseReport(job->phases, job->input, options.jsonReport, out);
+}
+
+static void writeOutput(MProgram* program, Job* job) {
+    if (EMIT_ASM && job->dump) emitAssembly(program, stdout);
+    char* path;
+    FILE* file = openOutput(job->input, &path);
+    if (options.object) {
+        emitObject(program, file);
+    } else {
+        emitAssembly(program, file);
+    }
+    closeOutput(file, path);
+}
 
 //---------------------- Pipeline----------------------
 
-void compile(const char* buffer) {
+// Past the whole program passes every function is optimized and compiled
+// on its own, threads functions at a time. Each writes only its own slot
+// of the program, so the output does not depend on the thread count.
+
+// instructions per function, to deal out the largest first
+static long* functionSizes(IrProgram* ir) {
+    long* sizes = allocateZeroed(ALLOC_DRIVER, ir->functionCount + 1, sizeof(long));
+    for (int i = 0; i < ir->functionCount; i++) {
+        IrFunction* fn = ir->functions[i];
+        for (int b = 0; b < fn->blockCount; b++) sizes[i] += fn->blocks[b]->count;
+    }
+    return sizes;
+}
+
+static void optimizeFunction(void* context, int i) {
+    IrFunction* fn = ((IrProgram*)context)->functions[i];
+    optimizeFunctionLoops(fn, options.vectorLanes);
+    if (promoteSlots(fn)) foldConstants(fn);
+}
+
+// the IR passes of -O1, with the inliner's report going to report
+static void optimize(IrProgram* ir, int threads, FILE* report) {
+    eliminateTailCalls(ir);
+    inlineFunctions(ir, options.inlineReport ? report : NULL);
+    long* sizes = functionSizes(ir);
+    runJobs(threads, ir->functionCount, optimizeFunction, ir, sizes);
+    release(sizes);
+}
+
+static void generateFunction(void* context, int i) {
+    MProgram* machine = context;
+    machine->functions[i] =
+        genMachineFunction(machine->ir, machine->ir->functions[i], options.optLevel);
+}
+
+static MProgram* generate(IrProgram* ir, int threads) {
+    MProgram* machine = irAlloc(ALLOC_CODEGEN, sizeof(MProgram));
+    machine->ir = ir;
+    machine->functionCount = ir->functionCount;
+    machine->functions = irAlloc(ALLOC_CODEGEN, sizeof(MFunction*) * (ir->functionCount + 1));
+    long* sizes = functionSizes(ir);
+    runJobs(threads, ir->functionCount, generateFunction, machine, sizes);
+    release(sizes);
+    return machine;
+}
+
+// what removeUnreachable took out of kept, with the bytes of code and
+// data it would have been compiled to
+static void reportDead(Program* dead, Program* kept, FILE* out) {
+    int functions = 0, globals = 0;
+    for (int i = 0; i < dead->count; i++) {
+        if (dead->declarations[i]->type == DECL_FUNCTION) functions++;
+        else globals++;
+    }
+    for (int i = 0; i < kept->count; i++) {
+        if (kept->declarations[i]->type == DECL_FUNCTION) functions++;
+        else if (kept->declarations[i]->type == DECL_VARIABLE) globals++;
+    }
+    IrContext context;
+    memset(&context, 0, sizeof(IrContext));
+    addIrContext(&context, kept);
+    IrProgram* ir = genIRInContext(dead, &context);
+    freeIrContext(&context);
+    // nothing of what the inliner does to code that is gone is reported
+    if (options.optLevel > 0) optimize(ir, options.threads, NULL);
+    ObjectFile object;
+    memset(&object, 0, sizeof(ObjectFile));
+    encodeProgram(generate(ir, options.threads), &object);
+    int deadFunctions = 0, deadGlobals = 0;
+    for (int i = 0; i < dead->count; i++) {
+        Decl* decl = dead->declarations[i];
+        bool function = decl->type == DECL_FUNCTION;
+        String name = function ? decl->function.name : decl->variable.name;
+        long size = object.symbols[symbolOf(&object, name)].size;
+        fprintf(out, "dead %s %.*s: %ld bytes\n", function ? "function" : "global",
+                name.length, name.chars, size);
+        if (function) deadFunctions++;
+        else deadGlobals++;
+    }
+    long bytes = 0;
+    for (int i = 0; i < SECTION_COUNT; i++) bytes += object.sections[i].count;
+    fprintf(out, "removed %d of %d functions and %d of %d globals, %ld bytes\n",
+            deadFunctions, functions, deadGlobals, globals, bytes);
+    freeObject(&object);
+}
+
+//---------------------- Cached Build ----------------
+// With -fcache every function's assembly text is looked up by its hash
+// and only the missing ones go through the back end; the compile server
+// does the same with a cache in memory unless asked for a directory.
+// Objects need the whole program encoded at once, so -c does not use the
+// cache.
+
+static bool serving;  // in -fserve
+
+typedef struct {
+    IrProgram* ir;
+    CacheKey seed;
+    char** texts;
+    size_t* lengths;
+    int generated;  // functions that were not in the cache
+} CachedBuild;
+
+static void buildCachedFunction(void* context, int i) {
+    CachedBuild* build = context;
+    IrFunction* fn = build->ir->functions[i];
+    // before instruction selection, which splits critical edges
+    CacheKey key = hashFunction(build->seed, build->ir, fn);
+    build->texts[i] = cacheLoad(options.cache, key, &build->lengths[i]);
+    if (build->texts[i]) return;
+    __atomic_fetch_add(&build->generated, 1, __ATOMIC_RELAXED);
+    MFunction* machine = genMachineFunction(build->ir, fn, options.optLevel);
+    FILE* out = open_memstream(&build->texts[i], &build->lengths[i]);
+    emitFunctionAssembly(build->ir, machine, out);
+    fclose(out);
+    cacheStore(options.cache, key, build->texts[i], build->lengths[i]);
+}
+
+static void writeTexts(CachedBuild* build, FILE* out) {
+    fprintf(out, "\t.text\n");
+    for (int i = 0; i < build->ir->functionCount; i++) {
+        fwrite(build->texts[i], 1, build->lengths[i], out);
+    }
+    emitDataAssembly(build->ir, out);
+}
+
+// returns how many functions went through the back end
+static int writeCachedOutput(IrProgram* ir, Job* job) {
+    CachedBuild build;
+    build.ir = ir;
+    build.generated = 0;
+    build.seed = cacheSeed(options.optLevel, options.vectorLanes);
+    build.texts = allocateZeroed(ALLOC_DRIVER, ir->functionCount + 1, sizeof(char*));
+    build.lengths = allocateZeroed(ALLOC_DRIVER, ir->functionCount + 1, sizeof(size_t));
+    long* sizes = functionSizes(ir);
+    runJobs(options.threads, ir->functionCount, buildCachedFunction, &build, sizes);
+    release(sizes);
+    if (EMIT_ASM && job->dump) writeTexts(&build, stdout);
+    char* path;
+    FILE* file = openOutput(job->input, &path);
+    writeTexts(&build, file);
+    closeOutput(file, path);
+    for (int i = 0; i < ir->functionCount; i++) release(build.texts[i]);
+    release(build.texts);
+    release(build.lengths);
+    return build.generated;
+}
+
+// instructions in every function
+static long irSize(IrProgram* ir) {
+    long size = 0;
+    for (int i = 0; i < ir->functionCount; i++) {
+        IrFunction* fn = ir->functions[i];
+        for (int b = 0; b < fn->blockCount; b++) size += fn->blocks[b]->count;
+    }
+    return size;
+}
+
+void compile(const char* buffer, Job* job) {
+    PhaseReport* phases = job->phases;
     // scan
+    if (phases) enterPhase(phases, PHASE_SCAN);
     Token* tokens = scanTokens(buffer);
     int i = 0;
     while (tokens[i].type != TOKEN_EOF) {
-        if (DEBUG_PRINT_TOKEN) printToken(&tokens[i]);
+        if (DEBUG_PRINT_TOKEN && job->dump) printToken(&tokens[i]);
         if (tokens[i].type == TOKEN_ERROR) {
             panic("TOEN_ERROR: %s\n", tokens[i].start);
         }
         i++;
     }
     // parse
+    if (phases) {
+        phases->objects[PHASE_SCAN] = i;
+        enterPhase(phases, PHASE_PARSE);
+    }
     Program* program = parse(tokens);
-    if (PRINT_AST) printProgram(program);
+    if (PRINT_AST && job->dump) printProgram(program);
     // semantic analysis
+    if (phases) {
+        phases->objects[PHASE_PARSE] = countNodes(phases, program);
+        enterPhase(phases, PHASE_SEMANTIC);
+    }
+    evaluateGlobalInitializers(program);
+    if (options.optLevel > 0) {
+        evaluatePureCalls(program);
+        String* roots = allocate(ALLOC_DRIVER, sizeof(String) * (options.exportCount + 1));
+        roots[0] = makeString("main", 4);
+        for (int i = 0; i < options.exportCount; i++) roots[i + 1] = options.exports[i];
+        Program* dead = removeUnreachable(program, roots, options.exportCount + 1);
+        if (options.deadReport) reportDead(dead, program, reports(job));
+        release(roots);
+    }
 
     // ir gen
+    if (phases) {
+        phases->objects[PHASE_SEMANTIC] = countAstNodes(program);
+        enterPhase(phases, PHASE_IRGEN);
+    }
+    IrProgram* ir = genIR(program);
+    if (phases) {
+        phases->objects[PHASE_IRGEN] = irSize(ir);
+        enterPhase(phases, PHASE_OPTIMIZE);
+    }
+    if (options.optLevel > 0) optimize(ir, options.threads, reports(job));
+    if (EMIT_IR && job->dump) printIrProgram(ir);
 
     // asm gen
+    if (phases) {
+        phases->objects[PHASE_OPTIMIZE] = irSize(ir);
+        enterPhase(phases, PHASE_CODEGEN);
+    }
+    int generated = ir->functionCount;
+    if ((options.cache || serving) && !options.object) {
+        generated = writeCachedOutput(ir, job);
+    } else {
+        writeOutput(generate(ir, options.threads), job);
+    }
+    if (phases) {
+        phases->objects[PHASE_CODEGEN] = generated;
+        enterPhase(phases, PHASE_COUNT);
+    }
+}
+
+//---------------------- REPL ------------------------
+// Every entry is compiled to native code and run at once. An entry is a
+// line, or more while brackets are open. Declarations stay loaded for
+// later entries; other entries become the body of a fresh function whose
+// final expression is printed. Only the new entry is scanned, parsed and
+// compiled: earlier ones are known by name in the session and in the
+// JIT's symbols, so an entry takes as long late in a session of
+// thousands of definitions as it does in the first.
+
+static Jit* jit;
+static IrContext session;  // names declared by earlier entries
+static int evalCount;
+
+// a lone expression needs no semicolon; entry has room for one more
+// character
+static void terminateEntry(char* entry) {
+    size_t length = strlen(entry);
+    while (length > 0 && strchr(" \t\r\n", entry[length - 1])) {
+        entry[--length] = '\0';
+    }
+    if (length > 0 && entry[length - 1] != ';' && entry[length - 1] != '}') {
+        strcpy(entry + length, ";");
+    }
+}
+
+// brackets line opens less those it closes, outside literals and comments
+static int openBrackets(const char* line) {
+    int depth = 0;
+    for (const char* c = line; *c; c++) {
+        if (*c == '"' || *c == '\'') {
+            char quote = *c;
+            while (c[1] && c[1] != quote) c += c[1] == '\\' && c[2] ? 2 : 1;
+            if (c[1]) c++;
+        } else if (c[0] == '/' && c[1] == '/') {
+            break;
+        } else if (strchr("({[", *c)) {
+            depth++;
+        } else if (strchr(")}]", *c)) {
+            depth--;
+        }
+    }
+    return depth;
+}
+
+// int __replN() { statements, returning the final expression }
+static Program* wrapStatements(Token* tokens, String name, bool* hasValue) {
+    Parser parser;
+    initParser(&parser, tokens);
+    Stmt* body = allocate(ALLOC_AST, sizeof(Stmt));
+    body->type = STMT_BLOCK;
+    body->block.count = 0;
+    body->block.statements = NULL;
+    while (tokens[parser.current].type != TOKEN_EOF) {
+        body->block.statements = reallocate(ALLOC_AST, body->block.statements,
+                                            sizeof(Stmt*) * (body->block.count + 1));
+        body->block.statements[body->block.count++] = statement(&parser);
+    }
+    Stmt* last = body->block.statements[body->block.count - 1];
+    *hasValue = last->type == STMT_EXPRESSION;
+    if (*hasValue) {
+        Expr* value = last->expr.expression;
+        last->type = STMT_RETURN;
+        last->returnStmt.value = value;
+    }
+    Decl* decl = allocate(ALLOC_AST, sizeof(Decl));
+    decl->type = DECL_FUNCTION;
+    decl->function.name = name;
+    decl->function.parameters = NULL;
+    decl->function.count = 0;
+    decl->function.returnType = makeString("int", 3);
+    decl->function.body = body;
+    Program* program = allocate(ALLOC_AST, sizeof(Program));
+    program->declarations = allocate(ALLOC_AST, sizeof(Decl*));
+    program->declarations[0] = decl;
+    program->count = 1;
+    return program;
+}
+
+static void evaluate(char* entry) {
+    terminateEntry(entry);
+    Token* tokens = scanTokens(entry);
+    if (tokens[0].type == TOKEN_EOF) return;
+    for (int i = 0; tokens[i].type != TOKEN_EOF; i++) {
+        if (tokens[i].type == TOKEN_ERROR) {
+            panic("TOKEN_ERROR: %s\n", tokens[i].start);
+        }
+    }
+    bool declarations =
+        tokens[0].type == TOKEN_TYPENAME || tokens[0].type == TOKEN_STRUCT;
+    char name[32];
+    sprintf(name, "__repl%d", evalCount++);
+    bool hasValue = false;
+    Program* program = declarations
+                           ? parse(tokens)
+                           : wrapStatements(tokens, makeString(name, strlen(name)),
+                                            &hasValue);
+    evaluateGlobalInitializers(program);
+    IrProgram* ir = genIRInContext(program, &session);
+    if (options.optLevel > 0) optimize(ir, 1, stderr);
+    jitLoad(jit, genMachineCode(ir, options.optLevel));
+    if (declarations) {
+        addIrContext(&session, program);
+        return;
+    }
+    long (*run)(void) = (long (*)(void))jitLookup(jit, makeString(name, strlen(name)));
+    long result = run();
+    fflush(stdout);
+    if (hasValue) printf("%ld\n", result);
 }
 
 static void repl() {
-    char line[1024];
+    char* line = NULL;
+    size_t lineCapacity = 0;
+    char* entry = NULL;
+    size_t length = 0;
+    int depth = 0;
+    jmp_buf recovery;
+    jit = newJit();
     for (;;) {
-        printf("> ");
-        if (!fgets(line, sizeof(line), stdin)) {
+        printf(length > 0 ? ". " : "> ");
+        ssize_t count = getline(&line, &lineCapacity, stdin);
+        if (count > 0) {
+            entry = reallocate(ALLOC_DRIVER, entry, length + count + 2);
+            memcpy(entry + length, line, count + 1);
+            length += count;
+            depth += openBrackets(line);
+            if (depth > 0) continue;
+        }
+        // a bad entry reports its panic and the session goes on
+        if (length > 0 && setjmp(recovery) == 0) {
+            panicRecovery = &recovery;
+            evaluate(entry);
+        }
+        panicRecovery = NULL;
+        length = 0;
+        depth = 0;
+        if (count < 0) {
             printf("\n");
             break;
         }
-        compile(line);
     }
+    free(line);
+    release(entry);
+    freeJit(jit);
+    freeIrContext(&session);
 }
 
 static char* readFile(const char* path) {
@@ -72,7 +622,7 @@ static char* readFile(const char* path) {
     fseek(file, 0L, SEEK_END);
     size_t filesize = ftell(file);
     rewind(file);
-    char* buffer = (char*)malloc(filesize + 1);
+    char* buffer = (char*)allocate(ALLOC_DRIVER, filesize + 1);
     if (buffer == NULL) {
         panic("Not enough memory to read \"%s\".\n", path);
     }
@@ -85,22 +635,245 @@ static char* readFile(const char* path) {
     return buffer;
 }
 
-static void runFile(char* filename) {
+// runs main with an interpreter, exiting with its result
+static void interpret(const char* buffer) {
+    Token* tokens = scanTokens(buffer);
+    for (int i = 0; tokens[i].type != TOKEN_EOF; i++) {
+        if (tokens[i].type == TOKEN_ERROR) {
+            panic("TOKEN_ERROR: %s\n", tokens[i].start);
+        }
+    }
+    Program* program = parse(tokens);
+    evaluateGlobalInitializers(program);
+    long result = options.run == RUN_TREE ? walkProgram(program, "main")
+                                          : runBytecode(compileBytecode(program), "main");
+    fflush(stdout);
+    if (options.allocReport) printAllocations(stderr);
+    exit((int)result);
+}
+
+static void runFile(const char* filename) {
     char* buffer = readFile(filename);
-    compile(buffer);
+    if (options.run != RUN_NATIVE) interpret(buffer);
+    Job job = {filename, true, NULL, NULL, 0, false, phaseReport()};
+    compile(buffer, &job);
+    printPhases(&job, stderr);
+    if (job.phases) freePhaseReport(job.phases);
+    release(buffer);
+}
+
+//---------------------- Output Cache ----------------
+// The compile server keeps what every file it compiled came to: the
+// output and the reports, under a hash of the source, the compiler and
+// the options that change either of them. An unchanged file is answered
+// by writing the output again, without scanning or parsing it.
+
+static CacheKey outputKey(const char* buffer) {
+    CacheKey key = cacheSeed(options.optLevel, options.vectorLanes);
+    char flags[] = {options.object, options.inlineReport, options.deadReport};
+    key = hashText(key, flags, sizeof(flags));
+    for (int i = 0; i < options.exportCount; i++) {
+        key = hashText(key, options.exports[i].chars, options.exports[i].length);
+        key = hashText(key, "", 1);
+    }
+    return hashText(key, buffer, strlen(buffer));
+}
+
+// an entry is the length of the reports on a line, the reports and the
+// output
+static bool replayOutput(CacheKey key, Job* job) {
+    size_t length;
+    char* entry = cacheLoad(NULL, key, &length);
+    if (entry == NULL) return false;
+    char* reports = strchr(entry, '\n') + 1;
+    size_t reportLength = strtoul(entry, NULL, 10);
+    char* output = reports + reportLength;
+    fwrite(reports, 1, reportLength, job->log);
+    char* path;
+    FILE* file = openOutput(job->input, &path);
+    fwrite(output, 1, entry + length - output, file);
+    closeOutput(file, path);
+    release(entry);
+    return true;
+}
+
+// what the job just wrote, read back
+static char* readOutput(Job* job, size_t* length) {
+    char* path = outputPath(job->input);
+    FILE* file = fopen(path, "rb");
+    freeOutputPath(path);
+    if (file == NULL) return NULL;
+    fseek(file, 0L, SEEK_END);
+    *length = ftell(file);
+    rewind(file);
+    char* output = allocate(ALLOC_DRIVER, *length + 1);
+    if (fread(output, 1, *length, file) != *length) {
+        release(output);
+        output = NULL;
+    }
+    fclose(file);
+    return output;
+}
+
+static void rememberOutput(CacheKey key, Job* job) {
+    size_t outputLength;
+    char* output = readOutput(job, &outputLength);
+    if (output == NULL) return;
+    fflush(job->log);
+    char* entry;
+    size_t length;
+    FILE* out = open_memstream(&entry, &length);
+    fprintf(out, "%zu\n", job->logLength);
+    fwrite(job->logText, 1, job->logLength, out);
+    fwrite(output, 1, outputLength, out);
+    fclose(out);
+    cacheStore(NULL, key, entry, length);
+    free(entry);
+    release(output);
+}
+
+static void compileJob(void* context, int i) {
+    Job* job = &((Job*)context)[i];
+    job->log = open_memstream(&job->logText, &job->logLength);
+    job->phases = phaseReport();
+    jmp_buf recovery;
+    if (setjmp(recovery) == 0) {
+        panicRecovery = &recovery;
+        panicOutput = job->log;
+        char* buffer = readFile(job->input);
+        CacheKey key = serving ? outputKey(buffer) : 0;
+        if (!serving || !replayOutput(key, job)) {
+            compile(buffer, job);
+            if (serving) rememberOutput(key, job);
+        }
+        release(buffer);
+    } else {
+        job->failed = true;
+    }
+    panicRecovery = NULL;
+    panicOutput = NULL;
+    fclose(job->log);
+}
+
+// every line a job logged, after the name of its input
+static void printLog(Job* job, FILE* out) {
+    char* end = job->logText + job->logLength;
+    for (char* line = job->logText; line < end;) {
+        char* newline = memchr(line, '\n', end - line);
+        // what follows the last newline, such as panic's color reset
+        if (newline == NULL) {
+            fprintf(out, "%.*s", (int)(end - line), line);
+            break;
+        }
+        fprintf(out, "%s: %.*s", job->input, (int)(newline + 1 - line), line);
+        line = newline + 1;
+    }
+}
+
+// compiles every input, largest first, and fails if any of them did;
+// the diagnostics go to out
+static bool runFiles(FILE* out) {
+    Job* jobs = allocateZeroed(ALLOC_DRIVER, options.inputCount, sizeof(Job));
+    long* sizes = allocateZeroed(ALLOC_DRIVER, options.inputCount, sizeof(long));
+    for (int i = 0; i < options.inputCount; i++) {
+        jobs[i].input = options.inputs[i];
+        FILE* file = fopen(jobs[i].input, "rb");
+        if (file) {
+            fseek(file, 0L, SEEK_END);
+            sizes[i] = ftell(file);
+            fclose(file);
+        }
+    }
+    runJobs(options.jobs, options.inputCount, compileJob, jobs, sizes);
+    bool failed = false;
+    for (int i = 0; i < options.inputCount; i++) {
+        printLog(&jobs[i], out);
+        printPhases(&jobs[i], out);
+        if (jobs[i].phases) freePhaseReport(jobs[i].phases);
+        failed = failed || jobs[i].failed;
+        free(jobs[i].logText);
+    }
+    release(jobs);
+    release(sizes);
+    return !failed;
+}
+
+//---------------------- Compile Server ----------------
+// scc -fserve=path stays up and compiles the command lines of scc
+// -fconnect=path clients. Between requests it keeps the output of every
+// file and the assembly of every function it compiled, so that a request
+// costs about as much as what changed since the last one. Requests are
+// compiled like several inputs are, with diagnostics after the input's
+// name and no debugging dumps; -run and the REPL are not served. A client
+// whose server is not there compiles on its own.
+
+// all a request allocates but what the caches keep, and what it releases
+// itself
+#define REQUEST_ARENA (~(ALLOC_TAG_BIT(ALLOC_CACHE) | ALLOC_TAG_BIT(ALLOC_DRIVER)))
+
+static int serveCommand(int argc, char* argv[], FILE* out) {
+    int status = 1;
+    options = defaultOptions;
+    openArena(REQUEST_ARENA);
+    jmp_buf recovery;
+    if (setjmp(recovery) == 0) {
+        panicRecovery = &recovery;
+        panicOutput = out;
+        parseOptions(argc, argv);
+        panicRecovery = NULL;
+        panicOutput = NULL;
+        if (options.inputCount == 0 || options.run != RUN_NATIVE ||
+            options.serve || options.server) {
+            fprintf(out, "The compile server only compiles files.\n");
+        } else {
+            status = runFiles(out) ? 0 : 1;
+            // counted since the server started
+            if (options.peepholeStats) printPeepholeStats(out);
+            if (options.allocReport) printAllocations(out);
+        }
+    }
+    panicRecovery = NULL;
+    panicOutput = NULL;
+    release(options.inputs);
+    release(options.exports);
+    closeArena();
+    return status;
+}
+
+// the command line without its -fconnect option
+static char** clientArguments(int argc, char* argv[], int* count) {
+    char** arguments = allocate(ALLOC_DRIVER, sizeof(char*) * (argc + 1));
+    *count = 0;
+    for (int i = 0; i < argc; i++) {
+        if (strncmp(argv[i], "-fconnect=", 10) != 0) arguments[(*count)++] = argv[i];
+    }
+    arguments[*count] = NULL;
+    return arguments;
 }
 
 //---------------------- Main--------------------------
 int main(int argc, char* argv[]) {
-    if (TEST) test_parse();
-    if (argc == 1) {
+    options = defaultOptions;
+    parseOptions(argc, argv);
+    if (TEST && options.test) runTests();
+    if (options.server) {
+        int count, status;
+        char** arguments = clientArguments(argc, argv, &count);
+        if (sendCommand(options.server, count, arguments, &status)) return status;
+        release(arguments);
+    }
+    if (options.serve) {
+        serving = true;
+        serveCommands(options.serve, serveCommand);
+    } else if (options.inputCount == 0) {
         repl();
-    } else if (argc == 2) {
-        runFile(argv[1]);
-    } else {
-        printf("Usage: %s <filename>\n", argv[0]);
+    } else if (options.inputCount == 1) {
+        runFile(options.inputs[0]);
+    } else if (!runFiles(stderr)) {
         return 1;
     }
+    if (options.peepholeStats) printPeepholeStats(stderr);
+    if (options.allocReport) printAllocations(stderr);
 
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,227 @@
+//---------------------- ELF Writer --------------------
+// Serializes an ObjectFile as an ELF64 x86-64 relocatable object: the
+// header, the section contents, then the section header table.
+#include <elf.h>
+
+#include "object.h"
+
+void appendByte(Buffer* buffer, int byte) {
+    if (buffer->count == buffer->capacity) {
+        buffer->capacity = buffer->capacity ? buffer->capacity * 2 : 256;
+        buffer->bytes = reallocate(ALLOC_CODEGEN, buffer->bytes, buffer->capacity);
+    }
+    buffer->bytes[buffer->count++] = byte;
+}
+
+void appendBytes(Buffer* buffer, long value, int size) {
+    for (int i = 0; i < size; i++) appendByte(buffer, (value >> (8 * i)) & 0xff);
+}
+
+void appendBuffer(Buffer* buffer, const void* bytes, long size) {
+    const unsigned char* from = bytes;
+    for (long i = 0; i < size; i++) appendByte(buffer, from[i]);
+}
+
+int symbolOf(ObjectFile* object, String name) {
+    for (int i = 0; i < object->symbolCount; i++) {
+        if (stringEqual(object->symbols[i].name, name)) return i;
+    }
+    if (object->symbolCount == object->symbolCapacity) {
+        object->symbolCapacity =
+            object->symbolCapacity ? object->symbolCapacity * 2 : 16;
+        object->symbols =
+            reallocate(ALLOC_CODEGEN, object->symbols, sizeof(Symbol) * object->symbolCapacity);
+    }
+    Symbol* symbol = &object->symbols[object->symbolCount];
+    memset(symbol, 0, sizeof(Symbol));
+    symbol->name = name;
+    symbol->section = -1;
+    // undefined symbols are resolved by the linker, so they are global
+    symbol->global = true;
+    return object->symbolCount++;
+}
+
+void defineSymbol(ObjectFile* object, int symbol, SectionId section,
+                  long offset, bool global) {
+    object->symbols[symbol].section = section;
+    object->symbols[symbol].offset = offset;
+    object->symbols[symbol].global = global;
+}
+
+void addRelocation(ObjectFile* object, long offset, int symbol,
+                   RelocType type, long addend) {
+    if (object->relocationCount == object->relocationCapacity) {
+        object->relocationCapacity =
+            object->relocationCapacity ? object->relocationCapacity * 2 : 16;
+        object->relocations = reallocate(ALLOC_CODEGEN,
+            object->relocations, sizeof(Relocation) * object->relocationCapacity);
+    }
+    Relocation* relocation = &object->relocations[object->relocationCount++];
+    relocation->offset = offset;
+    relocation->symbol = symbol;
+    relocation->type = type;
+    relocation->addend = addend;
+}
+
+void freeObject(ObjectFile* object) {
+    for (int i = 0; i < SECTION_COUNT; i++) release(object->sections[i].bytes);
+    release(object->symbols);
+    release(object->relocations);
+}
+
+//---------------------- Serialization -----------------
+
+// section header indices
+enum {
+    SH_NULL,
+    SH_TEXT,
+    SH_DATA,
+    SH_RODATA,
+    SH_RELA_TEXT,
+    SH_SYMTAB,
+    SH_STRTAB,
+    SH_SHSTRTAB,
+    SH_NOTE_STACK,
+    SH_COUNT,
+};
+
+// offset of name in a string table, appended with its terminator
+static int addString(Buffer* table, const char* name) {
+    int offset = table->count;
+    appendBuffer(table, name, strlen(name) + 1);
+    return offset;
+}
+
+static void align(Buffer* file, int alignment) {
+    while (file->count % alignment) appendByte(file, 0);
+}
+
+static void addSection(Buffer* file, Elf64_Shdr* header, Buffer* contents,
+                       int alignment) {
+    align(file, alignment);
+    header->sh_offset = file->count;
+    header->sh_size = contents->count;
+    header->sh_addralign = alignment;
+    appendBuffer(file, contents->bytes, contents->count);
+}
+
+void writeElf(ObjectFile* object, FILE* out) {
+    Buffer strtab = {0}, shstrtab = {0}, symtab = {0}, rela = {0};
+    appendByte(&strtab, 0);
+    appendByte(&shstrtab, 0);
+
+    // symbols: null, one per section, locals, then globals as ELF demands
+    int* elfIndex = allocateZeroed(ALLOC_CODEGEN, object->symbolCount + 1, sizeof(int));
+    Elf64_Sym sym;
+    memset(&sym, 0, sizeof(sym));
+    appendBuffer(&symtab, &sym, sizeof(sym));
+    for (int s = 0; s < SECTION_COUNT; s++) {
+        sym.st_info = ELF64_ST_INFO(STB_LOCAL, STT_SECTION);
+        sym.st_shndx = SH_TEXT + s;
+        appendBuffer(&symtab, &sym, sizeof(sym));
+    }
+    int count = 1 + SECTION_COUNT, firstGlobal = 0;
+    for (int pass = 0; pass < 2; pass++) {
+        if (pass == 1) firstGlobal = count;
+        for (int i = 0; i < object->symbolCount; i++) {
+            Symbol* symbol = &object->symbols[i];
+            if (symbol->global != (pass == 1)) continue;
+            // like as, keep .L labels out of the table
+            if (!symbol->global && symbol->name.length >= 2 &&
+                memcmp(symbol->name.chars, ".L", 2) == 0) {
+                continue;
+            }
+            memset(&sym, 0, sizeof(sym));
+            sym.st_name = addString(&strtab, symbol->name.chars);
+            int type = symbol->section < 0 ? STT_NOTYPE
+                       : symbol->function  ? STT_FUNC
+                                           : STT_OBJECT;
+            sym.st_info = ELF64_ST_INFO(symbol->global ? STB_GLOBAL : STB_LOCAL,
+                                        type);
+            sym.st_shndx = symbol->section < 0 ? SHN_UNDEF : SH_TEXT + symbol->section;
+            sym.st_value = symbol->offset;
+            sym.st_size = symbol->size;
+            appendBuffer(&symtab, &sym, sizeof(sym));
+            elfIndex[i] = count++;
+        }
+    }
+    for (int i = 0; i < object->relocationCount; i++) {
+        Relocation* relocation = &object->relocations[i];
+        Symbol* symbol = &object->symbols[relocation->symbol];
+        // local symbols are reached through their section's symbol
+        bool local = !symbol->global && symbol->section >= 0;
+        Elf64_Rela entry;
+        entry.r_offset = relocation->offset;
+        entry.r_info = ELF64_R_INFO(
+            local ? 1 + symbol->section : elfIndex[relocation->symbol],
+            relocation->type == RELOC_PLT32 ? R_X86_64_PLT32 : R_X86_64_PC32);
+        entry.r_addend = relocation->addend + (local ? symbol->offset : 0);
+        appendBuffer(&rela, &entry, sizeof(entry));
+    }
+
+    Elf64_Shdr headers[SH_COUNT];
+    memset(headers, 0, sizeof(headers));
+    static const char* names[SH_COUNT] = {
+        "",        ".text",   ".data",     ".rodata",        ".rela.text",
+        ".symtab", ".strtab", ".shstrtab", ".note.GNU-stack"};
+    for (int i = 1; i < SH_COUNT; i++) {
+        headers[i].sh_name = addString(&shstrtab, names[i]);
+    }
+    headers[SH_TEXT].sh_type = SHT_PROGBITS;
+    headers[SH_TEXT].sh_flags = SHF_ALLOC | SHF_EXECINSTR;
+    headers[SH_DATA].sh_type = SHT_PROGBITS;
+    headers[SH_DATA].sh_flags = SHF_ALLOC | SHF_WRITE;
+    headers[SH_RODATA].sh_type = SHT_PROGBITS;
+    headers[SH_RODATA].sh_flags = SHF_ALLOC;
+    headers[SH_RELA_TEXT].sh_type = SHT_RELA;
+    headers[SH_RELA_TEXT].sh_flags = SHF_INFO_LINK;
+    headers[SH_RELA_TEXT].sh_link = SH_SYMTAB;
+    headers[SH_RELA_TEXT].sh_info = SH_TEXT;
+    headers[SH_RELA_TEXT].sh_entsize = sizeof(Elf64_Rela);
+    headers[SH_SYMTAB].sh_type = SHT_SYMTAB;
+    headers[SH_SYMTAB].sh_link = SH_STRTAB;
+    headers[SH_SYMTAB].sh_info = firstGlobal;
+    headers[SH_SYMTAB].sh_entsize = sizeof(Elf64_Sym);
+    headers[SH_STRTAB].sh_type = SHT_STRTAB;
+    headers[SH_SHSTRTAB].sh_type = SHT_STRTAB;
+    headers[SH_NOTE_STACK].sh_type = SHT_PROGBITS;
+
+    Buffer file = {0};
+    Elf64_Ehdr header;
+    memset(&header, 0, sizeof(header));
+    appendBuffer(&file, &header, sizeof(header));
+    addSection(&file, &headers[SH_TEXT], &object->sections[SECTION_TEXT], 16);
+    addSection(&file, &headers[SH_DATA], &object->sections[SECTION_DATA], 8);
+    addSection(&file, &headers[SH_RODATA], &object->sections[SECTION_RODATA], 1);
+    addSection(&file, &headers[SH_RELA_TEXT], &rela, 8);
+    addSection(&file, &headers[SH_SYMTAB], &symtab, 8);
+    addSection(&file, &headers[SH_STRTAB], &strtab, 1);
+    addSection(&file, &headers[SH_SHSTRTAB], &shstrtab, 1);
+    Buffer empty = {0};
+    addSection(&file, &headers[SH_NOTE_STACK], &empty, 1);
+    align(&file, 8);
+
+    memcpy(header.e_ident, ELFMAG, SELFMAG);
+    header.e_ident[EI_CLASS] = ELFCLASS64;
+    header.e_ident[EI_DATA] = ELFDATA2LSB;
+    header.e_ident[EI_VERSION] = EV_CURRENT;
+    header.e_ident[EI_OSABI] = ELFOSABI_SYSV;
+    header.e_type = ET_REL;
+    header.e_machine = EM_X86_64;
+    header.e_version = EV_CURRENT;
+    header.e_ehsize = sizeof(Elf64_Ehdr);
+    header.e_shoff = file.count;
+    header.e_shentsize = sizeof(Elf64_Shdr);
+    header.e_shnum = SH_COUNT;
+    header.e_shstrndx = SH_SHSTRTAB;
+    memcpy(file.bytes, &header, sizeof(header));
+    appendBuffer(&file, headers, sizeof(headers));
+
+    fwrite(file.bytes, 1, file.count, out);
+    release(file.bytes);
+    release(strtab.bytes);
+    release(shstrtab.bytes);
+    release(symtab.bytes);
+    release(rela.bytes);
+    release(elfIndex);
+}
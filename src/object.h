@@ -0,0 +1,69 @@
+#ifndef OBJECT_H
+#define OBJECT_H
+
+#include "util.h"
+
+//---------------------- Object Files ------------------
+// An ELF64 relocatable object under construction: section contents,
+// symbols and the relocations of .text. object.c serializes it.
+
+typedef enum {
+    SECTION_TEXT,
+    SECTION_DATA,
+    SECTION_RODATA,
+    SECTION_COUNT,
+} SectionId;
+
+typedef struct {
+    unsigned char* bytes;
+    long count;
+    long capacity;
+} Buffer;
+
+typedef struct {
+    String name;
+    int section;  // SectionId, -1 while undefined
+    long offset;
+    long size;
+    bool global;
+    bool function;
+} Symbol;
+
+typedef enum {
+    RELOC_PC32,   // R_X86_64_PC32, a rip-relative data reference
+    RELOC_PLT32,  // R_X86_64_PLT32, a call
+} RelocType;
+
+typedef struct {
+    long offset;  // in .text
+    int symbol;
+    RelocType type;
+    long addend;
+} Relocation;
+
+typedef struct {
+    Buffer sections[SECTION_COUNT];
+    Symbol* symbols;
+    int symbolCount;
+    int symbolCapacity;
+    Relocation* relocations;
+    int relocationCount;
+    int relocationCapacity;
+} ObjectFile;
+
+void appendByte(Buffer* buffer, int byte);
+// little endian
+void appendBytes(Buffer* buffer, long value, int size);
+void appendBuffer(Buffer* buffer, const void* bytes, long size);
+
+// the symbol called name, added undefined if missing
+int symbolOf(ObjectFile* object, String name);
+void defineSymbol(ObjectFile* object, int symbol, SectionId section,
+                  long offset, bool global);
+void addRelocation(ObjectFile* object, long offset, int symbol,
+                   RelocType type, long addend);
+
+void writeElf(ObjectFile* object, FILE* out);
+void freeObject(ObjectFile* object);
+
+#endif
@@ -106,7 +106,7 @@ ParseRule* getRule(TokenType type) { return &rules[type]; }
 // parse literal, which is previous token.
 Expr* atom(Parser* parser) {
     Token token = parser->tokens[parser->previous];
-    Expr* expr = malloc(sizeof(Expr));
+    Expr* expr = allocate(ALLOC_AST, sizeof(Expr));
     expr->type = EXPR_LITERAL;
     String str = tokenToString(token);
     switch (token.type) {
@@ -161,7 +161,7 @@ Expr* grouping(Parser* parser) {
 Expr* unary(Parser* parser) {
     Token op= parser->tokens[parser->previous];
     Expr* expr = parsePrecedence(parser, PREC_UNARY);
-    Expr* new = malloc(sizeof(Expr));
+    Expr* new = allocate(ALLOC_AST, sizeof(Expr));
     new->type = EXPR_UNARY;
     new->unary.op = getOp(&op, false);
     new->unary.right = expr;
@@ -169,10 +169,10 @@ Expr* unary(Parser* parser) {
 }
 
 Expr* call(Parser* parser) {
-    Expr* expr = malloc(sizeof(Expr));
+    Expr* expr = allocate(ALLOC_AST, sizeof(Expr));
     expr->type = EXPR_CALL;
     expr->call.callee = getLeft(parser);
-    expr->call.arguments= malloc(sizeof(Expr*) * 8);
+    expr->call.arguments= allocate(ALLOC_AST, sizeof(Expr*) * 8);
     expr->call.argcount = 0;
     if (!match(parser, TOKEN_RIGHT_PAREN)) {
         do {
@@ -185,7 +185,7 @@ Expr* call(Parser* parser) {
 
 Expr* binary(Parser* parser) {
     Token op = parser->tokens[parser->previous];
-    Expr* expr = malloc(sizeof(Expr));
+    Expr* expr = allocate(ALLOC_AST, sizeof(Expr));
     expr->type = EXPR_BINARY;
     expr->binary.left = getLeft(parser);
     expr->binary.op = getOp(&op, true);
@@ -206,19 +206,19 @@ Expr* binary(Parser* parser) {
 
 // parse function declaration
 static Decl* functionDecl(Parser* parser, Token type, Token name) {
-    Decl* decl = malloc(sizeof(Decl));
+    Decl* decl = allocate(ALLOC_AST, sizeof(Decl));
     decl->type = DECL_FUNCTION;
     decl->function.returnType = tokenToString(type);
     decl->function.name = tokenToString(name);
     decl->function.parameters = NULL;
     decl->function.count = 0;
     if (!match (parser, TOKEN_RIGHT_PAREN)) {
-        decl->function.parameters = malloc(sizeof(Param*) * 10);
+        decl->function.parameters = allocate(ALLOC_AST, sizeof(Param*) * 10);
         do {
             Token paramType = advance(parser);
             Token paramName = eat(parser, TOKEN_IDENTIFIER,
                                   "expected identifier after type in parameter");
-            Param* param = malloc(sizeof(Param));
+            Param* param = allocate(ALLOC_AST, sizeof(Param));
             param->type = tokenToString(paramType);
             param->name = tokenToString(paramName);
             decl->function.parameters[decl->function.count++] = param;
@@ -241,7 +241,7 @@ Decl* declaration(Parser* parser) {
         return functionDecl(parser, type, name);
     } else {
         // variable declaration
-        Decl* decl = malloc(sizeof(Decl));
+        Decl* decl = allocate(ALLOC_AST, sizeof(Decl));
         decl->type = DECL_VARIABLE;
         decl->variable.type = tokenToString(type);
         decl->variable.name = tokenToString(name);
@@ -295,11 +295,17 @@ Expr* expression(Parser* parser) {
 
 static Stmt* block(Parser* parser) {
     eat(parser, TOKEN_LEFT_BRACE, "expected '{' before block");
-    Stmt* stmt = malloc(sizeof(Stmt));
+    Stmt* stmt = allocate(ALLOC_AST, sizeof(Stmt));
     stmt->type = STMT_BLOCK;
     stmt->block.count = 0;
-    stmt->block.statements = malloc(sizeof(Stmt*) * 10);
+    int capacity = 10;
+    stmt->block.statements = allocate(ALLOC_AST, sizeof(Stmt*) * capacity);
     while (!match(parser, TOKEN_RIGHT_BRACE)) {
+        if (stmt->block.count == capacity) {
+            capacity *= 2;
+            stmt->block.statements =
+                reallocate(ALLOC_AST, stmt->block.statements, sizeof(Stmt*) * capacity);
+        }
         stmt->block.statements[stmt->block.count] = statement(parser);
         stmt->block.count++;
     }
@@ -308,7 +314,7 @@ static Stmt* block(Parser* parser) {
 
 static Stmt* ifStmt(Parser* parser) {
     advance(parser);
-    Stmt* stmt = malloc(sizeof(Stmt));
+    Stmt* stmt = allocate(ALLOC_AST, sizeof(Stmt));
     stmt->type = STMT_IF;
     eat(parser, TOKEN_LEFT_PAREN, "expected '(' after 'if'");
     stmt->ifStmt.condition = expression(parser);
@@ -323,7 +329,7 @@ static Stmt* ifStmt(Parser* parser) {
 
 static Stmt* whileStmt(Parser* parser) {
     eat(parser, TOKEN_WHILE, "expected 'while' before while statement");
-    Stmt* stmt = malloc(sizeof(Stmt));
+    Stmt* stmt = allocate(ALLOC_AST, sizeof(Stmt));
     stmt->type = STMT_WHILE;
     eat(parser, TOKEN_LEFT_PAREN, "expected '(' after 'while'");
     stmt->whileStmt.condition = expression(parser);
@@ -333,7 +339,7 @@ static Stmt* whileStmt(Parser* parser) {
 }
 
 static Stmt* exprStmt(Parser* parser) {
-    Stmt* stmt = malloc(sizeof(Stmt));
+    Stmt* stmt = allocate(ALLOC_AST, sizeof(Stmt));
     stmt->type = STMT_EXPRESSION;
     stmt->expr.expression = expression(parser);
     eat(parser, TOKEN_SEMICOLON, "expected ';' after expression");
@@ -342,7 +348,7 @@ static Stmt* exprStmt(Parser* parser) {
 
 static Stmt* returnStmt(Parser* parser) {
     eat(parser, TOKEN_RETURN, "expected 'return' before return statement");
-    Stmt* stmt = malloc(sizeof(Stmt));
+    Stmt* stmt = allocate(ALLOC_AST, sizeof(Stmt));
     stmt->type = STMT_RETURN;
     // return without value
     if (match(parser, TOKEN_SEMICOLON)) {
@@ -369,7 +375,7 @@ Stmt* statement(Parser* parser) {
         case TOKEN_TYPENAME:
         case TOKEN_STRUCT: {
             Decl* decl = declaration(parser);
-            Stmt* stmt = malloc(sizeof(Stmt));
+            Stmt* stmt = allocate(ALLOC_AST, sizeof(Stmt));
             stmt->type = STMT_DECL;
             stmt->decl.decl = decl;
             return stmt;
@@ -385,10 +391,10 @@ Stmt* statement(Parser* parser) {
 
 // parse program
 Program* parse(Token* tokens) {
-    Parser* parser = malloc(sizeof(Parser));
+    Parser* parser = allocate(ALLOC_AST, sizeof(Parser));
     initParser(parser, tokens);
-    Program* program = malloc(sizeof(Program));
-    program->declarations = malloc(sizeof(Decl) * 1024);
+    Program* program = allocate(ALLOC_AST, sizeof(Program));
+    program->declarations = allocate(ALLOC_AST, sizeof(Decl) * 1024);
     program->count = 0;
     while (parser->tokens[parser->current].type != TOKEN_EOF) {
         program->declarations[program->count] = declaration(parser);
@@ -0,0 +1,448 @@
+//---------------------- Partial Evaluation ------------
+#include "partial.h"
+
+#include <limits.h>
+
+#include "ir.h"
+
+// the declaration a call refers to if it is a pure function taking as
+// many arguments as the call passes, or NULL
+static Decl* pureCallee(Program* ast, NameTable* functions, bool* pure, Expr* call) {
+    if (call->call.callee->type != EXPR_VARIABLE) return NULL;
+    int index = nameTableFind(functions, call->call.callee->variable.name);
+    if (index < 0 || !pure[index]) return NULL;
+    Decl* decl = ast->declarations[index];
+    return decl->function.count == call->call.argcount ? decl : NULL;
+}
+
+//---------------------- Purity ------------------------
+
+typedef struct {
+    Program* ast;
+    NameTable* functions;
+    bool* pure;     // per declaration, only meaningful for functions
+    String* scope;  // parameters and locals visible at this point
+    int scopeCount;
+    int scopeCapacity;
+} Purity;
+
+static void declareName(Purity* p, String name) {
+    if (p->scopeCount == p->scopeCapacity) {
+        p->scopeCapacity = p->scopeCapacity ? 2 * p->scopeCapacity : 16;
+        p->scope = reallocate(ALLOC_OPTIMIZER, p->scope, sizeof(String) * p->scopeCapacity);
+    }
+    p->scope[p->scopeCount++] = name;
+}
+
+static bool isLocal(Purity* p, String name) {
+    for (int i = p->scopeCount - 1; i >= 0; i--) {
+        if (stringEqual(p->scope[i], name)) return true;
+    }
+    return false;
+}
+
+static bool pureExpr(Purity* p, Expr* expr) {
+    switch (expr->type) {
+        case EXPR_LITERAL:
+            return expr->literal.type == TYPE_INT || expr->literal.type == TYPE_BOOL;
+        case EXPR_VARIABLE:
+            return isLocal(p, expr->variable.name);
+        case EXPR_ASSIGNMENT:
+            return isLocal(p, expr->assignment.name) && pureExpr(p, expr->assignment.value);
+        case EXPR_UNARY:
+            return (expr->unary.op == OP_NEG || expr->unary.op == OP_NOT) &&
+                   pureExpr(p, expr->unary.right);
+        case EXPR_BINARY:
+            switch (expr->binary.op) {
+                case OP_ASSIGN:
+                    return expr->binary.left->type == EXPR_VARIABLE &&
+                           pureExpr(p, expr->binary.left) && pureExpr(p, expr->binary.right);
+                case OP_ADD:
+                case OP_SUB:
+                case OP_MUL:
+                case OP_DIV:
+                case OP_EQ:
+                case OP_NEQ:
+                case OP_LT:
+                case OP_LTE:
+                case OP_GT:
+                case OP_GTE:
+                case OP_AND:
+                case OP_OR:
+                    return pureExpr(p, expr->binary.left) && pureExpr(p, expr->binary.right);
+                default:
+                    return false;
+            }
+        case EXPR_CALL:
+            if (pureCallee(p->ast, p->functions, p->pure, expr) == NULL) return false;
+            for (int i = 0; i < expr->call.argcount; i++) {
+                if (!pureExpr(p, expr->call.arguments[i])) return false;
+            }
+            return true;
+        case EXPR_GROUPING:
+            return false;
+    }
+    return false;
+}
+
+static bool pureStmt(Purity* p, Stmt* stmt) {
+    switch (stmt->type) {
+        case STMT_EXPRESSION:
+            return pureExpr(p, stmt->expr.expression);
+        case STMT_BLOCK: {
+            int scope = p->scopeCount;
+            bool pure = true;
+            for (int i = 0; i < stmt->block.count && pure; i++) {
+                pure = pureStmt(p, stmt->block.statements[i]);
+            }
+            p->scopeCount = scope;
+            return pure;
+        }
+        case STMT_IF:
+            return pureExpr(p, stmt->ifStmt.condition) &&
+                   pureStmt(p, stmt->ifStmt.thenBranch) &&
+                   (stmt->ifStmt.elseBranch == NULL || pureStmt(p, stmt->ifStmt.elseBranch));
+        case STMT_WHILE:
+            return pureExpr(p, stmt->whileStmt.condition) && pureStmt(p, stmt->whileStmt.body);
+        case STMT_RETURN:
+            return stmt->returnStmt.value == NULL || pureExpr(p, stmt->returnStmt.value);
+        case STMT_DECL: {
+            Decl* decl = stmt->decl.decl;
+            if (decl->type != DECL_VARIABLE) return false;
+            // the initializer is evaluated before the name is bound
+            if (decl->variable.initializer && !pureExpr(p, decl->variable.initializer)) {
+                return false;
+            }
+            declareName(p, decl->variable.name);
+            return true;
+        }
+    }
+    return false;
+}
+
+// every function starts out pure, so recursion does not spoil itself, and
+// functions are marked impure until nothing changes
+static bool* findPureFunctions(Program* ast, NameTable* functions) {
+    Purity p;
+    memset(&p, 0, sizeof(Purity));
+    p.ast = ast;
+    p.functions = functions;
+    p.pure = allocateZeroed(ALLOC_OPTIMIZER, ast->count + 1, sizeof(bool));
+    for (int i = 0; i < ast->count; i++) {
+        p.pure[i] = ast->declarations[i]->type == DECL_FUNCTION;
+    }
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (int i = 0; i < ast->count; i++) {
+            if (!p.pure[i]) continue;
+            Decl* decl = ast->declarations[i];
+            p.scopeCount = 0;
+            for (int k = 0; k < decl->function.count; k++) {
+                declareName(&p, decl->function.parameters[k]->name);
+            }
+            if (!pureStmt(&p, decl->function.body)) {
+                p.pure[i] = false;
+                changed = true;
+            }
+        }
+    }
+    release(p.scope);
+    return p.pure;
+}
+
+//---------------------- Evaluator ---------------------
+// A tree walker over pure functions only, so every name is a parameter or
+// local of the running call. Instead of panicking it sets failed, and the
+// call being folded stays as it is.
+
+typedef struct {
+    String name;
+    long value;
+} Binding;
+
+typedef struct {
+    Program* ast;
+    NameTable functions;  // the first function of each name
+    bool* pure;
+    Binding* bindings;
+    int count;
+    int capacity;
+    long* values;  // arguments evaluated and not bound yet, stack-like
+    int valueCount;
+    int valueCapacity;
+    int frame;  // first binding of the running call
+    int depth;
+    long steps;  // left of EVAL_STEP_BUDGET
+    bool returning;
+    long result;
+    bool failed;
+} Evaluator;
+
+static long eval(Evaluator* ev, Expr* expr);
+static void exec(Evaluator* ev, Stmt* stmt);
+
+static void bind(Evaluator* ev, String name, long value) {
+    if (ev->count == ev->capacity) {
+        ev->capacity = ev->capacity ? 2 * ev->capacity : 64;
+        ev->bindings = reallocate(ALLOC_OPTIMIZER, ev->bindings, sizeof(Binding) * ev->capacity);
+    }
+    ev->bindings[ev->count].name = name;
+    ev->bindings[ev->count++].value = value;
+}
+
+static long* lookup(Evaluator* ev, String name) {
+    for (int i = ev->count - 1; i >= ev->frame; i--) {
+        if (stringEqual(ev->bindings[i].name, name)) return &ev->bindings[i].value;
+    }
+    panic("undefined variable %s in a pure function\n", name.chars);
+    return NULL;
+}
+
+static void pushValue(Evaluator* ev, long value) {
+    if (ev->valueCount == ev->valueCapacity) {
+        ev->valueCapacity = ev->valueCapacity ? 2 * ev->valueCapacity : 64;
+        ev->values = reallocate(ALLOC_OPTIMIZER, ev->values, sizeof(long) * ev->valueCapacity);
+    }
+    ev->values[ev->valueCount++] = value;
+}
+
+static bool step(Evaluator* ev) {
+    if (--ev->steps < 0) ev->failed = true;
+    return !ev->failed;
+}
+
+static long call(Evaluator* ev, Expr* expr) {
+    Decl* decl = pureCallee(ev->ast, &ev->functions, ev->pure, expr);
+    if (ev->depth == EVAL_MAX_DEPTH) {
+        ev->failed = true;
+        return 0;
+    }
+    int argcount = expr->call.argcount;
+    int first = ev->valueCount;
+    for (int i = 0; i < argcount; i++) pushValue(ev, eval(ev, expr->call.arguments[i]));
+    int savedFrame = ev->frame, savedCount = ev->count;
+    ev->frame = ev->count;
+    for (int i = 0; i < argcount; i++) {
+        bind(ev, decl->function.parameters[i]->name, ev->values[first + i]);
+    }
+    ev->valueCount = first;
+    ev->depth++;
+    exec(ev, decl->function.body);
+    ev->depth--;
+    long result = ev->returning ? ev->result : 0;
+    ev->returning = false;
+    ev->frame = savedFrame;
+    ev->count = savedCount;
+    return result;
+}
+
+// signed overflow, which evaluation gives up on rather than wrap
+static bool overflows(Op op, long a, long b) {
+    long result;
+    switch (op) {
+        case OP_ADD:
+            return __builtin_add_overflow(a, b, &result);
+        case OP_SUB:
+            return __builtin_sub_overflow(a, b, &result);
+        case OP_MUL:
+            return __builtin_mul_overflow(a, b, &result);
+        default:
+            return false;
+    }
+}
+
+static long eval(Evaluator* ev, Expr* expr) {
+    if (!step(ev)) return 0;
+    switch (expr->type) {
+        case EXPR_LITERAL:
+            return expr->literal.type == TYPE_BOOL ? expr->literal.value.boolVal
+                                                   : expr->literal.value.intVal;
+        case EXPR_VARIABLE:
+            return *lookup(ev, expr->variable.name);
+        case EXPR_ASSIGNMENT: {
+            long value = eval(ev, expr->assignment.value);
+            return *lookup(ev, expr->assignment.name) = value;
+        }
+        case EXPR_UNARY:
+            return foldUnary(expr->unary.op, eval(ev, expr->unary.right));
+        case EXPR_BINARY:
+            switch (expr->binary.op) {
+                case OP_ASSIGN: {
+                    long value = eval(ev, expr->binary.right);
+                    return *lookup(ev, expr->binary.left->variable.name) = value;
+                }
+                case OP_AND:
+                    return eval(ev, expr->binary.left) && eval(ev, expr->binary.right);
+                case OP_OR:
+                    return eval(ev, expr->binary.left) || eval(ev, expr->binary.right);
+                default: {
+                    long left = eval(ev, expr->binary.left);
+                    long right = eval(ev, expr->binary.right);
+                    long value = 0;
+                    // the program traps or overflows here at run time, so let it
+                    if (!ev->failed && (overflows(expr->binary.op, left, right) ||
+                                        !foldBinary(expr->binary.op, left, right, &value))) {
+                        ev->failed = true;
+                    }
+                    return value;
+                }
+            }
+        case EXPR_CALL:
+            return call(ev, expr);
+        case EXPR_GROUPING:
+            break;
+    }
+    return 0;
+}
+
+static void exec(Evaluator* ev, Stmt* stmt) {
+    if (!step(ev)) return;
+    switch (stmt->type) {
+        case STMT_EXPRESSION:
+            eval(ev, stmt->expr.expression);
+            break;
+        case STMT_BLOCK: {
+            int scope = ev->count;
+            for (int i = 0; i < stmt->block.count && !ev->returning && !ev->failed; i++) {
+                exec(ev, stmt->block.statements[i]);
+            }
+            ev->count = scope;
+            break;
+        }
+        case STMT_IF:
+            if (eval(ev, stmt->ifStmt.condition)) {
+                exec(ev, stmt->ifStmt.thenBranch);
+            } else if (stmt->ifStmt.elseBranch) {
+                exec(ev, stmt->ifStmt.elseBranch);
+            }
+            break;
+        case STMT_WHILE:
+            while (!ev->returning && eval(ev, stmt->whileStmt.condition) && !ev->failed) {
+                exec(ev, stmt->whileStmt.body);
+            }
+            break;
+        case STMT_RETURN:
+            ev->result = stmt->returnStmt.value ? eval(ev, stmt->returnStmt.value) : 0;
+            ev->returning = true;
+            break;
+        case STMT_DECL: {
+            Decl* decl = stmt->decl.decl;
+            long value = decl->variable.initializer ? eval(ev, decl->variable.initializer) : 0;
+            bind(ev, decl->variable.name, value);
+            break;
+        }
+    }
+}
+
+//---------------------- Folding -----------------------
+
+static bool isConstant(Expr* expr) {
+    if (expr->type == EXPR_UNARY && expr->unary.op == OP_NEG) {
+        return isConstant(expr->unary.right);
+    }
+    return expr->type == EXPR_LITERAL &&
+           (expr->literal.type == TYPE_INT || expr->literal.type == TYPE_BOOL);
+}
+
+static int foldExpr(Evaluator* ev, Expr* expr);
+
+static int foldCall(Evaluator* ev, Expr* expr) {
+    int folded = foldExpr(ev, expr->call.callee);
+    bool constant = true;
+    for (int i = 0; i < expr->call.argcount; i++) {
+        folded += foldExpr(ev, expr->call.arguments[i]);
+        constant = constant && isConstant(expr->call.arguments[i]);
+    }
+    if (!constant || pureCallee(ev->ast, &ev->functions, ev->pure, expr) == NULL) return folded;
+    ev->count = ev->frame = ev->depth = ev->valueCount = 0;
+    ev->steps = EVAL_STEP_BUDGET;
+    ev->returning = ev->failed = false;
+    long result = call(ev, expr);
+    if (ev->failed || result < INT_MIN || result > INT_MAX) return folded;
+    expr->type = EXPR_LITERAL;
+    expr->literal.type = TYPE_INT;
+    expr->literal.value.intVal = (int)result;
+    return folded + 1;
+}
+
+static int foldExpr(Evaluator* ev, Expr* expr) {
+    switch (expr->type) {
+        case EXPR_ASSIGNMENT:
+            return foldExpr(ev, expr->assignment.value);
+        case EXPR_BINARY:
+            return foldExpr(ev, expr->binary.left) + foldExpr(ev, expr->binary.right);
+        case EXPR_UNARY:
+            return foldExpr(ev, expr->unary.right);
+        case EXPR_CALL:
+            return foldCall(ev, expr);
+        default:
+            return 0;
+    }
+}
+
+static int foldStmt(Evaluator* ev, Stmt* stmt) {
+    int folded = 0;
+    switch (stmt->type) {
+        case STMT_EXPRESSION:
+            return foldExpr(ev, stmt->expr.expression);
+        case STMT_BLOCK:
+            for (int i = 0; i < stmt->block.count; i++) {
+                folded += foldStmt(ev, stmt->block.statements[i]);
+            }
+            return folded;
+        case STMT_IF:
+            folded = foldExpr(ev, stmt->ifStmt.condition) + foldStmt(ev, stmt->ifStmt.thenBranch);
+            if (stmt->ifStmt.elseBranch) folded += foldStmt(ev, stmt->ifStmt.elseBranch);
+            return folded;
+        case STMT_WHILE:
+            return foldExpr(ev, stmt->whileStmt.condition) + foldStmt(ev, stmt->whileStmt.body);
+        case STMT_RETURN:
+            return stmt->returnStmt.value ? foldExpr(ev, stmt->returnStmt.value) : 0;
+        case STMT_DECL: {
+            Decl* decl = stmt->decl.decl;
+            if (decl->type != DECL_VARIABLE || decl->variable.initializer == NULL) return 0;
+            return foldExpr(ev, decl->variable.initializer);
+        }
+    }
+    return 0;
+}
+
+static int evaluate(Program* program, bool functions) {
+    Evaluator ev;
+    memset(&ev, 0, sizeof(Evaluator));
+    ev.ast = program;
+    for (int i = 0; i < program->count; i++) {
+        Decl* decl = program->declarations[i];
+        if (decl->type == DECL_FUNCTION) nameTableAdd(&ev.functions, decl->function.name, i);
+    }
+    ev.pure = findPureFunctions(program, &ev.functions);
+    int folded = 0;
+    for (int i = 0; i < program->count; i++) {
+        Decl* decl = program->declarations[i];
+        if (decl->type == DECL_FUNCTION && functions) {
+            folded += foldStmt(&ev, decl->function.body);
+        } else if (decl->type == DECL_VARIABLE && decl->variable.initializer) {
+            folded += foldExpr(&ev, decl->variable.initializer);
+        }
+    }
+    freeNameTable(&ev.functions);
+    release(ev.pure);
+    release(ev.bindings);
+    release(ev.values);
+    return folded;
+}
+
+int evaluatePureCalls(Program* program) { return evaluate(program, true); }
+
+// purity is only worked out when some global is initialized by a call
+int evaluateGlobalInitializers(Program* program) {
+    for (int i = 0; i < program->count; i++) {
+        Decl* decl = program->declarations[i];
+        if (decl->type == DECL_VARIABLE && decl->variable.initializer &&
+            !isConstant(decl->variable.initializer)) {
+            return evaluate(program, false);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,27 @@
+#ifndef PARTIAL_H
+#define PARTIAL_H
+
+#include "ast.h"
+
+//---------------------- Partial Evaluation ------------
+// A function is pure when it only reads and writes its own parameters and
+// locals and only calls pure functions: no pointers, no globals, no
+// strings, no calls out of the program (and so no syscalls). A call to a
+// pure function whose arguments are all constants is run at compile time
+// and the call expression becomes the literal it returns.
+//
+// Evaluation gives up, leaving the call alone, after EVAL_STEP_BUDGET
+// expressions and statements or EVAL_MAX_DEPTH nested calls, on a
+// division that traps or arithmetic that overflows, or when the result
+// does not fit an int literal.
+
+#define EVAL_STEP_BUDGET 1000000
+#define EVAL_MAX_DEPTH 256
+
+// returns the number of calls replaced by their result
+int evaluatePureCalls(Program* program);
+// the same for the initializers of globals only, which must be constants
+// by the time code is generated for them, so every mode runs this
+int evaluateGlobalInitializers(Program* program);
+
+#endif
@@ -0,0 +1,404 @@
+//---------------------- Peephole Optimization ---------
+// Rewrites short windows of allocated machine code. Every rule in the
+// table looks at the instructions starting at one index of a block and
+// either rewrites them in place or leaves them alone; the pass reruns the
+// table until no rule fires. Rules that delete a register write consult
+// a liveness of the physical registers at block boundaries, rules that
+// change the flags check that nothing reads them before the next write.
+#include "x86.h"
+
+typedef struct {
+    MFunction* fn;
+    unsigned* liveOut;  // per block, bit per physical register
+} Peephole;
+
+typedef bool (*RuleFn)(Peephole* p, MBlock* block, int i);
+
+typedef struct {
+    const char* name;
+    RuleFn apply;
+    long hits;
+} Rule;
+
+//---------------------- Liveness ----------------------
+
+static unsigned regMask(int* regs, int count) {
+    unsigned mask = 0;
+    for (int i = 0; i < count; i++) mask |= 1u << regs[i];
+    return mask;
+}
+
+static void computeLiveOut(Peephole* p) {
+    MFunction* fn = p->fn;
+    unsigned* liveIn = irAlloc(ALLOC_CODEGEN, sizeof(unsigned) * fn->blockCount);
+    int uses[REG_COUNT + 8], defs[REG_COUNT + 8], useCount, defCount;
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (int b = fn->blockCount - 1; b >= 0; b--) {
+            MBlock* block = fn->blocks[b];
+            unsigned live = 0;
+            for (int s = 0; s < block->succCount; s++) {
+                live |= liveIn[block->succs[s]->id];
+            }
+            p->liveOut[b] = live;
+            for (int i = block->count - 1; i >= 0; i--) {
+                machineOperands(block->instrs[i], uses, &useCount, defs,
+                                &defCount);
+                live &= ~regMask(defs, defCount);
+                live |= regMask(uses, useCount);
+            }
+            if (live != liveIn[b]) {
+                liveIn[b] = live;
+                changed = true;
+            }
+        }
+    }
+    release(liveIn);
+}
+
+// whether `reg` may be read after instruction i of the block
+static bool liveAfter(Peephole* p, MBlock* block, int i, int reg) {
+    int uses[REG_COUNT + 8], defs[REG_COUNT + 8], useCount, defCount;
+    for (int j = i + 1; j < block->count; j++) {
+        machineOperands(block->instrs[j], uses, &useCount, defs, &defCount);
+        if (regMask(uses, useCount) & (1u << reg)) return true;
+        if (regMask(defs, defCount) & (1u << reg)) return false;
+    }
+    return (p->liveOut[block->id] >> reg) & 1;
+}
+
+static bool readsFlags(MInstr* instr) {
+    return instr->opcode == M_JCC || instr->opcode == M_SETCC;
+}
+
+static bool writesFlags(MInstr* instr) {
+    switch (instr->opcode) {
+        case M_ADD:
+        case M_SUB:
+        case M_IMUL:
+        case M_NEG:
+        case M_XOR:
+        case M_IDIV:
+        case M_CMP:
+        case M_TEST:
+        case M_CALL:
+        case M_SYSCALL:  // r11 gets the flags back, not necessarily ours
+            return true;
+        default:
+            return false;
+    }
+}
+
+// the instruction selector never keeps flags across blocks
+static bool flagsLiveAfter(MBlock* block, int i) {
+    for (int j = i + 1; j < block->count; j++) {
+        if (readsFlags(block->instrs[j])) return true;
+        if (writesFlags(block->instrs[j])) return false;
+    }
+    return false;
+}
+
+//---------------------- Helpers -----------------------
+
+static MInstr* at(MBlock* block, int i) {
+    return i < block->count ? block->instrs[i] : NULL;
+}
+
+static bool isReg(MOperand* op) { return op->kind == OPND_REG; }
+
+static bool isGpr(MOperand* op) { return isReg(op) && op->reg < XMM0; }
+
+static bool isMemory(MOperand* op) {
+    return op->kind == OPND_MEM || op->kind == OPND_FRAME ||
+           op->kind == OPND_GLOBAL;
+}
+
+static bool sameOperand(MOperand* a, MOperand* b) {
+    if (a->kind != b->kind) return false;
+    switch (a->kind) {
+        case OPND_REG:
+            return a->reg == b->reg;
+        case OPND_IMM:
+            return a->imm == b->imm;
+        case OPND_MEM:
+            return a->reg == b->reg && a->index == b->index &&
+                   a->scale == b->scale && a->imm == b->imm;
+        case OPND_FRAME:
+            return a->slot == b->slot && a->imm == b->imm;
+        case OPND_GLOBAL:
+            return strcmp(a->name.chars, b->name.chars) == 0;
+        default:
+            return true;
+    }
+}
+
+// whether computing the operand reads `reg`
+static bool mentions(MOperand* op, int reg) {
+    if (op->kind == OPND_REG) return op->reg == reg;
+    return op->kind == OPND_MEM && (op->reg == reg || op->index == reg);
+}
+
+static bool isMove(MInstr* instr) {
+    return instr != NULL && instr->opcode == M_MOV;
+}
+
+//---------------------- Rules -------------------------
+
+// mov r, r
+static bool selfMove(Peephole* p, MBlock* block, int i) {
+    (void)p;
+    MInstr* mov = at(block, i);
+    if (mov->opcode != M_MOV && mov->opcode != M_VMOV) return false;
+    if (!isReg(&mov->ops[0]) || !sameOperand(&mov->ops[0], &mov->ops[1])) {
+        return false;
+    }
+    removeMInstr(block, i);
+    return true;
+}
+
+// mov m, r; mov s, m -> mov m, r; mov s, r: a reload right after a spill,
+// and likewise a second load of the same word
+static bool redundantLoad(Peephole* p, MBlock* block, int i) {
+    (void)p;
+    MInstr* first = at(block, i);
+    MInstr* second = at(block, i + 1);
+    if (!isMove(first) || !isMove(second) || !isGpr(&second->ops[0]) ||
+        !isMemory(&second->ops[1])) {
+        return false;
+    }
+    MOperand value;
+    if (isMemory(&first->ops[0]) && isGpr(&first->ops[1]) &&
+        sameOperand(&first->ops[0], &second->ops[1])) {
+        value = first->ops[1];
+    } else if (isGpr(&first->ops[0]) && sameOperand(&first->ops[1], &second->ops[1]) &&
+               !mentions(&first->ops[1], first->ops[0].reg)) {
+        value = first->ops[0];
+    } else {
+        return false;
+    }
+    if (value.reg == second->ops[0].reg) {
+        removeMInstr(block, i + 1);
+    } else {
+        second->ops[1] = value;
+    }
+    return true;
+}
+
+// mov t, x; mov y, t -> mov y, x when t dies
+static bool moveChain(Peephole* p, MBlock* block, int i) {
+    MInstr* first = at(block, i);
+    MInstr* second = at(block, i + 1);
+    if (!isMove(first) || !isMove(second) || !isGpr(&first->ops[0])) {
+        return false;
+    }
+    int t = first->ops[0].reg;
+    MOperand* x = &first->ops[1];
+    MOperand* y = &second->ops[0];
+    if (!isReg(&second->ops[1]) || second->ops[1].reg != t || mentions(y, t)) {
+        return false;
+    }
+    // x86 moves at most one memory operand, and only movq to a register
+    // takes a 64 bit immediate
+    if (isMemory(x) && isMemory(y)) return false;
+    if (x->kind == OPND_IMM && !isReg(y) && x->imm != (int)x->imm) return false;
+    if (liveAfter(p, block, i + 1, t)) return false;
+    second->ops[1] = *x;
+    removeMInstr(block, i);
+    return true;
+}
+
+// lea/setcc/imul t, ...; mov y, t -> the same computing y when t dies
+static bool retargetDef(Peephole* p, MBlock* block, int i) {
+    MInstr* def = at(block, i);
+    MInstr* copy = at(block, i + 1);
+    bool pure = def->opcode == M_LEA || def->opcode == M_SETCC ||
+                (def->opcode == M_IMUL && def->ops[2].kind == OPND_IMM);
+    if (!pure || !isGpr(&def->ops[0]) || !isMove(copy) ||
+        !isGpr(&copy->ops[0]) || !isReg(&copy->ops[1]) ||
+        copy->ops[1].reg != def->ops[0].reg) {
+        return false;
+    }
+    if (liveAfter(p, block, i + 1, def->ops[0].reg)) return false;
+    def->ops[0] = copy->ops[0];
+    removeMInstr(block, i + 1);
+    return true;
+}
+
+// mov r, $0 -> xor r, r
+static bool zeroIdiom(Peephole* p, MBlock* block, int i) {
+    (void)p;
+    MInstr* mov = at(block, i);
+    if (!isMove(mov) || !isGpr(&mov->ops[0]) || mov->ops[1].kind != OPND_IMM ||
+        mov->ops[1].imm != 0 || flagsLiveAfter(block, i)) {
+        return false;
+    }
+    mov->opcode = M_XOR;
+    mov->ops[1] = mov->ops[0];
+    return true;
+}
+
+// setcc r; test r, r; jne/je l -> jcc/jncc l when r dies
+static bool fuseCompare(Peephole* p, MBlock* block, int i) {
+    MInstr* set = at(block, i);
+    MInstr* test = at(block, i + 1);
+    MInstr* jump = at(block, i + 2);
+    if (set->opcode != M_SETCC || !test || test->opcode != M_TEST || !jump ||
+        jump->opcode != M_JCC) {
+        return false;
+    }
+    int r = set->ops[0].reg;
+    if (!isReg(&test->ops[0]) || !isReg(&test->ops[1]) || test->ops[0].reg != r ||
+        test->ops[1].reg != r) {
+        return false;
+    }
+    if (jump->cond != COND_NE && jump->cond != COND_E) return false;
+    if (liveAfter(p, block, i + 2, r)) return false;
+    jump->cond = jump->cond == COND_NE ? set->cond : invertCond(set->cond);
+    removeMInstr(block, i + 1);
+    removeMInstr(block, i);
+    return true;
+}
+
+// setcc t; cmp t, $0 (or test t, t); setne/sete r -> setcc/setncc r, the
+// truth value of a comparison normalized once more
+static bool normalizeSetcc(Peephole* p, MBlock* block, int i) {
+    MInstr* set = at(block, i);
+    MInstr* cmp = at(block, i + 1);
+    MInstr* again = at(block, i + 2);
+    if (set->opcode != M_SETCC || !cmp || !again || again->opcode != M_SETCC ||
+        (again->cond != COND_NE && again->cond != COND_E)) {
+        return false;
+    }
+    int t = set->ops[0].reg;
+    bool zeroTest =
+        (cmp->opcode == M_CMP && cmp->ops[1].kind == OPND_IMM &&
+         cmp->ops[1].imm == 0) ||
+        (cmp->opcode == M_TEST && isReg(&cmp->ops[1]) && cmp->ops[1].reg == t);
+    if (!zeroTest || !isReg(&cmp->ops[0]) || cmp->ops[0].reg != t) return false;
+    if (again->ops[0].reg != t && liveAfter(p, block, i + 2, t)) return false;
+    // the flags of the comparison are still those of the original compare
+    if (flagsLiveAfter(block, i + 2)) return false;
+    again->cond = again->cond == COND_NE ? set->cond : invertCond(set->cond);
+    removeMInstr(block, i + 1);
+    removeMInstr(block, i);
+    return true;
+}
+
+static bool isScale(long k) { return k == 2 || k == 4 || k == 8; }
+
+// imul t, s, k; lea d, (b, t) -> lea d, (b, s, k) when t dies, and the
+// same for add d, t
+static bool scaledIndex(Peephole* p, MBlock* block, int i) {
+    MInstr* mul = at(block, i);
+    MInstr* next = at(block, i + 1);
+    if (mul->opcode != M_IMUL || mul->ops[2].kind != OPND_IMM ||
+        !isScale(mul->ops[2].imm) || !isGpr(&mul->ops[0]) ||
+        !isGpr(&mul->ops[1]) || next == NULL) {
+        return false;
+    }
+    int t = mul->ops[0].reg, s = mul->ops[1].reg;
+    MOperand address;
+    if (next->opcode == M_LEA && next->ops[1].kind == OPND_MEM &&
+        next->ops[1].scale == 1) {
+        MOperand* m = &next->ops[1];
+        if (m->index == t && m->reg != t) {
+            address = memOperand(m->reg, s, mul->ops[2].imm, m->imm);
+        } else if (m->reg == t && m->index >= 0 && m->index != t) {
+            address = memOperand(m->index, s, mul->ops[2].imm, m->imm);
+        } else {
+            return false;
+        }
+    } else if (next->opcode == M_ADD && isGpr(&next->ops[0]) &&
+               isReg(&next->ops[1]) && next->ops[1].reg == t &&
+               next->ops[0].reg != t && !flagsLiveAfter(block, i + 1)) {
+        address = memOperand(next->ops[0].reg, s, mul->ops[2].imm, 0);
+    } else {
+        return false;
+    }
+    if (next->ops[0].reg != t && liveAfter(p, block, i + 1, t)) return false;
+    next->opcode = M_LEA;
+    next->ops[1] = address;
+    removeMInstr(block, i);
+    return true;
+}
+
+// imul d, s, 2/3/5/9 -> lea d, (s, s, 1/2/4/8)
+static bool multiplyByLea(Peephole* p, MBlock* block, int i) {
+    (void)p;
+    MInstr* mul = at(block, i);
+    if (mul->opcode != M_IMUL || mul->ops[2].kind != OPND_IMM ||
+        !isGpr(&mul->ops[0]) || !isGpr(&mul->ops[1]) ||
+        flagsLiveAfter(block, i)) {
+        return false;
+    }
+    long k = mul->ops[2].imm;
+    if (k != 2 && k != 3 && k != 5 && k != 9) return false;
+    int s = mul->ops[1].reg;
+    mul->opcode = M_LEA;
+    mul->ops[1] = memOperand(s, s, k == 2 ? 1 : k - 1, 0);
+    mul->ops[2].kind = OPND_NONE;
+    return true;
+}
+
+// tried in order at every index; earlier rules see the larger windows
+static Rule rules[] = {
+    {"self-move", selfMove, 0},
+    {"redundant-load", redundantLoad, 0},
+    {"move-chain", moveChain, 0},
+    {"retarget-def", retargetDef, 0},
+    {"normalize-setcc", normalizeSetcc, 0},
+    {"fuse-compare", fuseCompare, 0},
+    {"scaled-index", scaledIndex, 0},
+    {"multiply-by-lea", multiplyByLea, 0},
+    {"zero-idiom", zeroIdiom, 0},
+};
+
+#define RULE_COUNT (int)(sizeof(rules) / sizeof(rules[0]))
+
+//---------------------- Driver ------------------------
+
+static bool rewriteBlock(Peephole* p, MBlock* block) {
+    bool changed = false;
+    for (int i = 0; i < block->count; i++) {
+        for (int r = 0; r < RULE_COUNT; r++) {
+            if (!rules[r].apply(p, block, i)) continue;
+            // functions may be compiled on several threads at once
+            __atomic_fetch_add(&rules[r].hits, 1, __ATOMIC_RELAXED);
+            changed = true;
+            // a rewrite may complete a window starting a little earlier
+            i = (i < 3 ? 0 : i - 2) - 1;
+            break;
+        }
+    }
+    return changed;
+}
+
+void peephole(MFunction* fn) {
+    Peephole p;
+    p.fn = fn;
+    p.liveOut = irAlloc(ALLOC_CODEGEN, sizeof(unsigned) * fn->blockCount);
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        computeLiveOut(&p);
+        for (int b = 0; b < fn->blockCount; b++) {
+            if (rewriteBlock(&p, fn->blocks[b])) changed = true;
+        }
+    }
+    release(p.liveOut);
+}
+
+long peepholeHits(const char* rule) {
+    for (int r = 0; r < RULE_COUNT; r++) {
+        if (strcmp(rules[r].name, rule) == 0) return rules[r].hits;
+    }
+    panic("no peephole rule \"%s\"\n", rule);
+    return 0;
+}
+
+void printPeepholeStats(FILE* out) {
+    for (int r = 0; r < RULE_COUNT; r++) {
+        fprintf(out, "%-16s %8ld\n", rules[r].name, rules[r].hits);
+    }
+}
@@ -0,0 +1,395 @@
+//---------------------- Phase Report ------------------
+#include "phase.h"
+
+#include <errno.h>
+#include <linux/perf_event.h>
+#include <malloc.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+static const char* phaseNames[PHASE_COUNT] = {
+    [PHASE_SCAN] = "scan",         [PHASE_PARSE] = "parse",
+    [PHASE_SEMANTIC] = "semantic", [PHASE_IRGEN] = "irgen",
+    [PHASE_OPTIMIZE] = "optimize", [PHASE_CODEGEN] = "codegen",
+};
+
+// what objects counts in each phase
+static const char* phaseUnits[PHASE_COUNT] = {
+    [PHASE_SCAN] = "tokens",           [PHASE_PARSE] = "AST nodes",
+    [PHASE_SEMANTIC] = "AST nodes",    [PHASE_IRGEN] = "IR instructions",
+    [PHASE_OPTIMIZE] = "IR instructions", [PHASE_CODEGEN] = "functions compiled",
+};
+
+static const char* exprNames[EXPR_KIND_COUNT] = {
+    [EXPR_ASSIGNMENT] = "assignment", [EXPR_BINARY] = "binary",
+    [EXPR_CALL] = "call",             [EXPR_GROUPING] = "grouping",
+    [EXPR_LITERAL] = "literal",       [EXPR_UNARY] = "unary",
+    [EXPR_VARIABLE] = "variable",
+};
+
+static const char* stmtNames[STMT_KIND_COUNT] = {
+    [STMT_BLOCK] = "block", [STMT_EXPRESSION] = "expression", [STMT_IF] = "if",
+    [STMT_RETURN] = "return", [STMT_WHILE] = "while", [STMT_DECL] = "declaration",
+};
+
+static const char* declNames[DECL_KIND_COUNT] = {
+    [DECL_FUNCTION] = "function", [DECL_VARIABLE] = "variable", [DECL_STRUCT] = "struct",
+};
+
+static const struct {
+    const char* name;
+    unsigned type;
+    unsigned long config;
+} counterEvents[COUNTER_COUNT] = {
+    [COUNTER_CYCLES] = {"cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    [COUNTER_INSTRUCTIONS] = {"instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    [COUNTER_BRANCH_MISSES] = {"branch-misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+    [COUNTER_L1D_MISSES] = {"L1D-misses", PERF_TYPE_HW_CACHE,
+                            PERF_COUNT_HW_CACHE_L1D | PERF_COUNT_HW_CACHE_OP_READ << 8 |
+                                PERF_COUNT_HW_CACHE_RESULT_MISS << 16},
+    [COUNTER_LLC_MISSES] = {"LLC-misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+    [COUNTER_TASK_CLOCK] = {"task-clock", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK},
+    [COUNTER_PAGE_FAULTS] = {"page-faults", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS},
+};
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// bytes in use in every malloc arena and in mmapped blocks
+static long heapInUse(void) {
+    struct mallinfo2 info = mallinfo2();
+    return (long)(info.uordblks + info.hblkhd);
+}
+
+static long peakRss(void) {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+//---------------------- Counters ----------------------
+// Every counter the kernel lets us have joins one group on the calling
+// thread, user space only. Virtual machines and containers often have no
+// hardware counters, or forbid them; the software ones usually remain.
+
+static void openCounters(PhaseReport* report) {
+    report->group = -1;
+    for (int c = 0; c < COUNTER_COUNT; c++) {
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = counterEvents[c].type;
+        attr.config = counterEvents[c].config;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED |
+                           PERF_FORMAT_TOTAL_TIME_RUNNING;
+        report->fds[c] = syscall(SYS_perf_event_open, &attr, 0, -1, report->group, 0);
+        if (report->fds[c] < 0) {
+            if (report->counterError == 0) report->counterError = errno;
+            continue;
+        }
+        if (report->group < 0) report->group = report->fds[c];
+        report->slots[c] = report->slotCount++;
+    }
+}
+
+// the counts so far, scaled up when the kernel had to share the hardware
+// among more counters than it has; through syscall because main.c has a
+// read of its own
+static void readCounters(PhaseReport* report, long counts[COUNTER_COUNT]) {
+    // the number of counters, the times enabled and running, the values
+    unsigned long data[3 + COUNTER_COUNT];
+    if (syscall(SYS_read, report->group, data, sizeof(data)) < 0) return;
+    double scale = data[2] > 0 ? (double)data[1] / data[2] : 0;
+    for (int c = 0; c < COUNTER_COUNT; c++) {
+        if (report->fds[c] >= 0) counts[c] = data[3 + report->slots[c]] * scale;
+    }
+}
+
+//---------------------- Phases ------------------------
+
+PhaseReport* newPhaseReport(unsigned what) {
+    PhaseReport* report = allocateZeroed(ALLOC_DRIVER, 1, sizeof(PhaseReport));
+    report->what = what;
+    report->current = -1;
+    report->group = -1;
+    if (what & REPORT_COUNTERS) openCounters(report);
+    return report;
+}
+
+void freePhaseReport(PhaseReport* report) {
+    for (int c = 0; c < COUNTER_COUNT; c++) {
+        if (report->group >= 0 && report->fds[c] >= 0) close(report->fds[c]);
+    }
+    release(report);
+}
+
+void enterPhase(PhaseReport* report, Phase phase) {
+    long counts[COUNTER_COUNT] = {0};
+    if (report->group >= 0) readCounters(report, counts);
+    double time = now();
+    // mallinfo2 walks every arena, so only when asked
+    long heap = report->what & REPORT_MEMORY ? heapInUse() : 0;
+    int ended = report->current;
+    if (ended >= 0) {
+        report->seconds[ended] += time - report->started;
+        report->heap[ended] += heap - report->heapStarted;
+        if (report->what & REPORT_MEMORY) report->peakRss[ended] = peakRss();
+        for (int c = 0; c < COUNTER_COUNT; c++) {
+            report->counters[ended][c] += counts[c] - report->countersStarted[c];
+        }
+    }
+    report->current = phase < PHASE_COUNT ? (int)phase : -1;
+    report->started = time;
+    report->heapStarted = heap;
+    memcpy(report->countersStarted, counts, sizeof(counts));
+}
+
+//---------------------- Node Counts -------------------
+
+static void countExpr(PhaseReport* report, Expr* expr) {
+    if (expr == NULL) return;
+    report->exprs[expr->type]++;
+    switch (expr->type) {
+        case EXPR_ASSIGNMENT:
+            countExpr(report, expr->assignment.value);
+            break;
+        case EXPR_BINARY:
+            countExpr(report, expr->binary.left);
+            countExpr(report, expr->binary.right);
+            break;
+        case EXPR_CALL:
+            countExpr(report, expr->call.callee);
+            for (int i = 0; i < expr->call.argcount; i++) {
+                countExpr(report, expr->call.arguments[i]);
+            }
+            break;
+        case EXPR_UNARY:
+            countExpr(report, expr->unary.right);
+            break;
+        default:
+            break;
+    }
+}
+
+static void countDecl(PhaseReport* report, Decl* decl);
+
+static void countStmt(PhaseReport* report, Stmt* stmt) {
+    if (stmt == NULL) return;
+    report->stmts[stmt->type]++;
+    switch (stmt->type) {
+        case STMT_BLOCK:
+            for (int i = 0; i < stmt->block.count; i++) {
+                countStmt(report, stmt->block.statements[i]);
+            }
+            break;
+        case STMT_EXPRESSION:
+            countExpr(report, stmt->expr.expression);
+            break;
+        case STMT_IF:
+            countExpr(report, stmt->ifStmt.condition);
+            countStmt(report, stmt->ifStmt.thenBranch);
+            countStmt(report, stmt->ifStmt.elseBranch);
+            break;
+        case STMT_RETURN:
+            countExpr(report, stmt->returnStmt.value);
+            break;
+        case STMT_WHILE:
+            countExpr(report, stmt->whileStmt.condition);
+            countStmt(report, stmt->whileStmt.body);
+            break;
+        case STMT_DECL:
+            countDecl(report, stmt->decl.decl);
+            break;
+    }
+}
+
+static void countDecl(PhaseReport* report, Decl* decl) {
+    report->decls[decl->type]++;
+    switch (decl->type) {
+        case DECL_FUNCTION:
+            countStmt(report, decl->function.body);
+            break;
+        case DECL_VARIABLE:
+            countExpr(report, decl->variable.initializer);
+            break;
+        case DECL_STRUCT:
+            for (int i = 0; i < decl->record.fieldsCount; i++) {
+                countDecl(report, decl->record.fields[i]);
+            }
+            break;
+    }
+}
+
+long countNodes(PhaseReport* report, Program* program) {
+    memset(report->exprs, 0, sizeof(report->exprs));
+    memset(report->stmts, 0, sizeof(report->stmts));
+    memset(report->decls, 0, sizeof(report->decls));
+    for (int i = 0; i < program->count; i++) countDecl(report, program->declarations[i]);
+    long total = 0;
+    for (int i = 0; i < EXPR_KIND_COUNT; i++) total += report->exprs[i];
+    for (int i = 0; i < STMT_KIND_COUNT; i++) total += report->stmts[i];
+    for (int i = 0; i < DECL_KIND_COUNT; i++) total += report->decls[i];
+    return total;
+}
+
+long countAstNodes(Program* program) {
+    PhaseReport counts;
+    return countNodes(&counts, program);
+}
+
+//---------------------- Printing ----------------------
+
+static void printKindsJson(const char* name, const char** names, long* counts,
+                           int count, FILE* out) {
+    fprintf(out, ",\"%s\":{", name);
+    for (int i = 0; i < count; i++) {
+        fprintf(out, "%s\"%s\":%ld", i ? "," : "", names[i], counts[i]);
+    }
+    fprintf(out, "}");
+}
+
+static void printJson(PhaseReport* report, const char* input, FILE* out) {
+    fprintf(out, "{\"input\":\"");
+    for (const char* c = input; *c; c++) {
+        if (*c == '"' || *c == '\\') fputc('\\', out);
+        fputc(*c, out);
+    }
+    fprintf(out, "\",\"phases\":[");
+    for (int p = 0; p < PHASE_COUNT; p++) {
+        fprintf(out, "%s{\"name\":\"%s\"", p ? "," : "", phaseNames[p]);
+        if (report->what & REPORT_TIME) fprintf(out, ",\"seconds\":%.9f", report->seconds[p]);
+        if (report->what & REPORT_MEMORY) {
+            fprintf(out, ",\"heapBytes\":%ld,\"peakRssKb\":%ld", report->heap[p],
+                    report->peakRss[p]);
+        }
+        if (report->what & REPORT_COUNTERS) {
+            fprintf(out, ",\"counters\":{");
+            for (int c = 0; c < COUNTER_COUNT; c++) {
+                fprintf(out, "%s\"%s\":", c ? "," : "", counterEvents[c].name);
+                if (report->fds[c] >= 0) {
+                    fprintf(out, "%ld", report->counters[p][c]);
+                } else {
+                    fprintf(out, "null");
+                }
+            }
+            fprintf(out, "}");
+        }
+        fprintf(out, ",\"objects\":%ld,\"units\":\"%s\"}", report->objects[p], phaseUnits[p]);
+    }
+    fprintf(out, "]");
+    if (report->counterError) {
+        fprintf(out, ",\"counterError\":\"%s\"", strerror(report->counterError));
+    }
+    printKindsJson("exprs", exprNames, report->exprs, EXPR_KIND_COUNT, out);
+    printKindsJson("stmts", stmtNames, report->stmts, STMT_KIND_COUNT, out);
+    printKindsJson("decls", declNames, report->decls, DECL_KIND_COUNT, out);
+    fprintf(out, "}\n");
+}
+
+static void printKinds(const char* name, const char** names, long* counts, int count,
+                       FILE* out) {
+    fprintf(out, "%-10s", name);
+    for (int i = 0; i < count; i++) fprintf(out, " %s %ld", names[i], counts[i]);
+    fprintf(out, "\n");
+}
+
+// a counter, or its count for each object of the phase, "-" if it is not
+// there
+static void printCount(PhaseReport* report, int p, Counter c, bool perObject, FILE* out) {
+    if (report->fds[c] < 0) {
+        fprintf(out, " %11s", "-");
+    } else if (perObject) {
+        fprintf(out, " %11.2f",
+                report->objects[p] ? (double)report->counters[p][c] / report->objects[p] : 0);
+    } else {
+        fprintf(out, " %11ld", report->counters[p][c]);
+    }
+}
+
+static void printCounters(PhaseReport* report, FILE* out) {
+    if (report->group < 0) {
+        fprintf(out, "no counters: %s\n", strerror(report->counterError));
+        return;
+    }
+    if (report->counterError) {
+        fprintf(out, "not counted (%s):", strerror(report->counterError));
+        for (int c = 0; c < COUNTER_COUNT; c++) {
+            if (report->fds[c] < 0) fprintf(out, " %s", counterEvents[c].name);
+        }
+        fprintf(out, "\n");
+    }
+    fprintf(out, "%-10s %11s %11s %5s %11s %11s %11s %11s %11s %11s\n", "phase", "cycles",
+            "instrs", "IPC", "cycles/obj", "brmiss/obj", "L1D/obj", "LLC/obj", "cpu ms",
+            "faults");
+    for (int p = 0; p < PHASE_COUNT; p++) {
+        long* counts = report->counters[p];
+        fprintf(out, "%-10s", phaseNames[p]);
+        printCount(report, p, COUNTER_CYCLES, false, out);
+        printCount(report, p, COUNTER_INSTRUCTIONS, false, out);
+        if (report->fds[COUNTER_CYCLES] >= 0 && report->fds[COUNTER_INSTRUCTIONS] >= 0) {
+            fprintf(out, " %5.2f",
+                    counts[COUNTER_CYCLES]
+                        ? (double)counts[COUNTER_INSTRUCTIONS] / counts[COUNTER_CYCLES]
+                        : 0);
+        } else {
+            fprintf(out, " %5s", "-");
+        }
+        printCount(report, p, COUNTER_CYCLES, true, out);
+        printCount(report, p, COUNTER_BRANCH_MISSES, true, out);
+        printCount(report, p, COUNTER_L1D_MISSES, true, out);
+        printCount(report, p, COUNTER_LLC_MISSES, true, out);
+        if (report->fds[COUNTER_TASK_CLOCK] >= 0) {
+            fprintf(out, " %11.3f", counts[COUNTER_TASK_CLOCK] * 1e-6);
+        } else {
+            fprintf(out, " %11s", "-");
+        }
+        printCount(report, p, COUNTER_PAGE_FAULTS, false, out);
+        fprintf(out, "\n");
+    }
+}
+
+void printPhaseReport(PhaseReport* report, const char* input, bool json, FILE* out) {
+    if (json) {
+        printJson(report, input, out);
+        return;
+    }
+    bool time = report->what & REPORT_TIME, memory = report->what & REPORT_MEMORY;
+    double total = 0;
+    long heap = 0;
+    for (int p = 0; p < PHASE_COUNT; p++) {
+        total += report->seconds[p];
+        heap += report->heap[p];
+    }
+    fprintf(out, "%s\n%-10s", input, "phase");
+    if (time) fprintf(out, " %10s %6s", "time", "share");
+    if (memory) fprintf(out, " %10s %10s", "heap", "peak rss");
+    fprintf(out, "  objects\n");
+    for (int p = 0; p < PHASE_COUNT; p++) {
+        fprintf(out, "%-10s", phaseNames[p]);
+        if (time) {
+            fprintf(out, " %8.3fms %5.1f%%", report->seconds[p] * 1e3,
+                    total > 0 ? report->seconds[p] / total * 100 : 0);
+        }
+        if (memory) {
+            fprintf(out, " %+8ldKB %8ldKB", report->heap[p] / 1024, report->peakRss[p]);
+        }
+        fprintf(out, "  %ld %s\n", report->objects[p], phaseUnits[p]);
+    }
+    if (time || memory) {
+        fprintf(out, "%-10s", "total");
+        if (time) fprintf(out, " %8.3fms %5.1f%%", total * 1e3, 100.0);
+        if (memory) fprintf(out, " %+8ldKB %8ldKB", heap / 1024, peakRss());
+        fprintf(out, "\n");
+    }
+    if (report->what & REPORT_COUNTERS) printCounters(report, out);
+    printKinds("exprs", exprNames, report->exprs, EXPR_KIND_COUNT, out);
+    printKinds("stmts", stmtNames, report->stmts, STMT_KIND_COUNT, out);
+    printKinds("decls", declNames, report->decls, DECL_KIND_COUNT, out);
+}
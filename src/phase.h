@@ -0,0 +1,79 @@
+#ifndef PHASE_H
+#define PHASE_H
+
+#include "ast.h"
+
+//---------------------- Phase Report ------------------
+// -ftime-report, -fmem-report and -fperf-report: the wall clock time,
+// heap growth and peak resident size at the end of each phase of
+// compiling a file, the hardware and software counters of the compiling
+// thread over each phase, what each phase made, and the AST nodes of each
+// kind. A compile without a report has NULL for it and tests that once
+// per phase.
+
+typedef enum {
+    PHASE_SCAN,
+    PHASE_PARSE,
+    PHASE_SEMANTIC,
+    PHASE_IRGEN,
+    PHASE_OPTIMIZE,
+    PHASE_CODEGEN,
+    PHASE_COUNT,
+} Phase;
+
+// what a report measures
+#define REPORT_TIME 1
+#define REPORT_MEMORY 2
+#define REPORT_COUNTERS 4
+
+// perf_event_open counters, read as one group
+typedef enum {
+    COUNTER_CYCLES,
+    COUNTER_INSTRUCTIONS,
+    COUNTER_BRANCH_MISSES,
+    COUNTER_L1D_MISSES,
+    COUNTER_LLC_MISSES,
+    COUNTER_TASK_CLOCK,  // nanoseconds on the CPU
+    COUNTER_PAGE_FAULTS,
+    COUNTER_COUNT,
+} Counter;
+
+#define EXPR_KIND_COUNT (EXPR_VARIABLE + 1)
+#define STMT_KIND_COUNT (STMT_DECL + 1)
+#define DECL_KIND_COUNT (DECL_STRUCT + 1)
+
+typedef struct {
+    unsigned what;
+    int current;  // the running phase, -1 before the first
+    double started;
+    long heapStarted;
+    int group;                    // leading counter's descriptor, -1 if none opened
+    int fds[COUNTER_COUNT];       // -1 for a counter that could not be opened
+    int slots[COUNTER_COUNT];     // place of each open counter in the group
+    int slotCount;
+    int counterError;             // errno of the first counter that failed, or 0
+    long countersStarted[COUNTER_COUNT];
+    long counters[PHASE_COUNT][COUNTER_COUNT];
+    double seconds[PHASE_COUNT];
+    long heap[PHASE_COUNT];     // bytes the heap grew by, which may be less than 0
+    long peakRss[PHASE_COUNT];  // kilobytes
+    long objects[PHASE_COUNT];  // what the phase made: tokens, AST nodes, ...
+    long exprs[EXPR_KIND_COUNT];
+    long stmts[STMT_KIND_COUNT];
+    long decls[DECL_KIND_COUNT];
+} PhaseReport;
+
+PhaseReport* newPhaseReport(unsigned what);
+void freePhaseReport(PhaseReport* report);
+// ends the running phase and starts phase, or with PHASE_COUNT just ends
+void enterPhase(PhaseReport* report, Phase phase);
+
+// counts the nodes of program by kind, returning how many there are
+long countNodes(PhaseReport* report, Program* program);
+// the same without keeping the kinds
+long countAstNodes(Program* program);
+
+// a table of the phases of input, or a line of JSON
+void printPhaseReport(PhaseReport* report, const char* input, bool json, FILE* out);
+
+#endif
@@ -0,0 +1,141 @@
+//---------------------- Thread Pool -------------------
+#include "pool.h"
+
+#include <pthread.h>
+#include <unistd.h>
+
+// nothing is pushed once the workers start, so a deque is a fixed array
+// whose top moves up under steals and whose bottom moves down under pops
+typedef struct {
+    int* jobs;
+    long top;
+    long bottom;
+} Deque;
+
+typedef struct Pool Pool;
+
+typedef struct {
+    Pool* pool;
+    int id;
+    pthread_t thread;
+} Worker;
+
+struct Pool {
+    Deque* deques;
+    Worker* workers;
+    int workerCount;
+    JobFunction job;
+    void* context;
+};
+
+#define EMPTY -1
+#define ABORT -2  // lost a race for the last job, worth trying again
+
+static int pop(Deque* d) {
+    long b = __atomic_load_n(&d->bottom, __ATOMIC_RELAXED) - 1;
+    __atomic_store_n(&d->bottom, b, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    long t = __atomic_load_n(&d->top, __ATOMIC_RELAXED);
+    if (t > b) {
+        __atomic_store_n(&d->bottom, b + 1, __ATOMIC_RELAXED);
+        return EMPTY;
+    }
+    int job = d->jobs[b];
+    if (t == b) {
+        // the last job, which a thief may be taking as well
+        if (!__atomic_compare_exchange_n(&d->top, &t, t + 1, false, __ATOMIC_SEQ_CST,
+                                         __ATOMIC_RELAXED)) {
+            job = EMPTY;
+        }
+        __atomic_store_n(&d->bottom, b + 1, __ATOMIC_RELAXED);
+    }
+    return job;
+}
+
+static int steal(Deque* d) {
+    long t = __atomic_load_n(&d->top, __ATOMIC_ACQUIRE);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    long b = __atomic_load_n(&d->bottom, __ATOMIC_ACQUIRE);
+    if (t >= b) return EMPTY;
+    int job = d->jobs[t];
+    if (!__atomic_compare_exchange_n(&d->top, &t, t + 1, false, __ATOMIC_SEQ_CST,
+                                     __ATOMIC_RELAXED)) {
+        return ABORT;
+    }
+    return job;
+}
+
+static void* work(void* argument) {
+    Worker* worker = argument;
+    Pool* pool = worker->pool;
+    for (;;) {
+        int job = pop(&pool->deques[worker->id]);
+        // with nothing left at home, go round the others until a whole
+        // round finds every deque empty
+        for (bool retry = true; job == EMPTY && retry;) {
+            retry = false;
+            for (int i = 1; i < pool->workerCount && job < 0; i++) {
+                job = steal(&pool->deques[(worker->id + i) % pool->workerCount]);
+                if (job == ABORT) retry = true;
+            }
+            if (job == ABORT) job = EMPTY;
+        }
+        if (job == EMPTY) return NULL;
+        pool->job(pool->context, job);
+    }
+}
+
+int processorCount(void) {
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? (int)count : 1;
+}
+
+void runJobs(int threads, int count, JobFunction job, void* context, long* cost) {
+    if (threads <= 0) threads = processorCount();
+    if (threads > count) threads = count;
+    if (threads <= 1) {
+        for (int i = 0; i < count; i++) job(context, i);
+        return;
+    }
+    // deal the largest jobs first, round robin, so that every deque starts
+    // with a similar share of the work
+    int* order = allocate(ALLOC_DRIVER, sizeof(int) * count);
+    for (int i = 0; i < count; i++) {
+        int k = i;
+        while (cost && k > 0 && cost[order[k - 1]] < cost[i]) {
+            order[k] = order[k - 1];
+            k--;
+        }
+        order[k] = i;
+    }
+    Pool pool;
+    pool.workerCount = threads;
+    pool.job = job;
+    pool.context = context;
+    pool.deques = allocateZeroed(ALLOC_DRIVER, threads, sizeof(Deque));
+    pool.workers = allocateZeroed(ALLOC_DRIVER, threads, sizeof(Worker));
+    for (int w = 0; w < threads; w++) {
+        Deque* d = &pool.deques[w];
+        d->jobs = allocate(ALLOC_DRIVER, sizeof(int) * (count / threads + 1));
+        // a worker pops from the bottom, so the largest go on last
+        for (int i = w; i < count; i += threads) d->jobs[d->bottom++] = order[i];
+        for (long i = 0; i < d->bottom / 2; i++) {
+            int swap = d->jobs[i];
+            d->jobs[i] = d->jobs[d->bottom - 1 - i];
+            d->jobs[d->bottom - 1 - i] = swap;
+        }
+        pool.workers[w].pool = &pool;
+        pool.workers[w].id = w;
+    }
+    for (int w = 1; w < threads; w++) {
+        if (pthread_create(&pool.workers[w].thread, NULL, work, &pool.workers[w])) {
+            panic("could not start a worker thread\n");
+        }
+    }
+    work(&pool.workers[0]);
+    for (int w = 1; w < threads; w++) pthread_join(pool.workers[w].thread, NULL);
+    for (int w = 0; w < threads; w++) release(pool.deques[w].jobs);
+    release(pool.deques);
+    release(pool.workers);
+    release(order);
+}
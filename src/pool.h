@@ -0,0 +1,25 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include "util.h"
+
+//---------------------- Thread Pool -------------------
+// Runs a batch of independent jobs on worker threads. The jobs are dealt
+// out to a deque per worker up front; a worker pops from the bottom of
+// its own deque and, once that is empty, steals from the top of the
+// others' (Chase and Lev), so nothing takes a lock. Jobs are numbered and
+// write their results into slots of their own, which keeps the output in
+// job order whatever ran where.
+
+typedef void (*JobFunction)(void* context, int job);
+
+// runs job(context, i) for every i below count on up to threads threads,
+// the caller being one of them, and returns when all have finished. cost,
+// if not NULL, estimates each job's work so that the largest are dealt
+// first.
+void runJobs(int threads, int count, JobFunction job, void* context, long* cost);
+
+// the number of processors online, for a thread count of 0
+int processorCount(void);
+
+#endif
@@ -0,0 +1,147 @@
+//---------------------- Dead Declarations -------------
+#include "prune.h"
+
+typedef struct {
+    Program* ast;
+    NameTable names;  // first function or global of each name
+    int* next;        // the next declaration of the same name, or -1
+    bool* reached;    // per declaration
+    int* worklist;  // declarations reached whose bodies are still to scan
+    int count;
+} Reach;
+
+static String declName(Decl* decl) {
+    switch (decl->type) {
+        case DECL_FUNCTION:
+            return decl->function.name;
+        case DECL_VARIABLE:
+            return decl->variable.name;
+        case DECL_STRUCT:
+            return decl->record.name;
+    }
+    return makeString("", 0);
+}
+
+// every function or global called name, as a REPL session may redefine one
+static bool reachName(Reach* r, String name) {
+    bool found = false;
+    for (int i = nameTableFind(&r->names, name); i >= 0; i = r->next[i]) {
+        found = true;
+        if (r->reached[i]) continue;
+        r->reached[i] = true;
+        r->worklist[r->count++] = i;
+    }
+    return found;
+}
+
+static void reachExpr(Reach* r, Expr* expr) {
+    switch (expr->type) {
+        case EXPR_ASSIGNMENT:
+            reachName(r, expr->assignment.name);
+            reachExpr(r, expr->assignment.value);
+            break;
+        case EXPR_BINARY:
+            reachExpr(r, expr->binary.left);
+            reachExpr(r, expr->binary.right);
+            break;
+        case EXPR_CALL:
+            reachExpr(r, expr->call.callee);
+            for (int i = 0; i < expr->call.argcount; i++) {
+                reachExpr(r, expr->call.arguments[i]);
+            }
+            break;
+        case EXPR_UNARY:
+            reachExpr(r, expr->unary.right);
+            break;
+        case EXPR_VARIABLE:
+            reachName(r, expr->variable.name);
+            break;
+        case EXPR_GROUPING:
+        case EXPR_LITERAL:
+            break;
+    }
+}
+
+static void reachStmt(Reach* r, Stmt* stmt) {
+    switch (stmt->type) {
+        case STMT_EXPRESSION:
+            reachExpr(r, stmt->expr.expression);
+            break;
+        case STMT_BLOCK:
+            for (int i = 0; i < stmt->block.count; i++) {
+                reachStmt(r, stmt->block.statements[i]);
+            }
+            break;
+        case STMT_IF:
+            reachExpr(r, stmt->ifStmt.condition);
+            reachStmt(r, stmt->ifStmt.thenBranch);
+            if (stmt->ifStmt.elseBranch) reachStmt(r, stmt->ifStmt.elseBranch);
+            break;
+        case STMT_WHILE:
+            reachExpr(r, stmt->whileStmt.condition);
+            reachStmt(r, stmt->whileStmt.body);
+            break;
+        case STMT_RETURN:
+            if (stmt->returnStmt.value) reachExpr(r, stmt->returnStmt.value);
+            break;
+        case STMT_DECL: {
+            Decl* decl = stmt->decl.decl;
+            if (decl->type == DECL_VARIABLE && decl->variable.initializer) {
+                reachExpr(r, decl->variable.initializer);
+            }
+            break;
+        }
+    }
+}
+
+Program* removeUnreachable(Program* program, String* roots, int rootCount) {
+    Reach r;
+    r.ast = program;
+    r.reached = allocateZeroed(ALLOC_OPTIMIZER, program->count + 1, sizeof(bool));
+    r.worklist = allocate(ALLOC_OPTIMIZER, sizeof(int) * (program->count + 1));
+    r.count = 0;
+    memset(&r.names, 0, sizeof(NameTable));
+    r.next = allocate(ALLOC_OPTIMIZER, sizeof(int) * (program->count + 1));
+    for (int i = 0; i < program->count; i++) {
+        r.next[i] = -1;
+        Decl* decl = program->declarations[i];
+        if (decl->type == DECL_STRUCT) continue;
+        int last = nameTableFind(&r.names, declName(decl));
+        if (last < 0) {
+            nameTableAdd(&r.names, declName(decl), i);
+            continue;
+        }
+        while (r.next[last] >= 0) last = r.next[last];
+        r.next[last] = i;
+    }
+    bool rooted = false;
+    for (int i = 0; i < rootCount; i++) {
+        if (reachName(&r, roots[i])) rooted = true;
+    }
+    while (r.count > 0) {
+        Decl* decl = program->declarations[r.worklist[--r.count]];
+        if (decl->type == DECL_FUNCTION) {
+            reachStmt(&r, decl->function.body);
+        } else if (decl->variable.initializer) {
+            reachExpr(&r, decl->variable.initializer);
+        }
+    }
+    Program* dead = allocate(ALLOC_OPTIMIZER, sizeof(Program));
+    dead->declarations = allocate(ALLOC_OPTIMIZER, sizeof(Decl*) * (program->count + 1));
+    dead->count = 0;
+    int kept = 0;
+    for (int i = 0; i < program->count; i++) {
+        Decl* decl = program->declarations[i];
+        if (!rooted || decl->type == DECL_STRUCT || r.reached[i]) {
+            program->declarations[kept++] = decl;
+        } else {
+            dead->declarations[dead->count++] = decl;
+        }
+    }
+    program->count = kept;
+    freeNameTable(&r.names);
+    release(r.next);
+    release(r.reached);
+    release(r.worklist);
+    return dead;
+}
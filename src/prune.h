@@ -0,0 +1,17 @@
+#ifndef PRUNE_H
+#define PRUNE_H
+
+#include "ast.h"
+
+//---------------------- Dead Declarations -------------
+// Functions and globals that no root reaches through calls and variable
+// references are taken out of the program before IR generation. A name
+// counts as a reference even where a local shadows it, which only keeps
+// more. Structs always stay. When none of the roots is defined, as in a
+// library without main, everything stays.
+
+// moves the unreachable declarations of program, in their order, into
+// the returned program
+Program* removeUnreachable(Program* program, String* roots, int rootCount);
+
+#endif
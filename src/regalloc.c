@@ -0,0 +1,943 @@
+//---------------------- Register Allocation -----------
+// Linear scan over live intervals with lifetime holes and live range
+// splitting, after Wimmer and Franz, "Linear Scan Register Allocation on
+// SSA Form". Instruction i gets three positions: 4i is the gap before it,
+// where moves are inserted, 4i+1 reads its operands and 4i+2 writes its
+// results. Intervals are only ever split at gaps.
+#include <limits.h>
+#include <stdint.h>
+
+#include "x86.h"
+
+#define MAX_OPERANDS (REG_COUNT + 8)
+
+// allocation order: caller-saved registers first, so that leaf functions
+// need not save anything
+static const Reg gprOrder[] = {RAX, RCX, RDX, RSI, RDI, R8,  R9,
+                               R10, RBX, R12, R13, R14, R15};
+static const Reg xmmOrder[] = {XMM0, XMM1, XMM2,  XMM3,  XMM4,
+                               XMM5, XMM6, XMM7,  XMM8,  XMM9,
+                               XMM10, XMM11, XMM12, XMM13, XMM14};
+
+typedef struct {
+    int from;
+    int to;
+} Range;
+
+typedef struct Interval Interval;
+struct Interval {
+    int reg;  // the register this is (a piece of) the lifetime of
+    Range* ranges;  // ascending and disjoint
+    int rangeCount;
+    int rangeCapacity;
+    int* uses;  // ascending positions needing the value in a register
+    int useCount;
+    int useCapacity;
+    int hint;      // register to share a location with, or -1
+    int assigned;  // physical register, -1 while on the stack
+};
+
+typedef struct {
+    Interval** items;
+    int count;
+    int capacity;
+} IntervalList;
+
+typedef struct {
+    MFunction* fn;
+    MInstr** instrs;  // by index in the layout
+    int instrCount;
+    int words;  // per live set
+    uint64_t** liveIn;
+    uint64_t** liveOut;
+    IntervalList* pieces;  // per register, ordered by start
+    Interval** fixed;      // per physical register
+    int* spillSlot;        // per register, -1 until needed
+    IntervalList unhandled;  // ordered by decreasing start
+    IntervalList active;
+    IntervalList inactive;
+} Allocator;
+
+static bool isAllocatable(int reg) {
+    return IS_VIRTUAL(reg) ||
+           (reg != RSP && reg != RBP && reg != SCRATCH_GPR &&
+            reg != SCRATCH_XMM);
+}
+
+static void push(IntervalList* list, Interval* interval) {
+    if (list->count == list->capacity) {
+        list->capacity = list->capacity ? list->capacity * 2 : 16;
+        list->items = reallocate(ALLOC_CODEGEN, list->items, sizeof(Interval*) * list->capacity);
+    }
+    list->items[list->count++] = interval;
+}
+
+static void removeAt(IntervalList* list, int index) {
+    list->items[index] = list->items[--list->count];
+}
+
+//---------------------- Liveness ----------------------
+
+static bool testBit(uint64_t* set, int bit) {
+    return (set[bit / 64] >> (bit % 64)) & 1;
+}
+
+static void setBit(uint64_t* set, int bit) {
+    set[bit / 64] |= (uint64_t)1 << (bit % 64);
+}
+
+static void clearBit(uint64_t* set, int bit) {
+    set[bit / 64] &= ~((uint64_t)1 << (bit % 64));
+}
+
+static void numberInstructions(Allocator* alloc) {
+    MFunction* fn = alloc->fn;
+    int count = 0;
+    for (int b = 0; b < fn->blockCount; b++) count += fn->blocks[b]->count;
+    release(alloc->instrs);
+    alloc->instrs = irAlloc(ALLOC_CODEGEN, sizeof(MInstr*) * (count + 1));
+    alloc->instrCount = 0;
+    for (int b = 0; b < fn->blockCount; b++) {
+        MBlock* block = fn->blocks[b];
+        block->from = 4 * alloc->instrCount;
+        for (int i = 0; i < block->count; i++) {
+            alloc->instrs[alloc->instrCount++] = block->instrs[i];
+        }
+        block->to = 4 * alloc->instrCount;
+    }
+}
+
+// live-in and live-out sets of every block, iterated to a fixed point
+static void computeLiveness(Allocator* alloc) {
+    MFunction* fn = alloc->fn;
+    alloc->words = (fn->regCount + 63) / 64;
+    int words = alloc->words;
+    uint64_t** gen = irAlloc(ALLOC_CODEGEN, sizeof(uint64_t*) * fn->blockCount);
+    uint64_t** kill = irAlloc(ALLOC_CODEGEN, sizeof(uint64_t*) * fn->blockCount);
+    alloc->liveIn = irAlloc(ALLOC_CODEGEN, sizeof(uint64_t*) * fn->blockCount);
+    alloc->liveOut = irAlloc(ALLOC_CODEGEN, sizeof(uint64_t*) * fn->blockCount);
+    int uses[MAX_OPERANDS], defs[MAX_OPERANDS], useCount, defCount;
+    for (int b = 0; b < fn->blockCount; b++) {
+        MBlock* block = fn->blocks[b];
+        gen[b] = irAlloc(ALLOC_CODEGEN, sizeof(uint64_t) * words);
+        kill[b] = irAlloc(ALLOC_CODEGEN, sizeof(uint64_t) * words);
+        alloc->liveIn[b] = irAlloc(ALLOC_CODEGEN, sizeof(uint64_t) * words);
+        alloc->liveOut[b] = irAlloc(ALLOC_CODEGEN, sizeof(uint64_t) * words);
+        for (int i = 0; i < block->count; i++) {
+            machineOperands(block->instrs[i], uses, &useCount, defs, &defCount);
+            for (int u = 0; u < useCount; u++) {
+                if (isAllocatable(uses[u]) && !testBit(kill[b], uses[u])) {
+                    setBit(gen[b], uses[u]);
+                }
+            }
+            for (int d = 0; d < defCount; d++) {
+                if (isAllocatable(defs[d])) setBit(kill[b], defs[d]);
+            }
+        }
+    }
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (int b = fn->blockCount - 1; b >= 0; b--) {
+            MBlock* block = fn->blocks[b];
+            uint64_t* out = alloc->liveOut[b];
+            uint64_t* in = alloc->liveIn[b];
+            for (int s = 0; s < block->succCount; s++) {
+                uint64_t* succIn = alloc->liveIn[block->succs[s]->id];
+                for (int w = 0; w < words; w++) out[w] |= succIn[w];
+            }
+            for (int w = 0; w < words; w++) {
+                uint64_t next = gen[b][w] | (out[w] & ~kill[b][w]);
+                if (next != in[w]) {
+                    in[w] = next;
+                    changed = true;
+                }
+            }
+        }
+    }
+    for (int b = 0; b < fn->blockCount; b++) {
+        release(gen[b]);
+        release(kill[b]);
+    }
+    release(gen);
+    release(kill);
+}
+
+static void freeLiveness(Allocator* alloc) {
+    for (int b = 0; b < alloc->fn->blockCount; b++) {
+        release(alloc->liveIn[b]);
+        release(alloc->liveOut[b]);
+    }
+    release(alloc->liveIn);
+    release(alloc->liveOut);
+}
+
+// instructions whose only effect is to write a virtual register nobody
+// reads; typically constants that were folded into immediates
+static bool isRemovable(MInstr* instr) {
+    switch (instr->opcode) {
+        case M_MOV:
+        case M_LEA:
+        case M_ADD:
+        case M_SUB:
+        case M_IMUL:
+        case M_NEG:
+        case M_SETCC:
+        case M_VMOV:
+        case M_VADD:
+        case M_VSUB:
+        case M_VSPLAT:
+            return instr->ops[0].kind == OPND_REG &&
+                   IS_VIRTUAL(instr->ops[0].reg);
+        default:
+            return false;
+    }
+}
+
+static void removeDeadInstrs(Allocator* alloc) {
+    MFunction* fn = alloc->fn;
+    int uses[MAX_OPERANDS], defs[MAX_OPERANDS], useCount, defCount;
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        computeLiveness(alloc);
+        uint64_t* live = irAlloc(ALLOC_CODEGEN, sizeof(uint64_t) * alloc->words);
+        for (int b = 0; b < fn->blockCount; b++) {
+            MBlock* block = fn->blocks[b];
+            memcpy(live, alloc->liveOut[b], sizeof(uint64_t) * alloc->words);
+            for (int i = block->count - 1; i >= 0; i--) {
+                MInstr* instr = block->instrs[i];
+                machineOperands(instr, uses, &useCount, defs, &defCount);
+                if (isRemovable(instr) && !testBit(live, instr->ops[0].reg)) {
+                    removeMInstr(block, i);
+                    changed = true;
+                    continue;
+                }
+                for (int d = 0; d < defCount; d++) {
+                    if (isAllocatable(defs[d])) clearBit(live, defs[d]);
+                }
+                for (int u = 0; u < useCount; u++) {
+                    if (isAllocatable(uses[u])) setBit(live, uses[u]);
+                }
+            }
+        }
+        release(live);
+        freeLiveness(alloc);
+    }
+}
+
+//---------------------- Intervals ---------------------
+
+static Interval* newInterval(int reg) {
+    Interval* interval = irAlloc(ALLOC_CODEGEN, sizeof(Interval));
+    interval->reg = reg;
+    interval->hint = -1;
+    interval->assigned = IS_VIRTUAL(reg) ? -1 : reg;
+    return interval;
+}
+
+static int start(Interval* it) { return it->ranges[0].from; }
+
+static int end(Interval* it) { return it->ranges[it->rangeCount - 1].to; }
+
+static bool covers(Interval* it, int pos) {
+    for (int r = 0; r < it->rangeCount; r++) {
+        if (it->ranges[r].from <= pos && pos < it->ranges[r].to) return true;
+        if (it->ranges[r].from > pos) break;
+    }
+    return false;
+}
+
+// first position covered by both, INT_MAX if none
+static int nextIntersection(Interval* a, Interval* b) {
+    int i = 0, j = 0;
+    while (i < a->rangeCount && j < b->rangeCount) {
+        Range* x = &a->ranges[i];
+        Range* y = &b->ranges[j];
+        int from = x->from > y->from ? x->from : y->from;
+        int to = x->to < y->to ? x->to : y->to;
+        if (from < to) return from;
+        if (x->to <= y->to) {
+            i++;
+        } else {
+            j++;
+        }
+    }
+    return INT_MAX;
+}
+
+static int nextUseAfter(Interval* it, int pos) {
+    for (int u = 0; u < it->useCount; u++) {
+        if (it->uses[u] >= pos) return it->uses[u];
+    }
+    return INT_MAX;
+}
+
+// intervals are built backwards, so new ranges and uses come first; they
+// are collected in descending order and reversed once complete
+static void addRange(Interval* it, int from, int to) {
+    if (it->rangeCount > 0) {
+        Range* first = &it->ranges[it->rangeCount - 1];
+        if (to >= first->from) {
+            if (from < first->from) first->from = from;
+            if (to > first->to) first->to = to;
+            return;
+        }
+    }
+    if (it->rangeCount == it->rangeCapacity) {
+        it->rangeCapacity = it->rangeCapacity ? it->rangeCapacity * 2 : 4;
+        it->ranges = reallocate(ALLOC_CODEGEN, it->ranges, sizeof(Range) * it->rangeCapacity);
+    }
+    it->ranges[it->rangeCount].from = from;
+    it->ranges[it->rangeCount].to = to;
+    it->rangeCount++;
+}
+
+static void addUse(Interval* it, int pos) {
+    if (it->useCount > 0 && it->uses[it->useCount - 1] == pos) return;
+    if (it->useCount == it->useCapacity) {
+        it->useCapacity = it->useCapacity ? it->useCapacity * 2 : 4;
+        it->uses = reallocate(ALLOC_CODEGEN, it->uses, sizeof(int) * it->useCapacity);
+    }
+    it->uses[it->useCount++] = pos;
+}
+
+static void reverseInterval(Interval* it) {
+    for (int i = 0, j = it->rangeCount - 1; i < j; i++, j--) {
+        Range swap = it->ranges[i];
+        it->ranges[i] = it->ranges[j];
+        it->ranges[j] = swap;
+    }
+    for (int i = 0, j = it->useCount - 1; i < j; i++, j--) {
+        int swap = it->uses[i];
+        it->uses[i] = it->uses[j];
+        it->uses[j] = swap;
+    }
+}
+
+static Interval* intervalOf(Allocator* alloc, int reg) {
+    if (!IS_VIRTUAL(reg)) return alloc->fixed[reg];
+    if (alloc->pieces[reg].count == 0) push(&alloc->pieces[reg], newInterval(reg));
+    return alloc->pieces[reg].items[0];
+}
+
+static void buildIntervals(Allocator* alloc) {
+    MFunction* fn = alloc->fn;
+    alloc->pieces = irAlloc(ALLOC_CODEGEN, sizeof(IntervalList) * fn->regCount);
+    alloc->fixed = irAlloc(ALLOC_CODEGEN, sizeof(Interval*) * REG_COUNT);
+    for (int reg = 0; reg < REG_COUNT; reg++) alloc->fixed[reg] = newInterval(reg);
+    int uses[MAX_OPERANDS], defs[MAX_OPERANDS], useCount, defCount;
+    uint64_t* live = irAlloc(ALLOC_CODEGEN, sizeof(uint64_t) * alloc->words);
+    int index = alloc->instrCount;
+    for (int b = fn->blockCount - 1; b >= 0; b--) {
+        MBlock* block = fn->blocks[b];
+        memcpy(live, alloc->liveOut[b], sizeof(uint64_t) * alloc->words);
+        for (int reg = 0; reg < fn->regCount; reg++) {
+            if (testBit(live, reg)) addRange(intervalOf(alloc, reg), block->from, block->to);
+        }
+        for (int i = block->count - 1; i >= 0; i--) {
+            MInstr* instr = block->instrs[i];
+            int pos = 4 * --index;
+            machineOperands(instr, uses, &useCount, defs, &defCount);
+            for (int d = 0; d < defCount; d++) {
+                if (!isAllocatable(defs[d])) continue;
+                Interval* it = intervalOf(alloc, defs[d]);
+                if (testBit(live, defs[d])) {
+                    it->ranges[it->rangeCount - 1].from = pos + 2;
+                } else {
+                    addRange(it, pos + 2, pos + 3);
+                }
+                if (IS_VIRTUAL(defs[d])) addUse(it, pos + 2);
+                clearBit(live, defs[d]);
+            }
+            for (int u = 0; u < useCount; u++) {
+                if (!isAllocatable(uses[u])) continue;
+                Interval* it = intervalOf(alloc, uses[u]);
+                addRange(it, block->from, pos + 2);
+                if (IS_VIRTUAL(uses[u])) addUse(it, pos + 1);
+                setBit(live, uses[u]);
+            }
+            // try to give both sides of a copy the same register
+            if ((instr->opcode == M_MOV || instr->opcode == M_VMOV) &&
+                instr->ops[0].kind == OPND_REG && instr->ops[1].kind == OPND_REG) {
+                int dst = instr->ops[0].reg, src = instr->ops[1].reg;
+                if (IS_VIRTUAL(dst)) intervalOf(alloc, dst)->hint = src;
+                if (IS_VIRTUAL(src) && intervalOf(alloc, src)->hint < 0) {
+                    intervalOf(alloc, src)->hint = dst;
+                }
+            }
+        }
+    }
+    release(live);
+    for (int reg = 0; reg < REG_COUNT; reg++) reverseInterval(alloc->fixed[reg]);
+    for (int reg = REG_COUNT; reg < fn->regCount; reg++) {
+        if (alloc->pieces[reg].count) reverseInterval(alloc->pieces[reg].items[0]);
+    }
+}
+
+// cut `it` at the gap `pos`; the returned piece holds everything from pos on
+static Interval* splitAt(Allocator* alloc, Interval* it, int pos) {
+    Interval* child = newInterval(it->reg);
+    int r = 0;
+    while (r < it->rangeCount && it->ranges[r].to <= pos) r++;
+    for (int k = r; k < it->rangeCount; k++) {
+        int from = it->ranges[k].from > pos ? it->ranges[k].from : pos;
+        if (child->rangeCount == child->rangeCapacity) {
+            child->rangeCapacity = child->rangeCapacity ? child->rangeCapacity * 2 : 4;
+            child->ranges =
+                reallocate(ALLOC_CODEGEN, child->ranges, sizeof(Range) * child->rangeCapacity);
+        }
+        child->ranges[child->rangeCount].from = from;
+        child->ranges[child->rangeCount].to = it->ranges[k].to;
+        child->rangeCount++;
+    }
+    if (r < it->rangeCount && it->ranges[r].from < pos) {
+        it->ranges[r].to = pos;
+        r++;
+    }
+    it->rangeCount = r;
+    int u = 0;
+    while (u < it->useCount && it->uses[u] < pos) u++;
+    for (int k = u; k < it->useCount; k++) addUse(child, it->uses[k]);
+    it->useCount = u;
+    // keep the pieces of a register ordered by start
+    IntervalList* pieces = &alloc->pieces[it->reg];
+    push(pieces, child);
+    int i = pieces->count - 1;
+    while (i > 0 && pieces->items[i - 1] != it) {
+        pieces->items[i] = pieces->items[i - 1];
+        i--;
+    }
+    pieces->items[i] = child;
+    return child;
+}
+
+//---------------------- Linear Scan -------------------
+
+static void enqueue(Allocator* alloc, Interval* it) {
+    IntervalList* list = &alloc->unhandled;
+    push(list, it);
+    int i = list->count - 1;
+    while (i > 0 && start(list->items[i - 1]) < start(it)) {
+        list->items[i] = list->items[i - 1];
+        i--;
+    }
+    list->items[i] = it;
+}
+
+static const Reg* registersOf(RegClass cls, int* count) {
+    if (cls == CLASS_XMM) {
+        *count = sizeof(xmmOrder) / sizeof(xmmOrder[0]);
+        return xmmOrder;
+    }
+    *count = sizeof(gprOrder) / sizeof(gprOrder[0]);
+    return gprOrder;
+}
+
+// physical register the hint of `it` resolves to, or -1
+static int hintedRegister(Allocator* alloc, Interval* it) {
+    if (it->hint < 0) return -1;
+    if (!IS_VIRTUAL(it->hint)) return it->hint;
+    IntervalList* pieces = &alloc->pieces[it->hint];
+    for (int i = 0; i < pieces->count; i++) {
+        Interval* piece = pieces->items[i];
+        if (piece->assigned >= 0 &&
+            (covers(piece, start(it) - 1) || end(piece) == start(it))) {
+            return piece->assigned;
+        }
+    }
+    return -1;
+}
+
+// the part of `it` from the gap `pos` on leaves its register: it waits on
+// the stack until just before its next use and then competes again
+static void evict(Allocator* alloc, Interval* it, int pos) {
+    Interval* tail = pos <= start(it) ? it : splitAt(alloc, it, pos);
+    tail->assigned = -1;
+    int use = nextUseAfter(tail, start(tail));
+    if (use == INT_MAX) return;
+    int gap = use & ~3;
+    if (gap > start(tail)) {
+        enqueue(alloc, splitAt(alloc, tail, gap));
+    } else if (start(tail) > pos) {
+        // evicted in a lifetime hole, needed right where it resumes
+        enqueue(alloc, tail);
+    } else {
+        panic("register allocation failed in %s\n", alloc->fn->name.chars);
+    }
+}
+
+static bool tryAllocateFree(Allocator* alloc, Interval* current) {
+    int freeUntil[REG_COUNT];
+    for (int reg = 0; reg < REG_COUNT; reg++) freeUntil[reg] = INT_MAX;
+    for (int i = 0; i < alloc->active.count; i++) {
+        freeUntil[alloc->active.items[i]->assigned] = 0;
+    }
+    for (int i = 0; i < alloc->inactive.count; i++) {
+        Interval* it = alloc->inactive.items[i];
+        int pos = nextIntersection(it, current);
+        if (pos < freeUntil[it->assigned]) freeUntil[it->assigned] = pos;
+    }
+    int count;
+    const Reg* order = registersOf(regClass(alloc->fn, current->reg), &count);
+    for (int i = 0; i < count; i++) {
+        int pos = nextIntersection(alloc->fixed[order[i]], current);
+        if (pos < freeUntil[order[i]]) freeUntil[order[i]] = pos;
+    }
+    int reg = order[0];
+    for (int i = 1; i < count; i++) {
+        if (freeUntil[order[i]] > freeUntil[reg]) reg = order[i];
+    }
+    int hint = hintedRegister(alloc, current);
+    if (hint >= 0 && regClass(alloc->fn, hint) == regClass(alloc->fn, current->reg) &&
+        isAllocatable(hint) && freeUntil[hint] >= end(current)) {
+        reg = hint;
+    }
+    int split = freeUntil[reg] & ~3;
+    if (freeUntil[reg] < end(current) && split <= start(current)) return false;
+    current->assigned = reg;
+    if (freeUntil[reg] < end(current)) {
+        enqueue(alloc, splitAt(alloc, current, split));
+    }
+    return true;
+}
+
+static void allocateBlocked(Allocator* alloc, Interval* current) {
+    int pos = start(current);
+    int gap = pos & ~3;
+    int nextUse[REG_COUNT], blockPos[REG_COUNT];
+    for (int reg = 0; reg < REG_COUNT; reg++) {
+        nextUse[reg] = INT_MAX;
+        blockPos[reg] = INT_MAX;
+    }
+    for (int i = 0; i < alloc->active.count; i++) {
+        Interval* it = alloc->active.items[i];
+        int use = nextUseAfter(it, gap);
+        if (use < nextUse[it->assigned]) nextUse[it->assigned] = use;
+    }
+    for (int i = 0; i < alloc->inactive.count; i++) {
+        Interval* it = alloc->inactive.items[i];
+        if (nextIntersection(it, current) == INT_MAX) continue;
+        int use = nextUseAfter(it, gap);
+        if (use < nextUse[it->assigned]) nextUse[it->assigned] = use;
+    }
+    int count;
+    const Reg* order = registersOf(regClass(alloc->fn, current->reg), &count);
+    for (int i = 0; i < count; i++) {
+        int at = nextIntersection(alloc->fixed[order[i]], current);
+        if (at < blockPos[order[i]]) blockPos[order[i]] = at;
+        if (at < nextUse[order[i]]) nextUse[order[i]] = at;
+    }
+    int reg = order[0];
+    for (int i = 1; i < count; i++) {
+        if (nextUse[order[i]] > nextUse[reg]) reg = order[i];
+    }
+    int firstUse = nextUseAfter(current, pos);
+    if (firstUse == INT_MAX) {
+        current->assigned = -1;
+        return;
+    }
+    if (nextUse[reg] <= firstUse) {
+        // every register is needed sooner: current waits on the stack
+        int split = firstUse & ~3;
+        if (split <= pos) {
+            panic("register allocation failed in %s\n", alloc->fn->name.chars);
+        }
+        current->assigned = -1;
+        enqueue(alloc, splitAt(alloc, current, split));
+        return;
+    }
+    current->assigned = reg;
+    for (int i = alloc->active.count - 1; i >= 0; i--) {
+        Interval* it = alloc->active.items[i];
+        if (it->assigned != reg) continue;
+        removeAt(&alloc->active, i);
+        evict(alloc, it, gap);
+    }
+    for (int i = alloc->inactive.count - 1; i >= 0; i--) {
+        Interval* it = alloc->inactive.items[i];
+        if (it->assigned != reg || nextIntersection(it, current) == INT_MAX) {
+            continue;
+        }
+        removeAt(&alloc->inactive, i);
+        evict(alloc, it, gap);
+    }
+    if (blockPos[reg] < end(current)) {
+        int split = blockPos[reg] & ~3;
+        if (split <= pos) {
+            panic("register allocation failed in %s\n", alloc->fn->name.chars);
+        }
+        enqueue(alloc, splitAt(alloc, current, split));
+    }
+}
+
+static void linearScan(Allocator* alloc) {
+    for (int reg = REG_COUNT; reg < alloc->fn->regCount; reg++) {
+        if (alloc->pieces[reg].count) enqueue(alloc, alloc->pieces[reg].items[0]);
+    }
+    while (alloc->unhandled.count > 0) {
+        Interval* current = alloc->unhandled.items[--alloc->unhandled.count];
+        int pos = start(current);
+        for (int i = alloc->active.count - 1; i >= 0; i--) {
+            Interval* it = alloc->active.items[i];
+            if (end(it) <= pos) {
+                removeAt(&alloc->active, i);
+            } else if (!covers(it, pos)) {
+                removeAt(&alloc->active, i);
+                push(&alloc->inactive, it);
+            }
+        }
+        for (int i = alloc->inactive.count - 1; i >= 0; i--) {
+            Interval* it = alloc->inactive.items[i];
+            if (end(it) <= pos) {
+                removeAt(&alloc->inactive, i);
+            } else if (covers(it, pos)) {
+                removeAt(&alloc->inactive, i);
+                push(&alloc->active, it);
+            }
+        }
+        if (!tryAllocateFree(alloc, current)) allocateBlocked(alloc, current);
+        if (current->assigned >= 0) push(&alloc->active, current);
+    }
+}
+
+//---------------------- Resolution --------------------
+// Splitting leaves a value in different places in different pieces. Moves
+// connect consecutive pieces inside a block and the pieces at both ends of
+// every control flow edge.
+
+typedef struct {
+    int reg;  // virtual register moved
+    MOperand from;
+    MOperand to;
+} Move;
+
+// groups of moves at the same place run in this order; a block holding
+// nothing but its jump gets both the moves of its incoming edge and those
+// of its outgoing edge right before that jump
+typedef enum {
+    MOVES_IN_EDGE,
+    MOVES_SPLIT,
+    MOVES_OUT_EDGE,
+} MovePhase;
+
+typedef struct {
+    MBlock* block;
+    int index;  // moves go before this instruction of the block
+    MovePhase phase;
+    Move* moves;
+    int count;
+    int capacity;
+} MoveGroup;
+
+typedef struct {
+    MoveGroup* items;
+    int count;
+    int capacity;
+} MoveGroups;
+
+static MOperand spillLocation(Allocator* alloc, int reg) {
+    if (alloc->spillSlot[reg] < 0) {
+        bool vector = regClass(alloc->fn, reg) == CLASS_XMM;
+        alloc->spillSlot[reg] = newFrameSlot(alloc->fn, vector ? 32 : 8);
+    }
+    return frameOperand(alloc->spillSlot[reg]);
+}
+
+static MOperand location(Allocator* alloc, Interval* it) {
+    if (it->assigned >= 0) return regOperand(it->assigned);
+    return spillLocation(alloc, it->reg);
+}
+
+static Interval* pieceAt(Allocator* alloc, int reg, int pos) {
+    IntervalList* pieces = &alloc->pieces[reg];
+    for (int i = 0; i < pieces->count; i++) {
+        if (covers(pieces->items[i], pos)) return pieces->items[i];
+    }
+    return NULL;
+}
+
+static bool sameLocation(MOperand a, MOperand b) {
+    if (a.kind != b.kind) return false;
+    return a.kind == OPND_REG ? a.reg == b.reg : a.slot == b.slot;
+}
+
+static void addMove(MoveGroups* groups, MBlock* block, int index,
+                    MovePhase phase, int reg, MOperand from, MOperand to) {
+    if (sameLocation(from, to)) return;
+    MoveGroup* group = NULL;
+    for (int i = 0; i < groups->count; i++) {
+        if (groups->items[i].block == block && groups->items[i].index == index &&
+            groups->items[i].phase == phase) {
+            group = &groups->items[i];
+        }
+    }
+    if (group == NULL) {
+        if (groups->count == groups->capacity) {
+            groups->capacity = groups->capacity ? groups->capacity * 2 : 16;
+            groups->items =
+                reallocate(ALLOC_CODEGEN, groups->items, sizeof(MoveGroup) * groups->capacity);
+        }
+        group = &groups->items[groups->count++];
+        memset(group, 0, sizeof(MoveGroup));
+        group->block = block;
+        group->index = index;
+        group->phase = phase;
+    }
+    if (group->count == group->capacity) {
+        group->capacity = group->capacity ? group->capacity * 2 : 4;
+        group->moves = reallocate(ALLOC_CODEGEN, group->moves, sizeof(Move) * group->capacity);
+    }
+    Move* move = &group->moves[group->count++];
+    move->reg = reg;
+    move->from = from;
+    move->to = to;
+}
+
+static MBlock* blockAtPosition(MFunction* fn, int pos) {
+    for (int b = 0; b < fn->blockCount; b++) {
+        if (fn->blocks[b]->from <= pos && pos < fn->blocks[b]->to) {
+            return fn->blocks[b];
+        }
+    }
+    return NULL;
+}
+
+static void collectMoves(Allocator* alloc, MoveGroups* groups) {
+    MFunction* fn = alloc->fn;
+    // between pieces split inside a block
+    for (int reg = REG_COUNT; reg < fn->regCount; reg++) {
+        IntervalList* pieces = &alloc->pieces[reg];
+        for (int i = 1; i < pieces->count; i++) {
+            Interval* prev = pieces->items[i - 1];
+            Interval* next = pieces->items[i];
+            int pos = start(next);
+            if (end(prev) != pos || pos % 4 != 0) continue;
+            MBlock* block = blockAtPosition(fn, pos);
+            if (block->from == pos) continue;
+            addMove(groups, block, (pos - block->from) / 4, MOVES_SPLIT, reg,
+                    location(alloc, prev), location(alloc, next));
+        }
+    }
+    // along edges
+    for (int b = 0; b < fn->blockCount; b++) {
+        MBlock* pred = fn->blocks[b];
+        for (int s = 0; s < pred->succCount; s++) {
+            MBlock* succ = pred->succs[s];
+            for (int reg = REG_COUNT; reg < fn->regCount; reg++) {
+                if (!testBit(alloc->liveIn[succ->id], reg)) continue;
+                Interval* from = pieceAt(alloc, reg, pred->to - 1);
+                Interval* to = pieceAt(alloc, reg, succ->from);
+                if (pred->succCount == 1) {
+                    // before the jump ending the predecessor
+                    addMove(groups, pred, pred->count - 1, MOVES_OUT_EDGE, reg,
+                            location(alloc, from), location(alloc, to));
+                } else {
+                    addMove(groups, succ, 0, MOVES_IN_EDGE, reg,
+                            location(alloc, from), location(alloc, to));
+                }
+            }
+        }
+    }
+}
+
+static MInstr* copyInstr(MFunction* fn, RegClass cls, MOperand to,
+                         MOperand from) {
+    MInstr* move = moveInstr(cls, to, from);
+    move->imm = fn->usesYmm ? 32 : 16;
+    return move;
+}
+
+// order the moves of a group so that no location is overwritten before it
+// is read, breaking cycles through the scratch registers
+static int sequentialize(MFunction* fn, MoveGroup* group, MInstr** out) {
+    int emitted = 0;
+    int pending = group->count;
+    Move* moves = group->moves;
+    while (pending > 0) {
+        bool progress = false;
+        for (int i = 0; i < pending; i++) {
+            bool blocked = false;
+            for (int j = 0; j < pending && !blocked; j++) {
+                blocked = j != i && sameLocation(moves[j].from, moves[i].to);
+            }
+            if (blocked) continue;
+            out[emitted++] = copyInstr(fn, regClass(fn, moves[i].reg),
+                                       moves[i].to, moves[i].from);
+            moves[i] = moves[--pending];
+            progress = true;
+            break;
+        }
+        if (progress) continue;
+        // only register cycles remain
+        Move* move = &moves[0];
+        RegClass cls = regClass(fn, move->reg);
+        MOperand scratch = regOperand(cls == CLASS_XMM ? SCRATCH_XMM : SCRATCH_GPR);
+        out[emitted++] = copyInstr(fn, cls, scratch, move->to);
+        for (int j = 0; j < pending; j++) {
+            if (sameLocation(moves[j].from, move->to)) moves[j].from = scratch;
+        }
+    }
+    return emitted;
+}
+
+static int compareGroups(const void* a, const void* b) {
+    const MoveGroup* x = a;
+    const MoveGroup* y = b;
+    if (x->block->id != y->block->id) return x->block->id - y->block->id;
+    if (x->index != y->index) return y->index - x->index;
+    // later phases are inserted first and so end up last
+    return (int)y->phase - (int)x->phase;
+}
+
+static void insertMoves(Allocator* alloc, MoveGroups* groups) {
+    // insert from the back of each block so earlier indices stay valid
+    qsort(groups->items, groups->count, sizeof(MoveGroup), compareGroups);
+    for (int g = 0; g < groups->count; g++) {
+        MoveGroup* group = &groups->items[g];
+        MInstr** out = irAlloc(ALLOC_CODEGEN, sizeof(MInstr*) * (2 * group->count + 1));
+        int count = sequentialize(alloc->fn, group, out);
+        for (int i = count - 1; i >= 0; i--) {
+            insertMInstr(group->block, group->index, out[i]);
+        }
+        release(out);
+    }
+}
+
+//---------------------- Rewriting ---------------------
+
+static int physicalAt(Allocator* alloc, int reg, int pos) {
+    Interval* piece = pieceAt(alloc, reg, pos);
+    if (piece == NULL || piece->assigned < 0) {
+        panic("v%d has no register at %d in %s\n", reg, pos,
+              alloc->fn->name.chars);
+    }
+    return piece->assigned;
+}
+
+static void rewriteOperands(Allocator* alloc) {
+    MFunction* fn = alloc->fn;
+    for (int i = 0; i < alloc->instrCount; i++) {
+        MInstr* instr = alloc->instrs[i];
+        for (int k = 0; k < 3; k++) {
+            MOperand* op = &instr->ops[k];
+            if (op->kind != OPND_REG && op->kind != OPND_MEM) continue;
+            if (IS_VIRTUAL(op->reg)) {
+                // an operand both read and written covers both positions
+                bool read = op->kind == OPND_MEM ||
+                            pieceAt(alloc, op->reg, 4 * i + 1) != NULL;
+                op->reg = physicalAt(alloc, op->reg, 4 * i + (read ? 1 : 2));
+            }
+            if (op->kind == OPND_MEM && op->index >= 0 && IS_VIRTUAL(op->index)) {
+                op->index = physicalAt(alloc, op->index, 4 * i + 1);
+            }
+        }
+    }
+    (void)fn;
+}
+
+static void recordUsedRegs(MFunction* fn) {
+    int uses[MAX_OPERANDS], defs[MAX_OPERANDS], useCount, defCount;
+    for (int b = 0; b < fn->blockCount; b++) {
+        MBlock* block = fn->blocks[b];
+        for (int i = 0; i < block->count; i++) {
+            if (block->instrs[i]->opcode == M_CALL) continue;
+            machineOperands(block->instrs[i], uses, &useCount, defs, &defCount);
+            for (int d = 0; d < defCount; d++) fn->usedRegs |= 1u << defs[d];
+        }
+    }
+}
+
+void allocateRegisters(MFunction* fn) {
+    Allocator alloc;
+    memset(&alloc, 0, sizeof(Allocator));
+    alloc.fn = fn;
+    removeDeadInstrs(&alloc);
+    numberInstructions(&alloc);
+    computeLiveness(&alloc);
+    buildIntervals(&alloc);
+    alloc.spillSlot = irAlloc(ALLOC_CODEGEN, sizeof(int) * fn->regCount);
+    for (int reg = 0; reg < fn->regCount; reg++) alloc.spillSlot[reg] = -1;
+    linearScan(&alloc);
+    // operands refer to positions before any move is inserted
+    rewriteOperands(&alloc);
+    MoveGroups groups;
+    memset(&groups, 0, sizeof(MoveGroups));
+    collectMoves(&alloc, &groups);
+    insertMoves(&alloc, &groups);
+    recordUsedRegs(fn);
+
+    for (int g = 0; g < groups.count; g++) release(groups.items[g].moves);
+    release(groups.items);
+    freeLiveness(&alloc);
+    release(alloc.instrs);
+    release(alloc.unhandled.items);
+    release(alloc.active.items);
+    release(alloc.inactive.items);
+}
+
+//---------------------- Naive Allocation --------------
+// The -O0 baseline: every virtual register lives in its own frame slot and
+// is loaded into a scratch register for each instruction using it.
+
+static void replaceReg(MInstr* instr, int from, int to) {
+    for (int k = 0; k < 3; k++) {
+        MOperand* op = &instr->ops[k];
+        if ((op->kind == OPND_REG || op->kind == OPND_MEM) && op->reg == from) {
+            op->reg = to;
+        }
+        if (op->kind == OPND_MEM && op->index == from) op->index = to;
+    }
+}
+
+void spillEverything(MFunction* fn) {
+    static const Reg gprScratch[] = {R10, R11};
+    static const Reg xmmScratch[] = {XMM14, XMM15};
+    int* slots = irAlloc(ALLOC_CODEGEN, sizeof(int) * fn->regCount);
+    for (int reg = REG_COUNT; reg < fn->regCount; reg++) {
+        slots[reg] = newFrameSlot(fn, regClass(fn, reg) == CLASS_XMM ? 32 : 8);
+    }
+    int uses[MAX_OPERANDS], defs[MAX_OPERANDS], useCount, defCount;
+    for (int b = 0; b < fn->blockCount; b++) {
+        MBlock* block = fn->blocks[b];
+        for (int i = 0; i < block->count; i++) {
+            MInstr* instr = block->instrs[i];
+            machineOperands(instr, uses, &useCount, defs, &defCount);
+            int gprs = 0, xmms = 0;
+            int virtuals[MAX_OPERANDS], scratch[MAX_OPERANDS], count = 0;
+            for (int k = 0; k < useCount + defCount; k++) {
+                int reg = k < useCount ? uses[k] : defs[k - useCount];
+                bool seen = false;
+                for (int j = 0; j < count; j++) seen |= virtuals[j] == reg;
+                if (!IS_VIRTUAL(reg) || seen) continue;
+                bool vector = regClass(fn, reg) == CLASS_XMM;
+                if ((vector ? xmms : gprs) == 2) {
+                    panic("too many operands to spill in %s\n", fn->name.chars);
+                }
+                virtuals[count] = reg;
+                scratch[count++] = vector ? xmmScratch[xmms++] : gprScratch[gprs++];
+            }
+            for (int j = 0; j < count; j++) replaceReg(instr, virtuals[j], scratch[j]);
+            for (int u = 0; u < useCount; u++) {
+                for (int j = 0; j < count; j++) {
+                    if (virtuals[j] != uses[u]) continue;
+                    insertMInstr(block, i++,
+                                 copyInstr(fn, regClass(fn, virtuals[j]),
+                                           regOperand(scratch[j]),
+                                           frameOperand(slots[virtuals[j]])));
+                }
+            }
+            for (int d = 0; d < defCount; d++) {
+                for (int j = 0; j < count; j++) {
+                    if (virtuals[j] != defs[d]) continue;
+                    insertMInstr(block, ++i,
+                                 copyInstr(fn, regClass(fn, virtuals[j]),
+                                           frameOperand(slots[virtuals[j]]),
+                                           regOperand(scratch[j])));
+                }
+            }
+        }
+    }
+    release(slots);
+    recordUsedRegs(fn);
+}
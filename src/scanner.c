@@ -64,7 +64,7 @@ void initScanner(Scanner* scanner, const char* source) {
 String tokenToString(Token token) {
     String str;
     str.length = token.length;
-    str.chars = malloc(str.length + 1);
+    str.chars = allocate(ALLOC_STRINGS, str.length + 1);
     memcpy(str.chars, token.start, str.length);
     str.chars[str.length] = '\0';
     return str;
@@ -152,11 +152,13 @@ void convertKeyword(Token* token) {
     switch (token->length) {
         case 2:
             if (memcmp(token->start, "if", 2) == 0) token->type = TOKEN_IF;
+            break;
         case 3:
             if (memcmp(token->start, "int", 3) == 0)
                 token->type = TOKEN_TYPENAME;
             if (memcmp(token->start, "for", 3) == 0) 
                 token->type = TOKEN_FOR;
+            break;
         case 4:
             if (memcmp(token->start, "else", 4) == 0) 
                 token->type = TOKEN_ELSE;
@@ -289,11 +291,16 @@ Token scanToken(Scanner* scanner) {
 }
 
 Token* scanTokens(const char* source) {
-    Token* tokens = (Token*)malloc(sizeof(Token) * 100);
+    int capacity = 128;
+    Token* tokens = (Token*)allocate(ALLOC_TOKENS, sizeof(Token) * capacity);
     Scanner scanner;
     initScanner(&scanner, source);
     int i = 0;
     while (!isAtEnd(&scanner)) {
+        if (i + 1 == capacity) {
+            capacity *= 2;
+            tokens = reallocate(ALLOC_TOKENS, tokens, sizeof(Token) * capacity);
+        }
         tokens[i++] = scanToken(&scanner);
     }
     tokens[i] = makeToken(TOKEN_EOF, &scanner);
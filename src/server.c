@@ -0,0 +1,180 @@
+//---------------------- Compile Server ----------------
+#define _GNU_SOURCE
+#include "server.h"
+
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// recv and send rather than read and write, which main.c takes for itself;
+// NULL if the connection failed or timed out before its end
+static char* receiveAll(int fd, size_t* length) {
+    size_t capacity = 4096;
+    char* data = allocate(ALLOC_DRIVER, capacity + 1);
+    *length = 0;
+    ssize_t count;
+    while ((count = recv(fd, data + *length, capacity - *length, 0)) > 0) {
+        *length += count;
+        if (*length == capacity) data = reallocate(ALLOC_DRIVER, data, (capacity *= 2) + 1);
+    }
+    if (count < 0) {
+        release(data);
+        return NULL;
+    }
+    data[*length] = '\0';
+    return data;
+}
+
+static bool sendAll(int fd, const char* data, size_t length) {
+    while (length > 0) {
+        ssize_t count = send(fd, data, length, MSG_NOSIGNAL);
+        if (count <= 0) return false;
+        data += count;
+        length -= count;
+    }
+    return true;
+}
+
+static int socketAt(const char* path, struct sockaddr_un* address) {
+    memset(address, 0, sizeof(struct sockaddr_un));
+    address->sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(address->sun_path)) return -1;
+    strcpy(address->sun_path, path);
+    return socket(AF_UNIX, SOCK_STREAM, 0);
+}
+
+// a client runs commands as the server's user, in any directory it
+// names, so clients of other users are turned away
+static bool ownClient(int client) {
+    struct ucred credentials;
+    socklen_t length = sizeof(credentials);
+    return getsockopt(client, SOL_SOCKET, SO_PEERCRED, &credentials, &length) == 0 &&
+           credentials.uid == geteuid();
+}
+
+static int answer(char* request, size_t length, CommandFunction command, FILE* out) {
+    int argc = 0;
+    for (size_t i = 0; i < length; i++) argc += request[i] == '\0';
+    if (argc == 0 || request[length - 1] != '\0') {
+        fprintf(out, "Malformed request.\n");
+        return 1;
+    }
+    if (chdir(request) != 0) {
+        fprintf(out, "Could not enter \"%s\".\n", request);
+        return 1;
+    }
+    // the directory's place becomes the program name
+    char** argv = allocate(ALLOC_DRIVER, sizeof(char*) * (argc + 1));
+    argv[0] = "scc";
+    char* arg = request + strlen(request) + 1;
+    for (int i = 1; i < argc; i++, arg += strlen(arg) + 1) argv[i] = arg;
+    argv[argc] = NULL;
+    int status = command(argc, argv, out);
+    release(argv);
+    return status;
+}
+
+typedef struct {
+    int client;
+    CommandFunction command;
+} Connection;
+
+// a command changes the working directory and the options of the whole
+// process, so commands take turns; receiving and answering do not
+static pthread_mutex_t commandLock = PTHREAD_MUTEX_INITIALIZER;
+
+static void* serveClient(void* argument) {
+    Connection* connection = argument;
+    int client = connection->client;
+    size_t length;
+    char* request = receiveAll(client, &length);
+    if (request) {
+        char* reply;
+        size_t replyLength;
+        FILE* out = open_memstream(&reply, &replyLength);
+        fputc('0', out);
+        pthread_mutex_lock(&commandLock);
+        int status = answer(request, length, connection->command, out);
+        pthread_mutex_unlock(&commandLock);
+        fclose(out);
+        reply[0] = '0' + (status & 0xff ? 1 : 0);
+        // a client that went away does not matter
+        sendAll(client, reply, replyLength);
+        free(reply);
+        release(request);
+    }
+    close(client);
+    release(connection);
+    return NULL;
+}
+
+void serveCommands(const char* path, CommandFunction command) {
+    struct sockaddr_un address;
+    int listener = socketAt(path, &address);
+    // a socket left by an earlier server, but nothing else, is replaced
+    struct stat existing;
+    if (stat(path, &existing) == 0 && S_ISSOCK(existing.st_mode)) unlink(path);
+    // the socket is created 0600, so only the owner can connect at all
+    mode_t mask = umask(0077);
+    bool bound =
+        listener >= 0 && bind(listener, (struct sockaddr*)&address, sizeof(address)) == 0;
+    umask(mask);
+    if (!bound || listen(listener, 64) != 0) {
+        panic("Could not listen on \"%s\".\n", path);
+    }
+    pthread_attr_t detached;
+    pthread_attr_init(&detached);
+    pthread_attr_setdetachstate(&detached, PTHREAD_CREATE_DETACHED);
+    for (;;) {
+        int client = accept(listener, NULL, NULL);
+        if (client < 0) continue;
+        if (!ownClient(client)) {
+            close(client);
+            continue;
+        }
+        struct timeval timeout = {SERVER_TIMEOUT, 0};
+        setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+        Connection* connection = allocate(ALLOC_DRIVER, sizeof(Connection));
+        connection->client = client;
+        connection->command = command;
+        pthread_t thread;
+        if (pthread_create(&thread, &detached, serveClient, connection) != 0) {
+            close(client);
+            release(connection);
+        }
+    }
+}
+
+bool sendCommand(const char* path, int argc, char* argv[], int* status) {
+    struct sockaddr_un address;
+    int server = socketAt(path, &address);
+    if (server < 0) return false;
+    if (connect(server, (struct sockaddr*)&address, sizeof(address)) != 0) {
+        close(server);
+        return false;
+    }
+    char* request;
+    size_t length;
+    FILE* out = open_memstream(&request, &length);
+    char* cwd = getcwd(NULL, 0);
+    fwrite(cwd, 1, strlen(cwd) + 1, out);
+    free(cwd);
+    for (int i = 1; i < argc; i++) fwrite(argv[i], 1, strlen(argv[i]) + 1, out);
+    fclose(out);
+    bool sent = sendAll(server, request, length);
+    free(request);
+    shutdown(server, SHUT_WR);
+    char* reply = receiveAll(server, &length);
+    close(server);
+    if (!sent || reply == NULL || length == 0) {
+        panic("The compile server at \"%s\" did not answer.\n", path);
+    }
+    fwrite(reply + 1, 1, length - 1, stderr);
+    *status = reply[0] - '0';
+    release(reply);
+    return true;
+}
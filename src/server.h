@@ -0,0 +1,32 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include "util.h"
+
+//---------------------- Compile Server ----------------
+// A long-lived compiler answering command lines sent over a Unix socket.
+// A request is the client's working directory and its arguments, each
+// ending in a NUL, up to the end of the client's writes; the answer is
+// the exit status as a digit followed by the diagnostics. The socket is
+// only open to the user running the server, who is the only one whose
+// commands it runs.
+//
+// Every client has a thread of its own, and one that sends or takes
+// nothing for SERVER_TIMEOUT seconds is dropped, so a stalled client holds
+// up no other. The commands themselves run one at a time, each compiling
+// its files on as many threads as it asks for.
+
+#define SERVER_TIMEOUT 10
+
+// runs the command line argv, argv[0] being the program name, in the
+// client's directory, its diagnostics going to out; returns the status
+typedef int (*CommandFunction)(int argc, char* argv[], FILE* out);
+
+// listens at path and answers every client with command; never returns
+void serveCommands(const char* path, CommandFunction command);
+
+// has the server at path run argv in the working directory, printing its
+// diagnostics on stderr; false if no server is there
+bool sendCommand(const char* path, int argc, char* argv[], int* status);
+
+#endif
@@ -0,0 +1,382 @@
+//---------------------- SSA ---------------------------
+#include "ssa.h"
+
+#include "loop.h"
+
+typedef struct {
+    IrFunction* fn;
+    bool* promoted;   // indexed by slot
+    int* undefined;   // vreg read from a slot before any store
+    IrBlock*** children;  // dominator tree, indexed by block id
+    int* childCount;
+} Renamer;
+
+// slots reached through IR_ADDR_SLOT escape; everything else about a
+// slot is visible in its loads and stores
+static bool* findEscapes(IrFunction* fn) {
+    bool* escapes = irAlloc(ALLOC_OPTIMIZER, sizeof(bool) * (fn->slotCount + 1));
+    for (int b = 0; b < fn->blockCount; b++) {
+        IrBlock* block = fn->blocks[b];
+        for (int i = 0; i < block->count; i++) {
+            if (block->instrs[i]->opcode == IR_ADDR_SLOT) {
+                escapes[block->instrs[i]->slot] = true;
+            }
+        }
+    }
+    return escapes;
+}
+
+// Cooper, Harvey and Kennedy: the frontier of every block on the way up
+// from a join's predecessors to the join's immediate dominator
+static bool** dominanceFrontiers(IrFunction* fn) {
+    bool** frontier = irAlloc(ALLOC_OPTIMIZER, sizeof(bool*) * (fn->nextBlockId + 1));
+    for (int b = 0; b < fn->blockCount; b++) {
+        frontier[fn->blocks[b]->id] =
+            irAlloc(ALLOC_OPTIMIZER, sizeof(bool) * (fn->nextBlockId + 1));
+    }
+    for (int b = 0; b < fn->blockCount; b++) {
+        IrBlock* join = fn->blocks[b];
+        if (join->predCount < 2) continue;
+        for (int p = 0; p < join->predCount; p++) {
+            for (IrBlock* runner = join->preds[p]; runner != join->idom; runner = runner->idom) {
+                frontier[runner->id][join->id] = true;
+            }
+        }
+    }
+    return frontier;
+}
+
+static IrInstr* newPhi(IrFunction* fn, IrBlock* block, int slot) {
+    IrInstr* phi = newInstr(IR_PHI, newVreg(fn), block->predCount);
+    phi->slot = slot;
+    phi->sources = irAlloc(ALLOC_OPTIMIZER, sizeof(IrBlock*) * (block->predCount + 1));
+    for (int p = 0; p < block->predCount; p++) phi->sources[p] = block->preds[p];
+    insertInstr(block, 0, phi);
+    return phi;
+}
+
+static void placePhis(IrFunction* fn, bool* promoted) {
+    bool** frontier = dominanceFrontiers(fn);
+    IrBlock** worklist = irAlloc(ALLOC_OPTIMIZER, sizeof(IrBlock*) * (fn->blockCount + 1));
+    bool* queued = irAlloc(ALLOC_OPTIMIZER, sizeof(bool) * (fn->nextBlockId + 1));
+    bool* hasPhi = irAlloc(ALLOC_OPTIMIZER, sizeof(bool) * (fn->nextBlockId + 1));
+    for (int s = 0; s < fn->slotCount; s++) {
+        if (!promoted[s]) continue;
+        memset(queued, 0, sizeof(bool) * (fn->nextBlockId + 1));
+        memset(hasPhi, 0, sizeof(bool) * (fn->nextBlockId + 1));
+        int top = 0;
+        for (int b = 0; b < fn->blockCount; b++) {
+            IrBlock* block = fn->blocks[b];
+            for (int i = 0; i < block->count && !queued[block->id]; i++) {
+                IrInstr* instr = block->instrs[i];
+                if (instr->opcode == IR_STORE_SLOT && instr->slot == s) {
+                    queued[block->id] = true;
+                    worklist[top++] = block;
+                }
+            }
+        }
+        while (top > 0) {
+            IrBlock* block = worklist[--top];
+            for (int b = 0; b < fn->blockCount; b++) {
+                IrBlock* join = fn->blocks[b];
+                if (!frontier[block->id][join->id] || hasPhi[join->id]) continue;
+                newPhi(fn, join, s);
+                hasPhi[join->id] = true;
+                // a phi is a definition too
+                if (!queued[join->id]) {
+                    queued[join->id] = true;
+                    worklist[top++] = join;
+                }
+            }
+        }
+    }
+    for (int b = 0; b < fn->blockCount; b++) release(frontier[fn->blocks[b]->id]);
+    release(frontier);
+    release(worklist);
+    release(queued);
+    release(hasPhi);
+}
+
+// walks the dominator tree with the value of every slot on entry to block
+static void renameBlock(Renamer* r, IrBlock* block, int* incoming) {
+    IrFunction* fn = r->fn;
+    int* current = irAlloc(ALLOC_OPTIMIZER, sizeof(int) * (fn->slotCount + 1));
+    memcpy(current, incoming, sizeof(int) * fn->slotCount);
+    for (int i = 0; i < block->count; i++) {
+        IrInstr* instr = block->instrs[i];
+        if (instr->opcode == IR_PHI && r->promoted[instr->slot]) {
+            current[instr->slot] = instr->dst;
+        } else if (instr->opcode == IR_LOAD_SLOT && r->promoted[instr->slot]) {
+            IrInstr* copy = newInstr(IR_COPY, instr->dst, 1);
+            copy->uses[0] = current[instr->slot];
+            block->instrs[i] = copy;
+        } else if (instr->opcode == IR_STORE_SLOT && r->promoted[instr->slot]) {
+            current[instr->slot] = instr->uses[0];
+            removeInstr(block, i--);
+        }
+    }
+    for (int s = 0; s < block->succCount; s++) {
+        IrBlock* succ = block->succs[s];
+        for (int i = 0; i < succ->count && succ->instrs[i]->opcode == IR_PHI; i++) {
+            IrInstr* phi = succ->instrs[i];
+            for (int u = 0; u < phi->usecount; u++) {
+                if (phi->sources[u] == block) phi->uses[u] = current[phi->slot];
+            }
+        }
+    }
+    for (int c = 0; c < r->childCount[block->id]; c++) {
+        renameBlock(r, r->children[block->id][c], current);
+    }
+    release(current);
+}
+
+// uses of the destination of an IR_COPY read its source instead
+static void propagateCopies(IrFunction* fn) {
+    int* source = irAlloc(ALLOC_OPTIMIZER, sizeof(int) * (fn->vregCount + 1));
+    for (int v = 0; v < fn->vregCount; v++) source[v] = v;
+    for (int b = 0; b < fn->blockCount; b++) {
+        IrBlock* block = fn->blocks[b];
+        for (int i = 0; i < block->count; i++) {
+            IrInstr* instr = block->instrs[i];
+            if (instr->opcode == IR_COPY) source[instr->dst] = instr->uses[0];
+        }
+    }
+    for (int b = 0; b < fn->blockCount; b++) {
+        IrBlock* block = fn->blocks[b];
+        for (int i = 0; i < block->count; i++) {
+            IrInstr* instr = block->instrs[i];
+            if (instr->opcode == IR_COPY) {
+                removeInstr(block, i--);
+                continue;
+            }
+            for (int u = 0; u < instr->usecount; u++) {
+                int v = instr->uses[u];
+                while (source[v] != v) v = source[v];
+                instr->uses[u] = v;
+            }
+        }
+    }
+    release(source);
+}
+
+// phis only feeding other phis, as around a loop, are dead too
+static void removeDeadPhis(IrFunction* fn) {
+    IrInstr** defs = buildDefMap(fn);
+    bool* live = irAlloc(ALLOC_OPTIMIZER, sizeof(bool) * (fn->vregCount + 1));
+    int* worklist = irAlloc(ALLOC_OPTIMIZER, sizeof(int) * (fn->vregCount + 1));
+    int top = 0;
+    for (int b = 0; b < fn->blockCount; b++) {
+        IrBlock* block = fn->blocks[b];
+        for (int i = 0; i < block->count; i++) {
+            IrInstr* instr = block->instrs[i];
+            if (instr->opcode == IR_PHI) continue;
+            for (int u = 0; u < instr->usecount; u++) {
+                if (!live[instr->uses[u]]) {
+                    live[instr->uses[u]] = true;
+                    worklist[top++] = instr->uses[u];
+                }
+            }
+        }
+    }
+    while (top > 0) {
+        IrInstr* def = defs[worklist[--top]];
+        if (def == NULL || def->opcode != IR_PHI) continue;
+        for (int u = 0; u < def->usecount; u++) {
+            if (!live[def->uses[u]]) {
+                live[def->uses[u]] = true;
+                worklist[top++] = def->uses[u];
+            }
+        }
+    }
+    for (int b = 0; b < fn->blockCount; b++) {
+        IrBlock* block = fn->blocks[b];
+        for (int i = 0; i < block->count; i++) {
+            IrInstr* instr = block->instrs[i];
+            if (instr->opcode == IR_PHI && !live[instr->dst]) removeInstr(block, i--);
+        }
+    }
+    release(defs);
+    release(live);
+    release(worklist);
+}
+
+int promoteSlots(IrFunction* fn) {
+    computeCFG(fn);
+    computeDominators(fn);
+    bool* escapes = findEscapes(fn);
+    Renamer r;
+    r.fn = fn;
+    r.promoted = irAlloc(ALLOC_OPTIMIZER, sizeof(bool) * (fn->slotCount + 1));
+    int count = 0;
+    for (int s = 0; s < fn->slotCount; s++) {
+        // what genIR saw may have been optimized away since
+        fn->slots[s].addressTaken = escapes[s];
+        r.promoted[s] = !escapes[s];
+        if (r.promoted[s]) count++;
+    }
+    release(escapes);
+    if (count == 0) {
+        release(r.promoted);
+        return 0;
+    }
+    placePhis(fn, r.promoted);
+
+    // a slot read before any store holds whatever was there: 0 will do
+    IrBlock* entry = fn->blocks[0];
+    r.undefined = irAlloc(ALLOC_OPTIMIZER, sizeof(int) * (fn->slotCount + 1));
+    for (int s = 0; s < fn->slotCount; s++) {
+        if (!r.promoted[s]) continue;
+        IrInstr* zero = newInstr(IR_CONST, newVreg(fn), 0);
+        insertInstr(entry, 0, zero);
+        r.undefined[s] = zero->dst;
+    }
+    r.children = irAlloc(ALLOC_OPTIMIZER, sizeof(IrBlock**) * (fn->nextBlockId + 1));
+    r.childCount = irAlloc(ALLOC_OPTIMIZER, sizeof(int) * (fn->nextBlockId + 1));
+    for (int b = 1; b < fn->blockCount; b++) {
+        IrBlock* parent = fn->blocks[b]->idom;
+        r.children[parent->id] = reallocate(ALLOC_OPTIMIZER, r.children[parent->id],
+                                            sizeof(IrBlock*) * (r.childCount[parent->id] + 1));
+        r.children[parent->id][r.childCount[parent->id]++] = fn->blocks[b];
+    }
+    renameBlock(&r, entry, r.undefined);
+    propagateCopies(fn);
+    removeDeadPhis(fn);
+    removeDeadCode(fn);
+
+    for (int b = 0; b < fn->blockCount; b++) release(r.children[fn->blocks[b]->id]);
+    release(r.children);
+    release(r.childCount);
+    release(r.undefined);
+    release(r.promoted);
+    return count;
+}
+
+//---------------------- Constant Folding --------------
+
+// drops phi operands from blocks that are no longer predecessors
+static void prunePhis(IrFunction* fn) {
+    for (int b = 0; b < fn->blockCount; b++) {
+        IrBlock* block = fn->blocks[b];
+        for (int i = 0; i < block->count && block->instrs[i]->opcode == IR_PHI; i++) {
+            IrInstr* phi = block->instrs[i];
+            int kept = 0;
+            for (int u = 0; u < phi->usecount; u++) {
+                bool isPred = false;
+                for (int p = 0; p < block->predCount; p++) isPred |= block->preds[p] == phi->sources[u];
+                if (!isPred) continue;
+                phi->uses[kept] = phi->uses[u];
+                phi->sources[kept++] = phi->sources[u];
+            }
+            phi->usecount = kept;
+        }
+    }
+}
+
+static bool isConst(IrInstr** defs, int vreg, long* value) {
+    if (defs[vreg] == NULL || defs[vreg]->opcode != IR_CONST) return false;
+    *value = defs[vreg]->imm;
+    return true;
+}
+
+// the single vreg a phi merges, ignoring the phi itself, or -1
+static int phiValue(IrInstr* phi) {
+    int value = -1;
+    for (int u = 0; u < phi->usecount; u++) {
+        int use = phi->uses[u];
+        if (use == phi->dst || use == value) continue;
+        if (value >= 0) return -1;
+        value = use;
+    }
+    return value;
+}
+
+// does a phi merge equal constants from different vregs? those need not
+// dominate the phi, so it becomes a constant of its own
+static bool phiConstant(IrInstr* phi, IrInstr** defs, long* value) {
+    bool found = false;
+    for (int u = 0; u < phi->usecount; u++) {
+        long c;
+        if (phi->uses[u] == phi->dst) continue;
+        if (!isConst(defs, phi->uses[u], &c) || (found && c != *value)) return false;
+        *value = c;
+        found = true;
+    }
+    return found;
+}
+
+// one sweep; returns true if anything was folded
+static bool foldOnce(IrFunction* fn) {
+    IrInstr** defs = buildDefMap(fn);
+    bool changed = false, cfgChanged = false;
+    for (int b = 0; b < fn->blockCount; b++) {
+        IrBlock* block = fn->blocks[b];
+        for (int i = 0; i < block->count; i++) {
+            IrInstr* instr = block->instrs[i];
+            long a, c, folded;
+            // a division that traps is left to trap at run time
+            if (instr->opcode == IR_BINARY && isConst(defs, instr->uses[0], &a) &&
+                isConst(defs, instr->uses[1], &c) && foldBinary(instr->op, a, c, &folded)) {
+                instr->opcode = IR_CONST;
+                instr->imm = folded;
+                instr->usecount = 0;
+                changed = true;
+            } else if (instr->opcode == IR_UNARY && isConst(defs, instr->uses[0], &a)) {
+                instr->opcode = IR_CONST;
+                instr->imm = foldUnary(instr->op, a);
+                instr->usecount = 0;
+                changed = true;
+            } else if (instr->opcode == IR_PHI && phiValue(instr) >= 0) {
+                instr->uses[0] = phiValue(instr);
+                instr->opcode = IR_COPY;
+                instr->usecount = 1;
+                instr->sources = NULL;
+                changed = true;
+            } else if (instr->opcode == IR_PHI && phiConstant(instr, defs, &a)) {
+                instr->opcode = IR_CONST;
+                instr->imm = a;
+                instr->usecount = 0;
+                instr->sources = NULL;
+                changed = true;
+            } else if (instr->opcode == IR_BRANCH && isConst(defs, instr->uses[0], &a)) {
+                instr->opcode = IR_JUMP;
+                instr->usecount = 0;
+                if (!a) instr->target = instr->otherwise;
+                instr->otherwise = NULL;
+                changed = cfgChanged = true;
+            }
+        }
+    }
+    release(defs);
+    // the copies of folded phis may sit among the remaining phis
+    for (int b = 0; b < fn->blockCount && changed; b++) {
+        IrBlock* block = fn->blocks[b];
+        int phis = 0;
+        for (int i = 0; i < block->count; i++) {
+            IrInstr* instr = block->instrs[i];
+            if (instr->opcode != IR_PHI) continue;
+            memmove(&block->instrs[phis + 1], &block->instrs[phis],
+                    sizeof(IrInstr*) * (i - phis));
+            block->instrs[phis++] = instr;
+        }
+    }
+    if (changed) propagateCopies(fn);
+    if (cfgChanged) {
+        computeCFG(fn);
+        prunePhis(fn);
+    }
+    return changed;
+}
+
+void foldConstants(IrFunction* fn) {
+    while (foldOnce(fn)) {
+    }
+    removeDeadPhis(fn);
+    removeDeadCode(fn);
+}
+
+void buildSSA(IrProgram* program) {
+    for (int i = 0; i < program->functionCount; i++) {
+        IrFunction* fn = program->functions[i];
+        if (promoteSlots(fn)) foldConstants(fn);
+    }
+}
@@ -0,0 +1,22 @@
+#ifndef SSA_H
+#define SSA_H
+
+#include "ir.h"
+
+//---------------------- SSA ---------------------------
+// Slots whose address is never taken are promoted to vregs: each store
+// becomes the slot's current value, each load a use of it, and IR_PHI
+// joins the values reaching a block that several definitions reach
+// (Cytron et al., placed on the iterated dominance frontier). Slots that
+// escape through IR_ADDR_SLOT keep their loads and stores.
+//
+// Promotion runs after the loop passes, which match on slots, and is
+// followed by constant folding over the SSA values: operators of
+// constants, phis of a single value and branches on a constant.
+
+// returns the number of slots promoted
+int promoteSlots(IrFunction* fn);
+void foldConstants(IrFunction* fn);
+void buildSSA(IrProgram* program);
+
+#endif
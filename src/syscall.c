@@ -0,0 +1,78 @@
+//---------------------- Syscall ----------------------
+#include "syscall.h"
+
+#include <errno.h>
+#include <unistd.h>
+
+const SyscallInfo syscalls[SYSCALL_COUNT] = {
+    [SYS_READ] = {"sys_read", 0, 3},
+    [SYS_WRITE] = {"sys_write", 1, 3},
+    [SYS_EXIT] = {"sys_exit", 60, 1},
+    [SYS_OPEN] = {"sys_open", 2, 3},
+    [SYS_CLOSE] = {"sys_close", 3, 1},
+    [SYS_LSEEK] = {"sys_lseek", 8, 3},
+    [SYS_BRK] = {"sys_brk", 12, 1},
+    [SYS_MMAP] = {"sys_mmap", 9, 6},
+    [SYS_MUNMAP] = {"sys_munmap", 11, 2},
+    [SYS_MPROTECT] = {"sys_mprotect", 10, 3},
+    [SYS_MSYNC] = {"sys_msync", 26, 3},
+    [SYS_MADVISE] = {"sys_madvise", 28, 3},
+    [SYS_DUP] = {"sys_dup", 32, 1},
+    [SYS_DUP2] = {"sys_dup2", 33, 2},
+    [SYS_PIPE] = {"sys_pipe", 22, 1},
+    [SYS_INOTIFY_INIT] = {"sys_inotify_init", 253, 0},
+    [SYS_INOTIFY_ADD_WATCH] = {"sys_inotify_add_watch", 254, 3},
+    [SYS_INOTIFY_RM_WATCH] = {"sys_inotify_rm_watch", 255, 2},
+    [SYS_IOCTL] = {"sys_ioctl", 16, 3},
+    [SYS_FCNTL] = {"sys_fcntl", 72, 3},
+    [SYS_FUTEX] = {"sys_futex", 202, 6},
+    [SYS_GETDENTS64] = {"sys_getdents64", 217, 3},
+    [SYS_CLOCK_GETTIME] = {"sys_clock_gettime", 228, 2},
+    [SYS_NANOSLEEP] = {"sys_nanosleep", 35, 2},
+    [SYS_GETPID] = {"sys_getpid", 39, 0},
+    [SYS_GETTID] = {"sys_gettid", 186, 0},
+    [SYS_TGKILL] = {"sys_tgkill", 234, 3},
+    [SYS_KILL] = {"sys_kill", 62, 2},
+    [SYS_UNAME] = {"sys_uname", 63, 1},
+    [SYS_GETCWD] = {"sys_getcwd", 79, 2},
+    [SYS_CHDIR] = {"sys_chdir", 80, 1},
+    [SYS_MKDIR] = {"sys_mkdir", 83, 2},
+    [SYS_LINK] = {"sys_link", 86, 2},
+    [SYS_UNLINK] = {"sys_unlink", 87, 1},
+    [SYS_READLINK] = {"sys_readlink", 89, 3},
+    [SYS_CHMOD] = {"sys_chmod", 90, 2},
+    [SYS_FCHMOD] = {"sys_fchmod", 91, 2},
+    [SYS_CHOWN] = {"sys_chown", 92, 3},
+    [SYS_FCHOWN] = {"sys_fchown", 93, 3},
+    [SYS_LCHOWN] = {"sys_lchown", 94, 3},
+    [SYS_UMASK] = {"sys_umask", 95, 1},
+    [SYS_GETTIMEOFDAY] = {"sys_gettimeofday", 96, 2},
+    [SYS_GETRLIMIT] = {"sys_getrlimit", 97, 2},
+    [SYS_SETRLIMIT] = {"sys_setrlimit", 160, 2},
+    [SYS_GETRUSAGE] = {"sys_getrusage", 98, 2},
+    [SYS_SYSINFO] = {"sys_sysinfo", 99, 1},
+    [SYS_TIMES] = {"sys_times", 100, 1},
+    [SYS_PTRACE] = {"sys_ptrace", 101, 4},
+    [SYS_GETUID] = {"sys_getuid", 102, 0},
+    [SYS_READV] = {"sys_readv", 19, 3},
+    [SYS_WRITEV] = {"sys_writev", 20, 3},
+    [SYS_IO_URING_SETUP] = {"sys_io_uring_setup", 425, 2},
+    [SYS_IO_URING_ENTER] = {"sys_io_uring_enter", 426, 6},
+};
+
+int findSyscall(String name) {
+    if (name.length < 4 || strncmp(name.chars, "sys_", 4) != 0) return -1;
+    for (int i = 0; i < SYSCALL_COUNT; i++) {
+        const char* candidate = syscalls[i].name;
+        if ((int)strlen(candidate) == name.length &&
+            strncmp(candidate, name.chars, name.length) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+long callSyscall(int number, long* args) {
+    long result = syscall(number, args[0], args[1], args[2], args[3], args[4], args[5]);
+    return result == -1 ? -errno : result;
+}
@@ -1,6 +1,13 @@
 #ifndef SYSCALL_H
 #define SYSCALL_H
+
+#include "util.h"
+
 //---------------------- Syscall ----------------------
+// Calls to sys_read, sys_write and the rest of the names below compile to
+// a syscall instruction in place, unless the program defines a function of
+// that name. Arguments go in rdi, rsi, rdx, r10, r8 and r9, the number in
+// rax, and the kernel's result, a negated errno on failure, is the value.
 
 typedef enum {
     SYS_READ,
@@ -52,6 +59,25 @@ typedef enum {
     SYS_TIMES,
     SYS_PTRACE,
     SYS_GETUID,
+    SYS_READV,
+    SYS_WRITEV,
+    SYS_IO_URING_SETUP,
+    SYS_IO_URING_ENTER,
+    SYSCALL_COUNT,
 } SYSCALL;
 
-#endif
\ No newline at end of file
+typedef struct {
+    const char* name;  // what programs call it
+    int number;        // on x86-64 Linux
+    int argCount;
+} SyscallInfo;
+
+extern const SyscallInfo syscalls[SYSCALL_COUNT];
+
+// the intrinsic called name, or -1
+int findSyscall(String name);
+// makes system call number with the arguments it takes from args, for the
+// interpreters, returning what the syscall instruction would
+long callSyscall(int number, long* args);
+
+#endif
@@ -1,5 +1,7 @@
 #include "test.h"
 
+#include <unistd.h>
+
 static Program* parse_(const char* buffer) {
     Token* tokens = scanTokens(buffer);
     Program* program = parse(tokens);
@@ -103,5 +105,704 @@ void test_parse() {
     test_parse_var_def();
     test_parse_fun_def();
     test_parse_stmt();
+}
+
+//---------------------- IR interpreter ---------------
+// executes IR directly so optimized code can be checked against the
+// unoptimized program
+
+static long runIrFunction(IrProgram* program, IrFunction* fn, long* args) {
+    long* v = calloc(fn->vregCount + 1, sizeof(long));
+    long* slots = calloc(fn->slotCount + 1, sizeof(long));
+    IrBlock* block = fn->blocks[0];
+    IrBlock* previous = NULL;
+    for (;;) {
+        // the phis of a block all read their values before any is written
+        int phis = 0;
+        while (phis < block->count && block->instrs[phis]->opcode == IR_PHI) phis++;
+        long* incoming = calloc(phis + 1, sizeof(long));
+        for (int i = 0; i < phis; i++) {
+            IrInstr* phi = block->instrs[i];
+            for (int u = 0; u < phi->usecount; u++) {
+                if (phi->sources[u] == previous) incoming[i] = v[phi->uses[u]];
+            }
+        }
+        for (int i = 0; i < phis; i++) v[block->instrs[i]->dst] = incoming[i];
+        free(incoming);
+        IrBlock* next = NULL;
+        for (int i = phis; i < block->count && next == NULL; i++) {
+            IrInstr* instr = block->instrs[i];
+            int* u = instr->uses;
+            switch (instr->opcode) {
+                case IR_CONST:
+                    v[instr->dst] = instr->imm;
+                    break;
+                case IR_COPY:
+                    v[instr->dst] = v[u[0]];
+                    break;
+                case IR_PARAM:
+                    v[instr->dst] = args[instr->imm];
+                    break;
+                case IR_BINARY:
+                    assert(foldBinary(instr->op, v[u[0]], v[u[1]], &v[instr->dst]));
+                    break;
+                case IR_UNARY:
+                    v[instr->dst] = foldUnary(instr->op, v[u[0]]);
+                    break;
+                case IR_LOAD_SLOT:
+                    v[instr->dst] = slots[instr->slot];
+                    break;
+                case IR_STORE_SLOT:
+                    slots[instr->slot] = v[u[0]];
+                    break;
+                case IR_ADDR_SLOT:
+                    v[instr->dst] = (long)&slots[instr->slot];
+                    break;
+                case IR_ADDR_GLOBAL:
+                    for (int g = 0; g < program->globalCount; g++) {
+                        IrGlobal* global = &program->globals[g];
+                        if (!stringEqual(global->name, instr->name)) continue;
+                        v[instr->dst] = global->bytes.chars
+                                            ? (long)global->bytes.chars
+                                            : (long)&global->value;
+                    }
+                    break;
+                case IR_LOAD:
+                    v[instr->dst] = *(long*)v[u[0]];
+                    break;
+                case IR_STORE:
+                    *(long*)v[u[0]] = v[u[1]];
+                    break;
+                // vector values are held as pointers to their lanes
+                case IR_VLOAD:
+                case IR_VSPLAT:
+                case IR_VBINARY: {
+                    long* lanes = calloc(instr->imm, sizeof(long));
+                    for (int l = 0; l < instr->imm; l++) {
+                        if (instr->opcode == IR_VLOAD) {
+                            lanes[l] = ((long*)v[u[0]])[l];
+                        } else if (instr->opcode == IR_VSPLAT) {
+                            lanes[l] = v[u[0]];
+                        } else {
+                            assert(foldBinary(instr->op, ((long*)v[u[0]])[l],
+                                              ((long*)v[u[1]])[l], &lanes[l]));
+                        }
+                    }
+                    v[instr->dst] = (long)lanes;
+                    break;
+                }
+                case IR_VSTORE:
+                    memcpy((long*)v[u[0]], (long*)v[u[1]],
+                           sizeof(long) * instr->imm);
+                    break;
+                case IR_CALL: {
+                    IrFunction* callee = findIrFunction(program, instr->name);
+                    assert(callee != NULL);
+                    long* callArgs = calloc(instr->usecount + 1, sizeof(long));
+                    for (int a = 0; a < instr->usecount; a++) {
+                        callArgs[a] = v[u[a]];
+                    }
+                    v[instr->dst] = runIrFunction(program, callee, callArgs);
+                    free(callArgs);
+                    break;
+                }
+                case IR_SYSCALL: {
+                    long a[6] = {0};
+                    for (int i = 0; i < instr->usecount; i++) a[i] = v[u[i]];
+                    v[instr->dst] = syscall(instr->imm, a[0], a[1], a[2], a[3],
+                                            a[4], a[5]);
+                    break;
+                }
+                case IR_JUMP:
+                    next = instr->target;
+                    break;
+                case IR_BRANCH:
+                    next = v[u[0]] ? instr->target : instr->otherwise;
+                    break;
+                case IR_RET: {
+                    long result = instr->usecount ? v[u[0]] : 0;
+                    free(v);
+                    free(slots);
+                    return result;
+                }
+                case IR_PHI:
+                    break;
+            }
+        }
+        previous = block;
+        block = next;
+    }
+}
+
+static IrProgram* ir_(const char* buffer) { return genIR(parse_(buffer)); }
+
+static long runIr(IrProgram* program, const char* name, long* args) {
+    IrFunction* fn = findIrFunction(program, makeString(name, strlen(name)));
+    assert(fn != NULL);
+    return runIrFunction(program, fn, args);
+}
+
+// number of instructions inside loops matching opcode (and op for binaries)
+static int countInLoops(IrFunction* fn, IrOpcode opcode, Op op) {
+    computeCFG(fn);
+    computeDominators(fn);
+    Loop* loops;
+    int count = findLoops(fn, &loops);
+    int found = 0;
+    for (int b = 0; b < fn->blockCount; b++) {
+        IrBlock* block = fn->blocks[b];
+        bool inLoop = false;
+        for (int l = 0; l < count; l++) inLoop |= loops[l].body[block->id];
+        for (int i = 0; i < block->count && inLoop; i++) {
+            IrInstr* instr = block->instrs[i];
+            if (instr->opcode == opcode &&
+                (opcode != IR_BINARY || instr->op == op)) {
+                found++;
+            }
+        }
+    }
+    release(loops);
+    return found;
+}
+
+static int loopCount(IrFunction* fn) {
+    computeCFG(fn);
+    computeDominators(fn);
+    Loop* loops;
+    int count = findLoops(fn, &loops);
+    release(loops);
+    return count;
+}
+
+static void test_ir_gen() {
+    IrProgram* program = ir_(
+        "int g = 5;"
+        "int sq(int x) { return x * x; }"
+        "int f(int a, int b) { int c = 0;"
+        "  if (a < b && b < 10) { c = sq(b) - a; } else { c = -g; }"
+        "  return c; }");
+    long args[] = {2, 3};
+    assert(runIr(program, "f", args) == 7);
+    long args2[] = {4, 3};
+    assert(runIr(program, "f", args2) == -5);
+    long args3[] = {2, 30};
+    assert(runIr(program, "f", args3) == -5);
+}
+
+static void test_loop_opt() {
+    long data[] = {3, 1, 4, 1, 5, 9, 2, 6};
+    // licm + strength reduction
+    {
+        const char* source =
+            "int sum(int a, int n) { int s = 0; int i = 0;"
+            "  while (i < n) { s = s + a[i]; i = i + 1; } return s; }";
+        IrProgram* program = ir_(source);
+        IrFunction* fn = program->functions[0];
+        assert(countInLoops(fn, IR_BINARY, OP_MUL) == 1);
+        optimizeLoops(program, LANES_SCALAR);
+        assert(countInLoops(fn, IR_BINARY, OP_MUL) == 0);
+        assert(countInLoops(fn, IR_CONST, OP_ERROR) == 0);
+        long args[] = {(long)data, 8};
+        assert(runIr(program, "sum", args) == 31);
+    }
+    // full unrolling of a constant trip count
+    {
+        IrProgram* program = ir_(
+            "int tri() { int s = 0; int i = 0;"
+            "  while (i < 4) { s = s + i; i = i + 1; } return s; }");
+        optimizeLoops(program, LANES_SCALAR);
+        assert(loopCount(program->functions[0]) == 0);
+        assert(runIr(program, "tri", NULL) == 6);
+    }
+    // the inner loop of a nest is unrolled, the outer one is kept
+    {
+        const char* source =
+            "int nest(int a, int n) { int s = 0; int i = 0;"
+            "  while (i < n) { int j = 0;"
+            "    while (j < 3) { s = s + a[j] * i; j = j + 1; }"
+            "    i = i + 1; }"
+            "  return s; }";
+        long args[] = {(long)data, 5};
+        long expected = runIr(ir_(source), "nest", args);
+        IrProgram* program = ir_(source);
+        optimizeLoops(program, LANES_SCALAR);
+        assert(loopCount(program->functions[0]) == 1);
+        assert(runIr(program, "nest", args) == expected);
+    }
+}
+
+static void test_vectorize() {
+    const char* source =
+        "int vadd(int a, int b, int c, int n) { int i = 0;"
+        "  while (i < n) { c[i] = a[i] + b[i] - 1; i = i + 1; } return i; }";
+    long lanes[] = {LANES_SSE2, LANES_AVX2};
+    for (int w = 0; w < 2; w++) {
+        IrProgram* program = ir_(source);
+        optimizeLoops(program, lanes[w]);
+        assert(loopCount(program->functions[0]) == 2);
+        assert(countInLoops(program->functions[0], IR_VLOAD, OP_ERROR) == 2);
+        long a[11], b[11], c[11];
+        for (int i = 0; i < 11; i++) {
+            a[i] = i;
+            b[i] = 100 * i;
+        }
+        long args[] = {(long)a, (long)b, (long)c, 11};
+        assert(runIr(program, "vadd", args) == 11);
+        for (int i = 0; i < 11; i++) assert(c[i] == 101 * i - 1);
+        // overlapping arrays fall back to the scalar loop
+        long x[12] = {1};
+        long overlap[] = {(long)x, (long)x, (long)(x + 1), 11};
+        runIr(program, "vadd", overlap);
+        for (int i = 0; i < 12; i++) assert(x[i] == 1);
+    }
+    // a reduction carries a value across iterations and is left alone
+    IrProgram* program = ir_(
+        "int sum(int a, int n) { int s = 0; int i = 0;"
+        "  while (i < n) { s = s + a[i]; i = i + 1; } return s; }");
+    optimizeLoops(program, LANES_AVX2);
+    assert(countInLoops(program->functions[0], IR_VLOAD, OP_ERROR) == 0);
+}
+
+static void test_ssa() {
+    const char* source =
+        "int f(int n) { int s = 0; int i = 0; int t = 0; int k = 3;"
+        "  bump(&t);"
+        "  while (i < n) { if (i < k * 2) { s = s + i; } else { s = s - 1; }"
+        "    t = t + s; i = i + 1; }"
+        "  return s * 1000 + t; }"
+        "int bump(int p) { *p = *p + 1; return 0; }";
+    long args[] = {10};
+    long expected = runIr(ir_(source), "f", args);
+    IrProgram* program = ir_(source);
+    buildSSA(program);
+    IrFunction* fn = findIrFunction(program, makeString("f", 1));
+    // s and i live in vregs, s with a phi at the join of the if too; t
+    // escapes through &t and stays in memory
+    assert(countInLoops(fn, IR_PHI, OP_ERROR) == 3);
+    assert(countInLoops(fn, IR_LOAD_SLOT, OP_ERROR) == 1);
+    assert(countInLoops(fn, IR_STORE_SLOT, OP_ERROR) == 1);
+    // k * 2 is folded
+    assert(countInLoops(fn, IR_BINARY, OP_MUL) == 0);
+    assert(runIr(program, "f", args) == expected);
+}
+
+static void test_matmul() {
+    IrProgram* program =
+        ir_("int mm(int a, int b, int c) { return a @ b @ c; }");
+    IrBlock* entry = program->functions[0]->blocks[0];
+    int calls = 0;
+    for (int i = 0; i < entry->count; i++) {
+        IrInstr* instr = entry->instrs[i];
+        if (instr->opcode != IR_CALL) continue;
+        assert(strncmp(instr->name.chars, "scc_matmul", 10) == 0);
+        assert(instr->usecount == 2);
+        calls++;
+    }
+    assert(calls == 2);
+}
+
+void test_ir() {
+    printf("Testing IR...\n");
+    test_ir_gen();
+    test_loop_opt();
+    test_vectorize();
+    test_ssa();
+    test_matmul();
+}
+
+//---------------------- Code Generation ---------------
+
+// assembly for `buffer` at the given optimization level
+static char* asm_(const char* buffer, int optLevel) {
+    IrProgram* program = ir_(buffer);
+    if (optLevel > 0) optimizeLoops(program, LANES_SSE2);
+    char* text;
+    size_t size;
+    FILE* out = open_memstream(&text, &size);
+    emitAssembly(genMachineCode(program, optLevel), out);
+    fclose(out);
+    return text;
+}
+
+void test_codegen() {
+    printf("Testing codegen...\n");
+    const char* source =
+        "int sq(int x) { return x * x; }"
+        "int f(int n) { int s = 0; int i = 0;"
+        "  while (i < n) { s = s + sq(i); i = i + 1; } return s; }";
+    char* naive = asm_(source, 0);
+    char* text = asm_(source, 1);
+    // a leaf keeps everything in caller-saved registers and needs no frame
+    char* sq = strstr(text, "sq:");
+    char* f = strstr(text, "f:");
+    assert(sq && f && sq < f);
+    assert(strstr(sq, "imulq") < f);
+    assert(strstr(sq, "pushq") == NULL || strstr(sq, "pushq") > f);
+    assert(strstr(f, "pushq\t%rbp") != NULL);
+    assert(strstr(f, "call\tsq") != NULL);
+    // the loop state lives in registers: far less code than the naive
+    // lowering that goes through the frame for every value
+    assert(strlen(text) * 2 < strlen(naive));
+    release(naive);
+    release(text);
+}
+
+void test_peephole() {
+    long fused = peepholeHits("fuse-compare");
+    long zeroed = peepholeHits("zero-idiom");
+    char* text = asm_("int f(int a, int b) {"
+                      "  if (!(a == b)) { return 1; } return 0; }",
+                      1);
+    // setcc, test and jne collapse into a single jne after the compare
+    assert(peepholeHits("fuse-compare") > fused);
+    assert(strstr(text, "sete") == NULL);
+    assert(strstr(text, "testq") == NULL);
+    assert(peepholeHits("zero-idiom") > zeroed);
+    assert(strstr(text, "xorl\t%eax, %eax") != NULL);
+    release(text);
+}
+
+void test_object() {
+    IrProgram* program = ir_("int id(int x) { return x; }");
+    optimizeLoops(program, LANES_SSE2);
+    char* bytes;
+    size_t size;
+    FILE* out = open_memstream(&bytes, &size);
+    emitObject(genMachineCode(program, 1), out);
+    fclose(out);
+    assert(size > 64 && memcmp(bytes, "\177ELF", 4) == 0);
+    // .text follows the 64 byte header: movq %rdi, %rax; ret
+    assert(memcmp(bytes + 64, "\x48\x89\xf8\xc3", 4) == 0);
+    release(bytes);
+}
+
+void test_jit() {
+    Jit* jit = newJit();
+    Program* defs = parse_("int sq(int x) { return x * x; } int base = 2;");
+    jitLoad(jit, genMachineCode(genIR(defs), 1));
+    // a later program links against the earlier one
+    Program* use = parse_("int f() { return sq(7) + base; }");
+    IrContext context;
+    memset(&context, 0, sizeof(IrContext));
+    addIrContext(&context, defs);
+    jitLoad(jit, genMachineCode(genIRInContext(use, &context), 1));
+    freeIrContext(&context);
+    long (*f)(void) = (long (*)(void))jitLookup(jit, makeString("f", 1));
+    assert(f() == 51);
+    // and a redefinition takes over its callers
+    jitLoad(jit, genMachineCode(genIR(parse_("int sq(int x) { return x; }")), 1));
+    assert(f() == 9);
+    freeJit(jit);
+}
+
+void test_vm() {
+    Program* program = parse_(
+        "int total = 0;"
+        "int fib(int n) { if (n < 2) { return n; } return fib(n - 1) + fib(n - 2); }"
+        "int add(int p, int n) { *p = *p + n; return *p; }"
+        "int main() {"
+        "  int i = 0;"
+        "  while (i < 10 && fib(i) < 100) { add(&total, fib(i)); i = i + 1; }"
+        "  return total * 100 + fib(10);"
+        "}");
+    // both interpreters agree with each other and with native code
+    assert(runBytecode(compileBytecode(program), "main") == 8855);
+    assert(walkProgram(program, "main") == 8855);
+    // and make the syscalls compiled code would, unless the program has its own
+    program = parse_(
+        "int main() { return sys_getpid() * 2 + sys_close(0 - 1); }"
+        "int sys_close(int fd) { return fd; }");
+    assert(runBytecode(compileBytecode(program), "main") == getpid() * 2 - 1);
+    assert(walkProgram(program, "main") == getpid() * 2 - 1);
+}
+
+static int countCalls(IrFunction* fn, const char* name) {
+    int count = 0;
+    for (int b = 0; b < fn->blockCount; b++) {
+        for (int i = 0; i < fn->blocks[b]->count; i++) {
+            IrInstr* instr = fn->blocks[b]->instrs[i];
+            if (instr->opcode == IR_CALL && strcmp(instr->name.chars, name) == 0) count++;
+        }
+    }
+    return count;
+}
+
+void test_inline() {
+    IrProgram* ir = genIR(parse_(
+        "int add(int a, int b) { return a + b; }"
+        "int minus(int a, int b) { return a - b; }"
+        "int cal(int a, int b) { if (a > b) { return a; } return b; }"
+        "int fact(int n) { if (n < 2) { return 1; } return n * fact(n - 1); }"
+        "int f(int x) { return cal(add(x, 2), minus(x, 2)) + fact(x); }"));
+    inlineFunctions(ir, NULL);
+    IrFunction* f = findIrFunction(ir, makeString("f", 1));
+    assert(countCalls(f, "add") == 0 && countCalls(f, "cal") == 0);
+    // recursion stays a call in its own component
+    IrFunction* fact = findIrFunction(ir, makeString("fact", 4));
+    assert(countCalls(fact, "fact") == 1);
+    Jit* jit = newJit();
+    jitLoad(jit, genMachineCode(ir, 1));
+    long (*run)(long) = (long (*)(long))jitLookup(jit, makeString("f", 1));
+    assert(run(4) == 30);
+    freeJit(jit);
+}
+
+void test_tailcall() {
+    IrProgram* ir = genIR(parse_(
+        "int sum(int n, int acc) { if (n == 0) { return acc; } return sum(n - 1, acc + n); }"
+        "int even(int n) { if (n == 0) { return 1; } return odd(n - 1); }"
+        "int odd(int n) { if (n == 0) { return 0; } return even(n - 1); }"));
+    eliminateTailCalls(ir);
+    assert(countCalls(findIrFunction(ir, makeString("sum", 3)), "sum") == 0);
+    // far deeper than the stack would allow with a frame per call
+    Jit* jit = newJit();
+    jitLoad(jit, genMachineCode(ir, 1));
+    long (*sum)(long, long) = (long (*)(long, long))jitLookup(jit, makeString("sum", 3));
+    long (*even)(long) = (long (*)(long))jitLookup(jit, makeString("even", 4));
+    assert(sum(10000000, 0) == 50000005000000);
+    assert(even(10000000) == 1);
+    freeJit(jit);
+    // a call whose result is branched on rather than returned stays a call
+    ir = genIR(parse_("int id(int x) { return x; }"
+                      "int pick(int x) { if (id(x)) { return 1; } return 2; }"));
+    jit = newJit();
+    jitLoad(jit, genMachineCode(ir, 1));
+    long (*pick)(long) = (long (*)(long))jitLookup(jit, makeString("pick", 4));
+    assert(pick(5) == 1 && pick(0) == 2);
+    freeJit(jit);
+}
+
+void test_partial() {
+    Program* program = parse_(
+        "int total;"
+        "int square(int x) { return x * x; }"
+        "int sum(int n) { int s = 0; while (n > 0) { s = s + square(n); n = n - 1; } return s; }"
+        "int spin(int n) { while (1) { n = n + 1; } return n; }"
+        "int bump(int x) { total = total + x; return total; }"
+        "int show(int x) { printf(\"%d\", x); return x; }"
+        "int half(int x) { return 10 / x; }"
+        "int size = sum(10);"
+        "int main(int a) { return sum(3) + square(-4) + square(a) + spin(0) + bump(1)"
+        " + show(2) + half(0) + sum(sum(2)); }");
+    // sum(3), square(-4), sum(2) and the sum of its result, and size
+    assert(evaluatePureCalls(program) == 5);
+    assert(program->declarations[7]->variable.initializer->type == EXPR_LITERAL);
+    assert(program->declarations[7]->variable.initializer->literal.value.intVal == 385);
+    IrProgram* ir = genIR(program);
+    IrFunction* main = findIrFunction(ir, makeString("main", 4));
+    assert(countCalls(main, "sum") == 0);
+    assert(countCalls(main, "square") == 1);
+    assert(countCalls(main, "spin") == 1 && countCalls(main, "bump") == 1);
+    assert(countCalls(main, "show") == 1 && countCalls(main, "half") == 1);
+    // a division that traps and arithmetic that overflows are left to run
+    program = parse_(
+        "int pow2(int n) { int m = 1; while (n > 0) { m = m * 2; n = n - 1; } return m; }"
+        "int quotient(int n) { return (0 - pow2(62) - pow2(62)) / n; }"
+        "int main() { return quotient(-1) + pow2(64) + pow2(3); }");
+    assert(evaluatePureCalls(program) == 1);
+    main = findIrFunction(genIR(program), makeString("main", 4));
+    assert(countCalls(main, "quotient") == 1 && countCalls(main, "pow2") == 1);
+    // globals are folded on their own, for -O0 and the interpreters
+    program = parse_("int triple(int x) { return x * 3; } int n = triple(3);"
+                     "int main() { return triple(n); }");
+    assert(evaluateGlobalInitializers(program) == 1);
+    assert(program->declarations[1]->variable.initializer->literal.value.intVal == 9);
+    assert(runBytecode(compileBytecode(program), "main") == 27);
+}
+
+void test_prune() {
+    const char* source =
+        "int count;"
+        "int unused;"
+        "int leaf(int x) { count = count + 1; return x; }"
+        "int helper(int x) { return leaf(x) + 1; }"
+        "int orphan(int x) { return orphan(x) + unused; }"
+        "int api(int x) { return x; }"
+        "int main() { return helper(2); }";
+    String roots[] = {makeString("main", 4), makeString("api", 3)};
+    Program* program = parse_(source);
+    Program* dead = removeUnreachable(program, roots, 2);
+    assert(program->count == 5 && dead->count == 2);
+    assert(stringEqual(dead->declarations[0]->variable.name, makeString("unused", 6)));
+    assert(stringEqual(dead->declarations[1]->function.name, makeString("orphan", 6)));
+    program = parse_(source);
+    assert(removeUnreachable(program, roots, 1)->count == 3);
+    // a library without main keeps everything
+    program = parse_("int f() { return 1; } int g() { return 2; }");
+    assert(removeUnreachable(program, roots, 1)->count == 0 && program->count == 2);
+}
+
+typedef struct {
+    long squares[1000];
+    long runs;
+} PoolTest;
+
+static void square_(void* context, int job) {
+    PoolTest* test = context;
+    test->squares[job] = (long)job * job;
+    __atomic_fetch_add(&test->runs, 1, __ATOMIC_RELAXED);
+}
+
+void test_pool() {
+    PoolTest test;
+    memset(&test, 0, sizeof(PoolTest));
+    long cost[1000];
+    for (int i = 0; i < 1000; i++) cost[i] = i % 17;
+    runJobs(8, 1000, square_, &test, cost);
+    assert(test.runs == 1000);
+    for (int i = 0; i < 1000; i++) assert(test.squares[i] == (long)i * i);
+    // more threads than jobs
+    runJobs(16, 3, square_, &test, NULL);
+    assert(test.runs == 1003);
+}
+
+static CacheKey key_(const char* source, const char* name) {
+    IrProgram* ir = genIR(parse_(source));
+    return hashFunction(1, ir, findIrFunction(ir, makeString(name, strlen(name))));
+}
+
+void test_cache() {
+    const char* source = "int f(int x) { return g(x) + 1; } int g(int x) { return x * 2; }";
+    CacheKey f = key_(source, "f"), g = key_(source, "g");
+    assert(f == key_(source, "f") && f != g);
+    // only the edited function changes
+    const char* edited = "int f(int x) { return g(x) + 1; } int g(int x) { return x * 3; }";
+    assert(key_(edited, "f") == f && key_(edited, "g") != g);
+    // a callee defined elsewhere is called differently
+    assert(key_("int f(int x) { return g(x) + 1; }", "f") != f);
+    char dir[] = "/tmp/scc-cache-XXXXXX";
+    assert(mkdtemp(dir) != NULL);
+    size_t length;
+    assert(cacheLoad(dir, f, &length) == NULL);
+    cacheStore(dir, f, "f:\n\tret\n", 8);
+    char* text = cacheLoad(dir, f, &length);
+    assert(text != NULL && length == 8 && strcmp(text, "f:\n\tret\n") == 0);
+    release(text);
+    char path[64];
+    sprintf(path, "%s/%016lx.s", dir, f);
+    remove(path);
+    rmdir(dir);
+    // in memory, the entries used longest ago go first
+    size_t size = MEMORY_CACHE_LIMIT / 16;
+    char* big = calloc(size, 1);
+    for (CacheKey key = 1; key <= 17; key++) {
+        cacheStore(NULL, key, big, size);
+        if (key > 1) release(cacheLoad(NULL, 1, &length));
+    }
+    assert(cacheLoad(NULL, 2, &length) == NULL);
+    text = cacheLoad(NULL, 1, &length);
+    assert(text != NULL && length == size);
+    release(text);
+    free(big);
+}
+
+void test_syscall() {
+    const char* source =
+        "int pid() { return sys_getpid(); }"
+        "int put(int fd, int buf, int n) { return sys_write(fd, buf, n); }"
+        "int get(int fd, int buf, int n) { return sys_read(fd, buf, n); }"
+        "int sys_getuid() { return -1; }"
+        "int uid() { return sys_getuid(); }";
+    for (int level = 0; level <= 1; level++) {
+        IrProgram* ir = genIR(parse_(source));
+        assert(countCalls(findIrFunction(ir, makeString("pid", 3)), "sys_getpid") == 0);
+        // a function of the program shadows the intrinsic
+        assert(countCalls(findIrFunction(ir, makeString("uid", 3)), "sys_getuid") == 1);
+        Jit* jit = newJit();
+        jitLoad(jit, genMachineCode(ir, level));
+        long (*pid)(void) = (long (*)(void))jitLookup(jit, makeString("pid", 3));
+        long (*put)(long, long, long) =
+            (long (*)(long, long, long))jitLookup(jit, makeString("put", 3));
+        long (*get)(long, long, long) =
+            (long (*)(long, long, long))jitLookup(jit, makeString("get", 3));
+        assert(pid() == getpid());
+        int fds[2];
+        assert(pipe(fds) == 0);
+        char buffer[4] = {0};
+        assert(put(fds[1], (long)"abc", 3) == 3);
+        assert(get(fds[0], (long)buffer, 3) == 3 && strcmp(buffer, "abc") == 0);
+        close(fds[0]);
+        close(fds[1]);
+        // failures are negated errnos, as the kernel returns them
+        assert(put(-1, (long)"abc", 3) == -9);
+        freeJit(jit);
+    }
+}
+
+void test_phase() {
+    PhaseReport* report = newPhaseReport(REPORT_TIME | REPORT_MEMORY | REPORT_COUNTERS);
+    enterPhase(report, PHASE_SCAN);
+    char* block = malloc(1 << 20);
+    memset(block, 1, 1 << 20);
+    enterPhase(report, PHASE_PARSE);
+    free(block);
+    enterPhase(report, PHASE_COUNT);
+    // the megabyte is charged to the phase that allocated it
+    assert(report->heap[PHASE_SCAN] >= 1 << 20 && report->heap[PHASE_PARSE] < 0);
+    assert(report->seconds[PHASE_SCAN] >= 0 && report->peakRss[PHASE_SCAN] > 0);
+    assert(report->seconds[PHASE_IRGEN] == 0);
+    // whichever counters the machine has count the memset
+    if (report->fds[COUNTER_TASK_CLOCK] >= 0) {
+        assert(report->counters[PHASE_SCAN][COUNTER_TASK_CLOCK] > 0);
+    }
+    if (report->fds[COUNTER_INSTRUCTIONS] >= 0) {
+        assert(report->counters[PHASE_SCAN][COUNTER_INSTRUCTIONS] > 1 << 16);
+    }
+    Program* program = parse_("int g = 1; int f(int x) { while (x) { x = x - g; } return x; }");
+    assert(countNodes(report, program) == 15);
+    assert(report->decls[DECL_FUNCTION] == 1 && report->decls[DECL_VARIABLE] == 1);
+    assert(report->stmts[STMT_WHILE] == 1 && report->stmts[STMT_BLOCK] == 2);
+    // an assignment is a binary expression
+    assert(report->exprs[EXPR_BINARY] == 2 && report->exprs[EXPR_VARIABLE] == 5);
+    freePhaseReport(report);
+}
+
+void test_alloc() {
+    bool was = trackAllocations(true);
+    AllocStats before = allocationStats(ALLOC_STRINGS);
+    String name = makeString("name", 4);
+    char* copy = duplicateText(ALLOC_STRINGS, "copy");
+    copy = reallocate(ALLOC_STRINGS, copy, 64);
+    AllocStats during = allocationStats(ALLOC_STRINGS);
+    // 5 bytes twice, then the copy grown to 64
+    assert(during.calls == before.calls + 3 && during.bytes == before.bytes + 74);
+    assert(during.live == before.live + 69 && during.peak >= during.live);
+    release(name.chars);
+    release(copy);
+    // a block libc allocated is released without being counted
+    release(strdup("libc"));
+    AllocStats after = allocationStats(ALLOC_STRINGS);
+    assert(after.live == before.live && after.calls == during.calls);
+    // an arena releases its tags' blocks, counted or not, and no others
+    openArena(ALLOC_TAG_BIT(ALLOC_STRINGS));
+    makeString("left", 4);
+    char* kept = duplicateText(ALLOC_DRIVER, "kept");
+    trackAllocations(false);
+    duplicateText(ALLOC_STRINGS, "uncounted");
+    release(duplicateText(ALLOC_STRINGS, "released"));
+    trackAllocations(true);
+    assert(closeArena() == 2);
+    assert(allocationStats(ALLOC_STRINGS).live == before.live);
+    release(kept);
+    trackAllocations(was);
+}
+
+void runTests() {
+    test_parse();
+    test_ir();
+    test_codegen();
+    test_peephole();
+    test_object();
+    test_jit();
+    test_vm();
+    test_inline();
+    test_tailcall();
+    test_partial();
+    test_prune();
+    test_pool();
+    test_cache();
+    test_syscall();
+    test_phase();
+    test_alloc();
     printf("\033[0;32mAll unit tests passed!\033[0m\n");
 }
@@ -2,10 +2,48 @@
 #define TEST_H
 
 #include "ast.h"
+#include "cache.h"
+#include "inline.h"
+#include "ir.h"
+#include "jit.h"
+#include "loop.h"
 #include "parser.h"
+#include "partial.h"
+#include "phase.h"
+#include "pool.h"
+#include "prune.h"
 #include "scanner.h"
+#include "ssa.h"
 #include "util.h"
+#include "vectorize.h"
+#include "vm.h"
+#include "x86.h"
 
 void test_parse();
 
+void test_ir();
+
+void test_codegen();
+
+void test_peephole();
+
+void test_object();
+
+void test_jit();
+
+void test_vm();
+
+void test_inline();
+
+void test_tailcall();
+void test_partial();
+void test_prune();
+void test_pool();
+void test_cache();
+void test_syscall();
+void test_phase();
+void test_alloc();
+
+void runTests();
+
 #endif
\ No newline at end of file
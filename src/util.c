@@ -1,6 +1,9 @@
 #include "util.h"
 
 //---------------------- Util--------------------------
+__thread jmp_buf* panicRecovery = NULL;
+__thread FILE* panicOutput = NULL;
+
 // int panic(const char* format, ...) {
 //     printf("\033[1;31m");
 //     printf("panic: ");
@@ -14,7 +17,7 @@
 
 String makeString(const char* chars, int length) {
     String string;
-    string.chars = malloc(length + 1);
+    string.chars = allocate(ALLOC_STRINGS, length + 1);
     memcpy(string.chars, chars, length);
     string.chars[length] = '\0';
     string.length = length;
@@ -28,4 +31,98 @@ bool stringEqual(String a, String b) {
     return memcmp(a.chars, b.chars, a.length) == 0;
 }
 
-char* value(String string) { return string.chars; }
\ No newline at end of file
+char* value(String string) { return string.chars; }
+
+static int hexDigit(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+String unescape(String literal) {
+    String string;
+    string.chars = allocate(ALLOC_STRINGS, literal.length + 1);
+    string.length = 0;
+    const char* c = literal.chars;
+    const char* end = literal.chars + literal.length;
+    while (c < end) {
+        char* out = &string.chars[string.length++];
+        if (*c != '\\' || c + 1 == end) {
+            *out = *c++;
+            continue;
+        }
+        c++;
+        switch (*c) {
+            case 'n': *out = '\n'; c++; break;
+            case 't': *out = '\t'; c++; break;
+            case 'r': *out = '\r'; c++; break;
+            case 'a': *out = '\a'; c++; break;
+            case 'b': *out = '\b'; c++; break;
+            case 'f': *out = '\f'; c++; break;
+            case 'v': *out = '\v'; c++; break;
+            case 'x': {
+                int value = 0;
+                c++;
+                while (c < end && hexDigit(*c) >= 0) value = value * 16 + hexDigit(*c++);
+                *out = value;
+                break;
+            }
+            default:
+                if (*c >= '0' && *c <= '7') {
+                    int value = 0;
+                    for (int i = 0; i < 3 && c < end && *c >= '0' && *c <= '7'; i++) {
+                        value = value * 8 + (*c++ - '0');
+                    }
+                    *out = value;
+                } else {
+                    *out = *c++;
+                }
+        }
+    }
+    string.chars[string.length] = '\0';
+    return string;
+}
+
+// FNV-1a
+static unsigned nameHash(String name) {
+    unsigned hash = 2166136261u;
+    for (int i = 0; i < name.length; i++) hash = (hash ^ (unsigned char)name.chars[i]) * 16777619u;
+    return hash;
+}
+
+static int nameSlot(NameTable* table, String name) {
+    unsigned mask = table->capacity - 1;
+    unsigned i = nameHash(name) & mask;
+    while (table->names[i].chars && !stringEqual(table->names[i], name)) i = (i + 1) & mask;
+    return i;
+}
+
+void nameTableAdd(NameTable* table, String name, int value) {
+    if (2 * (table->count + 1) > table->capacity) {
+        NameTable grown = {NULL, NULL, table->capacity ? 2 * table->capacity : 16, 0};
+        grown.names = allocateZeroed(ALLOC_NAMES, grown.capacity, sizeof(String));
+        grown.values = allocateZeroed(ALLOC_NAMES, grown.capacity, sizeof(int));
+        for (int i = 0; i < table->capacity; i++) {
+            if (table->names[i].chars) nameTableAdd(&grown, table->names[i], table->values[i]);
+        }
+        freeNameTable(table);
+        *table = grown;
+    }
+    int slot = nameSlot(table, name);
+    if (table->names[slot].chars) return;
+    table->names[slot] = name;
+    table->values[slot] = value;
+    table->count++;
+}
+
+int nameTableFind(NameTable* table, String name) {
+    if (table->count == 0) return -1;
+    int slot = nameSlot(table, name);
+    return table->names[slot].chars ? table->values[slot] : -1;
+}
+
+void freeNameTable(NameTable* table) {
+    release(table->names);
+    release(table->values);
+}
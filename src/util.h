@@ -5,19 +5,33 @@
 #define true 1
 #define false 0
 
+#include "alloc.h"
+
+#include <setjmp.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
-#define panic(format, ...)                      \
-    do {                                        \
-        printf("[%s:%d] ", __FILE__, __LINE__); \
-        printf("\033[1;31m");                   \
-        printf("panic: ");                      \
-        printf(format, ##__VA_ARGS__);          \
-        printf("\033[0m");                      \
-        exit(1);                                \
+// where panic resumes instead of exiting, as the REPL survives bad lines
+// and a build of several files the failure of one; per thread, as those
+// files are compiled at once
+extern __thread jmp_buf* panicRecovery;
+// where panic reports, stdout if NULL
+extern __thread FILE* panicOutput;
+
+#define panic(format, ...)                                      \
+    do {                                                        \
+        FILE* panicTo = panicOutput ? panicOutput : stdout;     \
+        fprintf(panicTo, "[%s:%d] ", __FILE__, __LINE__);       \
+        fprintf(panicTo, "\033[1;31m");                         \
+        fprintf(panicTo, "panic: ");                            \
+        fprintf(panicTo, format, ##__VA_ARGS__);                \
+        fprintf(panicTo, "\033[0m");                            \
+        if (panicRecovery) {                                    \
+            longjmp(*panicRecovery, 1);                         \
+        }                                                       \
+        exit(1);                                                \
     } while (0)  // do { ... } while (0) is a common C idiom for macros that
                  // contain multiple statements and must be used with a
                  // semicolon
@@ -34,6 +48,24 @@ bool stringEqual(String a, String b);
 
 char* value(String string);
 
+// the bytes of a string literal's body with its C escapes decoded
+String unescape(String literal);
+
+// names to indices by open addressing, for lookups in programs of
+// thousands of declarations
+typedef struct {
+    String* names;
+    int* values;
+    int capacity;  // a power of two, at least twice count
+    int count;
+} NameTable;
+
+// keeps the first value added under a name
+void nameTableAdd(NameTable* table, String name, int value);
+// the value of name, -1 if there is none
+int nameTableFind(NameTable* table, String name);
+void freeNameTable(NameTable* table);
+
 #define assert(condition)                            \
     if (!(condition)) {                              \
         panic("assertion failed: %s\n", #condition); \
@@ -0,0 +1,338 @@
+//---------------------- Vectorizer -------------------
+#include "vectorize.h"
+
+// the role of each value computed in the loop body
+typedef enum {
+    CLASS_INVARIANT,  // same value in every iteration
+    CLASS_INDEX,      // the induction variable i
+    CLASS_NEXT,       // i + 1, only stored back to i
+    CLASS_OFFSET,     // i * 8
+    CLASS_ADDRESS,    // invariant base + i * 8, the address of base[i]
+    CLASS_VECTOR,     // a different value for each element
+    CLASS_REJECT,
+} ValueClass;
+
+typedef struct {
+    int base;
+    int baseSlot;  // slot the base was loaded from, or -1
+    bool store;
+} Access;
+
+typedef struct {
+    IrFunction* fn;
+    IrInstr** defs;
+    bool* defined;  // defined in the loop
+    ValueClass* classes;
+    Access* accesses;
+    int accessCount;
+    int* accessOf;  // address vreg -> index in accesses
+} Vectorizer;
+
+static ValueClass classOf(Vectorizer* vec, int vreg) {
+    return vec->defined[vreg] ? vec->classes[vreg] : CLASS_INVARIANT;
+}
+
+static bool isConst(Vectorizer* vec, int vreg, long value) {
+    IrInstr* def = vec->defs[vreg];
+    return def->opcode == IR_CONST && def->imm == value;
+}
+
+static void addAccess(Vectorizer* vec, int address, int base) {
+    vec->accessOf[address] = vec->accessCount;
+    Access* access = &vec->accesses[vec->accessCount++];
+    access->base = base;
+    IrInstr* def = vec->defs[base];
+    access->baseSlot = def->opcode == IR_LOAD_SLOT ? def->slot : -1;
+    access->store = false;
+}
+
+static bool sameBase(Access* a, Access* b) {
+    return a->base == b->base || (a->baseSlot >= 0 && a->baseSlot == b->baseSlot);
+}
+
+static ValueClass classifyBinary(Vectorizer* vec, IrInstr* instr,
+                                 InductionVar* iv) {
+    int l = instr->uses[0], r = instr->uses[1];
+    ValueClass a = classOf(vec, l), b = classOf(vec, r);
+    if (a == CLASS_INVARIANT && b == CLASS_INVARIANT) return CLASS_INVARIANT;
+    switch (instr->op) {
+        case OP_MUL:
+            // 64-bit lane multiplies need AVX-512, only i * 8 is accepted
+            if ((a == CLASS_INDEX && isConst(vec, r, 8)) ||
+                (b == CLASS_INDEX && isConst(vec, l, 8))) {
+                return CLASS_OFFSET;
+            }
+            return CLASS_REJECT;
+        case OP_ADD:
+            if ((a == CLASS_INVARIANT && b == CLASS_OFFSET) ||
+                (a == CLASS_OFFSET && b == CLASS_INVARIANT)) {
+                addAccess(vec, instr->dst, a == CLASS_INVARIANT ? l : r);
+                return CLASS_ADDRESS;
+            }
+            if (instr->dst == iv->update->uses[0]) return CLASS_NEXT;
+            // fall through
+        case OP_SUB:
+            if ((a == CLASS_VECTOR || a == CLASS_INVARIANT) &&
+                (b == CLASS_VECTOR || b == CLASS_INVARIANT)) {
+                return CLASS_VECTOR;
+            }
+            return CLASS_REJECT;
+        default:
+            return CLASS_REJECT;
+    }
+}
+
+// assign a class to every value of the body, false if any cannot be
+// vectorized
+static bool classify(Vectorizer* vec, IrBlock* body, InductionVar* iv) {
+    bool updated = false;
+    bool stores = false;
+    for (int i = 0; i < body->count - 1; i++) {
+        IrInstr* instr = body->instrs[i];
+        ValueClass a = instr->usecount > 0 ? classOf(vec, instr->uses[0])
+                                           : CLASS_INVARIANT;
+        ValueClass b = instr->usecount > 1 ? classOf(vec, instr->uses[1])
+                                           : CLASS_INVARIANT;
+        ValueClass result = CLASS_REJECT;
+        switch (instr->opcode) {
+            case IR_CONST:
+                result = CLASS_INVARIANT;
+                break;
+            case IR_LOAD_SLOT:
+                if (instr->slot == iv->slot && !updated) result = CLASS_INDEX;
+                break;
+            case IR_BINARY:
+                result = classifyBinary(vec, instr, iv);
+                break;
+            case IR_UNARY:
+                if (a == CLASS_INVARIANT) result = CLASS_INVARIANT;
+                break;
+            case IR_LOAD:
+                if (a == CLASS_ADDRESS) result = CLASS_VECTOR;
+                break;
+            case IR_STORE:
+                if (a == CLASS_ADDRESS &&
+                    (b == CLASS_VECTOR || b == CLASS_INVARIANT)) {
+                    result = CLASS_INVARIANT;
+                    stores = true;
+                    vec->accesses[vec->accessOf[instr->uses[0]]].store = true;
+                }
+                break;
+            case IR_STORE_SLOT:
+                if (instr == iv->update && a == CLASS_NEXT) {
+                    result = CLASS_INVARIANT;
+                    updated = true;
+                }
+                break;
+            default:
+                break;
+        }
+        if (result == CLASS_REJECT) return false;
+        if (instr->dst >= 0) vec->classes[instr->dst] = result;
+    }
+    return updated && stores;
+}
+
+static int emitConstInto(IrFunction* fn, IrBlock* block, long value) {
+    IrInstr* instr = newInstr(IR_CONST, newVreg(fn), 0);
+    instr->imm = value;
+    appendInstr(block, instr);
+    return instr->dst;
+}
+
+static int emitLoadSlotInto(IrFunction* fn, IrBlock* block, int slot) {
+    IrInstr* instr = newInstr(IR_LOAD_SLOT, newVreg(fn), 0);
+    instr->slot = slot;
+    appendInstr(block, instr);
+    return instr->dst;
+}
+
+static int emitBinaryInto(IrFunction* fn, IrBlock* block, Op op, int a, int b) {
+    IrInstr* instr = newInstr(IR_BINARY, newVreg(fn), 2);
+    instr->op = op;
+    instr->uses[0] = a;
+    instr->uses[1] = b;
+    appendInstr(block, instr);
+    return instr->dst;
+}
+
+// IR_VLOAD or IR_VSPLAT of one operand
+static int emitVectorInto(IrFunction* fn, IrBlock* block, IrOpcode opcode,
+                          int operand, int lanes) {
+    IrInstr* instr = newInstr(opcode, newVreg(fn), 1);
+    instr->uses[0] = operand;
+    instr->imm = lanes;
+    appendInstr(block, instr);
+    return instr->dst;
+}
+
+// the body handling `lanes` iterations at once
+static void emitVectorBody(Vectorizer* vec, IrBlock* body, IrBlock* out,
+                           InductionVar* iv, int lanes) {
+    IrFunction* fn = vec->fn;
+    int* map = irAlloc(ALLOC_OPTIMIZER, sizeof(int) * (fn->vregCount + 1));
+    for (int v = 0; v < fn->vregCount; v++) map[v] = v;
+    for (int i = 0; i < body->count - 1; i++) {
+        IrInstr* instr = body->instrs[i];
+        int operands[2];
+        for (int u = 0; u < instr->usecount && u < 2; u++) {
+            operands[u] = map[instr->uses[u]];
+            // invariant operands of vector operations are broadcast
+            bool vectorUse = (instr->opcode == IR_STORE && u == 1) ||
+                             (instr->dst >= 0 &&
+                              vec->classes[instr->dst] == CLASS_VECTOR &&
+                              instr->opcode == IR_BINARY);
+            if (vectorUse && classOf(vec, instr->uses[u]) == CLASS_INVARIANT) {
+                operands[u] = emitVectorInto(fn, out, IR_VSPLAT, operands[u], lanes);
+            }
+        }
+        if (instr->dst >= 0 && vec->classes[instr->dst] == CLASS_NEXT) continue;
+        switch (instr->opcode) {
+            case IR_STORE_SLOT: {
+                int index = emitLoadSlotInto(fn, out, iv->slot);
+                int step = emitConstInto(fn, out, lanes);
+                int next = emitBinaryInto(fn, out, OP_ADD, index, step);
+                IrInstr* store = newInstr(IR_STORE_SLOT, -1, 1);
+                store->slot = iv->slot;
+                store->uses[0] = next;
+                appendInstr(out, store);
+                break;
+            }
+            case IR_LOAD:
+                map[instr->dst] = emitVectorInto(fn, out, IR_VLOAD, operands[0], lanes);
+                break;
+            case IR_STORE: {
+                IrInstr* store = newInstr(IR_VSTORE, -1, 2);
+                store->uses[0] = operands[0];
+                store->uses[1] = operands[1];
+                store->imm = lanes;
+                appendInstr(out, store);
+                break;
+            }
+            default: {
+                IrInstr* copy = cloneInstr(instr);
+                copy->dst = newVreg(fn);
+                for (int u = 0; u < copy->usecount; u++) copy->uses[u] = operands[u];
+                if (vec->classes[instr->dst] == CLASS_VECTOR) {
+                    copy->opcode = IR_VBINARY;
+                    copy->imm = lanes;
+                }
+                map[instr->dst] = copy->dst;
+                appendInstr(out, copy);
+            }
+        }
+    }
+    release(map);
+}
+
+bool vectorizeLoop(IrFunction* fn, Loop* loop, int lanes) {
+    if (lanes < 2 || !loop->innermost || loop->preheader == NULL ||
+        loop->blockCount != 2 || loop->latchCount != 1) {
+        return false;
+    }
+    IrBlock* header = loop->header;
+    IrBlock* body = loop->latch;
+    IrInstr* branch = terminator(header);
+    if (body == header || header->count != 3 || branch->opcode != IR_BRANCH ||
+        branch->target != body) {
+        return false;
+    }
+    // the header is exactly `i < n` with n invariant
+    IrInstr* index = header->instrs[0];
+    IrInstr* cond = header->instrs[1];
+    if (index->opcode != IR_LOAD_SLOT || cond->opcode != IR_BINARY ||
+        branch->uses[0] != cond->dst) {
+        return false;
+    }
+    int bound;
+    if (cond->op == OP_LT && cond->uses[0] == index->dst) {
+        bound = cond->uses[1];
+    } else if (cond->op == OP_GT && cond->uses[1] == index->dst) {
+        bound = cond->uses[0];
+    } else {
+        return false;
+    }
+
+    Vectorizer vec;
+    vec.fn = fn;
+    vec.defs = buildDefMap(fn);
+    vec.defined = loopDefinitions(fn, loop);
+    vec.classes = irAlloc(ALLOC_OPTIMIZER, sizeof(ValueClass) * (fn->vregCount + 1));
+    vec.accesses = irAlloc(ALLOC_OPTIMIZER, sizeof(Access) * (body->count + 1));
+    vec.accessCount = 0;
+    vec.accessOf = irAlloc(ALLOC_OPTIMIZER, sizeof(int) * (fn->vregCount + 1));
+    InductionVar* ivs;
+    int ivCount = findInductionVars(fn, loop, vec.defs, &ivs);
+    InductionVar* iv = NULL;
+    for (int v = 0; v < ivCount; v++) {
+        if (ivs[v].slot == index->slot) iv = &ivs[v];
+    }
+    bool ok = !vec.defined[bound] && iv != NULL && iv->step == 1 &&
+              iv->block == body && classify(&vec, body, iv);
+    if (!ok) {
+        release(vec.defs);
+        release(vec.defined);
+        release(vec.classes);
+        release(vec.accesses);
+        release(vec.accessOf);
+        release(ivs);
+        return false;
+    }
+
+    // preheader: vector loop bound and the run time overlap check
+    IrBlock* preheader = loop->preheader;
+    IrInstr* jump = terminator(preheader);
+    removeInstr(preheader, preheader->count - 1);
+    int limit = emitBinaryInto(fn, preheader, OP_SUB, bound,
+                               emitConstInto(fn, preheader, lanes - 1));
+    int safe = emitConstInto(fn, preheader, 1);
+    for (int s = 0; s < vec.accessCount; s++) {
+        if (!vec.accesses[s].store) continue;
+        for (int t = 0; t < vec.accessCount; t++) {
+            if (t == s || sameBase(&vec.accesses[s], &vec.accesses[t])) continue;
+            // |store - other| >= one vector, or they are the same array
+            int distance = emitBinaryInto(fn, preheader, OP_SUB,
+                                          vec.accesses[s].base,
+                                          vec.accesses[t].base);
+            int width = lanes * 8;
+            int same = emitBinaryInto(fn, preheader, OP_EQ, distance,
+                                      emitConstInto(fn, preheader, 0));
+            int above = emitBinaryInto(fn, preheader, OP_GTE, distance,
+                                       emitConstInto(fn, preheader, width));
+            int below = emitBinaryInto(fn, preheader, OP_LTE, distance,
+                                       emitConstInto(fn, preheader, -width));
+            int apart = emitBinaryInto(
+                fn, preheader, OP_ADD,
+                emitBinaryInto(fn, preheader, OP_ADD, same, above), below);
+            safe = emitBinaryInto(fn, preheader, OP_MUL, safe, apart);
+        }
+    }
+    IrBlock* vectorHeader = newBlock(fn);
+    IrBlock* vectorBody = newBlock(fn);
+    IrInstr* check = newInstr(IR_BRANCH, -1, 1);
+    check->uses[0] = safe;
+    check->target = vectorHeader;
+    check->otherwise = jump->target;
+    appendInstr(preheader, check);
+
+    // vector loop: while (i < n - (lanes - 1)) handle lanes elements
+    int current = emitLoadSlotInto(fn, vectorHeader, iv->slot);
+    int more = emitBinaryInto(fn, vectorHeader, OP_LT, current, limit);
+    IrInstr* test = newInstr(IR_BRANCH, -1, 1);
+    test->uses[0] = more;
+    test->target = vectorBody;
+    test->otherwise = header;
+    appendInstr(vectorHeader, test);
+    emitVectorBody(&vec, body, vectorBody, iv, lanes);
+    IrInstr* back = newInstr(IR_JUMP, -1, 0);
+    back->target = vectorHeader;
+    appendInstr(vectorBody, back);
+
+    release(vec.defs);
+    release(vec.defined);
+    release(vec.classes);
+    release(vec.accesses);
+    release(vec.accessOf);
+    release(ivs);
+    return true;
+}
@@ -0,0 +1,20 @@
+#ifndef VECTORIZE_H
+#define VECTORIZE_H
+
+#include "loop.h"
+
+//---------------------- Vectorizer --------------------
+// Rewrites counted loops of element-wise subscript accesses
+//     while (i < n) { c[i] = a[i] + b[i]; i = i + 1; }
+// into a loop handling `lanes` elements per iteration, followed by the
+// original loop as scalar remainder. Possible overlap between the arrays
+// is checked at run time; the scalar loop runs alone if they overlap.
+
+// words per vector register for each -march
+#define LANES_SCALAR 0
+#define LANES_SSE2 2
+#define LANES_AVX2 4
+
+bool vectorizeLoop(IrFunction* fn, Loop* loop, int lanes);
+
+#endif
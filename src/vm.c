@@ -0,0 +1,190 @@
+//---------------------- Bytecode Interpreter ----------
+// Every handler ends by fetching the next word and jumping straight to
+// its handler through a table of label addresses, so that each opcode has
+// an indirect branch of its own for the predictor. Turning
+// VM_COMPUTED_GOTO off dispatches through a switch instead.
+#define _GNU_SOURCE
+#include <dlfcn.h>
+
+#include "syscall.h"
+#include "vm.h"
+
+#ifndef VM_COMPUTED_GOTO
+#define VM_COMPUTED_GOTO true
+#endif
+
+#define VM_STACK_SIZE (1 << 22)  // registers, shared by all windows
+#define VM_MAX_DEPTH (1 << 18)   // nested calls
+
+void* nativeFunction(String name) { return dlsym(RTLD_DEFAULT, name.chars); }
+
+// words past the arguments are passed too and ignored, also by variadic
+// functions since no vector registers are involved
+long callNative(void* function, long* args) {
+    long (*native)(long, long, long, long, long, long, long, long, long, long, long,
+                   long) = function;
+    return native(args[0], args[1], args[2], args[3], args[4], args[5], args[6], args[7],
+                  args[8], args[9], args[10], args[11]);
+}
+
+typedef struct {
+    uint32_t* pc;  // where the caller resumes
+    long* base;    // the caller's window
+} CallFrame;
+
+long runBytecode(VmProgram* program, const char* entry) {
+    VmFunction* fn = NULL;
+    for (int i = 0; i < program->functionCount; i++) {
+        if (strcmp(program->functions[i].name.chars, entry) == 0) {
+            fn = &program->functions[i];
+        }
+    }
+    if (fn == NULL || fn->paramCount != 0) {
+        panic("no function %s() to run\n", entry);
+    }
+    long* stack = allocateZeroed(ALLOC_INTERPRETER, VM_STACK_SIZE, sizeof(long));
+    long* stackEnd = stack + VM_STACK_SIZE;
+    CallFrame* frames = allocate(ALLOC_INTERPRETER, sizeof(CallFrame) * VM_MAX_DEPTH);
+    int depth = 0;
+    long* base = stack;
+    uint32_t* pc = fn->code;
+    long* constants = program->constants;
+    long* globals = program->globals;
+    uint32_t word;
+    long result;
+
+#define RA base[VM_A(word)]
+#define RB base[VM_B(word)]
+#define RC base[VM_C(word)]
+
+#if VM_COMPUTED_GOTO
+    static void* handlers[VM_OPCODE_COUNT] = {
+        &&op_MOVE, &&op_LOADI, &&op_LOADK, &&op_GETG,  &&op_SETG,     &&op_ADDRG,
+        &&op_ADDR, &&op_ADD,   &&op_ADDI,  &&op_SUB,   &&op_MUL,      &&op_DIV,
+        &&op_EQ,   &&op_NE,    &&op_LT,    &&op_LE,    &&op_GT,       &&op_GE,
+        &&op_NOT,  &&op_NEG,   &&op_LOAD,  &&op_STORE, &&op_INDEX,    &&op_SETINDEX,
+        &&op_JMP,  &&op_JZ,    &&op_JNZ,   &&op_JEQ,   &&op_JNE,      &&op_JLT,
+        &&op_JLE,  &&op_JGT,   &&op_JGE,   &&op_JEQI,  &&op_JNEI,     &&op_JLTI,
+        &&op_JLEI, &&op_JGTI,  &&op_JGEI,  &&op_CALL,  &&op_CALLN,    &&op_SYSCALL,
+        &&op_RET,
+    };
+#define CASE(op) op_##op:
+#define NEXT()                              \
+    do {                                    \
+        word = *pc++;                       \
+        goto* handlers[VM_OPCODE(word)];    \
+    } while (0)
+#else
+#define CASE(op) case VM_##op:
+#define NEXT()            \
+    do {                  \
+        word = *pc++;     \
+        goto dispatch;    \
+    } while (0)
+#endif
+
+// a compare-and-branch superinstruction and its offset word
+#define BRANCH(condition)              \
+    do {                               \
+        int32_t offset = (int32_t)*pc++; \
+        if (condition) pc += offset;   \
+        NEXT();                        \
+    } while (0)
+
+    NEXT();
+#if !VM_COMPUTED_GOTO
+dispatch:
+#endif
+    switch (VM_OPCODE(word)) {
+        CASE(MOVE) RA = RB; NEXT();
+        CASE(LOADI) RA = VM_SBX(word); NEXT();
+        CASE(LOADK) RA = constants[VM_BX(word)]; NEXT();
+        CASE(GETG) RA = globals[VM_BX(word)]; NEXT();
+        CASE(SETG) globals[VM_BX(word)] = RA; NEXT();
+        CASE(ADDRG) RA = (long)&globals[VM_BX(word)]; NEXT();
+        CASE(ADDR) RA = (long)&RB; NEXT();
+        CASE(ADD) RA = RB + RC; NEXT();
+        CASE(ADDI) RA = RB + VM_SC(word); NEXT();
+        CASE(SUB) RA = RB - RC; NEXT();
+        CASE(MUL) RA = RB * RC; NEXT();
+        CASE(DIV) {
+            if (RC == 0) {
+                panic("division by zero\n");
+            }
+            RA = RB / RC;
+            NEXT();
+        }
+        CASE(EQ) RA = RB == RC; NEXT();
+        CASE(NE) RA = RB != RC; NEXT();
+        CASE(LT) RA = RB < RC; NEXT();
+        CASE(LE) RA = RB <= RC; NEXT();
+        CASE(GT) RA = RB > RC; NEXT();
+        CASE(GE) RA = RB >= RC; NEXT();
+        CASE(NOT) RA = !RB; NEXT();
+        CASE(NEG) RA = -RB; NEXT();
+        CASE(LOAD) RA = *(long*)RB; NEXT();
+        CASE(STORE) *(long*)RA = RB; NEXT();
+        CASE(INDEX) RA = ((long*)RB)[RC]; NEXT();
+        CASE(SETINDEX) ((long*)RA)[RB] = RC; NEXT();
+        CASE(JMP) pc += VM_SAX(word); NEXT();
+        CASE(JZ) if (!RA) pc += VM_SBX(word); NEXT();
+        CASE(JNZ) if (RA) pc += VM_SBX(word); NEXT();
+        CASE(JEQ) BRANCH(RA == RB);
+        CASE(JNE) BRANCH(RA != RB);
+        CASE(JLT) BRANCH(RA < RB);
+        CASE(JLE) BRANCH(RA <= RB);
+        CASE(JGT) BRANCH(RA > RB);
+        CASE(JGE) BRANCH(RA >= RB);
+        CASE(JEQI) BRANCH(RA == VM_SB(word));
+        CASE(JNEI) BRANCH(RA != VM_SB(word));
+        CASE(JLTI) BRANCH(RA < VM_SB(word));
+        CASE(JLEI) BRANCH(RA <= VM_SB(word));
+        CASE(JGTI) BRANCH(RA > VM_SB(word));
+        CASE(JGEI) BRANCH(RA >= VM_SB(word));
+        CASE(CALL) {
+            VmFunction* callee = &program->functions[*pc++];
+            long* window = base + VM_A(word);
+            if (depth == VM_MAX_DEPTH || window + callee->registerCount > stackEnd) {
+                panic("stack overflow calling %s\n", callee->name.chars);
+            }
+            frames[depth].pc = pc;
+            frames[depth].base = base;
+            depth++;
+            base = window;
+            pc = callee->code;
+            NEXT();
+        }
+        CASE(CALLN) {
+            void* native = (void*)constants[*pc++];
+            RA = callNative(native, &RA);
+            NEXT();
+        }
+        CASE(SYSCALL) {
+            RA = callSyscall(*pc++, &RA);
+            NEXT();
+        }
+        CASE(RET) {
+            // the result goes where the caller put the first argument
+            result = RA;
+            base[0] = result;
+            if (depth == 0) goto done;
+            depth--;
+            pc = frames[depth].pc;
+            base = frames[depth].base;
+            NEXT();
+        }
+        default:
+            panic("bad opcode %d\n", VM_OPCODE(word));
+    }
+done:
+    release(stack);
+    release(frames);
+    return result;
+
+#undef RA
+#undef RB
+#undef RC
+#undef CASE
+#undef NEXT
+#undef BRANCH
+}
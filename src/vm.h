@@ -0,0 +1,115 @@
+#ifndef VM_H
+#define VM_H
+
+#include <stdint.h>
+
+#include "ast.h"
+
+//---------------------- Bytecode ----------------------
+// A register machine for running programs without native code generation.
+// Each function has a window of up to 256 word registers: parameters
+// first, then locals, then temporaries. A call passes its arguments in
+// consecutive registers of the caller, which become the first registers
+// of the callee's window, so nothing is copied.
+//
+// Instructions are 32 bit words: the opcode in the low byte, then the
+// operands A, B and C of a byte each, or A and a 16 bit Bx or sBx, or a
+// signed 24 bit sAx. Compare-and-branch superinstructions take a second
+// word with the jump offset. Jump offsets count words from the word after
+// the instruction.
+
+#define VM_OPCODE(word) ((word) & 0xff)
+#define VM_A(word) (((word) >> 8) & 0xff)
+#define VM_B(word) (((word) >> 16) & 0xff)
+#define VM_C(word) ((word) >> 24)
+#define VM_SB(word) ((int32_t)((word) << 8) >> 24)  // B as a signed byte
+#define VM_SC(word) ((int32_t)(word) >> 24)   // C as a signed byte
+#define VM_BX(word) ((word) >> 16)            // B and C as an index
+#define VM_SBX(word) ((int32_t)(word) >> 16)  // B and C as a signed half
+#define VM_SAX(word) ((int32_t)(word) >> 8)   // A, B and C signed
+
+typedef enum {
+    VM_MOVE,    // R[A] = R[B]
+    VM_LOADI,   // R[A] = sBx
+    VM_LOADK,   // R[A] = K[Bx]
+    VM_GETG,    // R[A] = G[Bx]
+    VM_SETG,    // G[Bx] = R[A]
+    VM_ADDRG,   // R[A] = &G[Bx]
+    VM_ADDR,    // R[A] = &R[B]
+    VM_ADD,     // R[A] = R[B] + R[C]
+    VM_ADDI,    // R[A] = R[B] + sC
+    VM_SUB,     // R[A] = R[B] - R[C]
+    VM_MUL,     // R[A] = R[B] * R[C]
+    VM_DIV,     // R[A] = R[B] / R[C]
+    VM_EQ,      // R[A] = R[B] == R[C], and so on up to VM_GE
+    VM_NE,
+    VM_LT,
+    VM_LE,
+    VM_GT,
+    VM_GE,
+    VM_NOT,     // R[A] = !R[B]
+    VM_NEG,     // R[A] = -R[B]
+    VM_LOAD,    // R[A] = *R[B]
+    VM_STORE,   // *R[A] = R[B]
+    VM_INDEX,   // R[A] = R[B][R[C]]
+    VM_SETINDEX,// R[A][R[B]] = R[C]
+    VM_JMP,     // pc += sAx
+    VM_JZ,      // if (!R[A]) pc += sBx
+    VM_JNZ,     // if (R[A]) pc += sBx
+    VM_JEQ,     // if (R[A] == R[B]) pc += next word, and so on up to VM_JGE
+    VM_JNE,
+    VM_JLT,
+    VM_JLE,
+    VM_JGT,
+    VM_JGE,
+    VM_JEQI,    // if (R[A] == sB) pc += next word, and so on up to VM_JGEI
+    VM_JNEI,
+    VM_JLTI,
+    VM_JLEI,
+    VM_JGTI,
+    VM_JGEI,
+    VM_CALL,    // R[A] = F[next word](R[A] .. R[A + C - 1])
+    VM_CALLN,   // R[A] = native K[next word](R[A] .. R[A + C - 1])
+    VM_SYSCALL, // R[A] = system call next word(R[A] .. R[A + C - 1])
+    VM_RET,     // return R[A]
+    VM_OPCODE_COUNT,
+} VmOpcode;
+
+typedef struct {
+    String name;
+    int paramCount;
+    int registerCount;  // size of the window
+    uint32_t* code;
+    int count;
+    int capacity;
+} VmFunction;
+
+typedef struct {
+    VmFunction* functions;
+    int functionCount;
+    long* constants;  // integers, string addresses and native functions
+    int constantCount;
+    int constantCapacity;
+    long* globals;
+    String* globalNames;
+    int globalCount;
+} VmProgram;
+
+VmProgram* compileBytecode(Program* program);
+void printBytecode(VmProgram* program);
+// runs the function called entry without arguments and returns its result
+long runBytecode(VmProgram* program, const char* entry);
+
+//---------------------- Tree Walker -------------------
+// Evaluates the AST directly, looking names up as it goes. It is the
+// baseline the bytecode machine is measured against.
+
+long walkProgram(Program* program, const char* entry);
+
+// calls out of interpreted code go to C functions of the process, with
+// up to NATIVE_MAX_ARGS word arguments
+#define NATIVE_MAX_ARGS 12
+void* nativeFunction(String name);
+long callNative(void* function, long* args);
+
+#endif
@@ -0,0 +1,268 @@
+//---------------------- Tree Walker -------------------
+// Evaluates the AST as it stands: every variable reference searches the
+// bindings by name and every call searches the declarations. Bindings
+// never move, so `&x` is the address of x's binding.
+#include "ir.h"
+#include "syscall.h"
+#include "vm.h"
+
+#define WALK_MAX_BINDINGS (1 << 20)
+
+typedef struct {
+    String name;
+    long value;
+} Binding;
+
+typedef struct {
+    Program* ast;
+    Binding* bindings;  // globals first, then the frames of active calls
+    int count;
+    int globalCount;
+    int frame;  // first binding of the running call
+    bool returning;
+    long result;
+    Expr** strings;  // literals decoded so far
+    char** stringBytes;
+    int stringCount;
+} Walker;
+
+static long eval(Walker* w, Expr* expr);
+
+static Binding* bind(Walker* w, String name, long value) {
+    if (w->count == WALK_MAX_BINDINGS) {
+        panic("stack overflow\n");
+    }
+    Binding* binding = &w->bindings[w->count++];
+    binding->name = name;
+    binding->value = value;
+    return binding;
+}
+
+static long* lookup(Walker* w, String name) {
+    for (int i = w->count - 1; i >= w->frame; i--) {
+        if (stringEqual(w->bindings[i].name, name)) return &w->bindings[i].value;
+    }
+    for (int i = 0; i < w->globalCount; i++) {
+        if (stringEqual(w->bindings[i].name, name)) return &w->bindings[i].value;
+    }
+    for (int i = 0; i < w->ast->count; i++) {
+        Decl* decl = w->ast->declarations[i];
+        if (decl->type == DECL_FUNCTION && stringEqual(decl->function.name, name)) {
+            panic("function %s has no address in interpreter mode\n", name.chars);
+        }
+    }
+    panic("undefined variable %s\n", name.chars);
+    return NULL;
+}
+
+static long* lvalue(Walker* w, Expr* expr) {
+    if (expr->type == EXPR_VARIABLE) return lookup(w, expr->variable.name);
+    if (expr->type == EXPR_UNARY && expr->unary.op == OP_DEREF) {
+        return (long*)eval(w, expr->unary.right);
+    }
+    if (expr->type == EXPR_BINARY && expr->binary.op == OP_SUBSCRIPT) {
+        long* base = (long*)eval(w, expr->binary.left);
+        return base + eval(w, expr->binary.right);
+    }
+    panic("expression %s is not assignable\n", sprintExpr(expr));
+    return NULL;
+}
+
+static void exec(Walker* w, Stmt* stmt);
+
+// a string literal is decoded the first time it is evaluated
+static char* stringBytes(Walker* w, Expr* literal) {
+    for (int i = 0; i < w->stringCount; i++) {
+        if (w->strings[i] == literal) return w->stringBytes[i];
+    }
+    String token = literal->literal.value.stringVal;
+    w->strings = reallocate(ALLOC_INTERPRETER, w->strings, sizeof(Expr*) * (w->stringCount + 1));
+    w->stringBytes =
+        reallocate(ALLOC_INTERPRETER, w->stringBytes, sizeof(char*) * (w->stringCount + 1));
+    w->strings[w->stringCount] = literal;
+    w->stringBytes[w->stringCount] =
+        unescape(makeString(token.chars + 1, token.length - 2)).chars;
+    return w->stringBytes[w->stringCount++];
+}
+
+static long call(Walker* w, Expr* expr) {
+    if (expr->call.callee->type != EXPR_VARIABLE) {
+        panic("indirect calls are not supported: %s\n", sprintExpr(expr));
+    }
+    String name = expr->call.callee->variable.name;
+    long args[NATIVE_MAX_ARGS] = {0};
+    int argcount = expr->call.argcount;
+    long* values =
+        argcount > NATIVE_MAX_ARGS ? allocate(ALLOC_INTERPRETER, sizeof(long) * argcount) : args;
+    for (int i = 0; i < argcount; i++) values[i] = eval(w, expr->call.arguments[i]);
+    for (int i = 0; i < w->ast->count; i++) {
+        Decl* decl = w->ast->declarations[i];
+        if (decl->type != DECL_FUNCTION || !stringEqual(decl->function.name, name)) {
+            continue;
+        }
+        if (decl->function.count != argcount) {
+            panic("%s takes %d arguments\n", name.chars, decl->function.count);
+        }
+        int savedFrame = w->frame, savedCount = w->count;
+        w->frame = w->count;
+        for (int p = 0; p < argcount; p++) {
+            bind(w, decl->function.parameters[p]->name, values[p]);
+        }
+        if (values != args) release(values);
+        exec(w, decl->function.body);
+        long result = w->returning ? w->result : 0;
+        w->returning = false;
+        w->frame = savedFrame;
+        w->count = savedCount;
+        return result;
+    }
+    int sys = findSyscall(name);
+    if (sys >= 0) {
+        if (argcount != syscalls[sys].argCount) {
+            panic("%s takes %d arguments, not %d\n", syscalls[sys].name, syscalls[sys].argCount,
+                  argcount);
+        }
+        return callSyscall(syscalls[sys].number, args);
+    }
+    void* native = nativeFunction(name);
+    if (native == NULL) {
+        panic("undefined function %s\n", name.chars);
+    }
+    if (argcount > NATIVE_MAX_ARGS) {
+        panic("calls to %s pass at most %d arguments\n", name.chars, NATIVE_MAX_ARGS);
+    }
+    return callNative(native, args);
+}
+
+static long eval(Walker* w, Expr* expr) {
+    switch (expr->type) {
+        case EXPR_LITERAL:
+            switch (expr->literal.type) {
+                case TYPE_INT:
+                    return expr->literal.value.intVal;
+                case TYPE_BOOL:
+                    return expr->literal.value.boolVal;
+                case TYPE_STRING:
+                    return (long)stringBytes(w, expr);
+                default:
+                    panic("literal type %d is not supported by the tree walker\n",
+                          expr->literal.type);
+            }
+            break;
+        case EXPR_VARIABLE:
+            return *lookup(w, expr->variable.name);
+        case EXPR_ASSIGNMENT:
+            return *lookup(w, expr->assignment.name) = eval(w, expr->assignment.value);
+        case EXPR_UNARY:
+            switch (expr->unary.op) {
+                case OP_REF:
+                    return (long)lvalue(w, expr->unary.right);
+                case OP_DEREF:
+                    return *(long*)eval(w, expr->unary.right);
+                default:
+                    return foldUnary(expr->unary.op, eval(w, expr->unary.right));
+            }
+        case EXPR_BINARY:
+            switch (expr->binary.op) {
+                case OP_ASSIGN: {
+                    long value = eval(w, expr->binary.right);
+                    return *lvalue(w, expr->binary.left) = value;
+                }
+                case OP_AND:
+                    return eval(w, expr->binary.left) && eval(w, expr->binary.right);
+                case OP_OR:
+                    return eval(w, expr->binary.left) || eval(w, expr->binary.right);
+                case OP_SUBSCRIPT:
+                    return *lvalue(w, expr);
+                case OP_DIV: {
+                    long left = eval(w, expr->binary.left);
+                    long right = eval(w, expr->binary.right);
+                    long value;
+                    if (right == 0) {
+                        panic("division by zero\n");
+                    }
+                    if (!foldBinary(OP_DIV, left, right, &value)) {
+                        panic("division of %ld by -1 overflows\n", left);
+                    }
+                    return value;
+                }
+                default: {
+                    long left = eval(w, expr->binary.left);
+                    long value;
+                    foldBinary(expr->binary.op, left, eval(w, expr->binary.right), &value);
+                    return value;
+                }
+            }
+        case EXPR_CALL:
+            return call(w, expr);
+        case EXPR_GROUPING:
+            panic("grouping expressions are folded by the parser\n");
+    }
+    return 0;
+}
+
+static void exec(Walker* w, Stmt* stmt) {
+    switch (stmt->type) {
+        case STMT_EXPRESSION:
+            eval(w, stmt->expr.expression);
+            break;
+        case STMT_BLOCK: {
+            int scope = w->count;
+            for (int i = 0; i < stmt->block.count && !w->returning; i++) {
+                exec(w, stmt->block.statements[i]);
+            }
+            w->count = scope;
+            break;
+        }
+        case STMT_IF:
+            if (eval(w, stmt->ifStmt.condition)) {
+                exec(w, stmt->ifStmt.thenBranch);
+            } else if (stmt->ifStmt.elseBranch) {
+                exec(w, stmt->ifStmt.elseBranch);
+            }
+            break;
+        case STMT_WHILE:
+            while (!w->returning && eval(w, stmt->whileStmt.condition)) {
+                exec(w, stmt->whileStmt.body);
+            }
+            break;
+        case STMT_RETURN:
+            w->result = stmt->returnStmt.value ? eval(w, stmt->returnStmt.value) : 0;
+            w->returning = true;
+            break;
+        case STMT_DECL: {
+            Decl* decl = stmt->decl.decl;
+            if (decl->type != DECL_VARIABLE) {
+                panic("only variables can be declared inside a function\n");
+            }
+            long value = decl->variable.initializer ? eval(w, decl->variable.initializer) : 0;
+            bind(w, decl->variable.name, value);
+            break;
+        }
+    }
+}
+
+long walkProgram(Program* program, const char* entry) {
+    Walker w;
+    memset(&w, 0, sizeof(Walker));
+    w.ast = program;
+    w.bindings = allocate(ALLOC_INTERPRETER, sizeof(Binding) * WALK_MAX_BINDINGS);
+    for (int i = 0; i < program->count; i++) {
+        Decl* decl = program->declarations[i];
+        if (decl->type != DECL_VARIABLE) continue;
+        long value = decl->variable.initializer ? eval(&w, decl->variable.initializer) : 0;
+        bind(&w, decl->variable.name, value);
+    }
+    w.globalCount = w.frame = w.count;
+    Expr callee = {.type = EXPR_VARIABLE};
+    callee.variable.name = makeString(entry, strlen(entry));
+    Expr main = {.type = EXPR_CALL};
+    main.call.callee = &callee;
+    main.call.arguments = NULL;
+    main.call.argcount = 0;
+    long result = call(&w, &main);
+    release(w.bindings);
+    release(w.strings);
+    release(w.stringBytes);
+    return result;
+}
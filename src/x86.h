@@ -0,0 +1,227 @@
+#ifndef X86_H
+#define X86_H
+
+#include "ir.h"
+#include "object.h"
+
+//---------------------- x86-64 ------------------------
+// Machine code for x86-64 System V. Instruction selection (isel.c) turns
+// the IR into MInstrs over virtual registers, the register allocator
+// (regalloc.c) maps those onto physical registers and stack slots, and
+// asm.c prints the result in GNU as syntax.
+
+typedef struct MBlock MBlock;
+
+// physical registers in hardware encoding order
+typedef enum {
+    RAX,
+    RCX,
+    RDX,
+    RBX,
+    RSP,
+    RBP,
+    RSI,
+    RDI,
+    R8,
+    R9,
+    R10,
+    R11,
+    R12,
+    R13,
+    R14,
+    R15,
+    XMM0,
+    XMM1,
+    XMM2,
+    XMM3,
+    XMM4,
+    XMM5,
+    XMM6,
+    XMM7,
+    XMM8,
+    XMM9,
+    XMM10,
+    XMM11,
+    XMM12,
+    XMM13,
+    XMM14,
+    XMM15,
+    REG_COUNT,
+} Reg;
+
+// registers numbered from REG_COUNT up are virtual
+#define IS_VIRTUAL(reg) ((reg) >= REG_COUNT)
+
+// never allocated: scratch for breaking cycles of moves
+#define SCRATCH_GPR R11
+#define SCRATCH_XMM XMM15
+
+typedef enum {
+    CLASS_GPR,
+    CLASS_XMM,
+} RegClass;
+
+typedef enum {
+    COND_E,
+    COND_NE,
+    COND_L,
+    COND_LE,
+    COND_G,
+    COND_GE,
+} Cond;
+
+typedef enum {
+    M_MOV,    // ops[0] = ops[1]
+    M_LEA,    // ops[0] = &ops[1]
+    M_ADD,    // ops[0] += ops[1]
+    M_SUB,    // ops[0] -= ops[1]
+    M_IMUL,   // ops[0] *= ops[1], or ops[0] = ops[1] * ops[2] (immediate)
+    M_NEG,    // ops[0] = -ops[0]
+    M_XOR,    // ops[0] ^= ops[1]; xor r, r only zeroes r
+    M_CQO,    // rdx:rax = sign extended rax
+    M_IDIV,   // rax, rdx = rdx:rax / ops[0], rdx:rax % ops[0]
+    M_CMP,    // flags = ops[0] - ops[1]
+    M_TEST,   // flags = ops[0] & ops[1]
+    M_SETCC,  // ops[0] = cond ? 1 : 0
+    M_PUSH,   // push ops[0]
+    M_CALL,   // call name with imm register arguments
+    M_TAILCALL,  // epilogue, then jump to name with imm register arguments
+    M_SYSCALL,   // system call rax with imm arguments in syscallRegs
+    M_JMP,    // goto target
+    M_JCC,    // if cond goto target
+    M_RET,    // epilogue and return; imm is 1 when rax holds a result
+    M_VMOV,   // ops[0] = ops[1], imm bytes of vector
+    M_VADD,   // ops[0] = ops[1] + ops[2] lane by lane
+    M_VSUB,   // ops[0] = ops[1] - ops[2] lane by lane
+    M_VSPLAT, // ops[0] = the word in ops[1] in every lane
+} MOpcode;
+
+typedef enum {
+    OPND_NONE,
+    OPND_REG,     // reg
+    OPND_IMM,     // imm
+    OPND_MEM,     // [reg + index * scale + imm], index is -1 when absent
+    OPND_FRAME,   // frame slot #slot + imm, placed by the emitter
+    OPND_GLOBAL,  // name(%rip)
+} MOperandKind;
+
+typedef struct {
+    MOperandKind kind;
+    int reg;
+    int index;
+    int scale;
+    long imm;
+    int slot;
+    String name;
+} MOperand;
+
+typedef struct {
+    MOpcode opcode;
+    MOperand ops[3];
+    Cond cond;
+    long imm;
+    String name;
+    MBlock* target;
+} MInstr;
+
+struct MBlock {
+    int id;  // index in the layout
+    MInstr** instrs;
+    int count;
+    int capacity;
+    MBlock* succs[2];
+    int succCount;
+    MBlock** preds;
+    int predCount;
+    // positions covered by the block, filled by the register allocator
+    int from;
+    int to;
+};
+
+typedef struct {
+    String name;
+    int paramCount;
+    MBlock** blocks;  // in layout order, blocks[0] is the entry
+    int blockCount;
+    RegClass* classes;  // indexed by register, physical ones included
+    int regCount;
+    int regCapacity;
+    int* frameSlots;  // size in bytes of each frame slot
+    int frameSlotCount;
+    int frameSlotCapacity;
+    unsigned usedRegs;  // bit per physical register written by the code
+    bool hasCalls;
+    bool usesYmm;
+} MFunction;
+
+typedef struct {
+    IrProgram* ir;  // for the globals
+    MFunction** functions;
+    int functionCount;
+} MProgram;
+
+extern const Reg argumentRegs[6];
+// the kernel takes r10 where functions take rcx, which syscall overwrites
+extern const Reg syscallRegs[6];
+
+bool isCalleeSaved(Reg reg);
+RegClass regClass(MFunction* fn, int reg);
+Cond invertCond(Cond cond);
+int newMReg(MFunction* fn, RegClass cls);
+int newFrameSlot(MFunction* fn, int size);
+
+MInstr* newMInstr(MOpcode opcode);
+void appendMInstr(MBlock* block, MInstr* instr);
+void insertMInstr(MBlock* block, int index, MInstr* instr);
+void removeMInstr(MBlock* block, int index);
+MOperand regOperand(int reg);
+MOperand immOperand(long imm);
+MOperand memOperand(int base, int index, int scale, long disp);
+MOperand frameOperand(int slot);
+MOperand globalOperand(String name);
+MInstr* moveInstr(RegClass cls, MOperand dst, MOperand src);
+
+// registers read and written by an instruction, implicit ones included
+void machineOperands(MInstr* instr, int* uses, int* useCount, int* defs,
+                     int* defCount);
+
+// -O0 keeps every value in the frame, -O1 folds operands and allocates
+// registers with linear scan
+MProgram* selectInstructions(IrProgram* program, int optLevel);
+void allocateRegisters(MFunction* fn);
+void spillEverything(MFunction* fn);
+// one function's selection, allocation and peephole pass, which touch
+// nothing of the other functions, so several may run at once
+MFunction* genMachineFunction(IrProgram* program, IrFunction* fn, int optLevel);
+MProgram* genMachineCode(IrProgram* program, int optLevel);
+
+// where the prologue puts things, shared by the assembly and object writers
+typedef struct {
+    bool framePointer;
+    Reg saved[5];      // callee-saved registers pushed by the prologue
+    int savedCount;
+    int* slotOffsets;  // distance below the frame base of each slot
+    int size;          // bytes below the saved registers
+} Frame;
+
+void layoutFrame(MFunction* fn, Frame* frame);
+// displacement of a frame operand from rbp, or from rsp in a leaf
+long frameOffset(Frame* frame, MOperand* op);
+
+// rewrites windows of allocated code with a table of rules
+void peephole(MFunction* fn);
+// times a rule fired since the start, for tuning the table
+long peepholeHits(const char* rule);
+void printPeepholeStats(FILE* out);
+
+void emitAssembly(MProgram* program, FILE* out);
+// the pieces of emitAssembly: one function's text, which depends on
+// nothing but the function and which callees are defined in ir, and the
+// globals that follow the last function
+void emitFunctionAssembly(IrProgram* ir, MFunction* fn, FILE* out);
+void emitDataAssembly(IrProgram* ir, FILE* out);
+// the same code as an ELF relocatable object, without running an assembler
+void encodeProgram(MProgram* program, ObjectFile* object);
+void emitObject(MProgram* program, FILE* out);
+
+#endif